@@ -0,0 +1,131 @@
+// Microbenchmark for the frame checksum kernels (make bench).
+// Checks every available kernel against the scalar reference, then times
+// single-frame and batch checksumming of 318-byte frame bodies.
+
+#include <time.h>
+
+#include "checksum.h"
+#include "helper.h"
+
+#define BENCH_FRAMES      4096
+#define BENCH_FRAME_SIZE  320
+#define BENCH_BODY_LEN    318
+#define BENCH_ROUNDS      400
+
+static uint8_t  g_frames[BENCH_FRAMES * BENCH_FRAME_SIZE];
+static uint16_t g_sums[BENCH_FRAMES];
+
+static void fill_random(uint8_t* data, size_t length) {
+    uint32_t state = 0x12345678u;
+    for (size_t i = 0; i < length; i++) {
+        state = state * 1103515245u + 12345u;
+        data[i] = (uint8_t)(state >> 16);
+    }
+}
+
+static void print_field(const char* label, unsigned long long value, const char* unit) {
+    char buf[32];
+    write_str(STDOUT_FILENO, label);
+    ulong_to_str(value, buf);
+    write_str(STDOUT_FILENO, buf);
+    write_str(STDOUT_FILENO, unit);
+}
+
+// Prints value / 10 with one decimal, e.g. 123 -> "12.3"
+static void print_tenths(const char* label, unsigned long long tenths, const char* unit) {
+    char buf[32];
+    write_str(STDOUT_FILENO, label);
+    ulong_to_str(tenths / 10, buf);
+    write_str(STDOUT_FILENO, buf);
+    write_str(STDOUT_FILENO, ".");
+    ulong_to_str(tenths % 10, buf);
+    write_str(STDOUT_FILENO, buf);
+    write_str(STDOUT_FILENO, unit);
+}
+
+// Compare each kernel with the scalar one over every length up to 4 KB
+static int verify_kernel(ChecksumKernel kernel) {
+    static uint8_t data[4096];
+    static uint16_t expect_sum[sizeof(data) + 1];
+    static uint16_t expect_fletcher[sizeof(data) + 1];
+    fill_random(data, sizeof(data));
+    data[0] = 0xFF;
+    data[1] = 0xFF;
+
+    checksum_force_kernel(CHECKSUM_KERNEL_SCALAR);
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        expect_sum[len] = checksum_sum16(data, len);
+        expect_fletcher[len] = checksum_fletcher16(data, len);
+    }
+    checksum_force_kernel(kernel);
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        if (checksum_sum16(data, len) != expect_sum[len] ||
+            checksum_fletcher16(data, len) != expect_fletcher[len]) {
+            write_str(STDERR_FILENO, "Error: kernel ");
+            write_str(STDERR_FILENO, checksum_kernel_name(kernel));
+            write_str(STDERR_FILENO, " disagrees with the scalar reference.\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void bench_kernel(ChecksumKernel kernel, ChecksumAlgorithm algorithm) {
+    checksum_force_kernel(kernel);
+    checksum_select(algorithm);
+
+    volatile uint16_t sink = 0;
+    clock_t start = clock();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (size_t i = 0; i < BENCH_FRAMES; i++) {
+            sink ^= checksum_compute(g_frames + i * BENCH_FRAME_SIZE, BENCH_BODY_LEN);
+        }
+    }
+    clock_t single = clock() - start;
+
+    start = clock();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        checksum_compute_batch(g_frames, BENCH_FRAME_SIZE, BENCH_BODY_LEN, BENCH_FRAMES, g_sums);
+        sink ^= g_sums[round % BENCH_FRAMES];
+    }
+    clock_t batch = clock() - start;
+    (void)sink;
+
+    unsigned long long frames = (unsigned long long)BENCH_FRAMES * BENCH_ROUNDS;
+    unsigned long long single_ns = (unsigned long long)single * 1000000000ull / CLOCKS_PER_SEC;
+    unsigned long long batch_ns = (unsigned long long)batch * 1000000000ull / CLOCKS_PER_SEC;
+
+    write_str(STDOUT_FILENO, (algorithm == CHECKSUM_FLETCHER16) ? "  fletcher16 " : "  sum16      ");
+    write_str(STDOUT_FILENO, checksum_kernel_name(kernel));
+    write_str(STDOUT_FILENO, (kernel == CHECKSUM_KERNEL_SCALAR) ? ": " : ":   ");
+    print_tenths("", single_ns * 10 / frames, " ns/frame");
+    if (single_ns > 0) {
+        print_field(", ", frames * BENCH_BODY_LEN * 1000 / single_ns, " MB/s");
+    }
+    print_tenths(" | batch ", batch_ns * 10 / frames, " ns/frame\n");
+}
+
+int main(void) {
+    fill_random(g_frames, sizeof(g_frames));
+    checksum_init();
+    ChecksumKernel best = checksum_active_kernel();
+    write_str(STDOUT_FILENO, "Checksum kernels (best available: ");
+    write_str(STDOUT_FILENO, checksum_kernel_name(best));
+    write_str(STDOUT_FILENO, "), 318-byte frame bodies\n");
+
+    ChecksumKernel kernels[] = { CHECKSUM_KERNEL_SCALAR, CHECKSUM_KERNEL_SSE2, CHECKSUM_KERNEL_AVX2 };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (checksum_force_kernel(kernels[k]) != 0) {
+            write_str(STDOUT_FILENO, "  ");
+            write_str(STDOUT_FILENO, checksum_kernel_name(kernels[k]));
+            write_str(STDOUT_FILENO, ": not supported by this CPU\n");
+            continue;
+        }
+        if (verify_kernel(kernels[k]) != 0) {
+            return 1;
+        }
+        bench_kernel(kernels[k], CHECKSUM_SUM16);
+        bench_kernel(kernels[k], CHECKSUM_FLETCHER16);
+    }
+    return 0;
+}
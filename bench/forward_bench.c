@@ -0,0 +1,345 @@
+// Transit forwarding throughput of a maester binary, once per I/O backend
+// (make bench-forward). Starts a hub realm with two routes, connects clients
+// that blast ORDER_DATA frames for either route through it and counts the
+// bytes arriving at two sink listeners standing in for the next hops.
+//
+// usage: forward_bench [maester-binary] [frames-per-client] [clients]
+
+#define _GNU_SOURCE   // mkdtemp(), clock_gettime(), kill()
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "checksum.h"
+#include "helper.h"
+#include "maester.h"
+
+#define BENCH_HUB_PORT     19200   // Sinks listen on the next two ports
+#define BENCH_MAX_CLIENTS  16
+#define BENCH_MAX_SINKS    16
+#define BENCH_BLOCK_FRAMES 64      // Frames written per client write()
+#define BENCH_IDLE_MS      3000    // Give up once nothing arrived for this long
+
+typedef struct {
+    int      fd;
+    uint8_t  block[BENCH_BLOCK_FRAMES * FRAME_MAX_SIZE];
+    size_t   total;     // Bytes to send
+    size_t   sent;
+} BenchClient;
+
+static char g_dir[64];
+static char g_config[128];
+static char g_errors[128];
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void print_num(const char* label, unsigned long long value) {
+    char buf[32];
+    write_str(STDOUT_FILENO, label);
+    ulong_to_str(value, buf);
+    write_str(STDOUT_FILENO, buf);
+}
+
+static void build_frame(uint8_t* frame, const char* destination, uint32_t sequence) {
+    memset(frame, 0, FRAME_MAX_SIZE);
+    frame[0] = FRAME_TYPE_ORDER_DATA;
+    memcpy(frame + 1, "127.0.0.1:1", 11);
+    memcpy(frame + 1 + FRAME_ORIGIN_LEN, destination, strlen(destination));
+    frame[41] = 0;
+    frame[42] = 4;
+    frame[43] = (uint8_t)(sequence >> 24);
+    frame[44] = (uint8_t)(sequence >> 16);
+    frame[45] = (uint8_t)(sequence >> 8);
+    frame[46] = (uint8_t)sequence;
+    uint16_t sum = checksum_sum16(frame, FRAME_MAX_SIZE - FRAME_CHECKSUM_LEN);
+    frame[318] = (uint8_t)(sum >> 8);
+    frame[319] = (uint8_t)sum;
+}
+
+static int write_file(const char* path, const char* text) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    write_str(fd, text);
+    close(fd);
+    return 0;
+}
+
+static int setup_hub_config(void) {
+    my_strcpy(g_dir, "/tmp/citadel-bench-XXXXXX");
+    if (mkdtemp(g_dir) == NULL) return -1;
+    char text[512];
+    char port[16];
+    text[0] = '\0';
+    safe_append(text, sizeof(text), "Hub\n");
+    safe_append(text, sizeof(text), g_dir);
+    safe_append(text, sizeof(text), "/hub\n1\n127.0.0.1\n");
+    int_to_str(BENCH_HUB_PORT, port);
+    safe_append(text, sizeof(text), port);
+    safe_append(text, sizeof(text), "\n--- ROUTES ---\nSinkA 127.0.0.1 ");
+    int_to_str(BENCH_HUB_PORT + 1, port);
+    safe_append(text, sizeof(text), port);
+    safe_append(text, sizeof(text), "\nSinkB 127.0.0.1 ");
+    int_to_str(BENCH_HUB_PORT + 2, port);
+    safe_append(text, sizeof(text), port);
+    safe_append(text, sizeof(text), "\n---\n");
+    my_strcpy(g_config, g_dir);
+    safe_append(g_config, sizeof(g_config), "/hub.dat");
+    my_strcpy(g_errors, g_dir);
+    safe_append(g_errors, sizeof(g_errors), "/hub.err");
+    return write_file(g_config, text);
+}
+
+static void remove_in_dir(const char* name, int is_dir) {
+    char path[128];
+    my_strcpy(path, g_dir);
+    safe_append(path, sizeof(path), name);
+    if (is_dir) {
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+}
+
+static void cleanup_hub_dir(void) {
+    remove_in_dir("/hub.dat", 0);
+    remove_in_dir("/hub.err", 0);
+    remove_in_dir("/hub.db", 0);
+    remove_in_dir("/hub", 1);
+    rmdir(g_dir);
+}
+
+static int listen_on(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// The hub needs a moment to come up: retry until it accepts
+static int connect_hub(void) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_HUB_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int attempt = 0; attempt < 250; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            return fd;
+        }
+        close(fd);
+        struct timespec pause = { 0, 20 * 1000000 };
+        nanosleep(&pause, NULL);
+    }
+    return -1;
+}
+
+static pid_t start_hub(const char* binary, const char* backend, int* stdin_fd) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) return -1;
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        int err_fd = open(g_errors, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(pipe_fds[0], STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+        close(pipe_fds[1]);
+        setenv("CITADEL_IO_BACKEND", backend, 1);
+        char stock[128];
+        my_strcpy(stock, g_dir);
+        safe_append(stock, sizeof(stock), "/hub.db");
+        execl(binary, binary, g_config, stock, (char*)NULL);
+        _exit(127);
+    }
+    close(pipe_fds[0]);
+    *stdin_fd = pipe_fds[1];
+    return pid;
+}
+
+static void stop_hub(pid_t pid, int stdin_fd) {
+    write_str(stdin_fd, "EXIT\n");
+    close(stdin_fd);
+    for (int i = 0; i < 250; i++) {
+        if (waitpid(pid, NULL, WNOHANG) == pid) return;
+        struct timespec pause = { 0, 20 * 1000000 };
+        nanosleep(&pause, NULL);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static int hub_fell_back(void) {
+    char text[4096];
+    int fd = open(g_errors, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t length = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (length <= 0) return 0;
+    text[length] = '\0';
+    return strstr(text, "io_uring is not available") != NULL;
+}
+
+static int run_backend(const char* binary, const char* backend, BenchClient* clients, int num_clients,
+                       size_t frames_per_client) {
+    int sinks[2] = { listen_on(BENCH_HUB_PORT + 1), listen_on(BENCH_HUB_PORT + 2) };
+    if (sinks[0] < 0 || sinks[1] < 0) {
+        write_str(STDERR_FILENO, "Error: cannot listen on the sink ports.\n");
+        return -1;
+    }
+    int stdin_fd = -1;
+    pid_t pid = start_hub(binary, backend, &stdin_fd);
+    if (pid < 0) {
+        write_str(STDERR_FILENO, "Error: cannot start the maester.\n");
+        return -1;
+    }
+    for (int i = 0; i < num_clients; i++) {
+        clients[i].fd = connect_hub();
+        clients[i].sent = 0;
+        clients[i].total = frames_per_client * FRAME_MAX_SIZE;
+        if (clients[i].fd < 0) {
+            write_str(STDERR_FILENO, "Error: the maester did not come up.\n");
+            stop_hub(pid, stdin_fd);
+            return -1;
+        }
+    }
+
+    int conns[BENCH_MAX_SINKS];
+    int num_conns = 0;
+    static uint8_t scratch[1 << 16];
+    size_t expected = (size_t)num_clients * frames_per_client * FRAME_MAX_SIZE;
+    size_t received = 0;
+    long long start = now_ms();
+    long long last_progress = start;
+    struct pollfd fds[2 + BENCH_MAX_SINKS + BENCH_MAX_CLIENTS];
+    while (received < expected && now_ms() - last_progress < BENCH_IDLE_MS) {
+        int n = 0;
+        fds[n].fd = sinks[0]; fds[n++].events = POLLIN;
+        fds[n].fd = sinks[1]; fds[n++].events = POLLIN;
+        for (int i = 0; i < num_conns; i++) {
+            fds[n].fd = conns[i];
+            fds[n++].events = POLLIN;
+        }
+        for (int i = 0; i < num_clients; i++) {
+            fds[n].fd = clients[i].fd;
+            fds[n++].events = (clients[i].sent < clients[i].total) ? POLLOUT : 0;
+        }
+        if (poll(fds, (nfds_t)n, 100) <= 0) continue;
+        for (int s = 0; s < 2; s++) {
+            if ((fds[s].revents & POLLIN) && num_conns < BENCH_MAX_SINKS) {
+                int fd = accept(sinks[s], NULL, NULL);
+                if (fd >= 0) conns[num_conns++] = fd;
+            }
+        }
+        for (int i = 0; i < num_conns; i++) {
+            if (!(fds[2 + i].revents & (POLLIN | POLLHUP))) continue;
+            ssize_t bytes = read(conns[i], scratch, sizeof(scratch));
+            if (bytes > 0) {
+                received += (size_t)bytes;
+                last_progress = now_ms();
+            }
+        }
+        for (int i = 0; i < num_clients; i++) {
+            BenchClient* client = &clients[i];
+            if (!(fds[2 + num_conns + i].revents & POLLOUT)) continue;
+            size_t offset = client->sent % sizeof(client->block);
+            size_t length = sizeof(client->block) - offset;
+            if (length > client->total - client->sent) {
+                length = client->total - client->sent;
+            }
+            ssize_t bytes = write(client->fd, client->block + offset, length);
+            if (bytes > 0) {
+                client->sent += (size_t)bytes;
+            }
+        }
+    }
+    long long elapsed = (received < expected) ? last_progress - start : now_ms() - start;
+    if (elapsed < 1) elapsed = 1;
+
+    for (int i = 0; i < num_clients; i++) {
+        close(clients[i].fd);
+    }
+    stop_hub(pid, stdin_fd);
+    for (int i = 0; i < num_conns; i++) {
+        close(conns[i]);
+    }
+    close(sinks[0]);
+    close(sinks[1]);
+
+    unsigned long long frames = received / FRAME_MAX_SIZE;
+    write_str(STDOUT_FILENO, "  ");
+    write_str(STDOUT_FILENO, backend);
+    write_str(STDOUT_FILENO, (backend[0] == 'e') ? ":    " : ": ");
+    print_num("", frames);
+    print_num(" frames in ", (unsigned long long)elapsed);
+    print_num(" ms, ", frames * 1000 / (unsigned long long)elapsed);
+    print_num(" frames/s, ", (unsigned long long)received / 1000 / (unsigned long long)elapsed);
+    write_str(STDOUT_FILENO, " MB/s");
+    if (received < expected) {
+        print_num(", lost ", (expected - received) / FRAME_MAX_SIZE);
+    }
+    if (hub_fell_back()) {
+        write_str(STDOUT_FILENO, " (io_uring unavailable: ran on epoll)");
+    }
+    write_str(STDOUT_FILENO, "\n");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* binary = (argc > 1) ? argv[1] : "./maester";
+    size_t frames_per_client = (argc > 2) ? (size_t)str_to_int(argv[2]) : 20000;
+    int num_clients = (argc > 3) ? str_to_int(argv[3]) : 4;
+    if (num_clients < 1) num_clients = 1;
+    if (num_clients > BENCH_MAX_CLIENTS) num_clients = BENCH_MAX_CLIENTS;
+    if (frames_per_client < 1) frames_per_client = 1;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (setup_hub_config() != 0) {
+        write_str(STDERR_FILENO, "Error: cannot write the hub configuration.\n");
+        return 1;
+    }
+    static BenchClient clients[BENCH_MAX_CLIENTS];
+    for (int i = 0; i < num_clients; i++) {
+        const char* destination = (i % 2 == 0) ? "SinkA" : "SinkB";
+        for (int f = 0; f < BENCH_BLOCK_FRAMES; f++) {
+            build_frame(clients[i].block + f * FRAME_MAX_SIZE, destination, (uint32_t)f);
+        }
+    }
+
+    print_num("Transit forwarding through one hub: ", (unsigned long long)num_clients);
+    print_num(" clients x ", (unsigned long long)frames_per_client);
+    write_str(STDOUT_FILENO, " frames\n");
+    const char* backends[] = { "epoll", "io_uring" };
+    int result = 0;
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]) && result == 0; b++) {
+        result = run_backend(binary, backends[b], clients, num_clients, frames_per_client);
+    }
+    cleanup_hub_dir();
+    return (result == 0) ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+// MD5 benchmark (make bench-md5).
+// Checks the in-process MD5 against the RFC 1321 vectors and md5sum, then
+// times whole-file digests with both backends and bulk verification of many
+// files on 1..N threads.
+
+#define _GNU_SOURCE   // mkdtemp(), clock_gettime()
+
+#include <time.h>
+#include <sys/stat.h>
+
+#include "md5.h"
+#include "helper.h"
+
+#define BENCH_FILES       16
+#define BENCH_FILE_SIZE   (4 * 1024 * 1024)
+#define BENCH_PATH_LEN    128
+
+static char g_dir[] = "/tmp/md5_bench_XXXXXX";
+static char g_paths[BENCH_FILES][BENCH_PATH_LEN];
+
+static const char* vectors[][2] = {
+    { "", "d41d8cd98f00b204e9800998ecf8427e" },
+    { "a", "0cc175b9c0f1b6a831c399e269772661" },
+    { "abc", "900150983cd24fb0d6963f7d28e17f72" },
+    { "message digest", "f96b697d7cb7938d525a2f31aaf161d0" },
+    { "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b" },
+    { "12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+      "57edf4a22be3c955ac49da2e2107b67a" }
+};
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ull + (unsigned long long)ts.tv_nsec / 1000ull;
+}
+
+static void print_field(const char* label, unsigned long long value, const char* unit) {
+    char buf[32];
+    write_str(STDOUT_FILENO, label);
+    ulong_to_str(value, buf);
+    write_str(STDOUT_FILENO, buf);
+    write_str(STDOUT_FILENO, unit);
+}
+
+static int write_file(const char* path, uint32_t seed) {
+    static uint8_t data[BENCH_FILE_SIZE];
+    uint32_t state = seed;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        state = state * 1103515245u + 12345u;
+        data[i] = (uint8_t)(state >> 16);
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    ssize_t written = write(fd, data, sizeof(data));
+    close(fd);
+    return (written == (ssize_t)sizeof(data)) ? 0 : -1;
+}
+
+static int verify(void) {
+    char hex[33];
+    uint8_t digest[16];
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        md5_buffer(vectors[i][0], (size_t)my_strlen(vectors[i][0]), digest);
+        md5_digest_to_hex(digest, hex);
+        if (my_strcmp(hex, vectors[i][1]) != 0) {
+            write_str(STDERR_FILENO, "Error: MD5 test vector mismatch.\n");
+            return -1;
+        }
+    }
+    uint8_t expect[16];
+    md5_select(MD5_BACKEND_MD5SUM);
+    int with_md5sum = md5_digest_file(g_paths[0], expect);
+    md5_select(MD5_BACKEND_INTERNAL);
+    if (with_md5sum == 0 && (md5_digest_file(g_paths[0], digest) != 0 || memcmp(digest, expect, 16) != 0)) {
+        write_str(STDERR_FILENO, "Error: in-process MD5 disagrees with md5sum.\n");
+        return -1;
+    }
+    if (with_md5sum != 0) {
+        write_str(STDOUT_FILENO, "  (md5sum not available: backend comparison skipped)\n");
+    }
+    return with_md5sum;
+}
+
+static void bench_bulk(Md5Backend backend, int threads) {
+    const char* paths[BENCH_FILES];
+    uint8_t digests[BENCH_FILES][16];
+    int results[BENCH_FILES];
+    for (int i = 0; i < BENCH_FILES; i++) {
+        paths[i] = g_paths[i];
+    }
+    md5_select(backend);
+    unsigned long long start = now_us();
+    int failures = md5_digest_files(paths, BENCH_FILES, digests, results, threads);
+    unsigned long long elapsed = now_us() - start;
+
+    write_str(STDOUT_FILENO, (backend == MD5_BACKEND_MD5SUM) ? "  md5sum   " : "  internal ");
+    print_field("", (unsigned long long)threads, (threads == 1) ? " thread:  " : " threads: ");
+    print_field("", elapsed / 1000, " ms");
+    if (elapsed > 0) {
+        print_field(", ", (unsigned long long)BENCH_FILES * BENCH_FILE_SIZE / elapsed, " MB/s");
+    }
+    if (failures > 0) {
+        print_field(" (", (unsigned long long)failures, " failed)");
+    }
+    write_str(STDOUT_FILENO, "\n");
+}
+
+int main(void) {
+    if (mkdtemp(g_dir) == NULL) {
+        write_str(STDERR_FILENO, "Error: Could not create a scratch directory.\n");
+        return 1;
+    }
+    for (int i = 0; i < BENCH_FILES; i++) {
+        char number[16];
+        int_to_str(i, number);
+        g_paths[i][0] = '\0';
+        safe_append(g_paths[i], BENCH_PATH_LEN, g_dir);
+        safe_append(g_paths[i], BENCH_PATH_LEN, "/file");
+        safe_append(g_paths[i], BENCH_PATH_LEN, number);
+        if (write_file(g_paths[i], 0x12345678u + (uint32_t)i) != 0) {
+            write_str(STDERR_FILENO, "Error: Could not write the benchmark files.\n");
+            return 1;
+        }
+    }
+
+    write_str(STDOUT_FILENO, "MD5 of ");
+    print_field("", BENCH_FILES, " files x ");
+    print_field("", BENCH_FILE_SIZE / (1024 * 1024), " MB (page cache)\n");
+    int status = verify();
+    if (status < 0) {
+        return 1;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (cpus > 1) ? (int)cpus : 1;
+    if (status == 0) {
+        bench_bulk(MD5_BACKEND_MD5SUM, 1);
+    }
+    for (int threads = 1; threads <= max_threads && threads <= BENCH_FILES; threads *= 2) {
+        bench_bulk(MD5_BACKEND_INTERNAL, threads);
+    }
+
+    for (int i = 0; i < BENCH_FILES; i++) {
+        unlink(g_paths[i]);
+    }
+    rmdir(g_dir);
+    return 0;
+}
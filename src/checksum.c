@@ -0,0 +1,333 @@
+#include "checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_HAVE_X86 1
+#else
+#define CHECKSUM_HAVE_X86 0
+#endif
+
+// Bytes folded before Fletcher sums are reduced mod 255; keeps the 32-bit
+// lane accumulators of the vector kernels well clear of overflow.
+#define FLETCHER_CHUNK 2048
+
+typedef uint16_t (*ChecksumFn)(const uint8_t* data, size_t length);
+
+static uint16_t sum16_scalar(const uint8_t* data, size_t length);
+static uint16_t fletcher16_scalar(const uint8_t* data, size_t length);
+
+static ChecksumKernel    g_kernel = CHECKSUM_KERNEL_SCALAR;
+static ChecksumFn        g_sum16 = NULL;
+static ChecksumFn        g_fletcher16 = NULL;
+static ChecksumAlgorithm g_algorithm = CHECKSUM_SUM16;
+
+// ============================================================================
+// Scalar kernels (reference behaviour)
+// ============================================================================
+
+static uint16_t sum16_scalar(const uint8_t* data, size_t length) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum += data[i];
+    }
+    return (uint16_t)(sum % 65536);
+}
+
+static void fletcher16_scalar_update(uint32_t* a, uint32_t* b, const uint8_t* data, size_t length) {
+    uint32_t s1 = *a;
+    uint32_t s2 = *b;
+    for (size_t i = 0; i < length; i++) {
+        s1 += data[i];
+        s2 += s1;
+    }
+    *a = s1 % 255;
+    *b = s2 % 255;
+}
+
+static uint16_t fletcher16_scalar(const uint8_t* data, size_t length) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    while (length > 0) {
+        size_t chunk = (length > FLETCHER_CHUNK) ? FLETCHER_CHUNK : length;
+        fletcher16_scalar_update(&a, &b, data, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+    return (uint16_t)((b << 8) | a);
+}
+
+#if CHECKSUM_HAVE_X86
+
+// ============================================================================
+// SSE2 kernels: 16 bytes per step
+// ============================================================================
+
+// The helpers below are always inlined so that inside the AVX2 kernels they are
+// VEX-encoded too; calling legacy-SSE code from AVX code stalls on the
+// SSE/AVX state transition.
+#define CHECKSUM_INLINE static inline __attribute__((always_inline))
+
+__attribute__((target("sse2")))
+CHECKSUM_INLINE uint32_t hsum_epi32_sse2(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse2")))
+static uint16_t sum16_sse2(const uint8_t* data, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+    // psadbw against zero adds 8 bytes into each 64-bit lane
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    uint32_t sum = hsum_epi32_sse2(acc);
+    for (; i < length; i++) {
+        sum += data[i];
+    }
+    return (uint16_t)(sum % 65536);
+}
+
+/**
+ * Fletcher-16 over whole 16-byte blocks. Over a run of L bytes starting from
+ * (a, b): b' = b + L*a + sum((L - i) * x[i]) and a' = a + sum(x[i]). Per block
+ * the weighted part is 16 * (bytes of earlier blocks) + sum((16 - p) * x[p]),
+ * so three vector accumulators cover it: block sums, their running prefix and
+ * the in-block weighted sums.
+ */
+__attribute__((target("sse2")))
+CHECKSUM_INLINE size_t fletcher16_blocks_sse2(uint32_t* a, uint32_t* b, const uint8_t* data, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights_lo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i weights_hi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+    size_t done = 0;
+    while (length - done >= 16) {
+        size_t run = length - done;
+        if (run > FLETCHER_CHUNK) {
+            run = FLETCHER_CHUNK;
+        }
+        run &= ~(size_t)15;
+        __m128i v_s1 = zero;
+        __m128i v_prefix = zero;
+        __m128i v_s2 = zero;
+        for (size_t i = 0; i < run; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + done + i));
+            v_prefix = _mm_add_epi32(v_prefix, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(v, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights_lo));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights_hi));
+        }
+        uint32_t s1 = hsum_epi32_sse2(v_s1);
+        uint32_t prefix = hsum_epi32_sse2(v_prefix);
+        uint32_t weighted = hsum_epi32_sse2(v_s2);
+        *b = (*b + (uint32_t)run * *a + 16 * prefix + weighted) % 255;
+        *a = (*a + s1) % 255;
+        done += run;
+    }
+    return done;
+}
+
+__attribute__((target("sse2")))
+static uint16_t fletcher16_sse2(const uint8_t* data, size_t length) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    size_t done = fletcher16_blocks_sse2(&a, &b, data, length);
+    fletcher16_scalar_update(&a, &b, data + done, length - done);
+    return (uint16_t)((b << 8) | a);
+}
+
+// ============================================================================
+// AVX2 kernels: 32 bytes per step
+// ============================================================================
+
+__attribute__((target("avx2")))
+CHECKSUM_INLINE uint32_t hsum_epi32_avx2(__m256i v) {
+    __m128i lo = _mm256_castsi256_si128(v);
+    __m128i hi = _mm256_extracti128_si256(v, 1);
+    return hsum_epi32_sse2(_mm_add_epi32(lo, hi));
+}
+
+__attribute__((target("avx2")))
+static uint16_t sum16_avx2(const uint8_t* data, size_t length) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+    }
+    uint32_t sum = hsum_epi32_avx2(acc);
+    if (i + 16 <= length) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        sum += hsum_epi32_sse2(_mm_sad_epu8(v, _mm_setzero_si128()));
+        i += 16;
+    }
+    for (; i < length; i++) {
+        sum += data[i];
+    }
+    return (uint16_t)(sum % 65536);
+}
+
+// Same decomposition as fletcher16_blocks_sse2 with 32-byte blocks; weights
+// 32..1 fit in a signed byte, so pmaddubsw does the multiply-add directly.
+__attribute__((target("avx2")))
+static uint16_t fletcher16_avx2(const uint8_t* data, size_t length) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    uint32_t a = 0;
+    uint32_t b = 0;
+    size_t done = 0;
+    while (length - done >= 32) {
+        size_t run = length - done;
+        if (run > FLETCHER_CHUNK) {
+            run = FLETCHER_CHUNK;
+        }
+        run &= ~(size_t)31;
+        __m256i v_s1 = zero;
+        __m256i v_prefix = zero;
+        __m256i v_s2 = zero;
+        for (size_t i = 0; i < run; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + done + i));
+            v_prefix = _mm256_add_epi32(v_prefix, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(v, zero));
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(v, weights), ones));
+        }
+        uint32_t s1 = hsum_epi32_avx2(v_s1);
+        uint32_t prefix = hsum_epi32_avx2(v_prefix);
+        uint32_t weighted = hsum_epi32_avx2(v_s2);
+        b = (b + (uint32_t)run * a + 32 * prefix + weighted) % 255;
+        a = (a + s1) % 255;
+        done += run;
+    }
+    done += fletcher16_blocks_sse2(&a, &b, data + done, length - done);
+    fletcher16_scalar_update(&a, &b, data + done, length - done);
+    return (uint16_t)((b << 8) | a);
+}
+
+#endif  // CHECKSUM_HAVE_X86
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static int checksum_kernel_supported(ChecksumKernel kernel) {
+    switch (kernel) {
+        case CHECKSUM_KERNEL_SCALAR:
+            return 1;
+#if CHECKSUM_HAVE_X86
+        case CHECKSUM_KERNEL_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case CHECKSUM_KERNEL_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+// Install a kernel; returns -1 (leaving the current one) if the CPU lacks it
+int checksum_force_kernel(ChecksumKernel kernel) {
+    if (!checksum_kernel_supported(kernel)) {
+        return -1;
+    }
+    switch (kernel) {
+#if CHECKSUM_HAVE_X86
+        case CHECKSUM_KERNEL_AVX2:
+            g_sum16 = sum16_avx2;
+            g_fletcher16 = fletcher16_avx2;
+            break;
+        case CHECKSUM_KERNEL_SSE2:
+            g_sum16 = sum16_sse2;
+            g_fletcher16 = fletcher16_sse2;
+            break;
+#endif
+        default:
+            g_sum16 = sum16_scalar;
+            g_fletcher16 = fletcher16_scalar;
+            break;
+    }
+    g_kernel = kernel;
+    return 0;
+}
+
+// Pick the widest kernel the CPU supports; call once at startup
+void checksum_init(void) {
+    if (checksum_force_kernel(CHECKSUM_KERNEL_AVX2) == 0) return;
+    if (checksum_force_kernel(CHECKSUM_KERNEL_SSE2) == 0) return;
+    checksum_force_kernel(CHECKSUM_KERNEL_SCALAR);
+}
+
+ChecksumKernel checksum_active_kernel(void) {
+    return g_kernel;
+}
+
+const char* checksum_kernel_name(ChecksumKernel kernel) {
+    switch (kernel) {
+        case CHECKSUM_KERNEL_AVX2: return "avx2";
+        case CHECKSUM_KERNEL_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void checksum_select(ChecksumAlgorithm algorithm) {
+    g_algorithm = algorithm;
+}
+
+ChecksumAlgorithm checksum_selected(void) {
+    return g_algorithm;
+}
+
+uint16_t checksum_sum16(const uint8_t* data, size_t length) {
+    if (g_sum16 == NULL) {
+        checksum_init();
+    }
+    return g_sum16(data, length);
+}
+
+uint16_t checksum_fletcher16(const uint8_t* data, size_t length) {
+    if (g_fletcher16 == NULL) {
+        checksum_init();
+    }
+    return g_fletcher16(data, length);
+}
+
+uint16_t checksum_compute(const uint8_t* data, size_t length) {
+    if (g_algorithm == CHECKSUM_FLETCHER16) {
+        return checksum_fletcher16(data, length);
+    }
+    return checksum_sum16(data, length);
+}
+
+/**
+ * Checksum of `data` followed by zero bytes up to `padded_length`, without
+ * reading the padding: zeros leave a byte sum unchanged, and in Fletcher-16
+ * each one adds the running first sum to the second, so n of them add n * a.
+ */
+uint16_t checksum_compute_padded(const uint8_t* data, size_t length, size_t padded_length) {
+    uint16_t result = checksum_compute(data, length);
+    if (g_algorithm != CHECKSUM_FLETCHER16 || padded_length <= length) {
+        return result;
+    }
+    uint32_t a = result & 0xFF;
+    uint32_t b = result >> 8;
+    b = (b + (uint32_t)((padded_length - length) % 255) * a) % 255;
+    return (uint16_t)((b << 8) | a);
+}
+
+void checksum_compute_batch(const uint8_t* data, size_t stride, size_t length, size_t count, uint16_t* out) {
+    if (data == NULL || out == NULL) return;
+    if (g_sum16 == NULL) {
+        checksum_init();
+    }
+    ChecksumFn fn = (g_algorithm == CHECKSUM_FLETCHER16) ? g_fletcher16 : g_sum16;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = fn(data + i * stride, length);
+    }
+}
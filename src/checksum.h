@@ -0,0 +1,38 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame checksum algorithms. CHECKSUM_SUM16 (byte sum mod 65536) is the one
+// the statement defines for the wire; Fletcher-16 is available for setups
+// where every realm on the path is configured the same way.
+typedef enum {
+    CHECKSUM_SUM16 = 0,
+    CHECKSUM_FLETCHER16
+} ChecksumAlgorithm;
+
+// Kernel chosen by checksum_init() from the CPU features
+typedef enum {
+    CHECKSUM_KERNEL_SCALAR = 0,
+    CHECKSUM_KERNEL_SSE2,
+    CHECKSUM_KERNEL_AVX2
+} ChecksumKernel;
+
+void           checksum_init(void);
+int            checksum_force_kernel(ChecksumKernel kernel);
+ChecksumKernel checksum_active_kernel(void);
+const char*    checksum_kernel_name(ChecksumKernel kernel);
+
+void              checksum_select(ChecksumAlgorithm algorithm);
+ChecksumAlgorithm checksum_selected(void);
+
+uint16_t checksum_sum16(const uint8_t* data, size_t length);
+uint16_t checksum_fletcher16(const uint8_t* data, size_t length);
+uint16_t checksum_compute(const uint8_t* data, size_t length);   // Selected algorithm
+uint16_t checksum_compute_padded(const uint8_t* data, size_t length, size_t padded_length);
+
+// Checksum `count` records laid out `stride` bytes apart, `length` bytes each
+void checksum_compute_batch(const uint8_t* data, size_t stride, size_t length, size_t count, uint16_t* out);
+
+#endif
@@ -0,0 +1,303 @@
+#include "connections.h"
+
+typedef enum {
+    CONN_KEY_REALM,
+    CONN_KEY_ENDPOINT
+} ConnKeyKind;
+
+static void     conn_index_init(ConnIndex* index);
+static void     conn_index_free(ConnIndex* index);
+static int      conn_index_insert(ConnectionTable* table, ConnKeyKind kind, ConnectionEntry* entry);
+static void     conn_index_remove(ConnectionTable* table, ConnKeyKind kind, const ConnectionEntry* entry);
+static uint32_t conn_hash_entry(ConnKeyKind kind, const ConnectionEntry* entry);
+
+// ============================================================================
+// Key hashing (FNV-1a; realms use the case-insensitive str_hash_nocase)
+// ============================================================================
+
+static uint32_t conn_hash_endpoint(const char* ip, int port) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; ip[i] != '\0'; i++) {
+        hash ^= (uint8_t)ip[i];
+        hash *= 16777619u;
+    }
+    hash ^= (uint32_t)port;
+    hash *= 16777619u;
+    return hash;
+}
+
+static uint32_t conn_hash_entry(ConnKeyKind kind, const ConnectionEntry* entry) {
+    if (kind == CONN_KEY_REALM) {
+        return str_hash_nocase(entry->peer_realm);
+    }
+    return conn_hash_endpoint(entry->peer_ip, entry->peer_port);
+}
+
+// ============================================================================
+// Slab
+// ============================================================================
+
+void connection_table_init(ConnectionTable* table, pthread_mutex_t* lock) {
+    if (table == NULL) return;
+    table->lock = lock;
+    memset(table->chunks, 0, sizeof(table->chunks));
+    table->num_chunks = 0;
+    table->high_water = 0;
+    table->free_head = -1;
+    table->live = 0;
+    conn_index_init(&table->by_realm);
+    conn_index_init(&table->by_endpoint);
+}
+
+void connection_table_destroy(ConnectionTable* table) {
+    if (table == NULL) return;
+    for (int i = 0; i < table->num_chunks; i++) {
+        free(table->chunks[i]);
+        table->chunks[i] = NULL;
+    }
+    table->num_chunks = 0;
+    table->high_water = 0;
+    table->free_head = -1;
+    table->live = 0;
+    conn_index_free(&table->by_realm);
+    conn_index_free(&table->by_endpoint);
+}
+
+// high_water is published with release semantics after the chunk holding the
+// new slot is in place, so readers without connections_lock see a valid slot.
+int connection_table_slots(const ConnectionTable* table) {
+    return (table != NULL) ? __atomic_load_n(&table->high_water, __ATOMIC_ACQUIRE) : 0;
+}
+
+ConnectionEntry* connection_table_at(const ConnectionTable* table, int slot) {
+    if (table == NULL || slot < 0 || slot >= connection_table_slots(table)) return NULL;
+    return &table->chunks[slot / CONN_SLAB_CHUNK][slot % CONN_SLAB_CHUNK];
+}
+
+static int connection_table_add_chunk(ConnectionTable* table) {
+    if (table->num_chunks >= CONN_SLAB_MAX_CHUNKS) {
+        return -1;
+    }
+    ConnectionEntry* chunk = (ConnectionEntry*)calloc(CONN_SLAB_CHUNK, sizeof(ConnectionEntry));
+    if (chunk == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < CONN_SLAB_CHUNK; i++) {
+        chunk[i].sockfd = -1;
+        chunk[i].slot = table->num_chunks * CONN_SLAB_CHUNK + i;
+        chunk[i].generation = 1;
+        chunk[i].next_free = -1;
+    }
+    table->chunks[table->num_chunks++] = chunk;
+    return 0;
+}
+
+/**
+ * Hand out a cleared slot (sockfd = -1) with its identity fields set.
+ * Recycled slots are preferred; otherwise the next never-used slot is taken,
+ * adding a chunk when the slab is full. Returns NULL when out of memory.
+ */
+ConnectionEntry* connection_table_acquire(ConnectionTable* table) {
+    if (table == NULL) return NULL;
+    int slot;
+    if (table->free_head >= 0) {
+        slot = table->free_head;
+        table->free_head = connection_table_at(table, slot)->next_free;
+    } else {
+        if (table->high_water >= table->num_chunks * CONN_SLAB_CHUNK &&
+            connection_table_add_chunk(table) != 0) {
+            return NULL;
+        }
+        slot = table->high_water;
+        __atomic_store_n(&table->high_water, slot + 1, __ATOMIC_RELEASE);
+    }
+    ConnectionEntry* entry = connection_table_at(table, slot);
+    uint32_t generation = entry->generation;
+    memset(entry, 0, sizeof(ConnectionEntry));
+    entry->sockfd = -1;
+    entry->slot = slot;
+    entry->generation = generation;
+    entry->next_free = -1;
+    entry->table = table;
+    table->live++;
+    return entry;
+}
+
+// Drop the slot's index keys and put it back on the free list
+void connection_table_release(ConnectionEntry* entry) {
+    if (entry == NULL || entry->table == NULL) return;
+    ConnectionTable* table = entry->table;
+    if (entry->realm_indexed) {
+        conn_index_remove(table, CONN_KEY_REALM, entry);
+        entry->realm_indexed = 0;
+    }
+    if (entry->endpoint_indexed) {
+        conn_index_remove(table, CONN_KEY_ENDPOINT, entry);
+        entry->endpoint_indexed = 0;
+    }
+    entry->generation++;
+    if (entry->generation == 0 || entry->generation == UINT32_MAX) {
+        entry->generation = 1;  // Keep handles clear of 0 and the reserved reactor tags
+    }
+    entry->table = NULL;
+    entry->next_free = table->free_head;
+    table->free_head = entry->slot;
+    table->live--;
+}
+
+ConnHandle connection_handle(const ConnectionEntry* entry) {
+    if (entry == NULL || entry->table == NULL) return 0;
+    return ((uint64_t)entry->generation << 32) | (uint32_t)entry->slot;
+}
+
+ConnectionEntry* connection_table_lookup(const ConnectionTable* table, ConnHandle handle) {
+    if (table == NULL || handle == 0) return NULL;
+    ConnectionEntry* entry = connection_table_at(table, (int)(handle & 0xFFFFFFFFu));
+    if (entry == NULL || entry->table == NULL || entry->sockfd < 0) return NULL;
+    if (entry->generation != (uint32_t)(handle >> 32)) return NULL;
+    return entry;
+}
+
+// ============================================================================
+// Hash indexes
+// ============================================================================
+
+static void conn_index_init(ConnIndex* index) {
+    index->buckets = NULL;
+    index->capacity = 0;
+    index->used = 0;
+}
+
+static void conn_index_free(ConnIndex* index) {
+    free(index->buckets);
+    conn_index_init(index);
+}
+
+static ConnIndex* conn_index_of(ConnectionTable* table, ConnKeyKind kind) {
+    return (kind == CONN_KEY_REALM) ? &table->by_realm : &table->by_endpoint;
+}
+
+// Rebuild at `capacity` buckets, dropping tombstones
+static int conn_index_rehash(ConnectionTable* table, ConnKeyKind kind, size_t capacity) {
+    ConnIndex* index = conn_index_of(table, kind);
+    int* buckets = (int*)calloc(capacity, sizeof(int));
+    if (buckets == NULL) {
+        return -1;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->buckets[i] <= 0) {
+            continue;
+        }
+        const ConnectionEntry* entry = connection_table_at(table, index->buckets[i] - 1);
+        size_t pos = conn_hash_entry(kind, entry) & (capacity - 1);
+        while (buckets[pos] != 0) {
+            pos = (pos + 1) & (capacity - 1);
+        }
+        buckets[pos] = index->buckets[i];
+        used++;
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->capacity = capacity;
+    index->used = used;
+    return 0;
+}
+
+static int conn_index_insert(ConnectionTable* table, ConnKeyKind kind, ConnectionEntry* entry) {
+    ConnIndex* index = conn_index_of(table, kind);
+    // Keep the load (tombstones included) under one half
+    if ((index->used + 1) * 2 > index->capacity) {
+        size_t capacity = (index->capacity == 0) ? CONN_INDEX_INITIAL : index->capacity;
+        while ((size_t)(table->live + 1) * 2 > capacity) {
+            capacity <<= 1;
+        }
+        if (conn_index_rehash(table, kind, capacity) != 0) {
+            return -1;
+        }
+    }
+    size_t mask = index->capacity - 1;
+    size_t pos = conn_hash_entry(kind, entry) & mask;
+    while (index->buckets[pos] > 0) {
+        pos = (pos + 1) & mask;
+    }
+    if (index->buckets[pos] == 0) {
+        index->used++;
+    }
+    index->buckets[pos] = entry->slot + 1;
+    return 0;
+}
+
+static void conn_index_remove(ConnectionTable* table, ConnKeyKind kind, const ConnectionEntry* entry) {
+    ConnIndex* index = conn_index_of(table, kind);
+    if (index->capacity == 0) return;
+    size_t mask = index->capacity - 1;
+    size_t pos = conn_hash_entry(kind, entry) & mask;
+    while (index->buckets[pos] != 0) {
+        if (index->buckets[pos] == entry->slot + 1) {
+            index->buckets[pos] = -1;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+/**
+ * (Re)index an entry under its current peer_realm and peer_ip:peer_port.
+ * Call after those fields are filled in; an empty realm is not indexed.
+ */
+int connection_table_index(ConnectionEntry* entry) {
+    if (entry == NULL || entry->table == NULL) return -1;
+    ConnectionTable* table = entry->table;
+    if (entry->realm_indexed) {
+        conn_index_remove(table, CONN_KEY_REALM, entry);
+        entry->realm_indexed = 0;
+    }
+    if (entry->endpoint_indexed) {
+        conn_index_remove(table, CONN_KEY_ENDPOINT, entry);
+        entry->endpoint_indexed = 0;
+    }
+    if (entry->peer_realm[0] != '\0') {
+        if (conn_index_insert(table, CONN_KEY_REALM, entry) != 0) return -1;
+        entry->realm_indexed = 1;
+    }
+    if (entry->peer_ip[0] != '\0' && entry->peer_port > 0) {
+        if (conn_index_insert(table, CONN_KEY_ENDPOINT, entry) != 0) return -1;
+        entry->endpoint_indexed = 1;
+    }
+    return 0;
+}
+
+ConnectionEntry* connection_table_find_realm(const ConnectionTable* table, const char* realm) {
+    if (table == NULL || realm == NULL || table->by_realm.capacity == 0) return NULL;
+    size_t mask = table->by_realm.capacity - 1;
+    size_t pos = str_hash_nocase(realm) & mask;
+    while (table->by_realm.buckets[pos] != 0) {
+        int bucket = table->by_realm.buckets[pos];
+        if (bucket > 0) {
+            ConnectionEntry* entry = connection_table_at(table, bucket - 1);
+            if (entry->sockfd >= 0 && my_strcasecmp(entry->peer_realm, realm) == 0) {
+                return entry;
+            }
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
+
+ConnectionEntry* connection_table_find_endpoint(const ConnectionTable* table, const char* ip, int port) {
+    if (table == NULL || ip == NULL || table->by_endpoint.capacity == 0) return NULL;
+    size_t mask = table->by_endpoint.capacity - 1;
+    size_t pos = conn_hash_endpoint(ip, port) & mask;
+    while (table->by_endpoint.buckets[pos] != 0) {
+        int bucket = table->by_endpoint.buckets[pos];
+        if (bucket > 0) {
+            ConnectionEntry* entry = connection_table_at(table, bucket - 1);
+            if (entry->sockfd >= 0 && entry->peer_port == port && my_strcmp(entry->peer_ip, ip) == 0) {
+                return entry;
+            }
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef CONNECTIONS_H
+#define CONNECTIONS_H
+
+#include "maester.h"
+
+// Slab of connection slots: entries never move, so pointers stay valid for the
+// life of the table and handles detect slot reuse through the generation.
+void             connection_table_init(ConnectionTable* table, pthread_mutex_t* lock);
+void             connection_table_destroy(ConnectionTable* table);
+ConnectionEntry* connection_table_acquire(ConnectionTable* table);
+void             connection_table_release(ConnectionEntry* entry);
+int              connection_table_slots(const ConnectionTable* table);
+ConnectionEntry* connection_table_at(const ConnectionTable* table, int slot);
+
+ConnHandle       connection_handle(const ConnectionEntry* entry);
+ConnectionEntry* connection_table_lookup(const ConnectionTable* table, ConnHandle handle);
+
+// Hash indexes (case-insensitive realm, exact ip:port)
+int              connection_table_index(ConnectionEntry* entry);
+ConnectionEntry* connection_table_find_realm(const ConnectionTable* table, const char* realm);
+ConnectionEntry* connection_table_find_endpoint(const ConnectionTable* table, const char* ip, int port);
+
+#endif
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE   // st_mtim / st_ctim, clock_gettime()
+
+#include "digests.h"
+#include "helper.h"
+
+#include <stdio.h>    // rename()
+#include <time.h>
+
+// Longest line of the cache file: digest, seven numbers and the path
+#define DIGEST_LINE_MAX  (32 + 7 * 21 + DIGEST_CACHE_PATH_MAX + 2)
+
+static DigestCacheEntry* digest_cache_find(DigestCache* cache, const char* path);
+static int  digest_cache_matches(const DigestCacheEntry* entry, const struct stat* st);
+static void digest_cache_fill(DigestCacheEntry* entry, const char* path, const struct stat* st);
+static void digest_cache_load(DigestCache* cache);
+static void digest_cache_save(DigestCache* cache);
+static int  digest_parse_line(const char* line, DigestCacheEntry* entry);
+static const char* digest_parse_number(const char* text, int64_t* out);
+
+void digest_cache_init(DigestCache* cache, const char* folder_path, int enabled) {
+    if (cache == NULL) return;
+    cache->count = 0;
+    cache->enabled = enabled;
+    cache->clock = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->file_path[0] = '\0';
+    pthread_mutex_init(&cache->lock, NULL);
+    if (!enabled || folder_path == NULL) {
+        cache->enabled = 0;
+        return;
+    }
+    if (safe_append(cache->file_path, sizeof(cache->file_path), folder_path) != 0 ||
+        safe_append(cache->file_path, sizeof(cache->file_path), "/") != 0 ||
+        safe_append(cache->file_path, sizeof(cache->file_path), DIGEST_CACHE_FILE) != 0) {
+        cache->enabled = 0;
+        return;
+    }
+    digest_cache_load(cache);
+}
+
+void digest_cache_destroy(DigestCache* cache) {
+    if (cache == NULL) return;
+    pthread_mutex_destroy(&cache->lock);
+}
+
+int digest_cache_lookup(DigestCache* cache, const char* path, const struct stat* st, uint8_t digest[16]) {
+    if (cache == NULL || !cache->enabled || path == NULL || st == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&cache->lock);
+    DigestCacheEntry* entry = digest_cache_find(cache, path);
+    int hit = (entry != NULL && digest_cache_matches(entry, st));
+    if (hit) {
+        memcpy(digest, entry->digest, 16);
+        entry->last_used = ++cache->clock;
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+/**
+ * Remember the digest of a freshly hashed file. A file modified within the
+ * last second is left out: a write landing in the same timestamp tick after
+ * it was hashed would not change its identity.
+ */
+void digest_cache_store(DigestCache* cache, const char* path, const struct stat* st, const uint8_t digest[16]) {
+    if (cache == NULL || !cache->enabled || path == NULL || st == NULL) {
+        return;
+    }
+    if (my_strlen(path) >= DIGEST_CACHE_PATH_MAX) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if ((int64_t)st->st_mtim.tv_sec + 1 >= (int64_t)now.tv_sec ||
+        (int64_t)st->st_ctim.tv_sec + 1 >= (int64_t)now.tv_sec) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    DigestCacheEntry* entry = digest_cache_find(cache, path);
+    if (entry == NULL && cache->count < DIGEST_CACHE_CAPACITY) {
+        entry = &cache->entries[cache->count++];
+    }
+    if (entry == NULL) {
+        entry = &cache->entries[0];
+        for (int i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used < entry->last_used) {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+    digest_cache_fill(entry, path, st);
+    memcpy(entry->digest, digest, 16);
+    entry->last_used = ++cache->clock;
+    digest_cache_save(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void digest_cache_stats(DigestCache* cache, int* entries, unsigned long long* hits, unsigned long long* misses) {
+    if (cache == NULL) return;
+    pthread_mutex_lock(&cache->lock);
+    if (entries != NULL) *entries = cache->count;
+    if (hits != NULL) *hits = cache->hits;
+    if (misses != NULL) *misses = cache->misses;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// ============= INTERNALS =============
+
+static DigestCacheEntry* digest_cache_find(DigestCache* cache, const char* path) {
+    for (int i = 0; i < cache->count; i++) {
+        if (my_strcmp(cache->entries[i].path, path) == 0) {
+            return &cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static int digest_cache_matches(const DigestCacheEntry* entry, const struct stat* st) {
+    return entry->size == (uint64_t)st->st_size &&
+           entry->dev == (uint64_t)st->st_dev &&
+           entry->ino == (uint64_t)st->st_ino &&
+           entry->mtime_s == (int64_t)st->st_mtim.tv_sec &&
+           entry->mtime_ns == (int64_t)st->st_mtim.tv_nsec &&
+           entry->ctime_s == (int64_t)st->st_ctim.tv_sec &&
+           entry->ctime_ns == (int64_t)st->st_ctim.tv_nsec;
+}
+
+static void digest_cache_fill(DigestCacheEntry* entry, const char* path, const struct stat* st) {
+    my_strcpy(entry->path, path);
+    entry->size = (uint64_t)st->st_size;
+    entry->dev = (uint64_t)st->st_dev;
+    entry->ino = (uint64_t)st->st_ino;
+    entry->mtime_s = (int64_t)st->st_mtim.tv_sec;
+    entry->mtime_ns = (int64_t)st->st_mtim.tv_nsec;
+    entry->ctime_s = (int64_t)st->st_ctim.tv_sec;
+    entry->ctime_ns = (int64_t)st->st_ctim.tv_nsec;
+}
+
+/**
+ * Read the cache file: "<md5> <size> <dev> <ino> <mtime_s> <mtime_ns>
+ * <ctime_s> <ctime_ns> <path>" per line. Unparsable lines are skipped.
+ */
+static void digest_cache_load(DigestCache* cache) {
+    int fd = open(cache->file_path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    size_t capacity = (size_t)DIGEST_CACHE_CAPACITY * DIGEST_LINE_MAX;
+    char* text = (char*)malloc(capacity + 1);
+    if (text == NULL) {
+        close(fd);
+        return;
+    }
+    size_t length = 0;
+    while (length < capacity) {
+        ssize_t n = read(fd, text + length, capacity - length);
+        if (n <= 0) break;
+        length += (size_t)n;
+    }
+    close(fd);
+    text[length] = '\0';
+
+    char* line = text;
+    while (*line != '\0' && cache->count < DIGEST_CACHE_CAPACITY) {
+        char* end = line;
+        while (*end != '\0' && *end != '\n') end++;
+        int more = (*end == '\n');
+        *end = '\0';
+        DigestCacheEntry* entry = &cache->entries[cache->count];
+        if (digest_parse_line(line, entry) == 0) {
+            entry->last_used = ++cache->clock;
+            cache->count++;
+        }
+        line = more ? end + 1 : end;
+    }
+    free(text);
+}
+
+/**
+ * Rewrite the cache file through a temporary file, so a crash leaves either
+ * the old or the new contents.
+ */
+static void digest_cache_save(DigestCache* cache) {
+    char tmp_path[DIGEST_CACHE_PATH_MAX + 8];
+    tmp_path[0] = '\0';
+    safe_append(tmp_path, sizeof(tmp_path), cache->file_path);
+    safe_append(tmp_path, sizeof(tmp_path), ".tmp");
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        write_str(STDERR_FILENO, "Warning: Could not write the digest cache.\n");
+        return;
+    }
+
+    char* text = (char*)malloc((size_t)cache->count * DIGEST_LINE_MAX + 1);
+    if (text == NULL) {
+        close(fd);
+        unlink(tmp_path);
+        return;
+    }
+    size_t length = 0;
+    for (int i = 0; i < cache->count; i++) {
+        const DigestCacheEntry* entry = &cache->entries[i];
+        char line[DIGEST_LINE_MAX];
+        char hex[33];
+        char number[24];
+        int64_t fields[7] = {
+            (int64_t)entry->size, (int64_t)entry->dev, (int64_t)entry->ino,
+            entry->mtime_s, entry->mtime_ns, entry->ctime_s, entry->ctime_ns
+        };
+        md5_digest_to_hex(entry->digest, hex);
+        line[0] = '\0';
+        safe_append(line, sizeof(line), hex);
+        for (int f = 0; f < 7; f++) {
+            long_to_str((long long)fields[f], number);
+            safe_append(line, sizeof(line), " ");
+            safe_append(line, sizeof(line), number);
+        }
+        safe_append(line, sizeof(line), " ");
+        safe_append(line, sizeof(line), entry->path);
+        safe_append(line, sizeof(line), "\n");
+        size_t line_len = (size_t)my_strlen(line);
+        memcpy(text + length, line, line_len);
+        length += line_len;
+    }
+
+    ssize_t written = write(fd, text, length);
+    free(text);
+    close(fd);
+    if (written != (ssize_t)length || rename(tmp_path, cache->file_path) != 0) {
+        write_str(STDERR_FILENO, "Warning: Could not write the digest cache.\n");
+        unlink(tmp_path);
+    }
+}
+
+static int digest_parse_line(const char* line, DigestCacheEntry* entry) {
+    if (md5_hex_to_digest(line, entry->digest) != 0 || line[32] != ' ') {
+        return -1;
+    }
+    const char* p = line + 33;
+    int64_t fields[7];
+    for (int f = 0; f < 7; f++) {
+        p = digest_parse_number(p, &fields[f]);
+        if (p == NULL || *p != ' ') {
+            return -1;
+        }
+        p++;
+    }
+    if (*p == '\0' || my_strlen(p) >= DIGEST_CACHE_PATH_MAX) {
+        return -1;
+    }
+    my_strcpy(entry->path, p);
+    entry->size = (uint64_t)fields[0];
+    entry->dev = (uint64_t)fields[1];
+    entry->ino = (uint64_t)fields[2];
+    entry->mtime_s = fields[3];
+    entry->mtime_ns = fields[4];
+    entry->ctime_s = fields[5];
+    entry->ctime_ns = fields[6];
+    return 0;
+}
+
+// Signed decimal; returns the first character after it, NULL if there is none
+static const char* digest_parse_number(const char* text, int64_t* out) {
+    int negative = (*text == '-');
+    if (negative) text++;
+    if (*text < '0' || *text > '9') {
+        return NULL;
+    }
+    uint64_t value = 0;
+    while (*text >= '0' && *text <= '9') {
+        value = value * 10 + (uint64_t)(*text - '0');
+        text++;
+    }
+    *out = negative ? -(int64_t)value : (int64_t)value;
+    return text;
+}
@@ -0,0 +1,52 @@
+#ifndef DIGESTS_H
+#define DIGESTS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// MD5 digests of sigils already hashed for a pledge, so pledging the same
+// file again skips hashing it. Entries are keyed by the path as given plus
+// the identity of the open file (size, device, inode, mtime, ctime) taken with
+// fstat(); any change to the file misses. The cache is kept in
+// <folder>/.digest_cache, one line per entry, and rewritten on every store.
+
+#define DIGEST_CACHE_CAPACITY  256
+#define DIGEST_CACHE_PATH_MAX  256
+#define DIGEST_CACHE_FILE      ".digest_cache"
+
+typedef struct {
+    char     path[DIGEST_CACHE_PATH_MAX];
+    uint64_t size;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t  mtime_s;
+    int64_t  mtime_ns;
+    int64_t  ctime_s;
+    int64_t  ctime_ns;
+    uint8_t  digest[16];
+    uint64_t last_used;         // Eviction order (least recently used first)
+} DigestCacheEntry;
+
+typedef struct {
+    DigestCacheEntry   entries[DIGEST_CACHE_CAPACITY];
+    int                count;
+    int                enabled;
+    uint64_t           clock;
+    unsigned long long hits;
+    unsigned long long misses;
+    char               file_path[DIGEST_CACHE_PATH_MAX];
+    pthread_mutex_t    lock;
+} DigestCache;
+
+// Loads <folder_path>/.digest_cache; a disabled cache misses without counting
+void digest_cache_init(DigestCache* cache, const char* folder_path, int enabled);
+void digest_cache_destroy(DigestCache* cache);
+
+// 1 and the digest on a hit, 0 on a miss
+int  digest_cache_lookup(DigestCache* cache, const char* path, const struct stat* st, uint8_t digest[16]);
+void digest_cache_store(DigestCache* cache, const char* path, const struct stat* st, const uint8_t digest[16]);
+
+void digest_cache_stats(DigestCache* cache, int* entries, unsigned long long* hits, unsigned long long* misses);
+
+#endif
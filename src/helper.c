@@ -172,6 +172,20 @@ void str_tolower(char *dest, const char *src) {
     dest[i] = '\0';
 }
 
+// FNV-1a over the lowercased string; equal under my_strcasecmp => equal hash
+uint32_t str_hash_nocase(const char *str) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; str[i] != '\0'; i++) {
+        char c = str[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = c + ('a' - 'A');
+        }
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 int my_strcmp(const char *s1, const char *s2) {
     int i = 0;
     while (s1[i] != '\0' && s2[i] != '\0') {
@@ -207,6 +221,18 @@ void clean_realm_name(char *name) {
     name[j] = '\0';
 }
 
+// Whether a name taken from a frame may become one component of a path: not
+// empty, no separators, no "..", no control characters
+int is_safe_name(const char *name) {
+    if (name == NULL || name[0] == '\0') return 0;
+    for (int i = 0; name[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (c < 0x20 || c == 0x7F || c == '/' || c == '\\') return 0;
+        if (c == '.' && name[i + 1] == '.') return 0;
+    }
+    return 1;
+}
+
 // Helper function to convert hex character to value
 static int hex_char_to_val(char c) {
     if (c >= '0' && c <= '9') return c - '0';
@@ -298,3 +324,18 @@ void md5_digest_to_hex(const uint8_t digest[16], char hex[33]) {
     }
     hex[32] = '\0';
 }
+
+int md5_hex_to_digest(const char* hex, uint8_t digest[16]) {
+    if (hex == NULL || my_strlen(hex) < 32) {
+        return -1;
+    }
+    for (int i = 0; i < 16; i++) {
+        int hi = hex_char_to_val(hex[i * 2]);
+        int lo = hex_char_to_val(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        digest[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return 0;
+}
@@ -16,6 +16,7 @@ int  my_strcasecmp(const char *s1, const char *s2);
 int  my_strcmp(const char *s1, const char *s2);
 void my_strcpy(char *dest, const char *src);
 void str_tolower(char *dest, const char *src);
+uint32_t str_hash_nocase(const char *str);
 void int_to_str(int num, char *buffer);
 void long_to_str(long long num, char *buffer);
 void ulong_to_str(unsigned long long num, char *buffer);
@@ -23,6 +24,7 @@ void str_append(char *dest, const char *src);
 int  safe_append(char *dest, size_t dest_size, const char *src);
 int  read_line_fd(int fd, char *buffer, int max_len);
 void clean_realm_name(char *name);
+int  is_safe_name(const char *name);
 
 // Error handling
 void die(char *msg);
@@ -30,5 +32,6 @@ void die(char *msg);
 // MD5 utilities (uses fork/exec to call md5sum command per statement requirement)
 int  md5_compute_file(const char* path, uint8_t digest[16]);
 void md5_digest_to_hex(const uint8_t digest[16], char hex[33]);
+int  md5_hex_to_digest(const char* hex, uint8_t digest[16]);
 
 #endif
@@ -2,26 +2,55 @@
 #include "trade.h"
 #include "network.h"
 #include "missions.h"
+#include "connections.h"
+#include "checksum.h"
+#include "md5.h"
+#include "shards.h"
+#include "uring.h"
+#include "transfer.h"
+
+#include <sys/eventfd.h>
 
 #define MAX_LINE_LENGTH 256
 
+static int g_stop_fd = -1;   // Maester::stop_fd, for the SIGINT handler
+
 static int  set_socket_nonblocking(int fd);
 static int  maester_setup_listener(Maester* maester);
 static void maester_accept_placeholder(Maester* maester);
+static void maester_adopt_client(Maester* maester, int client_fd, const struct sockaddr_in* addr);
+static void maester_adopt_ring_client(Maester* maester, int client_fd);
+static int  maester_start_listener_thread(Maester* maester);
+static void maester_stop_threads(Maester* maester);
 static void maester_event_loop(Maester* maester);
 static int  build_origin_string(const Maester* maester, char* buffer, size_t len);
 static const char* maester_basename(const char* path);
+static void maester_payload_field(const CitadelFrame* frame, int index, char* out, size_t out_len);
+static int  maester_payload_packing(const char* option, const char* key, char* dict_id, size_t* size);
+static unsigned maester_payload_offers(const CitadelFrame* frame, int first, uint16_t* stream,
+                                       TransferPacking* packing);
 static int  maester_prepare_sigil_metadata(Maester* maester, const char* sigil, char* sigil_name,
-                                           size_t sigil_name_len, char* file_size_str,
-                                           size_t size_len, char md5_hex[33]);
-static void   maester_handle_connection_event(Maester* maester, ConnectionEntry* entry, short revents);
+                                           size_t sigil_name_len, char* file_size_str, size_t size_len);
+static int  maester_build_pledge_frame(Maester* maester, CitadelFrame* frame, const char* origin, const char* realm,
+                                       const char* sigil_name, const char* file_size_str, const char* md5_hex,
+                                       uint16_t stream);
 static void   maester_receive_placeholder(Maester* maester, ConnectionEntry* entry);
-static void   maester_process_incoming_frame(Maester* maester, ConnectionEntry* entry, const CitadelFrame* frame);
+static size_t maester_batch_through_link_options(const uint8_t* run, size_t count);
+static void   maester_close_after_read(ConnectionEntry* entry, int peer_closed);
+static int    maester_process_incoming_frame(Maester* maester, ConnectionEntry* entry, const FrameView* view);
+static int    maester_forward_frame(Maester* maester, ConnectionEntry* entry, const FrameView* view);
+static int    maester_resend_nacked(Maester* maester, ConnectionEntry* entry, const FrameView* view);
+static void   maester_handle_local_frame(Maester* maester, ConnectionEntry* entry, const CitadelFrame* frame);
 static AllianceEntry* maester_find_alliance(Maester* maester, const char* realm);
 static int    maester_add_or_update_alliance(Maester* maester, const char* realm, const char* ip, int port, AllianceState state);
 static AllianceState maester_get_alliance_state(Maester* maester, const char* realm);
 static int    maester_is_allied(Maester* maester, const char* realm);
 static const char* alliance_state_to_string(AllianceState state);
+static void   maester_print_digest_stats(Maester* maester);
+static void   maester_print_store_stats(Maester* maester);
+static void   maester_print_repair_stats(Maester* maester);
+static void   maester_print_compact_stats(Maester* maester);
+static void   maester_print_forward_stats(Maester* maester);
 
 Maester* create_maester(const char* realm_name, const char* folder_path, const char* ip, int port) {
     Maester* maester = (Maester*)malloc(sizeof(Maester));
@@ -39,28 +68,44 @@ Maester* create_maester(const char* realm_name, const char* folder_path, const c
     maester->num_envoys = 0;
     maester->routes = NULL;
     maester->num_routes = 0;
+    maester->route_index.buckets = NULL;
+    maester->route_index.capacity = 0;
+    maester->route_index.default_route = -1;
+    maester->route_index.dirty = 1;
     maester->stock = NULL;
     maester->num_products = 0;
     maester->alliances = NULL;
     maester->num_alliances = 0;
     maester->envoy_missions = NULL;
-    maester->connections = NULL;
-    maester->num_connections = 0;
-    maester->connections_capacity = 0;
+    connection_table_init(&maester->connections, &maester->connections_lock);
+    maester->shards = NULL;
+    maester->num_shards = 0;
+    maester->next_shard = 0;
     maester->listen_fd = -1;
+    maester->reactor.epoll_fd = -1;
     maester->listener_thread = 0;
-    maester->shutting_down = 0;
-    maester->outbound_queue.buffer = NULL;
-    maester->outbound_queue.capacity = 0;
-    maester->outbound_queue.count = 0;
-    maester->outbound_queue.head = 0;
-    maester->outbound_queue.tail = 0;
+    maester->listener_running = 0;
+    maester->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    __atomic_store_n(&maester->shutting_down, 0, __ATOMIC_RELEASE);
+    load_maester_tuning(&maester->tuning);
+    checksum_init();
+    checksum_select((ChecksumAlgorithm)maester->tuning.checksum_algorithm);
+    md5_select((Md5Backend)maester->tuning.md5_backend);
+    send_pool_init(&maester->send_pool, (size_t)maester->tuning.send_pool_kb * 1024);
+    recv_pool_init(&maester->recv_pool);
     pthread_mutex_init(&maester->routes_lock, NULL);
     pthread_mutex_init(&maester->alliances_lock, NULL);
     pthread_mutex_init(&maester->envoys_lock, NULL);
     pthread_mutex_init(&maester->connections_lock, NULL);
-    pthread_mutex_init(&maester->outbound_queue.lock, NULL);
-    pthread_cond_init(&maester->outbound_queue.cond, NULL);
+    pthread_mutex_init(&maester->transfers_lock, NULL);
+    transfer_table_init(&maester->transfers, &maester->connections);
+    // fstat() is not used in the statement's md5sum mode
+    digest_cache_init(&maester->digests, maester->folder_path,
+                      maester->tuning.digest_cache && maester->tuning.md5_backend == MD5_BACKEND_INTERNAL);
+    sigil_store_init(&maester->sigils, maester->folder_path, maester->tuning.sigil_store);
+    memset(&maester->repair, 0, sizeof(maester->repair));
+    memset(&maester->compact_links, 0, sizeof(maester->compact_links));
+    memset(&maester->forwarding, 0, sizeof(maester->forwarding));
     maester_mission_init(maester);
 
     return maester;
@@ -84,8 +129,11 @@ void add_route(Maester* maester, const char* realm, const char* ip, int port) {
     clean_realm_name(maester->routes[maester->num_routes].realm);
     my_strcpy(maester->routes[maester->num_routes].ip, ip);
     maester->routes[maester->num_routes].port = port;
+    maester->routes[maester->num_routes].known = 0;
+    maester->routes[maester->num_routes].next_hop = 0;
 
     maester->num_routes++;
+    maester->route_index.dirty = 1;
 }
 
 void add_product(Maester* maester, const char* name, float weight, int quantity) {
@@ -247,20 +295,79 @@ Maester* load_maester_config(const char* config_file, const char* stock_file) {
     return maester;
 }
 
+static int tuning_env_int(const char* name, int fallback, int min_value, int max_value) {
+    const char* value = getenv(name);
+    if (value == NULL || value[0] < '0' || value[0] > '9') {
+        return fallback;
+    }
+    int parsed = str_to_int(value);
+    if (parsed < min_value) parsed = min_value;
+    if (parsed > max_value) parsed = max_value;
+    return parsed;
+}
+
+// Optional overrides; maester.dat keeps the statement's fixed format
+void load_maester_tuning(MaesterTuning* tuning) {
+    if (tuning == NULL) return;
+    tuning->send_queue_kb = tuning_env_int("CITADEL_SEND_QUEUE_KB", SEND_QUEUE_DEFAULT_KB, 4, 1 << 20);
+    tuning->send_pool_kb = tuning_env_int("CITADEL_SEND_POOL_KB", SEND_POOL_DEFAULT_KB, 64, 1 << 22);
+    tuning->recv_buffer_kb = tuning_env_int("CITADEL_RECV_BUFFER_KB", RECV_BUFFER_DEFAULT_KB, 64, 1 << 20);
+    tuning->connect_timeout_s = tuning_env_int("CITADEL_CONNECT_TIMEOUT_S", CONNECT_TIMEOUT_DEFAULT_S, 1, 600);
+    const char* checksum = getenv("CITADEL_CHECKSUM");
+    tuning->checksum_algorithm = CHECKSUM_SUM16;
+    if (checksum != NULL && my_strcasecmp(checksum, "fletcher16") == 0) {
+        tuning->checksum_algorithm = CHECKSUM_FLETCHER16;
+    }
+    const char* md5 = getenv("CITADEL_MD5");
+    tuning->md5_backend = MD5_BACKEND_INTERNAL;
+    if (md5 != NULL && my_strcasecmp(md5, "md5sum") == 0) {
+        tuning->md5_backend = MD5_BACKEND_MD5SUM;
+    }
+    tuning->digest_cache = tuning_env_int("CITADEL_DIGEST_CACHE", 1, 0, 1);
+    tuning->sigil_store = tuning_env_int("CITADEL_SIGIL_STORE", 1, 0, 1);
+    tuning->workers = tuning_env_int("CITADEL_WORKERS", 0, 0, SHARD_MAX);   // 0: one per CPU
+    const char* backend = getenv("CITADEL_IO_BACKEND");
+    tuning->io_backend = IO_BACKEND_EPOLL;
+    if (backend != NULL && (my_strcasecmp(backend, "io_uring") == 0 || my_strcasecmp(backend, "uring") == 0)) {
+        tuning->io_backend = IO_BACKEND_URING;
+    }
+    tuning->transfer_window = tuning_env_int("CITADEL_TRANSFER_WINDOW", TRANSFER_WINDOW_DEFAULT,
+                                             TRANSFER_WINDOW_MIN, TRANSFER_WINDOW_LIMIT);
+    tuning->transfer_stripes = tuning_env_int("CITADEL_TRANSFER_STRIPES", 1, 1, TRANSFER_STRIPE_MAX);
+    tuning->transfer_pack = tuning_env_int("CITADEL_TRANSFER_PACK", TRANSFER_PACK_DICT, TRANSFER_PACK_NONE,
+                                           TRANSFER_PACK_DICT);
+    tuning->resend_frames = tuning_env_int("CITADEL_RESEND_FRAMES", RESEND_FRAMES_DEFAULT, 0, 1 << 16);
+    tuning->corrupt_ppm = tuning_env_int("CITADEL_CORRUPT_PPM", 0, 0, 1000000);
+    // Off unless asked for: the offer is a frame type older realms do not
+    // know, and they would try to route it
+    tuning->compact_frames = tuning_env_int("CITADEL_COMPACT_FRAMES", 0, 0, 1);
+    // Half the queue at most: what is forwarded past the mark before the
+    // holds take effect still has to fit
+    tuning->forward_high_kb = tuning_env_int("CITADEL_FORWARD_HIGH_KB", FORWARD_HIGH_DEFAULT_KB, 0,
+                                             tuning->send_queue_kb / 2);
+}
+
 void free_maester(Maester* maester) {
     if (maester == NULL) return;
 
+    maester_stop_threads(maester);
     maester_close_all_connections(maester);
-    if (maester->connections != NULL) {
-        free(maester->connections);
-        maester->connections = NULL;
-        maester->connections_capacity = 0;
-    }
+    connection_table_destroy(&maester->connections);
+    shards_destroy(maester);
+    transfer_table_destroy(&maester->transfers);
+    digest_cache_destroy(&maester->digests);
 
     if (maester->listen_fd >= 0) {
         close(maester->listen_fd);
         maester->listen_fd = -1;
     }
+    reactor_destroy(&maester->reactor);
+    if (maester->stop_fd >= 0) {
+        close(maester->stop_fd);
+        maester->stop_fd = -1;
+    }
+    send_pool_destroy(&maester->send_pool);
+    recv_pool_destroy(&maester->recv_pool);
     if (maester->socket_fd >= 0) {
         close(maester->socket_fd);
         maester->socket_fd = -1;
@@ -277,21 +384,17 @@ void free_maester(Maester* maester) {
     if (maester->routes != NULL) {
         free(maester->routes);
     }
+    free(maester->route_index.buckets);
 
     if (maester->stock != NULL) {
         free(maester->stock);
     }
 
-    if (maester->outbound_queue.buffer != NULL) {
-        free(maester->outbound_queue.buffer);
-    }
-
     pthread_mutex_destroy(&maester->routes_lock);
     pthread_mutex_destroy(&maester->alliances_lock);
     pthread_mutex_destroy(&maester->envoys_lock);
     pthread_mutex_destroy(&maester->connections_lock);
-    pthread_mutex_destroy(&maester->outbound_queue.lock);
-    pthread_cond_destroy(&maester->outbound_queue.cond);
+    pthread_mutex_destroy(&maester->transfers_lock);
 
     free(maester);
 }
@@ -320,6 +423,82 @@ static int build_origin_string(const Maester* maester, char* buffer, size_t len)
     return 0;
 }
 
+// Copy the `index`-th '&'-separated field of the frame payload (empty if missing)
+// TRANSFER_OFFER_* flags named by the fields from `first` on; "STREAM=<id>"
+// also stores the ID in `stream` (left 0 without one)
+static unsigned maester_payload_offers(const CitadelFrame* frame, int first, uint16_t* stream,
+                                       TransferPacking* packing) {
+    char option[32];
+    unsigned offers = 0;
+    *stream = 0;
+    packing->plain = 0;
+    packing->dict = 0;
+    packing->dict_id[0] = '\0';
+    for (int field = first; field < first + 7; field++) {
+        maester_payload_field(frame, field, option, sizeof(option));
+        if (my_strcasecmp(option, "SACK") == 0) offers |= TRANSFER_OFFER_SACK;
+        if (my_strcasecmp(option, "DEDUP") == 0) offers |= TRANSFER_OFFER_DEDUP;
+        if (my_strcasecmp(option, "RESUME") == 0) offers |= TRANSFER_OFFER_RESUME;
+        if (my_strcasecmp(option, "STRIPE") == 0) offers |= TRANSFER_OFFER_STRIPE;
+        if (option[0] == 'S' && option[1] == 'T' && option[2] == 'R' && option[3] == 'E' &&
+            option[4] == 'A' && option[5] == 'M' && option[6] == '=') {
+            int id = str_to_int(option + 7);
+            if (id > 0 && id <= 0xFFFF) {
+                offers |= TRANSFER_OFFER_STREAM;
+                *stream = (uint16_t)id;
+            }
+        }
+        if (maester_payload_packing(option, "PACK=", NULL, &packing->plain)) {
+            offers |= TRANSFER_OFFER_PACK;
+        }
+        if (maester_payload_packing(option, "DICT=", packing->dict_id, &packing->dict)) {
+            offers |= TRANSFER_OFFER_DICT;
+        }
+    }
+    return offers;
+}
+
+/**
+ * Packing offer "<key><bytes>", or "<key><id>:<bytes>" when `dict_id` is
+ * given (PACK_DICT_ID_LEN characters). Returns 1 with the size (and the
+ * dictionary ID) filled in when the option is one.
+ */
+static int maester_payload_packing(const char* option, const char* key, char* dict_id, size_t* size) {
+    while (*key != '\0') {
+        if (*option++ != *key++) return 0;
+    }
+    if (dict_id != NULL) {
+        for (int i = 0; i < PACK_DICT_ID_LEN; i++) {
+            if (option[i] == '\0' || option[i] == ':') return 0;
+            dict_id[i] = option[i];
+        }
+        dict_id[PACK_DICT_ID_LEN] = '\0';
+        option += PACK_DICT_ID_LEN;
+        if (*option++ != ':') return 0;
+    }
+    size_t value = 0;
+    for (const char* p = option; *p != '\0'; ++p) {
+        if (*p < '0' || *p > '9' || value > TRANSFER_PACK_MAX_BYTES) return 0;
+        value = value * 10 + (size_t)(*p - '0');
+    }
+    if (value == 0) return 0;
+    *size = value;
+    return 1;
+}
+
+static void maester_payload_field(const CitadelFrame* frame, int index, char* out, size_t out_len) {
+    int data_len = (frame->data_length < FRAME_MAX_DATA) ? frame->data_length : FRAME_MAX_DATA;
+    int i = 0;
+    for (int field = 0; field < index && i < data_len; i++) {
+        if (frame->data[i] == '&') field++;
+    }
+    size_t len = 0;
+    while (i < data_len && frame->data[i] != '&' && len + 1 < out_len) {
+        out[len++] = (char)frame->data[i++];
+    }
+    out[len] = '\0';
+}
+
 static const char* maester_basename(const char* path) {
     if (path == NULL) return "";
     const char* base = path;
@@ -332,10 +511,9 @@ static const char* maester_basename(const char* path) {
 }
 
 static int maester_prepare_sigil_metadata(Maester* maester, const char* sigil, char* sigil_name,
-                                          size_t sigil_name_len, char* file_size_str,
-                                          size_t size_len, char md5_hex[33]) {
+                                          size_t sigil_name_len, char* file_size_str, size_t size_len) {
     (void)maester; // folder_path not used - sigil path is used as-is per statement
-    if (sigil == NULL || sigil_name == NULL || file_size_str == NULL || md5_hex == NULL) {
+    if (sigil == NULL || sigil_name == NULL || file_size_str == NULL) {
         return -1;
     }
 
@@ -359,14 +537,6 @@ static int maester_prepare_sigil_metadata(Maester* maester, const char* sigil, c
         return -1;
     }
 
-    uint8_t digest[16];
-    if (md5_compute_file(sigil, digest) != 0) {
-        write_str(STDOUT_FILENO, "Error: Could not compute MD5 of sigil file.\n");
-        return -1;
-    }
-
-    md5_digest_to_hex(digest, md5_hex);
-
     const char* base_name = maester_basename(sigil);
     size_t base_len = my_strlen(base_name);
     if (base_len + 1 > sigil_name_len) {
@@ -445,30 +615,11 @@ void cmd_list_products(Maester* maester, const char* realm) {
     write_str(STDOUT_FILENO, ": OK (Phase 3 will implement file transfer)\n");
 }
 
-void cmd_pledge(Maester* maester, const char* realm, const char* sigil) {
-    if (maester == NULL || realm == NULL) return;
-
-    if (maester_mission_is_active(maester)) {
-        maester_mission_print_busy(maester, "a pledge mission");
-        return;
-    }
-
-    char sigil_name[PATH_MAX_LEN];
-    char file_size_str[32];
-    char md5_hex[33];
-    if (maester_prepare_sigil_metadata(maester, sigil, sigil_name, sizeof(sigil_name),
-                                       file_size_str, sizeof(file_size_str), md5_hex) != 0) {
-        return;
-    }
-
-    char origin[FRAME_ORIGIN_LEN + 1];
-    if (build_origin_string(maester, origin, sizeof(origin)) != 0) {
-        write_str(STDOUT_FILENO, "Error: Origin endpoint too long.\n");
-        return;
-    }
-
-    CitadelFrame frame;
-    frame_init(&frame, FRAME_TYPE_PLEDGE, origin, realm);
+// PLEDGE header announcing the sigil that follows it
+static int maester_build_pledge_frame(Maester* maester, CitadelFrame* frame, const char* origin, const char* realm,
+                                      const char* sigil_name, const char* file_size_str, const char* md5_hex,
+                                      uint16_t stream) {
+    frame_init(frame, FRAME_TYPE_PLEDGE, origin, realm);
 
     // Build "realm&sigil&size&md5" payload manually without snprintf
     int offset = 0;
@@ -477,39 +628,77 @@ void cmd_pledge(Maester* maester, const char* realm, const char* sigil) {
     len = my_strlen(maester->realm_name);
     if (offset + len >= FRAME_MAX_DATA) {
         write_str(STDOUT_FILENO, "Error: Pledge data too large.\n");
-        return;
+        return -1;
     }
-    memcpy(frame.data + offset, maester->realm_name, len);
+    memcpy(frame->data + offset, maester->realm_name, len);
     offset += len;
-    frame.data[offset++] = '&';
+    frame->data[offset++] = '&';
 
     len = my_strlen(sigil_name);
     if (offset + len >= FRAME_MAX_DATA) {
         write_str(STDOUT_FILENO, "Error: Pledge data too large.\n");
-        return;
+        return -1;
     }
-    memcpy(frame.data + offset, sigil_name, len);
+    memcpy(frame->data + offset, sigil_name, len);
     offset += len;
-    frame.data[offset++] = '&';
+    frame->data[offset++] = '&';
 
     len = my_strlen(file_size_str);
     if (offset + len >= FRAME_MAX_DATA) {
         write_str(STDOUT_FILENO, "Error: Pledge data too large.\n");
-        return;
+        return -1;
     }
-    memcpy(frame.data + offset, file_size_str, len);
+    memcpy(frame->data + offset, file_size_str, len);
     offset += len;
-    frame.data[offset++] = '&';
+    frame->data[offset++] = '&';
 
     len = my_strlen(md5_hex);
     if (offset + len >= FRAME_MAX_DATA) {
         write_str(STDOUT_FILENO, "Error: Pledge data too large.\n");
-        return;
+        return -1;
+    }
+    memcpy(frame->data + offset, md5_hex, len);
+    offset += len;
+
+    // Offer the windowed transfer protocol, answers from the receiver's sigil
+    // store, resumption of a partial file (or striping of a large one), the
+    // stream ID of the transfer and its packed images; older receivers ignore
+    // the fields
+    char offers[96];
+    transfer_header_offers(maester, realm, stream, offers, sizeof(offers));
+    len = my_strlen(offers);
+    if (offset + len >= FRAME_MAX_DATA) {
+        write_str(STDOUT_FILENO, "Error: Pledge data too large.\n");
+        return -1;
     }
-    memcpy(frame.data + offset, md5_hex, len);
+    memcpy(frame->data + offset, offers, len);
     offset += len;
 
-    frame.data_length = (uint16_t)offset;
+    frame->data_length = (uint16_t)offset;
+    return 0;
+}
+
+void cmd_pledge(Maester* maester, const char* realm, const char* sigil) {
+    if (maester == NULL || realm == NULL) return;
+
+    if (maester_mission_is_active(maester)) {
+        maester_mission_print_busy(maester, "a pledge mission");
+        return;
+    }
+
+    char sigil_name[PATH_MAX_LEN];
+    char file_size_str[32];
+    char md5_hex[33];
+    if (maester_prepare_sigil_metadata(maester, sigil, sigil_name, sizeof(sigil_name),
+                                       file_size_str, sizeof(file_size_str)) != 0) {
+        return;
+    }
+
+    char origin[FRAME_ORIGIN_LEN + 1];
+    if (build_origin_string(maester, origin, sizeof(origin)) != 0) {
+        write_str(STDOUT_FILENO, "Error: Origin endpoint too long.\n");
+        return;
+    }
 
     int used_default = 0;
     Route* route = maester_resolve_route(maester, realm, &used_default);
@@ -522,14 +711,53 @@ void cmd_pledge(Maester* maester, const char* realm, const char* sigil) {
 
     maester_log_route_resolution(realm, route, used_default);
 
-    ConnectionEntry* connection = maester_get_or_open_connection(maester, route->realm, route->ip, route->port);
+    ConnectionEntry* connection = maester_route_connection(maester, route);
     if (connection == NULL) {
         write_str(STDOUT_FILENO, "Failed to prepare connection for pledge.\n");
         return;
     }
 
+    // The sigil follows the header once the receiver answers ACK_FILE. Its MD5
+    // comes from the mapping the data frames are cut from. Hashing and packing
+    // a large file takes a while: only the CLI thread starts transfers and
+    // missions, so the shards carry on meanwhile, as during START TRADE. The
+    // stock dictionary is built first, since the lock guards the stock.
+    ConnHandle next_hop = connection_handle(connection);
+    PackDictionary dict;
+    pack_dictionary_init(&dict);
+    if (maester->tuning.transfer_pack == TRANSFER_PACK_DICT) {
+        transfer_stock_dictionary(maester, &dict);
+    }
+    TransferSource source;
+    pthread_mutex_unlock(&maester->alliances_lock);
+    int prepared = transfer_send_prepare(maester, sigil, &dict, &source);
+    pthread_mutex_lock(&maester->alliances_lock);
+    pack_dictionary_free(&dict);
+    if (prepared != 0) {
+        return;
+    }
+    connection = connection_table_lookup(&maester->connections, next_hop);
+    if (connection == NULL) {
+        transfer_source_release(&source);
+        write_str(STDOUT_FILENO, "Failed to prepare connection for pledge.\n");
+        return;
+    }
+    my_strcpy(md5_hex, source.md5);
+    uint16_t stream = 0;
+    if (transfer_send_begin(maester, FRAME_TYPE_SIGIL_DATA, realm, origin, &source, sigil_name, next_hop,
+                            &stream) != 0) {
+        return;
+    }
+
+    CitadelFrame frame;
+    if (maester_build_pledge_frame(maester, &frame, origin, realm, sigil_name, file_size_str, md5_hex, stream) != 0) {
+        transfer_send_cancel(maester, realm, stream);
+        return;
+    }
+
     if (maester_send_frame(connection, &frame) != 0) {
         write_str(STDOUT_FILENO, "Error: Failed to send pledge frame.\n");
+        transfer_send_cancel(maester, realm, stream);
         maester_close_connection_entry(connection);
         return;
     }
@@ -544,8 +772,10 @@ void cmd_pledge(Maester* maester, const char* realm, const char* sigil) {
     safe_append(mission_desc, sizeof(mission_desc), "Pledge to ");
     safe_append(mission_desc, sizeof(mission_desc), realm);
     if (!maester_mission_begin(maester, FRAME_TYPE_PLEDGE, realm, mission_desc, 120)) {
+        transfer_send_cancel(maester, realm, stream);
         return;
     }
+    maester_mission_set_next_hop(maester, route->realm);
 
     write_str(STDOUT_FILENO, "Command OK\n");
 }
@@ -608,7 +838,7 @@ void cmd_pledge_respond(Maester* maester, const char* realm, const char* respons
     }
 
     // Get or create connection
-    ConnectionEntry* conn = maester_get_or_open_connection(maester, route->realm, route->ip, route->port);
+    ConnectionEntry* conn = maester_route_connection(maester, route);
     if (conn == NULL) {
         write_str(STDERR_FILENO, "Warning: Cannot send response - connection failed to ");
         write_str(STDERR_FILENO, realm);
@@ -651,6 +881,11 @@ void cmd_pledge_status(Maester* maester) {
 
     if (maester->alliances == NULL || maester->num_alliances == 0) {
         write_str(STDOUT_FILENO, "  No alliances recorded.\n");
+        maester_print_digest_stats(maester);
+        maester_print_store_stats(maester);
+        maester_print_repair_stats(maester);
+        maester_print_compact_stats(maester);
+        maester_print_forward_stats(maester);
         return;
     }
 
@@ -678,6 +913,92 @@ void cmd_pledge_status(Maester* maester) {
 
         write_str(STDOUT_FILENO, "\n");
     }
+    maester_print_digest_stats(maester);
+    maester_print_store_stats(maester);
+    maester_print_repair_stats(maester);
+    maester_print_compact_stats(maester);
+    maester_print_forward_stats(maester);
+}
+
+static void maester_print_digest_stats(Maester* maester) {
+    write_str(STDOUT_FILENO, "Sigil Digests: ");
+    if (!maester->digests.enabled) {
+        write_str(STDOUT_FILENO, "cache off\n");
+        return;
+    }
+    int entries = 0;
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    char number[32];
+    digest_cache_stats(&maester->digests, &entries, &hits, &misses);
+    int_to_str(entries, number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " cached, ");
+    ulong_to_str(hits, number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " hits, ");
+    ulong_to_str(misses, number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " misses\n");
+}
+
+static void maester_print_store_stats(Maester* maester) {
+    write_str(STDOUT_FILENO, "Sigil Store: ");
+    if (!maester->sigils.enabled) {
+        write_str(STDOUT_FILENO, "off\n");
+        return;
+    }
+    unsigned long long reused = 0;
+    unsigned long long bytes_saved = 0;
+    char number[32];
+    sigil_store_stats(&maester->sigils, &reused, &bytes_saved);
+    ulong_to_str(reused, number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " transfers answered from the store, ");
+    ulong_to_str(bytes_saved, number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " bytes not sent\n");
+}
+
+static void maester_print_repair_stats(Maester* maester) {
+    unsigned long long counts[4] = {
+        __atomic_load_n(&maester->repair.nacks_sent, __ATOMIC_RELAXED),
+        __atomic_load_n(&maester->repair.frames_resent, __ATOMIC_RELAXED),
+        __atomic_load_n(&maester->repair.resends_missed, __ATOMIC_RELAXED),
+        __atomic_load_n(&maester->repair.corrupted, __ATOMIC_RELAXED)
+    };
+    static const char* labels[4] = {
+        " NACKs sent, ", " frames resent, ", " too old to resend, ", " damaged on purpose\n"
+    };
+    char number[32];
+    write_str(STDOUT_FILENO, "Link Repair: ");
+    for (int i = 0; i < 4; i++) {
+        ulong_to_str(counts[i], number);
+        write_str(STDOUT_FILENO, number);
+        write_str(STDOUT_FILENO, labels[i]);
+    }
+}
+
+static void maester_print_compact_stats(Maester* maester) {
+    char number[32];
+    write_str(STDOUT_FILENO, "Compact Links: ");
+    ulong_to_str(__atomic_load_n(&maester->compact_links.sending, __ATOMIC_RELAXED), number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " switched to compact frames, ");
+    ulong_to_str(__atomic_load_n(&maester->compact_links.receiving, __ATOMIC_RELAXED), number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " receiving them\n");
+}
+
+static void maester_print_forward_stats(Maester* maester) {
+    char number[32];
+    write_str(STDOUT_FILENO, "Forwarding: ");
+    ulong_to_str(__atomic_load_n(&maester->forwarding.holds, __ATOMIC_RELAXED), number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " holds for a full next hop, ");
+    ulong_to_str(__atomic_load_n(&maester->forwarding.dropped, __ATOMIC_RELAXED), number);
+    write_str(STDOUT_FILENO, number);
+    write_str(STDOUT_FILENO, " frames dropped\n");
 }
 
 void cmd_envoy_status(Maester* maester) {
@@ -686,91 +1007,281 @@ void cmd_envoy_status(Maester* maester) {
     write_str(STDOUT_FILENO, "Command OK\n");
 }
 
-static void maester_receive_placeholder(Maester* maester, ConnectionEntry* entry) {
-    if (entry == NULL || entry->sockfd < 0) return;
-    uint8_t buffer[FRAME_MAX_SIZE];
-    ssize_t bytes = read(entry->sockfd, buffer, sizeof(buffer));
-    if (bytes > 0) {
-        // Log received bytes (DEBUG)
-        // write_str(STDOUT_FILENO, "DEBUG: Received ");
-        // char bytes_buf[32];
-        // long_to_str(bytes, bytes_buf);
-        // write_str(STDOUT_FILENO, bytes_buf);
-        // write_str(STDOUT_FILENO, " bytes from peer ");
-        // write_str(STDOUT_FILENO, entry->peer_ip);
-        // write_str(STDOUT_FILENO, "\n");
-
-        if (frame_buffer_append(&entry->recv_buffer, buffer, (size_t)bytes) != 0) {
-            write_str(STDERR_FILENO, "Warning: receive buffer overflow, dropping data.\n");
-            frame_buffer_reset(&entry->recv_buffer);
-            return;
+/**
+ * Act on one frame at the head of the receive ring and release its `length`
+ * bytes (less than FRAME_MAX_SIZE for a compact frame).
+ * Returns -1 if the connection was closed while processing.
+ */
+static int maester_handle_frame_result(Maester* maester, ConnectionEntry* entry, const FrameView* view,
+                                       FrameParseResult result, size_t length) {
+    if (result == FRAME_PARSE_OK) {
+        if (maester_process_incoming_frame(maester, entry, view) != 0) {
+            return 0;   // Held for a full next hop: the frame stays at the head of the ring
         }
-        CitadelFrame frame;
-        size_t consumed = 0;
-        FrameParseResult result;
-        // int frame_count = 0;  // DEBUG
-        while ((result = frame_buffer_extract(&entry->recv_buffer, &frame, &consumed)) == FRAME_PARSE_OK) {
-            // frame_count++;  // DEBUG
-            maester_process_incoming_frame(maester, entry, &frame);
-        }
-
-        // Log parse results (DEBUG)
-        // if (frame_count > 0) {
-        //     write_str(STDOUT_FILENO, "DEBUG: Successfully parsed ");
-        //     char count_buf[16];
-        //     int_to_str(frame_count, count_buf);
-        //     write_str(STDOUT_FILENO, count_buf);
-        //     write_str(STDOUT_FILENO, " frame(s)\n");
-        // } else
-        if (result == FRAME_PARSE_NEED_MORE) {
-            // write_str(STDOUT_FILENO, "DEBUG: Need more data for complete frame\n");
-        } else if (result == FRAME_PARSE_BAD_CHECKSUM) {
-            write_str(STDERR_FILENO, "Warning: Received frame with invalid checksum.\n");
-
-            // Send NACK frame back to sender
-            CitadelFrame nack_frame;
-            frame_init(&nack_frame, FRAME_TYPE_NACK, maester->realm_name, frame.origin);
-
-            // Add error message in DATA field
-            const char* error_msg = "Checksum validation failed";
-            size_t msg_len = my_strlen(error_msg);
-            if (msg_len > FRAME_MAX_DATA) {
-                msg_len = FRAME_MAX_DATA;
+        entry->frames_received++;
+        if (entry->sockfd < 0) {
+            return -1;
+        }
+        frame_buffer_consume(&entry->recv_buffer, length);
+    } else if (result == FRAME_PARSE_BAD_CHECKSUM) {
+        write_str(STDERR_FILENO, "Warning: Received frame with invalid checksum.\n");
+        char bad_origin[FRAME_ORIGIN_LEN + 1];
+        frame_view_origin(view, bad_origin, sizeof(bad_origin));
+        // The length field held, so only the damaged frame is dropped
+        frame_buffer_consume(&entry->recv_buffer, length);
+        uint64_t index = entry->frames_received++;
+
+        // Send NACK frame back to sender
+        CitadelFrame nack_frame;
+        frame_init(&nack_frame, FRAME_TYPE_NACK, maester->realm_name, bad_origin);
+
+        // Add error message in DATA field; while the frame count on this
+        // connection is trustworthy it names the frame, so the neighbour that
+        // wrote it can resend its intact copy
+        char error_msg[64] = "Checksum validation failed";
+        if (!entry->frames_unsynced) {
+            char number[24];
+            ulong_to_str((unsigned long long)index, number);
+            safe_append(error_msg, sizeof(error_msg), NACK_FRAME_FIELD);
+            safe_append(error_msg, sizeof(error_msg), number);
+        }
+        size_t msg_len = my_strlen(error_msg);
+        memcpy(nack_frame.data, error_msg, msg_len);
+        nack_frame.data_length = (uint16_t)msg_len;
+
+        // Send NACK frame
+        if (maester_send_frame(entry, &nack_frame) == 0) {
+            __atomic_fetch_add(&maester->repair.nacks_sent, 1, __ATOMIC_RELAXED);
+            write_str(STDOUT_FILENO, "Sent NACK to ");
+            write_str(STDOUT_FILENO, bad_origin);
+            write_str(STDOUT_FILENO, " due to checksum failure.\n");
+        } else {
+            write_str(STDERR_FILENO, "Warning: Failed to send NACK frame.\n");
+        }
+        if (entry->sockfd < 0) {
+            return -1;
+        }
+    } else {
+        write_str(STDERR_FILENO, "Warning: Invalid frame format.\n");
+        frame_buffer_reset(&entry->recv_buffer);
+        entry->frames_unsynced = 1;   // An unknown number of frames went with it
+    }
+    return 0;
+}
+
+/**
+ * Handle every complete frame sitting in the receive ring.
+ * Frames lying contiguously in the ring are validated in batches (one
+ * checksum pass for up to FRAME_BATCH_MAX frames); a frame straddling the
+ * wrap point goes through frame_buffer_peek_view(). Frames are inspected in
+ * place and each ring slot is only released once handled. A batch ends at a
+ * LINK_OPTIONS frame, since what follows a SWITCH is compact; once the peer
+ * has switched, frames are taken one at a time instead. A held
+ * connection stops at the frame its next hop has no room for.
+ * Returns -1 if the connection was closed while processing.
+ */
+static int maester_drain_frames(Maester* maester, ConnectionEntry* entry) {
+    FrameView view;
+    for (;;) {
+        if (entry->held) {
+            return 0;
+        }
+        if (entry->compact_recv) {
+            size_t length = 0;
+            FrameParseResult result = frame_buffer_peek_compact(&entry->recv_buffer, &view, &length);
+            if (result == FRAME_PARSE_NEED_MORE) {
+                return 0;
             }
-            memcpy(nack_frame.data, error_msg, msg_len);
-            nack_frame.data_length = (uint16_t)msg_len;
-
-            // Send NACK frame
-            if (maester_send_frame(entry, &nack_frame) == 0) {
-                write_str(STDOUT_FILENO, "Sent NACK to ");
-                write_str(STDOUT_FILENO, frame.origin);
-                write_str(STDOUT_FILENO, " due to checksum failure.\n");
-            } else {
-                write_str(STDERR_FILENO, "Warning: Failed to send NACK frame.\n");
+            if (maester_handle_frame_result(maester, entry, &view, result, length) != 0) {
+                return -1;
             }
-        } else if (result == FRAME_PARSE_INVALID) {
-            write_str(STDERR_FILENO, "Warning: Invalid frame format.\n");
+            continue;
         }
-    } else if (bytes == 0) {
+        const uint8_t* run = NULL;
+        size_t count = frame_buffer_contiguous(&entry->recv_buffer, &run) / FRAME_MAX_SIZE;
+        if (count > 0) {
+            if (count > FRAME_BATCH_MAX) {
+                count = FRAME_BATCH_MAX;
+            }
+            count = maester_batch_through_link_options(run, count);
+            FrameParseResult results[FRAME_BATCH_MAX];
+            size_t valid = frame_validate_batch(run, count, results);
+            size_t handled = (valid < count) ? valid + 1 : count;
+            for (size_t i = 0; i < handled; i++) {
+                view.bytes = run + i * FRAME_MAX_SIZE;
+                if (maester_handle_frame_result(maester, entry, &view, results[i], FRAME_MAX_SIZE) != 0) {
+                    return -1;
+                }
+                if (results[i] == FRAME_PARSE_INVALID || entry->compact_recv || entry->held) {
+                    break;  // Ring was reset, what follows is compact, or it waits
+                }
+            }
+            continue;
+        }
+        FrameParseResult result = frame_buffer_peek_view(&entry->recv_buffer, &view);
+        if (result == FRAME_PARSE_NEED_MORE) {
+            return 0;
+        }
+        if (maester_handle_frame_result(maester, entry, &view, result, FRAME_MAX_SIZE) != 0) {
+            return -1;
+        }
+    }
+}
+
+// Leading frames of a run up to and including the first LINK_OPTIONS, which
+// may be a SWITCH: the bytes after it are not 320-byte frames then
+static size_t maester_batch_through_link_options(const uint8_t* run, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (run[i * FRAME_MAX_SIZE] == FRAME_TYPE_LINK_OPTIONS) {
+            return i + 1;
+        }
+    }
+    return count;
+}
+
+static void maester_close_after_read(ConnectionEntry* entry, int peer_closed) {
+    if (peer_closed) {
         write_str(STDOUT_FILENO, "Peer closed connection: ");
         write_str(STDOUT_FILENO, entry->peer_realm[0] ? entry->peer_realm : entry->peer_ip);
         write_str(STDOUT_FILENO, "\n");
-        maester_close_connection_entry(entry);
     } else {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            write_str(STDERR_FILENO, "Error reading from peer connection. Closing it.\n");
-            maester_close_connection_entry(entry);
+        write_str(STDERR_FILENO, "Error reading from peer connection. Closing it.\n");
+    }
+    maester_close_connection_entry(entry);
+}
+
+static void maester_receive_placeholder(Maester* maester, ConnectionEntry* entry) {
+    if (entry == NULL || entry->sockfd < 0) return;
+
+    // Drain the socket straight into the ring until it runs dry, then parse the
+    // whole batch. The budget keeps one busy peer from starving the others;
+    // epoll is level-triggered so whatever is left wakes us again.
+    size_t drained = 0;
+    int peer_closed = 0;
+    int read_failed = 0;
+    while (drained < RECV_BATCH_BUDGET) {
+        size_t requested = 0;
+        ssize_t bytes = frame_buffer_read_fd(&entry->recv_buffer, entry->sockfd, &requested);
+        if (bytes > 0) {
+            drained += (size_t)bytes;
+            if ((size_t)bytes < requested) {
+                break;  // Short read: the socket is empty
+            }
+            continue;
+        }
+        if (bytes == 0 && requested == 0) {
+            // Ring is at its maximum size: handle what we have before reading on
+            if (maester_drain_frames(maester, entry) != 0) {
+                return;
+            }
+            if (entry->held || frame_buffer_space(&entry->recv_buffer) == 0) {
+                break;
+            }
+            continue;
+        }
+        if (bytes == 0) {
+            peer_closed = 1;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            read_failed = 1;
         }
+        break;
+    }
+
+    if (maester_drain_frames(maester, entry) != 0) {
+        return;
+    }
+
+    // A held connection is closed once its frames are out: reading on after
+    // the hold finds the end of the stream again
+    if ((peer_closed || read_failed) && !entry->held) {
+        maester_close_after_read(entry, peer_closed);
+    }
+}
+
+/**
+ * A held connection's next hop may have room again: if so, handle the frames
+ * waiting in its receive ring and read on. Runs on the owning shard.
+ */
+void maester_resume_reading(Maester* maester, ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL || entry->sockfd < 0 || !entry->held) return;
+    if (!maester_hold_released(maester, entry)) {
+        return;
+    }
+    entry->held = 0;
+    __atomic_store_n(&entry->held_on, 0, __ATOMIC_RELAXED);
+    if (maester_drain_frames(maester, entry) != 0) {
+        return;
     }
+    maester_connection_update_interest(entry);
 }
 
-static void maester_handle_connection_event(Maester* maester, ConnectionEntry* entry, short revents) {
+/**
+ * io_uring receive path: `length` bytes the kernel already placed in a
+ * provided buffer (0: the peer closed, negative: -errno). They are copied into
+ * the receive ring, parsing frames whenever it is full. Returns -1 once the
+ * connection has been closed.
+ */
+int maester_handle_received(Maester* maester, ConnectionEntry* entry, const uint8_t* data, int length) {
+    if (maester == NULL || entry == NULL || entry->sockfd < 0) return -1;
+    if (length < 0) {
+        // Reset or failed socket: reported like an epoll error/hangup event
+        maester_handle_connection_event(maester, entry, REACTOR_ERROR);
+        return -1;
+    }
+    if (length == 0 || data == NULL) {
+        if (entry->held) {
+            return 0;   // Seen again once the receive is re-armed after the hold
+        }
+        maester_close_after_read(entry, 1);
+        return -1;
+    }
+    size_t remaining = (size_t)length;
+    while (frame_buffer_append(&entry->recv_buffer, data, remaining) != 0) {
+        // Ring is at its maximum size: fill it, handle the frames, go on
+        size_t space = frame_buffer_space(&entry->recv_buffer);
+        if (space > remaining) {
+            space = remaining;
+        }
+        frame_buffer_append(&entry->recv_buffer, data, space);
+        data += space;
+        remaining -= space;
+        if (maester_drain_frames(maester, entry) != 0) {
+            return -1;
+        }
+        if (frame_buffer_space(&entry->recv_buffer) == 0) {
+            // Held: the receive is being cancelled, and what it took off the
+            // socket before that is kept past the limit rather than lost
+            if (entry->held && frame_buffer_append_over(&entry->recv_buffer, data, remaining) == 0) {
+                return 0;
+            }
+            write_str(STDERR_FILENO, "Warning: receive buffer full, dropping data.\n");
+            break;
+        }
+    }
+    return maester_drain_frames(maester, entry);
+}
+
+void maester_handle_connection_event(Maester* maester, ConnectionEntry* entry, uint32_t events) {
     if (entry == NULL) return;
-    if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    if (entry->state == CONNECTION_CONNECTING) {
+        // Writable (or error) here means the non-blocking connect() has settled
+        maester_connection_complete_connect(maester, entry);
+        return;
+    }
+    if (events & (REACTOR_ERROR | REACTOR_HANGUP)) {
+        if (entry->stripe) {
+            maester_close_connection_entry(entry);  // Its transfer carries on without it
+            return;
+        }
         // Check if this is a known allied realm
         if (entry->peer_realm[0] != '\0') {
+            pthread_mutex_lock(&maester->alliances_lock);
             AllianceEntry* ally = maester_find_alliance(maester, entry->peer_realm);
-            if (ally != NULL && ally->state == ALLIANCE_ACTIVE) {
+            int allied = (ally != NULL && ally->state == ALLIANCE_ACTIVE);
+            pthread_mutex_unlock(&maester->alliances_lock);
+            if (allied) {
                 write_str(STDOUT_FILENO, "\n>>> Alliance partner ");
                 write_str(STDOUT_FILENO, entry->peer_realm);
                 write_str(STDOUT_FILENO, " has disconnected.\n");
@@ -788,72 +1299,202 @@ static void maester_handle_connection_event(Maester* maester, ConnectionEntry* e
         maester_close_connection_entry(entry);
         return;
     }
-    if ((revents & POLLOUT) && entry->sockfd >= 0) {
+    if ((events & REACTOR_WRITABLE) && entry->sockfd >= 0) {
         maester_flush_send_buffer(entry);
         if (entry->sockfd < 0) {
             return;
         }
+        if (entry->transfer_out) {
+            transfer_pump(maester, entry);
+        }
+        maester_connection_drained(maester, entry);
     }
-    if (revents & POLLIN) {
+    if ((events & REACTOR_READABLE) && !entry->held) {
         maester_receive_placeholder(maester, entry);
     }
 }
 
-static void maester_process_incoming_frame(Maester* maester, ConnectionEntry* entry, const CitadelFrame* frame) {
-    (void)entry;
-    // frame_log_summary("Received frame", frame);  // DEBUG
-    if (maester == NULL || frame == NULL) {
-        return;
+// Returns 1 when the frame has to wait for room on its next hop (the entry
+// now holds), 0 once it was handled
+static int maester_process_incoming_frame(Maester* maester, ConnectionEntry* entry, const FrameView* view) {
+    if (maester == NULL || view == NULL) {
+        return 0;
     }
 
-    // Check if this frame is for us or needs forwarding
-    if (my_strcasecmp(frame->destination, maester->realm_name) != 0) {
-        // Frame is NOT for us - forward it to the next hop
+    // Type and destination are read straight from the receive ring; the frame
+    // is only decoded into a CitadelFrame once a handler actually needs it.
+    FrameType type = frame_view_type(view);
+    if (type == FRAME_TYPE_NACK && maester_resend_nacked(maester, entry, view)) {
+        return 0;   // About this link only: never forwarded
+    }
+    if (type == FRAME_TYPE_LINK_OPTIONS) {
+        maester_handle_link_options(maester, entry, view);   // Likewise
+        return 0;
+    }
+    int for_us = frame_view_destination_is(view, maester->realm_name);
+    if (for_us && (type == FRAME_TYPE_NACK || type == FRAME_TYPE_ERROR_UNKNOWN ||
+                   type == FRAME_TYPE_ERROR_UNAUTHORIZED)) {
+        // Nothing consumes these locally yet: discard without copying
+        return 0;
+    }
+    if (for_us && type == FRAME_TYPE_SIGIL_DATA) {
+        // File data goes from the receive ring to disk without alliances_lock
+        char realm[REALM_NAME_MAX];
+        if (transfer_receive_data(maester, entry, view, realm, sizeof(realm)) < 0) {
+            pthread_mutex_lock(&maester->alliances_lock);
+            if (maester_get_alliance_state(maester, realm) == ALLIANCE_PENDING) {
+                maester_add_or_update_alliance(maester, realm, NULL, 0, ALLIANCE_INACTIVE);
+            }
+            pthread_mutex_unlock(&maester->alliances_lock);
+        }
+        return 0;
+    }
+    if (for_us && type == FRAME_TYPE_ACK_DATA) {
+        transfer_handle_data_ack(maester, view);
+        return 0;
+    }
+
+    if (!for_us) {
+        return maester_forward_frame(maester, entry, view);
+    }
+
+    CitadelFrame frame;
+    frame_view_to_frame(view, &frame);
+    // frame_log_summary("Received frame", &frame);  // DEBUG
+    // Alliance and mission state is shared with the CLI thread
+    pthread_mutex_lock(&maester->alliances_lock);
+    maester_handle_local_frame(maester, entry, &frame);
+    pthread_mutex_unlock(&maester->alliances_lock);
+    return 0;
+}
+
+/**
+ * A NACK naming a frame (NACK_FRAME_FIELD) comes from the neighbour that got
+ * it damaged: write our intact copy of that frame again on the same
+ * connection. Frames are numbered per connection in the order they were
+ * queued, which TCP keeps, so both ends count alike. Returns 0 for a NACK
+ * without a frame number (an older peer), which is handled as before.
+ */
+static int maester_resend_nacked(Maester* maester, ConnectionEntry* entry, const FrameView* view) {
+    char text[64];
+    uint16_t length = frame_view_data_length(view);
+    if (length >= sizeof(text)) {
+        length = sizeof(text) - 1;
+    }
+    memcpy(text, frame_view_data(view), length);
+    text[length] = '\0';
+    const char* field = NULL;
+    int field_len = my_strlen(NACK_FRAME_FIELD);
+    for (const char* p = text; *p != '\0'; p++) {
+        int i = 0;
+        while (i < field_len && p[i] == NACK_FRAME_FIELD[i]) i++;
+        if (i == field_len) {
+            field = p + field_len;
+            break;
+        }
+    }
+    if (field == NULL || *field < '0' || *field > '9' || entry == NULL) {
+        return 0;
+    }
+    uint64_t index = 0;
+    while (*field >= '0' && *field <= '9') {
+        index = index * 10 + (uint64_t)(*field - '0');
+        field++;
+    }
+
+    // Copied out first: queueing it again overwrites a ring slot
+    uint8_t frame[FRAME_MAX_SIZE];
+    if (send_queue_kept_frame(&entry->send_queue, index, frame) != 0) {
+        __atomic_fetch_add(&maester->repair.resends_missed, 1, __ATOMIC_RELAXED);
+        write_str(STDERR_FILENO, "Warning: NACKed frame no longer kept for ");
+        write_str(STDERR_FILENO, entry->peer_realm[0] ? entry->peer_realm : entry->peer_ip);
+        write_str(STDERR_FILENO, ".\n");
+        return 1;
+    }
+    if (maester_send_bytes(entry, frame, FRAME_MAX_SIZE) == 0) {
+        __atomic_fetch_add(&maester->repair.frames_resent, 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+/**
+ * Transit fast path: the frame is NOT for us. Only the destination is read out
+ * of the ring to pick the next hop; the original 320 bytes (checksum already
+ * validated by the receive path) are copied unchanged into the next hop's send
+ * queue, with no decode, re-serialize or checksum recompute. Returns 1 when
+ * the next hop has no room: the entry holds, and the frame is taken again
+ * once it does (maester_resume_reading).
+ */
+static int maester_forward_frame(Maester* maester, ConnectionEntry* entry, const FrameView* view) {
+    char origin[FRAME_ORIGIN_LEN + 1];
+    char destination[FRAME_DEST_LEN + 1];
+    frame_view_origin(view, origin, sizeof(origin));
+    frame_view_destination(view, destination, sizeof(destination));
+
+    // Resolve route to destination
+    int used_default = 0;
+    Route* route = maester_resolve_route(maester, destination, &used_default);
+
+    if (route == NULL) {
         write_str(STDOUT_FILENO, "Forwarding frame from ");
-        write_str(STDOUT_FILENO, frame->origin);
+        write_str(STDOUT_FILENO, origin);
         write_str(STDOUT_FILENO, " to ");
-        write_str(STDOUT_FILENO, frame->destination);
+        write_str(STDOUT_FILENO, destination);
         write_str(STDOUT_FILENO, " via next hop...\n");
 
-        // Resolve route to destination
-        int used_default = 0;
-        Route* route = maester_resolve_route(maester, frame->destination, &used_default);
-
-        if (route == NULL) {
-            // No route found - send ERROR_UNKNOWN back to origin
-            write_str(STDERR_FILENO, "No route to ");
-            write_str(STDERR_FILENO, frame->destination);
-            write_str(STDERR_FILENO, ", sending ERROR_UNKNOWN to origin.\n");
-
-            CitadelFrame error_frame;
-            frame_init(&error_frame, FRAME_TYPE_ERROR_UNKNOWN, maester->realm_name, frame->origin);
-            const char* error_msg = "No route to destination";
-            int msg_len = my_strlen(error_msg);
-            if (msg_len > FRAME_MAX_DATA) msg_len = FRAME_MAX_DATA;
-            memcpy(error_frame.data, error_msg, msg_len);
-            error_frame.data_length = msg_len;
+        // No route found - send ERROR_UNKNOWN back to origin
+        write_str(STDERR_FILENO, "No route to ");
+        write_str(STDERR_FILENO, destination);
+        write_str(STDERR_FILENO, ", sending ERROR_UNKNOWN to origin.\n");
+
+        CitadelFrame error_frame;
+        frame_init(&error_frame, FRAME_TYPE_ERROR_UNKNOWN, maester->realm_name, origin);
+        const char* error_msg = "No route to destination";
+        int msg_len = my_strlen(error_msg);
+        if (msg_len > FRAME_MAX_DATA) msg_len = FRAME_MAX_DATA;
+        memcpy(error_frame.data, error_msg, msg_len);
+        error_frame.data_length = msg_len;
+
+        // Send error back through the connection we received from
+        maester_send_frame(entry, &error_frame);
+        return 0;
+    }
 
-            // Send error back through the connection we received from
-            maester_send_frame(entry, &error_frame);
-            return;
+    // Get or open connection to next hop
+    ConnectionEntry* next_hop = maester_route_connection(maester, route);
+    int result = -1;
+    if (next_hop != NULL) {
+        result = maester_forward_bytes(maester, entry, next_hop, view->bytes, FRAME_MAX_SIZE);
+        if (result > 0) {
+            return 1;   // Logged once it goes out
         }
+    }
 
-        // Get or open connection to next hop
-        ConnectionEntry* next_hop = maester_get_or_open_connection(maester, route->realm, route->ip, route->port);
-        if (next_hop == NULL) {
-            write_str(STDERR_FILENO, "Failed to connect to next hop. Dropping frame.\n");
-            return;
-        }
+    // One write per forwarded frame keeps logging off the transit hot path
+    char log_line[160];
+    log_line[0] = '\0';
+    safe_append(log_line, sizeof(log_line), "Forwarding frame from ");
+    safe_append(log_line, sizeof(log_line), origin);
+    safe_append(log_line, sizeof(log_line), " to ");
+    safe_append(log_line, sizeof(log_line), destination);
+    safe_append(log_line, sizeof(log_line), " via next hop...\n");
+    if (result == 0) {
+        safe_append(log_line, sizeof(log_line), "Frame forwarded successfully.\n");
+    }
+    write_str(STDOUT_FILENO, log_line);
 
-        // Forward the frame
-        if (maester_send_frame(next_hop, frame) == 0) {
-            write_str(STDOUT_FILENO, "Frame forwarded successfully.\n");
-        } else {
-            write_str(STDERR_FILENO, "Failed to forward frame.\n");
-        }
-        return;
+    if (result != 0) {
+        __atomic_fetch_add(&maester->forwarding.dropped, 1, __ATOMIC_RELAXED);
+    }
+    if (next_hop == NULL) {
+        write_str(STDERR_FILENO, "Failed to connect to next hop. Dropping frame.\n");
+    } else if (result != 0) {
+        write_str(STDERR_FILENO, "Failed to forward frame.\n");
     }
+    return 0;
+}
 
+static void maester_handle_local_frame(Maester* maester, ConnectionEntry* entry, const CitadelFrame* frame) {
     // Frame IS for us - process it locally
     if (frame->type == FRAME_TYPE_PLEDGE_RESPONSE &&
         maester_mission_is_active(maester) &&
@@ -946,6 +1587,42 @@ static void maester_process_incoming_frame(Maester* maester, ConnectionEntry* en
         maester_mission_finish(maester, NULL);
     }
 
+    // Sigil transfer acknowledgements for our pledge
+    if (frame->type == FRAME_TYPE_ACK_FILE || frame->type == FRAME_TYPE_ACK_MD5) {
+        if (transfer_handle_ack(maester, frame) < 0 &&
+            maester_mission_is_active(maester) &&
+            maester->active_mission.type == FRAME_TYPE_PLEDGE &&
+            my_strcasecmp(maester->active_mission.target_realm, frame->origin) == 0) {
+            maester_add_or_update_alliance(maester, frame->origin, NULL, 0, ALLIANCE_INACTIVE);
+            maester_mission_finish(maester, "Mission failed: the sigil was not accepted.");
+            write_str(STDOUT_FILENO, "$ ");
+        }
+        return;
+    }
+
+    // A sender that lost its next hop mid-transfer announces the file again:
+    // "<data type>&realm&name&size&md5&offers". No alliance state changes.
+    if (frame->type == FRAME_TYPE_TRANSFER_RESUME) {
+        char data_type[8];
+        char realm_name[REALM_NAME_MAX];
+        char sigil_name[PATH_MAX_LEN];
+        char file_size[32];
+        char md5_hex[33];
+        maester_payload_field(frame, 0, data_type, sizeof(data_type));
+        maester_payload_field(frame, 1, realm_name, sizeof(realm_name));
+        maester_payload_field(frame, 2, sigil_name, sizeof(sigil_name));
+        maester_payload_field(frame, 3, file_size, sizeof(file_size));
+        maester_payload_field(frame, 4, md5_hex, sizeof(md5_hex));
+        if (str_to_int(data_type) == FRAME_TYPE_SIGIL_DATA && realm_name[0] != '\0') {
+            uint16_t stream;
+            TransferPacking packing;
+            unsigned offers = maester_payload_offers(frame, 5, &stream, &packing);
+            transfer_receive_begin(maester, entry, FRAME_TYPE_SIGIL_DATA, frame->origin, realm_name,
+                                   sigil_name, file_size, md5_hex, offers, stream, &packing);
+        }
+        return;
+    }
+
     // Handle incoming ALLIANCE_REQUEST (PLEDGE)
     if (frame->type == FRAME_TYPE_PLEDGE) {
         write_str(STDOUT_FILENO, "\n>>> Incoming ALLIANCE REQUEST from ");
@@ -974,6 +1651,14 @@ static void maester_process_incoming_frame(Maester* maester, ConnectionEntry* en
             write_str(STDERR_FILENO, "Warning: Could not extract realm name from PLEDGE payload.\n");
             return;
         }
+        if (!is_safe_name(realm_name)) {
+            // It would name the received sigil's file: nothing is recorded,
+            // and the header is answered KO
+            write_str(STDERR_FILENO, "Warning: Rejecting PLEDGE with an unusable realm name.\n");
+            transfer_receive_begin(maester, entry, FRAME_TYPE_SIGIL_DATA, frame->origin, realm_name,
+                                   "", "", "", 0, 0, NULL);
+            return;
+        }
 
         // Extract IP and port from frame->origin (format is "IP:Port")
         char sender_ip[IP_ADDR_MAX];
@@ -1014,6 +1699,19 @@ static void maester_process_incoming_frame(Maester* maester, ConnectionEntry* en
         } else {
             write_str(STDERR_FILENO, "Warning: Could not record alliance request.\n");
         }
+
+        // Remaining fields describe the sigil that follows: accept it with ACK_FILE
+        char sigil_name[PATH_MAX_LEN];
+        char file_size[32];
+        char md5_hex[33];
+        maester_payload_field(frame, 1, sigil_name, sizeof(sigil_name));
+        maester_payload_field(frame, 2, file_size, sizeof(file_size));
+        maester_payload_field(frame, 3, md5_hex, sizeof(md5_hex));
+        uint16_t stream;
+        TransferPacking packing;
+        unsigned offers = maester_payload_offers(frame, 4, &stream, &packing);
+        transfer_receive_begin(maester, entry, FRAME_TYPE_SIGIL_DATA, frame->origin, realm_name,
+                               sigil_name, file_size, md5_hex, offers, stream, &packing);
     }
 
     // Handle DISCONNECT notification (0x27)
@@ -1090,8 +1788,13 @@ static void maester_process_incoming_frame(Maester* maester, ConnectionEntry* en
 static void maester_handle_sigint(int sig) {
     (void)sig;
     g_should_exit = 1;
-    // write() is async-signal-safe
+    // write() is async-signal-safe; the signal may land on any thread, so
+    // the CLI loop is woken through stop_fd rather than by EINTR
     write(STDOUT_FILENO, "\nReceived SIGINT. Shutting down gracefully...\n", 46);
+    if (g_stop_fd >= 0) {
+        uint64_t one = 1;
+        write(g_stop_fd, &one, sizeof(one));
+    }
 }
 
 // ========== Small tokenizer used by the CLI ==========
@@ -1171,7 +1874,11 @@ static void process_command(Maester* maester, char* input) {
                 if (!maester_mission_begin(maester, FRAME_TYPE_ORDER_HEADER, tokens[2], desc, 0)) {
                     return;
                 }
+                // The trade prompt waits on stdin; the busy mission already
+                // keeps other commands out, so let the shards carry on meanwhile
+                pthread_mutex_unlock(&maester->alliances_lock);
                 cmd_start_trade(maester, tokens[2]);
+                pthread_mutex_lock(&maester->alliances_lock);
                 maester_mission_finish(maester, "Trade mission finished.");
             } else {
                 write_str(STDOUT_FILENO, "Did you mean to start a trade? Please review syntax.\n");
@@ -1199,7 +1906,7 @@ static void process_command(Maester* maester, char* input) {
         write_str(STDOUT_FILENO, maester->realm_name);
         write_str(STDOUT_FILENO, " signs off. The ravens rest.\n");
         g_should_exit = 1;
-        maester->shutting_down = 1;
+        __atomic_store_n(&maester->shutting_down, 1, __ATOMIC_RELEASE);
         return;
     }
 
@@ -1286,180 +1993,204 @@ static void maester_accept_placeholder(Maester* maester) {
             break;
         }
 
-        // Add connection to pool
-        ConnectionEntry* entry = maester_add_connection_entry(maester);
-        if (entry == NULL) {
-            write_str(STDERR_FILENO, "\nWarning: Connection pool full, rejecting incoming connection.\n");
-            close(client_fd);
-            continue;
-        }
-
         // Set socket to non-blocking
         if (set_socket_nonblocking(client_fd) < 0) {
             write_str(STDERR_FILENO, "Warning: Failed to set non-blocking mode on accepted socket.\n");
         }
-
-        // Initialize connection entry
-        entry->sockfd = client_fd;
-        entry->addr = addr;
-        entry->last_used = time(NULL);
-
-        // Extract peer IP and port from addr structure
-        char peer_ip[IP_ADDR_MAX];
-        inet_ntop(AF_INET, &addr.sin_addr, peer_ip, sizeof(peer_ip));
-        int peer_port = ntohs(addr.sin_port);
-        my_strcpy(entry->peer_ip, peer_ip);
-        entry->peer_port = peer_port;
-        entry->peer_realm[0] = '\0';  // Unknown realm until we receive a frame
-
-        // Log the connection
-        write_str(STDOUT_FILENO, "\nAccepted connection from ");
-        write_str(STDOUT_FILENO, peer_ip);
-        write_str(STDOUT_FILENO, ":");
-        char port_buf[16];
-        int_to_str(peer_port, port_buf);
-        write_str(STDOUT_FILENO, port_buf);
-        write_str(STDOUT_FILENO, "\n");
-        // Note: Event loop will handle prompt printing
+        maester_adopt_client(maester, client_fd, &addr);
     }
 }
 
-static void maester_event_loop(Maester* maester) {
-    if (maester == NULL) return;
+static void maester_adopt_client(Maester* maester, int client_fd, const struct sockaddr_in* addr) {
+    // Index it and hand it to a network worker (round-robin)
+    if (maester_add_accepted_connection(maester, client_fd, addr) == NULL) {
+        write_str(STDERR_FILENO, "\nWarning: Connection pool full, rejecting incoming connection.\n");
+        return;
+    }
 
-    int need_prompt = 1;
-    char input[256];
+    // Extract peer IP and port from addr structure
+    char peer_ip[IP_ADDR_MAX];
+    inet_ntop(AF_INET, &addr->sin_addr, peer_ip, sizeof(peer_ip));
+    int peer_port = ntohs(addr->sin_port);
 
-    while (!g_should_exit && !maester->shutting_down) {
-        maester_mission_check_timeouts(maester);
-        maester_compact_connections(maester);
+    // Log the connection
+    write_str(STDOUT_FILENO, "\nAccepted connection from ");
+    write_str(STDOUT_FILENO, peer_ip);
+    write_str(STDOUT_FILENO, ":");
+    char port_buf[16];
+    int_to_str(peer_port, port_buf);
+    write_str(STDOUT_FILENO, port_buf);
+    write_str(STDOUT_FILENO, "\n");
+}
 
-        if (need_prompt) {
-            write_str(STDOUT_FILENO, "$ ");
-            need_prompt = 0;
-        }
+// Multishot accept hands over bare (already non-blocking) descriptors
+static void maester_adopt_ring_client(Maester* maester, int client_fd) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    if (getpeername(client_fd, (struct sockaddr*)&addr, &addrlen) < 0) {
+        write_str(STDERR_FILENO, "Warning: accept() failed on listener socket.\n");
+        close(client_fd);
+        return;
+    }
+    maester_adopt_client(maester, client_fd, &addr);
+}
 
-        int poll_capacity = 1; // stdin
-        if (maester->listen_fd >= 0) {
-            poll_capacity++;
+// Listener thread: accepts until shutdown, when stop_fd becomes readable
+static void* maester_listener_main(void* arg) {
+    Maester* maester = (Maester*)arg;
+    if (maester->tuning.io_backend == IO_BACKEND_URING &&
+        uring_run_listener(maester, maester->listen_fd, maester->stop_fd, maester_adopt_ring_client) == 0) {
+        return NULL;
+    }
+    struct pollfd fds[2];
+    fds[0].fd = maester->listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = maester->stop_fd;
+    fds[1].events = POLLIN;
+    while (!g_should_exit && !__atomic_load_n(&maester->shutting_down, __ATOMIC_ACQUIRE)) {
+        int ready = poll(fds, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            write_str(STDERR_FILENO, "Listener poll failed. No longer accepting connections.\n");
+            break;
         }
-        poll_capacity += maester->num_connections;
-        if (poll_capacity < 2) poll_capacity = 2;
-
-        struct pollfd *pollfds = (struct pollfd *)malloc(poll_capacity * sizeof(struct pollfd));
-        if (pollfds == NULL) {
-            write_str(STDERR_FILENO, "Error: Failed to allocate pollfds\n");
+        if (fds[1].revents != 0) {
             break;
         }
-        int poll_index = 0;
+        if (fds[0].revents & POLLIN) {
+            maester_accept_placeholder(maester);
+        } else if (fds[0].revents & (POLLERR | POLLHUP)) {
+            write_str(STDERR_FILENO, "Listener socket reported an error.\n");
+        }
+    }
+    return NULL;
+}
 
-        pollfds[poll_index].fd = STDIN_FILENO;
-        pollfds[poll_index].events = POLLIN;
-        pollfds[poll_index].revents = 0;
-        poll_index++;
+static int maester_start_listener_thread(Maester* maester) {
+    if (maester->listen_fd < 0 || maester->stop_fd < 0) return -1;
+    if (pthread_create(&maester->listener_thread, NULL, maester_listener_main, maester) != 0) {
+        return -1;
+    }
+    maester->listener_running = 1;
+    return 0;
+}
 
-        int listen_index = -1;
-        if (maester->listen_fd >= 0) {
-            listen_index = poll_index;
-            pollfds[poll_index].fd = maester->listen_fd;
-            pollfds[poll_index].events = POLLIN;
-            pollfds[poll_index].revents = 0;
-            poll_index++;
-        }
+// Join the listener first so no new socket is handed to a stopping shard
+static void maester_stop_threads(Maester* maester) {
+    __atomic_store_n(&maester->shutting_down, 1, __ATOMIC_RELEASE);
+    if (maester->stop_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(maester->stop_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    if (maester->listener_running) {
+        pthread_join(maester->listener_thread, NULL);
+        maester->listener_running = 0;
+    }
+    shards_stop(maester);
+}
 
-        int conn_slots = (maester->num_connections > 0) ? maester->num_connections : 1;
-        ConnectionEntry** conn_map = (ConnectionEntry**)malloc(conn_slots * sizeof(ConnectionEntry*));
-        if (conn_map == NULL) {
-            free(pollfds);
-            write_str(STDERR_FILENO, "Error: Failed to allocate conn_map\n");
+static void maester_read_stdin(Maester* maester) {
+    char input[256];
+    int bytes_read = read(STDIN_FILENO, input, sizeof(input) - 1);
+    if (bytes_read <= 0) {
+        if (bytes_read == 0) {
+            write_str(STDOUT_FILENO, "\nStandard input closed. Exiting...\n");
+            g_should_exit = 1;
+        } else if (errno != EINTR) {
+            write_str(STDERR_FILENO, "Error reading from stdin. Exiting...\n");
+            g_should_exit = 1;
+        }
+        return;
+    }
+    input[bytes_read] = '\0';
+    for (int i = 0; i < bytes_read; i++) {
+        if (input[i] == '\n' || input[i] == '\r') {
+            input[i] = '\0';
             break;
         }
-        int conn_start = poll_index;
-        int conn_count = 0;
-        for (int i = 0; i < maester->num_connections; i++) {
-            if (maester->connections[i].sockfd < 0) {
-                continue;
-            }
-            pollfds[poll_index].fd = maester->connections[i].sockfd;
-            pollfds[poll_index].events = POLLIN;
-            if (maester_connection_has_pending_send(&maester->connections[i])) {
-                pollfds[poll_index].events |= POLLOUT;
-            }
-            pollfds[poll_index].revents = 0;
-            conn_map[conn_count++] = &maester->connections[i];
-            poll_index++;
+    }
+    if (my_strlen(input) > 0) {
+        pthread_mutex_lock(&maester->alliances_lock);
+        process_command(maester, input);
+        pthread_mutex_unlock(&maester->alliances_lock);
+    }
+}
+
+/**
+ * CLI thread loop. Sockets are served by the shard threads and new
+ * connections by the listener thread, so this only waits on stdin, the stop
+ * signal and mission deadlines, and a slow command never stalls forwarding.
+ */
+static void maester_event_loop(Maester* maester) {
+    if (maester == NULL) return;
+
+    if (reactor_init(&maester->reactor) != 0) {
+        write_str(STDERR_FILENO, "Error: Unable to create the event reactor.\n");
+        return;
+    }
+
+    // Regular files cannot be watched by epoll (EPERM) but are always readable.
+    int stdin_always_ready = 0;
+    if (reactor_add(&maester->reactor, STDIN_FILENO, REACTOR_READABLE, REACTOR_TAG_STDIN) != 0) {
+        if (errno != EPERM) {
+            write_str(STDERR_FILENO, "Error: Unable to watch standard input.\n");
+            return;
         }
+        stdin_always_ready = 1;
+    }
+    if (maester->stop_fd >= 0 &&
+        reactor_add(&maester->reactor, maester->stop_fd, REACTOR_READABLE, REACTOR_TAG_WAKE) != 0) {
+        write_str(STDERR_FILENO, "Error: Unable to watch the shutdown signal.\n");
+        return;
+    }
 
-        int nfds = poll_index;
+    int need_prompt = 1;
+    ReactorEvent events[REACTOR_MAX_EVENTS];
 
-        int poll_result = poll(pollfds, nfds, 500);
-        if (poll_result < 0) {
-            if (errno == EINTR) {
-                free(pollfds);
-                free(conn_map);
-                continue;
-            }
-            write_str(STDERR_FILENO, "Poll failed. Leaving event loop.\n");
-            free(pollfds);
-            free(conn_map);
-            break;
+    while (!g_should_exit && !__atomic_load_n(&maester->shutting_down, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&maester->alliances_lock);
+        maester_mission_check_timeouts(maester);
+        int transfer_ms = transfer_expire(maester);
+        // Sleep until something is ready, the mission deadline expires or
+        // file transfers need another look
+        int timeout_ms = stdin_always_ready ? 0 : maester_mission_next_timeout_ms(maester);
+        if (transfer_ms >= 0 && (timeout_ms < 0 || transfer_ms < timeout_ms)) {
+            timeout_ms = transfer_ms;
         }
-        if (poll_result == 0) {
-            free(pollfds);
-            free(conn_map);
-            continue;
+        pthread_mutex_unlock(&maester->alliances_lock);
+
+        if (need_prompt) {
+            write_str(STDOUT_FILENO, "$ ");
+            need_prompt = 0;
         }
 
-        if (pollfds[0].revents & (POLLIN | POLLPRI)) {
-            int bytes_read = read(STDIN_FILENO, input, sizeof(input) - 1);
-            if (bytes_read <= 0) {
-                if (bytes_read == 0) {
-                    write_str(STDOUT_FILENO, "\nStandard input closed. Exiting...\n");
-                } else if (errno != EINTR) {
-                    write_str(STDERR_FILENO, "Error reading from stdin. Exiting...\n");
-                }
-                g_should_exit = 1;
-            } else {
-                input[bytes_read] = '\0';
-                for (int i = 0; i < bytes_read; i++) {
-                    if (input[i] == '\n' || input[i] == '\r') {
-                        input[i] = '\0';
-                        break;
-                    }
-                }
-                if (my_strlen(input) > 0) {
-                    process_command(maester, input);
-                }
-            }
-            need_prompt = 1;
-        } else if (pollfds[0].revents & (POLLHUP | POLLERR)) {
-            g_should_exit = 1;
+        int ready = reactor_wait(&maester->reactor, events, REACTOR_MAX_EVENTS, timeout_ms);
+        if (ready < 0) {
+            write_str(STDERR_FILENO, "Reactor wait failed. Leaving event loop.\n");
+            break;
         }
 
-        if (listen_index != -1 && listen_index < nfds) {
-            if (pollfds[listen_index].revents & POLLIN) {
-                maester_accept_placeholder(maester);
-                need_prompt = 1;
-            } else if (pollfds[listen_index].revents & (POLLHUP | POLLERR)) {
-                write_str(STDERR_FILENO, "Listener socket reported an error.\n");
-            }
+        if (stdin_always_ready) {
+            maester_read_stdin(maester);
+            need_prompt = 1;
         }
 
-        for (int i = 0; i < conn_count; i++) {
-            ConnectionEntry* entry = conn_map[i];
-            short revents = pollfds[conn_start + i].revents;
-            if (revents != 0 && entry != NULL) {
-                maester_handle_connection_event(maester, entry, revents);
+        for (int i = 0; i < ready && !g_should_exit; i++) {
+            if (events[i].tag == REACTOR_TAG_STDIN) {
+                if (events[i].events & REACTOR_READABLE) {
+                    maester_read_stdin(maester);
+                    need_prompt = 1;
+                } else if (events[i].events & (REACTOR_HANGUP | REACTOR_ERROR)) {
+                    g_should_exit = 1;
+                }
+            } else if (events[i].tag == REACTOR_TAG_WAKE) {
+                g_should_exit = 1;
             }
         }
-
-        maester_compact_connections(maester);
-
-        free(pollfds);
-        free(conn_map);
     }
 
-    maester->shutting_down = 1;
+    __atomic_store_n(&maester->shutting_down, 1, __ATOMIC_RELEASE);
 }
 
 // ============================================================================
@@ -1638,8 +2369,17 @@ int maester_run(const char* config_file, const char* stock_file) {
         die("Unable to initialize networking listener.\n");
     }
 
+    g_stop_fd = maester->stop_fd;
+    if (shards_start(maester) != 0 || maester_start_listener_thread(maester) != 0) {
+        free_maester(maester);
+        die("Unable to start the network threads.\n");
+    }
+
     maester_event_loop(maester);
 
+    // Back to a single thread: connections are driven directly from here on
+    maester_stop_threads(maester);
+
     // Gracefully notify all peers before closing connections
     maester_broadcast_disconnect(maester);
     maester_close_all_connections(maester);
@@ -1655,6 +2395,7 @@ int maester_run(const char* config_file, const char* stock_file) {
         }
     }
 
+    g_stop_fd = -1;
     free_maester(maester);
     write_str(STDOUT_FILENO, "Maester process terminated. Farewell.\n");
     return 0;
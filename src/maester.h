@@ -12,12 +12,19 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <sys/socket.h>
-#include <sys/stat.h>   // Needed for mkdir() only (stat() function is forbidden and not used)
+#include <sys/stat.h>   // mkdir(); fstat() only for the digest cache (stat() itself is forbidden and not used)
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 
 #include "stock.h"
 #include "helper.h"
+#include "md5.h"
+#include "digests.h"
+#include "sigils.h"
+#include "sinks.h"
+#include "pack.h"
+#include "reactor.h"
 
 // Global variable declared in main.c (signal handling)
 extern volatile sig_atomic_t g_should_exit;
@@ -33,7 +40,22 @@ extern volatile sig_atomic_t g_should_exit;
 #define FRAME_HEADER_LEN      (1 + FRAME_ORIGIN_LEN + FRAME_DEST_LEN + 2)
 #define FRAME_CHECKSUM_LEN    2
 #define FRAME_MAX_SIZE        320  // Fixed size per protocol specification
-#define FRAME_BUFFER_CAPACITY (FRAME_MAX_SIZE * 4)
+#define FRAME_BATCH_MAX       64   // Frames validated per frame_validate_batch() call
+#define FRAME_BUFFER_CAPACITY 2048  // Smallest ring: power of two, holds at least four frames
+#define NACK_FRAME_FIELD      "&FRAME="  // NACK payload: index of the damaged frame on the link
+
+// LINK_OPTIONS payload: "<verb>&<sender's end>&<receiver's end>&<option>".
+// Once a side has sent SWITCH, its frames on that socket are compact: the
+// header, the data and the checksum, without the padding.
+#define LINK_OPTIONS_OFFER    "OFFER"
+#define LINK_OPTIONS_SWITCH   "SWITCH"
+#define LINK_OPTION_COMPACT   "COMPACT"
+#define LINK_ADDRESS_MAX      (IP_ADDR_MAX + 8)   // "ip:port"
+
+#define RECV_BLOCK_SIZE        65536         // Pooled receive ring block (power of two)
+#define RECV_POOL_KEEP         32            // Idle blocks kept for reuse
+#define RECV_BUFFER_DEFAULT_KB 1024          // Max ring growth per connection
+#define RECV_BATCH_BUDGET      (256 * 1024)  // Bytes drained per wakeup before yielding
 
 typedef enum {
     ALLIANCE_UNKNOWN = 0,
@@ -59,6 +81,7 @@ typedef enum {
 
 typedef enum {
     FRAME_TYPE_PLEDGE            = 0x01,
+    FRAME_TYPE_SIGIL_DATA        = 0x02,
     FRAME_TYPE_PLEDGE_RESPONSE   = 0x03,
     FRAME_TYPE_LIST_REQUEST      = 0x11,
     FRAME_TYPE_LIST_RESPONSE     = 0x12,
@@ -70,15 +93,31 @@ typedef enum {
     FRAME_TYPE_ERROR_UNAUTHORIZED= 0x25,
     FRAME_TYPE_ACK_FILE          = 0x31,
     FRAME_TYPE_ACK_MD5           = 0x32,
+    FRAME_TYPE_ACK_DATA          = 0x33,   // Windowed transfers only (negotiated in the header)
+    FRAME_TYPE_TRANSFER_RESUME   = 0x34,   // Re-sent file header after a lost next hop (negotiated)
+    FRAME_TYPE_LINK_OPTIONS      = 0x35,   // Between neighbours only: compact frame offer and switch
     FRAME_TYPE_NACK              = 0x69
 } FrameType;
 
+typedef uint64_t ConnHandle;
+
 typedef struct {
-    char realm[REALM_NAME_MAX];
-    char ip[IP_ADDR_MAX];
-    int  port;
+    char       realm[REALM_NAME_MAX];
+    char       ip[IP_ADDR_MAX];
+    int        port;
+    int        known;       // Usable next hop (not "*.*.*.*", port > 0); set when compiled
+    ConnHandle next_hop;    // Cached connection to ip:port, re-validated on every use
 } Route;
 
+// Case-insensitive hash of realm -> route, rebuilt lazily after add_route().
+// Buckets hold route index + 1 (0 = empty).
+typedef struct {
+    int*   buckets;
+    size_t capacity;
+    int    default_route;   // Index of a usable DEFAULT route, -1 if none
+    int    dirty;
+} RouteIndex;
+
 typedef struct {
     FrameType  type;
     char       origin[FRAME_ORIGIN_LEN + 1];
@@ -104,14 +143,40 @@ typedef struct {
     time_t             started_at;
 } EnvoyMission;
 
+typedef enum {
+    QUEUED_SEND = 0,    // Queue `bytes` on the connection named by `handle`
+    QUEUED_ADOPT,       // Start watching a connection created on another thread
+    QUEUED_CLOSE,       // Close the connection
+    QUEUED_TRANSFER,    // Resume the outgoing file transfers sent through the connection
+    QUEUED_RESUME       // Read on from the connection if the next hop it holds for has room again
+} QueuedFrameKind;
+
+// One cross-thread request for the shard that owns `handle`
 typedef struct {
-    CitadelFrame   *buffer;
-    size_t          capacity;
-    size_t          count;
-    size_t          head;
+    QueuedFrameKind kind;
+    ConnHandle      handle;
+    uint16_t        length;
+    uint8_t         bytes[FRAME_MAX_SIZE];
+} QueuedFrame;
+
+typedef struct {
+    size_t      sequence;   // == position when free, position + 1 once filled
+    QueuedFrame frame;
+} FrameQueueSlot;
+
+// Bounded lock-free multi-producer / single-consumer ring (Vyukov style): a
+// producer claims a position by CAS on `tail` and publishes it through the
+// slot's sequence; the consumer owns `head`. wake_fd (an eventfd watched by
+// the consumer's reactor) is only written when the consumer has announced it
+// is about to sleep.
+typedef struct {
+    FrameQueueSlot* slots;
+    size_t          capacity;   // Power of two
+    size_t          head;       // Consumer only
+    int             sleeping;   // Consumer is (about to be) blocked in reactor_wait()
+    int             wake_fd;
+    char            pad[64];    // Keep the producers' tail off the consumer's cache line
     size_t          tail;
-    pthread_mutex_t lock;
-    pthread_cond_t  cond;
 } FrameQueue;
 
 typedef enum {
@@ -126,26 +191,414 @@ typedef struct {
     FrameType type;
     char      target_realm[REALM_NAME_MAX];
     char      description[64];
+    char      next_hop[REALM_NAME_MAX];   // Realm the mission's frames leave through
     time_t    started_at;
     time_t    deadline;
+    int       timeout_s;                  // Restarted while its transfer waits to resume
 } MissionState;
 
 typedef struct {
-    uint8_t data[FRAME_BUFFER_CAPACITY];
-    size_t  length;
+    uint8_t* blocks[RECV_POOL_KEEP];
+    int      count;
+} RecvBufferPool;
+
+// Growable ring buffer: head/tail run freely and are masked on access, so
+// consuming a frame is an index bump instead of a memmove of everything behind
+// it. Storage starts as a pooled block and doubles (up to max_capacity) when a
+// burst arrives faster than it is parsed.
+typedef struct {
+    uint8_t*        data;
+    size_t          capacity;       // Power of two, 0 until first use
+    size_t          max_capacity;
+    size_t          head;
+    size_t          tail;
+    RecvBufferPool* pool;
 } FrameBuffer;
 
+// Read-only window over one complete 320-byte frame. `bytes` points straight
+// into the ring unless the frame wraps around the end, in which case it is
+// linearized into `scratch` (the only copy made before a handler decides it
+// needs a CitadelFrame).
+typedef struct {
+    const uint8_t* bytes;
+    uint8_t        scratch[FRAME_MAX_SIZE];
+} FrameView;
+
+#define SEND_SLOT_SIZE           FRAME_MAX_SIZE
+#define SEND_QUEUE_IOV_MAX       64     // Slots handed to a single writev()
+#define SEND_QUEUE_DEFAULT_KB    256    // Per-connection backlog limit
+#define SEND_POOL_DEFAULT_KB     8192   // Limit across all connections
+#define SEND_POOL_KEEP_FREE      256    // Drained slots kept cached for reuse
+#define RESEND_FRAMES_DEFAULT    64     // Frames per connection kept for NACK-driven resends (about one BDP)
+#define FORWARD_HIGH_DEFAULT_KB  128    // Next-hop backlog that stops reading the connections feeding it
+#define FORWARD_RECHECK_MS       20     // Held connections look at their next hop again this often
+#define FORWARD_WAKE_BATCH       64     // Held connections woken per drained queue; the rest wait for the recheck
+
+#define CONNECT_TIMEOUT_DEFAULT_S 5     // Give up on a next hop that has not answered
+
+// One pooled 320-byte chunk of outgoing bytes; queues chain them together
+typedef struct SendSlot {
+    struct SendSlot* next;
+    uint16_t         length;   // Bytes stored in data
+    uint16_t         offset;   // Bytes of data already written to the socket
+    uint8_t          data[SEND_SLOT_SIZE];
+} SendSlot;
+
+typedef struct {
+    SendSlot* free_list;
+    size_t    free_count;
+    size_t    allocated;   // Slots owned by the pool (queued + cached)
+    size_t    max_slots;
+} SendSlotPool;
+
+// NACK-driven repair between neighbours, summed over every connection
+typedef struct {
+    unsigned long long nacks_sent;      // Damaged frames reported to the peer that wrote them
+    unsigned long long frames_resent;   // Frames written again from a resend ring
+    unsigned long long resends_missed;  // NACKs for frames already gone from the ring
+    unsigned long long corrupted;       // Frames damaged on purpose (CITADEL_CORRUPT_PPM)
+} LinkRepairStats;
+
+// Links switched to compact frames, summed over every connection
+typedef struct {
+    unsigned long long sending;     // We announced the switch to the neighbour
+    unsigned long long receiving;   // The neighbour announced it to us
+} CompactLinkStats;
+
+typedef struct {
+    SendSlot*     head;
+    SendSlot*     tail;
+    size_t        slots;
+    size_t        bytes;       // Unsent bytes across all slots (read atomically by other shards)
+    size_t        max_slots;
+    SendSlotPool* pool;
+    uint8_t*      kept;          // Ring of the last keep_frames frames queued (allocated on first use)
+    size_t        keep_frames;   // 0: no resends on this connection
+    uint64_t      frames_queued; // Frames queued since the connection opened: the next one's index
+    uint32_t      corrupt_ppm;   // Test mode: frames per million written damaged
+    uint32_t      corrupt_state; // xorshift32 state for picking them
+    LinkRepairStats* repair;
+} SendQueue;
+
+// Transit backpressure, summed over every connection
+typedef struct {
+    unsigned long long holds;       // Times a connection stopped being read for a full next hop
+    unsigned long long dropped;     // Transit frames that could not be forwarded
+} ForwardStats;
+
+// Runtime knobs read from CITADEL_* environment variables at startup
+typedef struct {
+    int send_queue_kb;
+    int send_pool_kb;
+    int recv_buffer_kb;
+    int connect_timeout_s;
+    int checksum_algorithm;     // ChecksumAlgorithm (checksum.h)
+    int md5_backend;            // Md5Backend (md5.h)
+    int digest_cache;           // Reuse sigil digests of unchanged files (digests.h)
+    int sigil_store;            // Keep received sigils by MD5 and answer repeats from it (sigils.h)
+    int workers;                // Network shards (threads)
+    int io_backend;             // IoBackend
+    int transfer_window;        // Max data frames of a file transfer in flight
+    int transfer_stripes;       // Connections to the next hop a large windowed transfer spreads over
+    int transfer_pack;          // Pack file payloads: 0 never, 1 plain, 2 also against the stock dictionary
+    int resend_frames;          // Frames per connection kept for NACK-driven resends (0: off)
+    int corrupt_ppm;            // Test mode: frames per million damaged on their way out
+    int compact_frames;         // Offer and accept compact frames on links between our own kind
+    int forward_high_kb;        // Next-hop backlog at which the connections forwarding into it stop being read (0: drop)
+} MaesterTuning;
+
+// Socket I/O backend of the network shards (CITADEL_IO_BACKEND)
+typedef enum {
+    IO_BACKEND_EPOLL = 0,       // Readiness: epoll + read/writev
+    IO_BACKEND_URING            // Completion: io_uring, falls back to epoll when unsupported
+} IoBackend;
+
+typedef enum {
+    CONNECTION_CONNECTED = 0,
+    CONNECTION_CONNECTING       // Non-blocking connect() in flight; sends are queued
+} ConnectionState;
+
+struct ConnectionTable;
+struct Shard;
+struct Uring;
+
 typedef struct {
     int                sockfd;
+    ConnectionState    state;
+    time_t             connect_deadline;
     char               peer_realm[REALM_NAME_MAX];
     char               peer_ip[IP_ADDR_MAX];
     int                peer_port;
     struct sockaddr_in addr;
     time_t             last_used;
     FrameBuffer        recv_buffer;
-    FrameBuffer        send_buffer;
+    SendQueue          send_queue;
+    struct Shard*      shard;           // Owning network thread; only it touches the socket and queues
+    Reactor*           reactor;         // Reactor the socket is registered with (NULL if none)
+    uint64_t           reactor_tag;
+    uint32_t           reactor_events;  // Interest mask currently installed in the reactor
+    struct Uring*      uring;           // io_uring the socket is driven by instead (NULL with epoll)
+    uint16_t           uring_sends;     // SENDMSG requests in flight (one linked chain)
+    uint8_t            uring_recv;      // Multishot receive armed
+    uint8_t            uring_poll;      // Connect-completion poll armed
+    uint8_t            uring_flush;     // On the ring's list of send queues to submit
+    uint8_t            transfer_out;    // Outgoing file transfers refill its send queue as it drains
+    uint8_t            stripe;          // Extra connection of a striped transfer: not indexed, fails quietly
+    uint8_t            frames_unsynced; // A malformed frame was dropped: NACKs can no longer name frames
+    uint8_t            compact_send;    // We announced the switch: our frames go out compact
+    uint8_t            compact_recv;    // The peer announced it: its frames arrive compact
+    uint64_t           frames_received; // Frames taken off the socket, damaged ones included
+    uint8_t            held;            // Not read: the frame at the head of the ring waits for room on `held_on`
+    uint8_t            uring_recv_stop; // Cancel of the multishot receive submitted while held
+    uint8_t            waiters;         // Some connection holds for this one's queue to drain (atomic)
+    ConnHandle         held_on;         // Next hop the connection holds for, 0 when reading (atomic)
+    size_t             posted;          // Bytes other threads handed to the shard for this queue (atomic)
+    struct ConnectionTable* table;      // Owning table while the slot is in use, NULL when free
+    int                slot;
+    uint32_t           generation;      // Bumped on release so stale handles stop resolving
+    int                next_free;
+    int                realm_indexed;
+    int                endpoint_indexed;
 } ConnectionEntry;
 
+// ConnHandle (declared with Route) is a generation-tagged reference to a
+// connection slot: (generation << 32) | slot. 0 never names a live connection.
+
+#define CONN_SLAB_CHUNK      64   // Slots per slab chunk; chunks never move once allocated
+#define CONN_SLAB_MAX_CHUNKS 1024 // Fixed chunk directory, so lookups never race a realloc
+#define CONN_INDEX_INITIAL   64   // Buckets per hash index (power of two)
+
+// Open-addressing index from a key (realm or ip:port) to a slot.
+// Buckets hold slot + 1; 0 is empty and -1 a tombstone.
+typedef struct {
+    int*   buckets;
+    size_t capacity;
+    size_t used;        // Live keys plus tombstones
+} ConnIndex;
+
+// Shared by every shard: acquire, release and the indexes need connections_lock;
+// connection_table_lookup() and connection_table_at() do not.
+typedef struct ConnectionTable {
+    ConnectionEntry*  chunks[CONN_SLAB_MAX_CHUNKS];
+    int               num_chunks;
+    int               high_water;   // Slots ever handed out; iteration bound
+    int               free_head;    // -1 when every handed-out slot is in use
+    int               live;
+    ConnIndex         by_realm;
+    ConnIndex         by_endpoint;
+    pthread_mutex_t*  lock;         // Maester::connections_lock
+} ConnectionTable;
+
+#define SHARD_MAX            64
+#define SHARD_AUTO_MAX       8     // Cap for the one-per-CPU default
+#define SHARD_QUEUE_CAPACITY 1024  // Cross-thread requests queued per shard
+
+#define TRANSFER_MAX             8     // Concurrent file transfers per direction
+#define TRANSFER_WINDOW_DEFAULT  256   // Max data frames in flight per transfer (CITADEL_TRANSFER_WINDOW)
+#define TRANSFER_WINDOW_MIN      16    // Floor of the adaptive window; keeps acknowledgements flowing
+#define TRANSFER_WINDOW_LIMIT    4096  // Ceiling of the tunable; size of the send-time ring
+#define TRANSFER_IDLE_TIMEOUT_S  60    // A transfer that makes no progress for this long is dropped
+
+// Windowed data frames start with a big-endian frame sequence number
+#define TRANSFER_SEQ_LEN         4
+#define TRANSFER_CHUNK           (FRAME_MAX_DATA - TRANSFER_SEQ_LEN)
+#define TRANSFER_ACK_EVERY       8     // In-order frames per ACK_DATA from the receiver
+#define TRANSFER_SACK_MAX        16    // Selective ack blocks per ACK_DATA
+
+// Stream-tagged transfers (TRANSFER_OFFER_STREAM) put the sender's 16-bit
+// stream ID in front of the sequence number of every data frame and ACK_DATA,
+// so several files between the same two realms can interleave on one
+// connection; stream 0 means untagged frames
+#define TRANSFER_STREAM_LEN      2
+#define TRANSFER_STREAM_CHUNK    (FRAME_MAX_DATA - TRANSFER_STREAM_LEN - TRANSFER_SEQ_LEN)
+
+#define TRANSFER_RTO_INITIAL_US  1000000
+#define TRANSFER_RTO_MIN_US      20000
+#define TRANSFER_RTO_MAX_US      8000000
+
+// Options a file header offers after its MD5 field ("&SACK&DEDUP"); a
+// receiver uses the ones it knows and ignores the rest
+#define TRANSFER_OFFER_SACK      0x01  // Windowed transfer with ACK_DATA
+#define TRANSFER_OFFER_DEDUP     0x02  // An ACK_MD5 may answer the header directly
+#define TRANSFER_OFFER_RESUME    0x04  // ACK_FILE "OK&SACK&AT=<bytes>" resumes a partial file
+#define TRANSFER_OFFER_STRIPE    0x08  // Data frames arrive over several connections, in any order
+#define TRANSFER_OFFER_STREAM    0x10  // "STREAM=<id>": frames and answers are tagged with the stream ID
+#define TRANSFER_OFFER_PACK      0x20  // "PACK=<bytes>": the file can come packed (pack.h), in that many bytes
+#define TRANSFER_OFFER_DICT      0x40  // "DICT=<id>:<bytes>": ...or packed against the stock dictionary <id>
+
+// Packed windowed transfers: the data frames carry a packed image of the file
+// instead of the file, when the receiver picked one of the packings the
+// header offered by naming it ("&PACK" or "&DICT") in its ACK_FILE. Images
+// are made up front, so only files up to TRANSFER_PACK_MAX_BYTES are packed,
+// and only kept when at least 1/TRANSFER_PACK_SAVING smaller.
+#define TRANSFER_PACK_NONE        0
+#define TRANSFER_PACK_PLAIN       1
+#define TRANSFER_PACK_DICT        2    // Against the realm's product names (CITADEL_TRANSFER_PACK=2)
+#define TRANSFER_PACKINGS         3
+#define TRANSFER_PACK_MIN_BYTES   (TRANSFER_CHUNK + 1)    // One frame's worth cannot take fewer
+#define TRANSFER_PACK_MAX_BYTES   (64 * 1024 * 1024)
+#define TRANSFER_PACK_SAVING      8
+
+// Packings a file header offers (TRANSFER_OFFER_PACK, TRANSFER_OFFER_DICT)
+typedef struct {
+    size_t plain;                               // Packed size without a dictionary
+    size_t dict;                                // Packed size against dictionary `dict_id`
+    char   dict_id[PACK_DICT_ID_LEN + 1];
+} TransferPacking;
+
+// Striped transfers: windowed files of at least TRANSFER_STRIPE_MIN_BYTES go
+// out over CITADEL_TRANSFER_STRIPES connections to the next hop
+#define TRANSFER_STRIPE_MAX       8
+#define TRANSFER_STRIPE_MIN_BYTES (1024 * 1024)
+
+// Windowed receivers record their in-order progress this often, so a
+// transfer cut short can resume from <path>.part and <path>.resume
+#define TRANSFER_CHECKPOINT_FRAMES 4096
+#define TRANSFER_RETRY_MAX_S       8     // Longest pause between attempts to reach a lost next hop
+
+typedef enum {
+    TRANSFER_IDLE = 0,
+    TRANSFER_AWAIT_ACK_FILE,    // Header sent; waiting for the receiver to accept the file
+    TRANSFER_STREAMING,         // Data frames going out (windowed: until all are acknowledged)
+    TRANSFER_AWAIT_ACK_MD5,     // Every frame delivered; waiting for the receiver's MD5 verdict
+    TRANSFER_RECONNECT          // Next hop lost mid-transfer; the header is re-sent once a route is back
+} TransferState;
+
+// Per-frame flags of a windowed outgoing transfer
+#define TRANSFER_FRAME_SACKED   0x01   // Selectively acknowledged
+#define TRANSFER_FRAME_LOST     0x02   // Queued for retransmission
+#define TRANSFER_FRAME_RESENT   0x04   // Retransmitted; gives no RTT sample
+
+// File being sent: frames are built straight out of a read-only mapping of it,
+// so the page cache is the only copy of the file in memory. A windowed
+// transfer (receiver answered ACK_FILE "OK&SACK") numbers its frames, keeps at
+// most `cwnd` unacknowledged and retransmits what ACK_DATA or the timer
+// reports missing; otherwise frames are streamed once, in order. A striped
+// transfer shares its window across several connections to the next hop, each
+// keeping its own order for loss detection. Transfers to the same realm are
+// told apart by their stream ID once the receiver tagged its ACK_FILE with it.
+typedef struct {
+    TransferState  state;
+    FrameType      data_type;                   // Data frame type (0x02 for a sigil)
+    char           realm[REALM_NAME_MAX];       // Receiver
+    uint16_t       stream;                      // Offered with the header; unique among our transfers
+    int            streamed;                    // The receiver tags its answers with `stream`
+    size_t         chunk;                       // Windowed: file bytes per data frame
+    char           origin[FRAME_ORIGIN_LEN + 1];
+    char           name[PATH_MAX_LEN];          // Base name, for messages
+    char           md5[33];                     // Identifies the transfer when it resumes
+    ConnHandle     next_hop;                    // Connection the data frames leave through
+    const uint8_t* map;
+    size_t         size;
+    const uint8_t* payload;                     // What windowed data frames carry: `map` or a packed image
+    size_t         payload_size;
+    int            packing;                     // TRANSFER_PACK_*: image the receiver picked
+    uint8_t*       packed[TRANSFER_PACKINGS];   // Images offered with the header, by packing
+    size_t         packed_size[TRANSFER_PACKINGS];
+    char           dict_id[PACK_DICT_ID_LEN + 1];   // Dictionary of packed[TRANSFER_PACK_DICT]
+    size_t         offset;                      // Plain stream: bytes already framed and queued
+    time_t         last_progress;
+    int            windowed;
+    int            resumable;                   // Receiver answered with a resume offset
+    time_t         retry_at;                    // TRANSFER_RECONNECT: next attempt
+    int            retry_delay_s;               // ...doubling after each failed one
+    uint32_t       frames;                      // Windowed: total data frames
+    uint32_t       next_seq;                    // First frame never sent
+    uint32_t       acked;                       // Cumulative: every frame below is acknowledged
+    uint32_t       in_flight;                   // Sent and neither acknowledged nor marked lost
+    uint32_t       lost;                        // Frames flagged TRANSFER_FRAME_LOST
+    uint32_t       lost_cursor;                 // Scan position for the next retransmission
+    uint64_t       delivered_us[TRANSFER_STRIPE_MAX];  // Per stripe: send time of the latest-sent frame
+    uint32_t       delivered_seq[TRANSFER_STRIPE_MAX]; // known delivered, and that frame
+    uint32_t       recovery_end;                // No further window cut until acked passes this
+    uint8_t*       frame_flags;                 // One byte per frame
+    uint64_t*      sent_us;                     // Send time, indexed by seq % TRANSFER_WINDOW_LIMIT
+    uint8_t*       sent_on;                     // Stripe it left through, indexed likewise
+    int            num_stripes;                 // Connections carrying data frames (1: next_hop only)
+    ConnHandle     stripes[TRANSFER_STRIPE_MAX];    // Stripe i > 0; 0 once closed (stripe 0 is next_hop)
+    uint32_t       stripe_in_flight[TRANSFER_STRIPE_MAX];
+    uint32_t       cwnd;                        // Frames allowed in flight
+    uint32_t       cwnd_max;
+    int            slow_start;
+    uint32_t       round_end;                   // Window adapts once acked passes this frame
+    uint64_t       round_rtt_us;                // Smallest RTT sample of the current round
+    uint64_t       rtt_min_us;
+    uint64_t       srtt_us;
+    uint64_t       rttvar_us;
+    uint64_t       rto_us;
+    uint64_t       timer_us;                    // Retransmission deadline, 0 when idle
+} OutgoingTransfer;
+
+// A file mapped, hashed and packed for sending, not yet registered as a
+// transfer; transfer_send_begin() takes it over
+typedef struct {
+    const uint8_t* map;
+    size_t         size;
+    char           md5[33];
+    uint8_t*       packed[TRANSFER_PACKINGS];
+    size_t         packed_size[TRANSFER_PACKINGS];
+    char           dict_id[PACK_DICT_ID_LEN + 1];
+} TransferSource;
+
+// File being received: data frames are matched to it by their origin field and,
+// when tagged, their stream ID
+typedef struct {
+    int       in_use;
+    FrameType data_type;
+    char      origin[FRAME_ORIGIN_LEN + 1];     // Sender's IP:Port, as in its frames
+    char      realm[REALM_NAME_MAX];            // Sender; the ACKs are routed to it
+    char      path[PATH_MAX_LEN];               // Final name; data goes to path + ".part"
+    char      md5[33];
+    uint16_t  stream;                           // Sender's stream ID; 0 for untagged frames
+    size_t    chunk;                            // File bytes per windowed data frame
+    FileSink  sink;                             // The .part file and the digest over its in-order prefix
+    size_t    size;                             // Bytes the data frames carry
+    int       packing;                          // TRANSFER_PACK_*: they carry a packed image of the file
+    size_t    unpacked_size;                    // Packed: size of the file itself
+    PackDictionary dict;                        // TRANSFER_PACK_DICT: our dictionary, to unpack with
+    size_t    received;
+    time_t    last_progress;
+    int       windowed;
+    uint32_t  frames;
+    uint32_t  next_expected;                    // Cumulative: every frame below is on disk
+    uint32_t  last_seq;                         // Previous frame taken (spots new holes)
+    uint32_t  highest;                          // One past the highest frame taken
+    uint32_t  since_ack;                        // Frames taken since the last ACK_DATA
+    int       resumable;                        // Sender resumes: keep the partial file and its record
+    int       striped;                          // Frames arrive in any order: hashed once complete
+    uint32_t  checkpoint;                       // next_expected when the .resume record was written
+    uint8_t*  have;                             // One byte per frame
+} IncomingTransfer;
+
+typedef struct {
+    OutgoingTransfer outgoing[TRANSFER_MAX];
+    IncomingTransfer incoming[TRANSFER_MAX];
+    ConnectionTable* connections;               // Stripes are closed with their transfer
+    uint16_t         last_stream;               // Stream ID handed out last
+} TransferTable;
+
+struct Maester;
+
+// One network worker: its own epoll instance (or io_uring), buffer pools and
+// the sockets assigned to it. Other threads never touch those sockets; they
+// hand frames over through `outbound` instead.
+typedef struct Shard {
+    struct Maester* maester;
+    int             id;
+    pthread_t       thread;
+    int             running;           // Read by other threads: accessed with __atomic builtins
+    int             stop;              // Likewise; set by shards_stop()
+    Reactor         reactor;
+    struct Uring*   uring;             // Set when this shard runs the io_uring backend
+    FrameQueue      outbound;
+    SendSlotPool    send_pool;
+    RecvBufferPool  recv_pool;
+    int             connects_pending;  // An owned connect() may be in flight: check deadlines
+    int             transfers_pending; // A windowed transfer through an owned connection awaits acks
+    int             holds_pending;     // An owned connection holds for a next hop: look at it again
+    uint64_t        holds_check_us;    // ...no earlier than this
+} Shard;
+
 typedef struct Maester {
     char realm_name[REALM_NAME_MAX];
     char folder_path[PATH_MAX_LEN];
@@ -155,23 +608,37 @@ typedef struct Maester {
     int  socket_fd;
     Route*   routes;
     int      num_routes;
+    RouteIndex route_index;
     Product* stock;
     int      num_products;
     char     stock_file_path[PATH_MAX_LEN];  // Path to stock database file
     AllianceEntry*   alliances;
     int              num_alliances;
     EnvoyMission*    envoy_missions;
-    ConnectionEntry* connections;
-    int              num_connections;
-    int              connections_capacity;
-    FrameQueue       outbound_queue;
+    ConnectionTable  connections;
+    Shard*           shards;
+    int              num_shards;
+    int              next_shard;        // Round-robin cursor for new connections
     int              listen_fd;
-    pthread_t        listener_thread;
+    Reactor          reactor;           // CLI thread: stdin only
+    MaesterTuning    tuning;
+    SendSlotPool     send_pool;         // Used while no shard is running
+    RecvBufferPool   recv_pool;
+    pthread_t        listener_thread;   // accept() loop; hands sockets to shards
+    int              listener_running;
+    int              stop_fd;           // eventfd signalled on shutdown (wakes CLI and listener)
     pthread_mutex_t  routes_lock;
-    pthread_mutex_t  alliances_lock;
+    pthread_mutex_t  alliances_lock;    // Alliances, stock and the active mission
     pthread_mutex_t  envoys_lock;
-    pthread_mutex_t  connections_lock;
-    int              shutting_down;
+    pthread_mutex_t  connections_lock;  // Connection table slots and indexes
+    pthread_mutex_t  transfers_lock;    // File transfers (taken after alliances_lock, never before)
+    TransferTable    transfers;
+    DigestCache      digests;           // MD5 of sigils already pledged
+    SigilStore       sigils;            // Received sigils by MD5
+    LinkRepairStats  repair;            // Updated atomically by every shard
+    CompactLinkStats compact_links;     // Likewise
+    ForwardStats     forwarding;        // Likewise
+    int              shutting_down;     // Read by every thread: accessed with __atomic builtins
     MissionState     active_mission;
  } Maester;
 
@@ -183,6 +650,7 @@ void     free_maester(Maester* maester);
 
 // Load maester from configuration files
 Maester* load_maester_config(const char* config_file, const char* stock_file);
+void     load_maester_tuning(MaesterTuning* tuning);
 
 // Command handlers for Phase 1
 void cmd_list_realms(Maester* maester);
@@ -194,6 +662,11 @@ void cmd_envoy_status(Maester* maester);
 // Runs the Maester
 int maester_run(const char* config_file, const char* stock_file);
 
+// Readiness callback run by the shard that owns the connection
+void maester_handle_connection_event(Maester* maester, ConnectionEntry* entry, uint32_t events);
+int  maester_handle_received(Maester* maester, ConnectionEntry* entry, const uint8_t* data, int length);
+void maester_resume_reading(Maester* maester, ConnectionEntry* entry);
+
 // Frame helpers (Phase 2 networking)
 void             frame_init(CitadelFrame* frame, FrameType type, const char* origin, const char* destination);
 int              frame_serialize(const CitadelFrame* frame, uint8_t* buffer, size_t buffer_len, size_t* out_len);
@@ -202,9 +675,10 @@ uint16_t         frame_compute_checksum_bytes(const uint8_t* buffer, size_t leng
 void             frame_log_summary(const char* prefix, const CitadelFrame* frame);
 const char*      frame_type_to_string(FrameType type);
 
-void frame_buffer_init(FrameBuffer* fb);
-void frame_buffer_reset(FrameBuffer* fb);
-int  frame_buffer_append(FrameBuffer* fb, const uint8_t* data, size_t length);
+void   frame_buffer_init(FrameBuffer* fb);
+void   frame_buffer_reset(FrameBuffer* fb);
+size_t frame_buffer_length(const FrameBuffer* fb);
+int    frame_buffer_append(FrameBuffer* fb, const uint8_t* data, size_t length);
 FrameParseResult frame_buffer_extract(FrameBuffer* fb, CitadelFrame* frame, size_t* consumed_bytes);
 
 #endif
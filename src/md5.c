@@ -0,0 +1,270 @@
+#include "md5.h"
+#include "helper.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+#define MD5_READ_CHUNK   (64 * 1024)   // read() size of md5_digest_file
+#define MD5_THREADS_MAX  16
+
+#define MD5_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// Round functions and one step of each round (RFC 1321, 3.4). The 64 steps
+// are unrolled and the block function is optimized even though the maester
+// is built without -O; otherwise it runs at half of md5sum's speed.
+#define MD5_ROUND_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_ROUND_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_ROUND_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_ROUND_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, word, constant, shift) \
+    (a) += f((b), (c), (d)) + (word) + (uint32_t)(constant); \
+    (a) = MD5_ROTL((a), (shift)) + (b)
+
+static Md5Backend g_backend = MD5_BACKEND_INTERNAL;
+
+// Work shared by the md5_digest_files threads; files are claimed one by one
+typedef struct {
+    const char* const* paths;
+    uint8_t          (*digests)[16];
+    int*               results;
+    int                count;
+    int                next;
+} Md5Batch;
+
+static void  md5_transform(uint32_t state[4], const uint8_t block[64]) __attribute__((optimize("O2")));
+static int   md5_file_internal(const char* path, uint8_t digest[16]);
+static void* md5_batch_worker(void* arg);
+
+void md5_select(Md5Backend backend) {
+    g_backend = backend;
+}
+
+Md5Backend md5_selected(void) {
+    return g_backend;
+}
+
+void md5_init(Md5Context* ctx) {
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xefcdab89;
+    ctx->state[2] = 0x98badcfe;
+    ctx->state[3] = 0x10325476;
+    ctx->length = 0;
+}
+
+static void md5_transform(uint32_t state[4], const uint8_t block[64]) {
+    uint32_t x[16];
+    for (int i = 0; i < 16; i++) {
+        x[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) |
+               ((uint32_t)block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+    MD5_STEP(MD5_ROUND_F, a, b, c, d, x[0],  0xd76aa478, 7);
+    MD5_STEP(MD5_ROUND_F, d, a, b, c, x[1],  0xe8c7b756, 12);
+    MD5_STEP(MD5_ROUND_F, c, d, a, b, x[2],  0x242070db, 17);
+    MD5_STEP(MD5_ROUND_F, b, c, d, a, x[3],  0xc1bdceee, 22);
+    MD5_STEP(MD5_ROUND_F, a, b, c, d, x[4],  0xf57c0faf, 7);
+    MD5_STEP(MD5_ROUND_F, d, a, b, c, x[5],  0x4787c62a, 12);
+    MD5_STEP(MD5_ROUND_F, c, d, a, b, x[6],  0xa8304613, 17);
+    MD5_STEP(MD5_ROUND_F, b, c, d, a, x[7],  0xfd469501, 22);
+    MD5_STEP(MD5_ROUND_F, a, b, c, d, x[8],  0x698098d8, 7);
+    MD5_STEP(MD5_ROUND_F, d, a, b, c, x[9],  0x8b44f7af, 12);
+    MD5_STEP(MD5_ROUND_F, c, d, a, b, x[10], 0xffff5bb1, 17);
+    MD5_STEP(MD5_ROUND_F, b, c, d, a, x[11], 0x895cd7be, 22);
+    MD5_STEP(MD5_ROUND_F, a, b, c, d, x[12], 0x6b901122, 7);
+    MD5_STEP(MD5_ROUND_F, d, a, b, c, x[13], 0xfd987193, 12);
+    MD5_STEP(MD5_ROUND_F, c, d, a, b, x[14], 0xa679438e, 17);
+    MD5_STEP(MD5_ROUND_F, b, c, d, a, x[15], 0x49b40821, 22);
+
+    MD5_STEP(MD5_ROUND_G, a, b, c, d, x[1],  0xf61e2562, 5);
+    MD5_STEP(MD5_ROUND_G, d, a, b, c, x[6],  0xc040b340, 9);
+    MD5_STEP(MD5_ROUND_G, c, d, a, b, x[11], 0x265e5a51, 14);
+    MD5_STEP(MD5_ROUND_G, b, c, d, a, x[0],  0xe9b6c7aa, 20);
+    MD5_STEP(MD5_ROUND_G, a, b, c, d, x[5],  0xd62f105d, 5);
+    MD5_STEP(MD5_ROUND_G, d, a, b, c, x[10], 0x02441453, 9);
+    MD5_STEP(MD5_ROUND_G, c, d, a, b, x[15], 0xd8a1e681, 14);
+    MD5_STEP(MD5_ROUND_G, b, c, d, a, x[4],  0xe7d3fbc8, 20);
+    MD5_STEP(MD5_ROUND_G, a, b, c, d, x[9],  0x21e1cde6, 5);
+    MD5_STEP(MD5_ROUND_G, d, a, b, c, x[14], 0xc33707d6, 9);
+    MD5_STEP(MD5_ROUND_G, c, d, a, b, x[3],  0xf4d50d87, 14);
+    MD5_STEP(MD5_ROUND_G, b, c, d, a, x[8],  0x455a14ed, 20);
+    MD5_STEP(MD5_ROUND_G, a, b, c, d, x[13], 0xa9e3e905, 5);
+    MD5_STEP(MD5_ROUND_G, d, a, b, c, x[2],  0xfcefa3f8, 9);
+    MD5_STEP(MD5_ROUND_G, c, d, a, b, x[7],  0x676f02d9, 14);
+    MD5_STEP(MD5_ROUND_G, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+    MD5_STEP(MD5_ROUND_H, a, b, c, d, x[5],  0xfffa3942, 4);
+    MD5_STEP(MD5_ROUND_H, d, a, b, c, x[8],  0x8771f681, 11);
+    MD5_STEP(MD5_ROUND_H, c, d, a, b, x[11], 0x6d9d6122, 16);
+    MD5_STEP(MD5_ROUND_H, b, c, d, a, x[14], 0xfde5380c, 23);
+    MD5_STEP(MD5_ROUND_H, a, b, c, d, x[1],  0xa4beea44, 4);
+    MD5_STEP(MD5_ROUND_H, d, a, b, c, x[4],  0x4bdecfa9, 11);
+    MD5_STEP(MD5_ROUND_H, c, d, a, b, x[7],  0xf6bb4b60, 16);
+    MD5_STEP(MD5_ROUND_H, b, c, d, a, x[10], 0xbebfbc70, 23);
+    MD5_STEP(MD5_ROUND_H, a, b, c, d, x[13], 0x289b7ec6, 4);
+    MD5_STEP(MD5_ROUND_H, d, a, b, c, x[0],  0xeaa127fa, 11);
+    MD5_STEP(MD5_ROUND_H, c, d, a, b, x[3],  0xd4ef3085, 16);
+    MD5_STEP(MD5_ROUND_H, b, c, d, a, x[6],  0x04881d05, 23);
+    MD5_STEP(MD5_ROUND_H, a, b, c, d, x[9],  0xd9d4d039, 4);
+    MD5_STEP(MD5_ROUND_H, d, a, b, c, x[12], 0xe6db99e5, 11);
+    MD5_STEP(MD5_ROUND_H, c, d, a, b, x[15], 0x1fa27cf8, 16);
+    MD5_STEP(MD5_ROUND_H, b, c, d, a, x[2],  0xc4ac5665, 23);
+
+    MD5_STEP(MD5_ROUND_I, a, b, c, d, x[0],  0xf4292244, 6);
+    MD5_STEP(MD5_ROUND_I, d, a, b, c, x[7],  0x432aff97, 10);
+    MD5_STEP(MD5_ROUND_I, c, d, a, b, x[14], 0xab9423a7, 15);
+    MD5_STEP(MD5_ROUND_I, b, c, d, a, x[5],  0xfc93a039, 21);
+    MD5_STEP(MD5_ROUND_I, a, b, c, d, x[12], 0x655b59c3, 6);
+    MD5_STEP(MD5_ROUND_I, d, a, b, c, x[3],  0x8f0ccc92, 10);
+    MD5_STEP(MD5_ROUND_I, c, d, a, b, x[10], 0xffeff47d, 15);
+    MD5_STEP(MD5_ROUND_I, b, c, d, a, x[1],  0x85845dd1, 21);
+    MD5_STEP(MD5_ROUND_I, a, b, c, d, x[8],  0x6fa87e4f, 6);
+    MD5_STEP(MD5_ROUND_I, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+    MD5_STEP(MD5_ROUND_I, c, d, a, b, x[6],  0xa3014314, 15);
+    MD5_STEP(MD5_ROUND_I, b, c, d, a, x[13], 0x4e0811a1, 21);
+    MD5_STEP(MD5_ROUND_I, a, b, c, d, x[4],  0xf7537e82, 6);
+    MD5_STEP(MD5_ROUND_I, d, a, b, c, x[11], 0xbd3af235, 10);
+    MD5_STEP(MD5_ROUND_I, c, d, a, b, x[2],  0x2ad7d2bb, 15);
+    MD5_STEP(MD5_ROUND_I, b, c, d, a, x[9],  0xeb86d391, 21);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+void md5_update(Md5Context* ctx, const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t buffered = (size_t)(ctx->length & 63);
+    ctx->length += length;
+    if (buffered > 0) {
+        size_t take = 64 - buffered;
+        if (take > length) take = length;
+        memcpy(ctx->block + buffered, bytes, take);
+        bytes += take;
+        length -= take;
+        if (buffered + take < 64) return;
+        md5_transform(ctx->state, ctx->block);
+    }
+    // Whole blocks straight from the caller's buffer
+    while (length >= 64) {
+        md5_transform(ctx->state, bytes);
+        bytes += 64;
+        length -= 64;
+    }
+    if (length > 0) {
+        memcpy(ctx->block, bytes, length);
+    }
+}
+
+void md5_final(Md5Context* ctx, uint8_t digest[16]) {
+    uint64_t bits = ctx->length * 8;
+    uint8_t padding[72];
+    size_t buffered = (size_t)(ctx->length & 63);
+    size_t pad_len = (buffered < 56) ? 56 - buffered : 120 - buffered;
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    for (int i = 0; i < 8; i++) {
+        padding[pad_len + i] = (uint8_t)(bits >> (8 * i));
+    }
+    md5_update(ctx, padding, pad_len + 8);
+    for (int i = 0; i < 4; i++) {
+        digest[i * 4]     = (uint8_t)ctx->state[i];
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 3] = (uint8_t)(ctx->state[i] >> 24);
+    }
+}
+
+void md5_buffer(const void* data, size_t length, uint8_t digest[16]) {
+    Md5Context ctx;
+    md5_init(&ctx);
+    md5_update(&ctx, data, length);
+    md5_final(&ctx, digest);
+}
+
+static int md5_file_internal(const char* path, uint8_t digest[16]) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    uint8_t* buffer = (uint8_t*)malloc(MD5_READ_CHUNK);
+    if (buffer == NULL) {
+        close(fd);
+        return -1;
+    }
+    Md5Context ctx;
+    md5_init(&ctx);
+    int result = 0;
+    for (;;) {
+        ssize_t n = read(fd, buffer, MD5_READ_CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            result = -1;
+            break;
+        }
+        if (n == 0) break;
+        md5_update(&ctx, buffer, (size_t)n);
+    }
+    free(buffer);
+    close(fd);
+    if (result == 0) {
+        md5_final(&ctx, digest);
+    }
+    return result;
+}
+
+int md5_digest_file(const char* path, uint8_t digest[16]) {
+    if (path == NULL || digest == NULL) return -1;
+    if (g_backend == MD5_BACKEND_MD5SUM) {
+        return md5_compute_file(path, digest);
+    }
+    return md5_file_internal(path, digest);
+}
+
+static void* md5_batch_worker(void* arg) {
+    Md5Batch* batch = (Md5Batch*)arg;
+    for (;;) {
+        int i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (i >= batch->count) break;
+        batch->results[i] = md5_digest_file(batch->paths[i], batch->digests[i]);
+    }
+    return NULL;
+}
+
+/**
+ * Bulk verification: hash many files at once. Each thread claims the next
+ * unhashed file, so one large file does not hold up the small ones behind it.
+ * With the md5sum backend every thread runs its own md5sum processes.
+ */
+int md5_digest_files(const char* const* paths, int count, uint8_t (*digests)[16], int* results, int threads) {
+    if (paths == NULL || digests == NULL || results == NULL || count <= 0) return 0;
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus < 1) ? 1 : (int)cpus;
+    }
+    if (threads > MD5_THREADS_MAX) threads = MD5_THREADS_MAX;
+    if (threads > count) threads = count;
+
+    Md5Batch batch;
+    batch.paths = paths;
+    batch.digests = digests;
+    batch.results = results;
+    batch.count = count;
+    batch.next = 0;
+
+    // The calling thread is one of the workers
+    pthread_t workers[MD5_THREADS_MAX];
+    int started = 0;
+    while (started < threads - 1 && pthread_create(&workers[started], NULL, md5_batch_worker, &batch) == 0) {
+        started++;
+    }
+    md5_batch_worker(&batch);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        if (results[i] != 0) failures++;
+    }
+    return failures;
+}
@@ -0,0 +1,35 @@
+#ifndef MD5_H
+#define MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MD5 of sigil files (RFC 1321). The digest is computed in-process and can be
+// fed incrementally while a file is sent or received; MD5_BACKEND_MD5SUM
+// keeps the statement's fork/exec of md5sum for whole-file digests.
+typedef enum {
+    MD5_BACKEND_INTERNAL = 0,
+    MD5_BACKEND_MD5SUM
+} Md5Backend;
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;        // Bytes hashed so far
+    uint8_t  block[64];     // Partial block awaiting more input
+} Md5Context;
+
+void md5_init(Md5Context* ctx);
+void md5_update(Md5Context* ctx, const void* data, size_t length);
+void md5_final(Md5Context* ctx, uint8_t digest[16]);
+void md5_buffer(const void* data, size_t length, uint8_t digest[16]);
+
+void       md5_select(Md5Backend backend);
+Md5Backend md5_selected(void);
+
+// Whole-file digests with the selected backend. md5_digest_files hashes
+// `count` files on up to `threads` threads (0: one per CPU), storing each
+// digest and 0/-1 in results[i]; returns the number of failures.
+int md5_digest_file(const char* path, uint8_t digest[16]);
+int md5_digest_files(const char* const* paths, int count, uint8_t (*digests)[16], int* results, int threads);
+
+#endif
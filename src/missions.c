@@ -1,5 +1,6 @@
 #include "missions.h"
 #include "network.h"
+#include "transfer.h"
 
 static void maester_mission_reset(Maester* maester);
 
@@ -19,8 +20,10 @@ static void maester_mission_reset(Maester* maester) {
     maester->active_mission.type = FRAME_TYPE_PLEDGE;
     maester->active_mission.target_realm[0] = '\0';
     maester->active_mission.description[0] = '\0';
+    maester->active_mission.next_hop[0] = '\0';
     maester->active_mission.started_at = 0;
     maester->active_mission.deadline = 0;
+    maester->active_mission.timeout_s = 0;
 }
 
 void maester_mission_print_busy(const Maester* maester, const char* new_action) {
@@ -65,6 +68,7 @@ int maester_mission_begin(Maester* maester, FrameType type, const char* target,
     } else {
         maester->active_mission.description[0] = '\0';
     }
+    maester->active_mission.timeout_s = timeout_seconds;
     if (timeout_seconds > 0) {
         maester->active_mission.deadline = maester->active_mission.started_at + timeout_seconds;
     } else {
@@ -107,6 +111,13 @@ void maester_mission_check_timeouts(Maester* maester) {
     if (!maester_mission_is_active(maester)) return;
     if (maester->active_mission.deadline == 0) return;
     time_t now = time(NULL);
+    if (now >= maester->active_mission.deadline &&
+        transfer_send_resumes(maester, maester->active_mission.target_realm)) {
+        // Its transfer is waiting for the route to come back: the count starts
+        // over, the transfer drops itself once it stops making progress
+        maester->active_mission.deadline = now + maester->active_mission.timeout_s;
+        return;
+    }
     if (now >= maester->active_mission.deadline) {
         write_str(STDOUT_FILENO, "Mission timed out: ");
         if (maester->active_mission.description[0] != '\0') {
@@ -123,3 +134,57 @@ void maester_mission_check_timeouts(Maester* maester) {
         maester_mission_reset(maester);
     }
 }
+
+int maester_mission_next_timeout_ms(const Maester* maester) {
+    if (!maester_mission_is_active(maester)) return -1;
+    if (maester->active_mission.deadline == 0) return -1;
+    time_t now = time(NULL);
+    if (now >= maester->active_mission.deadline) return 0;
+    return (int)(maester->active_mission.deadline - now) * 1000;
+}
+
+void maester_mission_set_next_hop(Maester* maester, const char* realm) {
+    if (!maester_mission_is_active(maester) || realm == NULL) return;
+    my_strcpy(maester->active_mission.next_hop, realm);
+}
+
+// The connection a mission was waiting on could not be established
+void maester_mission_next_hop_failed(Maester* maester, const char* realm, const char* reason) {
+    if (!maester_mission_is_active(maester) || realm == NULL) return;
+    if (my_strcasecmp(maester->active_mission.next_hop, realm) != 0 &&
+        my_strcasecmp(maester->active_mission.target_realm, realm) != 0) {
+        return;
+    }
+    if (transfer_send_resumes(maester, maester->active_mission.target_realm)) {
+        // The transfer retries and picks up where it stopped: the mission
+        // ends with the receiver's answer, as it would have without the loss
+        write_str(STDOUT_FILENO, "Mission waiting: ");
+        if (maester->active_mission.description[0] != '\0') {
+            write_str(STDOUT_FILENO, maester->active_mission.description);
+        } else {
+            write_str(STDOUT_FILENO, frame_type_to_string(maester->active_mission.type));
+        }
+        write_str(STDOUT_FILENO, " (next hop ");
+        write_str(STDOUT_FILENO, realm);
+        if (reason != NULL) {
+            write_str(STDOUT_FILENO, ": ");
+            write_str(STDOUT_FILENO, reason);
+        }
+        write_str(STDOUT_FILENO, "); the transfer resumes once the route is back.\n");
+        return;
+    }
+    write_str(STDOUT_FILENO, "Mission failed: ");
+    if (maester->active_mission.description[0] != '\0') {
+        write_str(STDOUT_FILENO, maester->active_mission.description);
+    } else {
+        write_str(STDOUT_FILENO, frame_type_to_string(maester->active_mission.type));
+    }
+    write_str(STDOUT_FILENO, " (next hop ");
+    write_str(STDOUT_FILENO, realm);
+    if (reason != NULL) {
+        write_str(STDOUT_FILENO, ": ");
+        write_str(STDOUT_FILENO, reason);
+    }
+    write_str(STDOUT_FILENO, ").\n");
+    maester_mission_reset(maester);
+}
@@ -9,5 +9,8 @@ void maester_mission_print_busy(const Maester* maester, const char* new_action);
 int  maester_mission_begin(Maester* maester, FrameType type, const char* target, const char* description, int timeout_seconds);
 void maester_mission_finish(Maester* maester, const char* log_message);
 void maester_mission_check_timeouts(Maester* maester);
+int  maester_mission_next_timeout_ms(const Maester* maester);
+void maester_mission_set_next_hop(Maester* maester, const char* realm);
+void maester_mission_next_hop_failed(Maester* maester, const char* realm, const char* reason);
 
 #endif
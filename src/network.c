@@ -1,15 +1,33 @@
+#define _GNU_SOURCE   // clock_gettime()
+
 #include "network.h"
+#include "missions.h"
+#include "connections.h"
+#include "checksum.h"
+#include "shards.h"
+#include "uring.h"
+#include "transfer.h"
+
+#include <netinet/tcp.h>
 
 static void frame_copy_field_padded(const char* src, uint8_t* dst, size_t field_len);
 static void frame_extract_field(const uint8_t* src, size_t field_len, char* dst, size_t dst_len);
 static void frame_store_field(char* dst, size_t dst_len, const char* src);
+static void send_queue_set_bytes(SendQueue* queue, size_t bytes);
+static FrameParseResult frame_check_checksum(const uint8_t* buffer, uint16_t computed);
 static Route* maester_find_route(Maester* maester, const char* realm);
-static Route* maester_find_default_route(Maester* maester);
-static int    maester_route_is_known(const Route* route);
-static ConnectionEntry* maester_find_connection(Maester* maester, const char* realm);
-ConnectionEntry* maester_add_connection_entry(Maester* maester);
 static int    set_socket_nonblocking(int fd);
-static int    maester_queue_bytes(ConnectionEntry* entry, const uint8_t* data, size_t length);
+static void   set_socket_nodelay(int fd);
+static int    maester_queue_bytes(ConnectionEntry* entry, const uint8_t* data, size_t length, int quiet);
+static size_t maester_connection_backlog(const ConnectionEntry* entry);
+static void   maester_connection_hold(Maester* maester, ConnectionEntry* entry, ConnectionEntry* next_hop);
+static uint64_t maester_now_us(void);
+static void   maester_link_offer(Maester* maester, ConnectionEntry* entry);
+static int    maester_send_link_options(Maester* maester, ConnectionEntry* entry, const char* verb);
+static int    maester_link_addresses(const ConnectionEntry* entry, char* local, char* remote);
+static void   maester_format_address(const struct sockaddr_in* addr, char* out);
+static ConnectionEntry* maester_open_connection_locked(Maester* maester, const char* realm, const char* ip,
+                                                       int port, int stripe);
 
 static void frame_copy_field_padded(const char* src, uint8_t* dst, size_t field_len) {
     if (dst == NULL || field_len == 0) {
@@ -80,50 +98,130 @@ int frame_serialize(const CitadelFrame* frame, uint8_t* buffer, size_t buffer_le
         return -1;
     }
 
-    // Zero-initialize entire frame (provides padding)
-    memset(buffer, 0, FRAME_MAX_SIZE);
+    frame_encode_bytes(buffer, frame->type, frame->origin, frame->destination, frame->data, frame->data_length);
+
+    if (out_len != NULL) {
+        *out_len = FRAME_MAX_SIZE;
+    }
+    return 0;
+}
 
+/**
+ * Write a complete 320-byte frame into `buffer` (FRAME_MAX_SIZE bytes) from
+ * its parts, so callers holding the payload elsewhere (a mapped file) build
+ * the frame in its final place without staging a CitadelFrame.
+ * `length` must not exceed FRAME_MAX_DATA. `data` may already sit at the data
+ * field of `buffer` (payload assembled in place); it is then left untouched.
+ */
+void frame_encode_bytes(uint8_t* buffer, FrameType type, const char* origin, const char* destination,
+                        const uint8_t* data, uint16_t length) {
     size_t offset = 0;
-    buffer[offset++] = (uint8_t)frame->type;
+    buffer[offset++] = (uint8_t)type;
 
-    frame_copy_field_padded(frame->origin, buffer + offset, FRAME_ORIGIN_LEN);
+    frame_copy_field_padded(origin, buffer + offset, FRAME_ORIGIN_LEN);
     offset += FRAME_ORIGIN_LEN;
-    frame_copy_field_padded(frame->destination, buffer + offset, FRAME_DEST_LEN);
+    frame_copy_field_padded(destination, buffer + offset, FRAME_DEST_LEN);
     offset += FRAME_DEST_LEN;
 
-    buffer[offset++] = (uint8_t)((frame->data_length >> 8) & 0xFF);
-    buffer[offset++] = (uint8_t)(frame->data_length & 0xFF);
+    buffer[offset++] = (uint8_t)((length >> 8) & 0xFF);
+    buffer[offset++] = (uint8_t)(length & 0xFF);
 
-    if (frame->data_length > 0) {
-        memcpy(buffer + offset, frame->data, frame->data_length);
+    if (length > 0 && data != buffer + offset) {
+        memcpy(buffer + offset, data, length);
     }
-    // Padding already set to zero by memset
+    // Zero padding up to the checksum
+    memset(buffer + offset + length, 0, 318 - offset - length);
 
-    // Checksum at FIXED position (bytes 318-319), computed over first 318 bytes
-    uint16_t checksum = frame_compute_checksum_bytes(buffer, 318);
+    // Checksum at FIXED position (bytes 318-319), computed over first 318 bytes;
+    // the padding just written is zero, so it is accounted for without reading it
+    uint16_t checksum = checksum_compute_padded(buffer, offset + length, 318);
     buffer[318] = (uint8_t)((checksum >> 8) & 0xFF);
     buffer[319] = (uint8_t)(checksum & 0xFF);
+}
 
-    if (out_len != NULL) {
-        *out_len = FRAME_MAX_SIZE;
+/**
+ * Compact wire form of a 320-byte frame: the header and data as they are,
+ * then the checksum, without the padding. The checksum is the padded frame's,
+ * so a relay converts between the two forms without recomputing it. `out`
+ * may be `frame` itself. Returns the compact length.
+ */
+size_t frame_compact_bytes(const uint8_t* frame, uint8_t* out) {
+    uint16_t data_len = (uint16_t)((frame[FRAME_HEADER_LEN - 2] << 8) | frame[FRAME_HEADER_LEN - 1]);
+    if (data_len > FRAME_MAX_DATA) {
+        data_len = FRAME_MAX_DATA;
     }
-    return 0;
+    size_t used = FRAME_HEADER_LEN + data_len;
+    uint8_t high = frame[FRAME_MAX_SIZE - 2];
+    uint8_t low = frame[FRAME_MAX_SIZE - 1];
+    if (out != frame) {
+        memcpy(out, frame, used);
+    }
+    out[used] = high;
+    out[used + 1] = low;
+    return used + FRAME_CHECKSUM_LEN;
 }
 
-FrameParseResult frame_deserialize(const uint8_t* buffer, size_t length, CitadelFrame* frame, size_t* consumed_bytes) {
-    if (consumed_bytes != NULL) {
-        *consumed_bytes = 0;
+/**
+ * Check a complete 320-byte frame in place: data length bound and checksum.
+ * Nothing is copied, so callers can validate before deciding to decode.
+ */
+FrameParseResult frame_validate_bytes(const uint8_t* buffer) {
+    if (buffer == NULL) {
+        return FRAME_PARSE_INVALID;
     }
-    if (buffer == NULL || frame == NULL) {
+    uint16_t data_len = (uint16_t)((buffer[FRAME_HEADER_LEN - 2] << 8) | buffer[FRAME_HEADER_LEN - 1]);
+    if (data_len > FRAME_MAX_DATA) {
         return FRAME_PARSE_INVALID;
     }
 
-    // Protocol specifies FIXED 320-byte frames
-    if (length < FRAME_MAX_SIZE) {
-        return FRAME_PARSE_NEED_MORE;
+    // Checksum is ALWAYS at fixed position (bytes 318-319), computed over the first 318 bytes
+    return frame_check_checksum(buffer, frame_compute_checksum_bytes(buffer, 318));
+}
+
+static FrameParseResult frame_check_checksum(const uint8_t* buffer, uint16_t computed) {
+    uint16_t received = (uint16_t)((buffer[318] << 8) | buffer[319]);
+    if (received != computed) {
+        // Debug: Log checksum mismatch
+        write_str(STDERR_FILENO, "DEBUG Checksum: received=0x");
+        char hex_buf[16];
+        ulong_to_str(received, hex_buf);
+        write_str(STDERR_FILENO, hex_buf);
+        write_str(STDERR_FILENO, " computed=0x");
+        ulong_to_str(computed, hex_buf);
+        write_str(STDERR_FILENO, hex_buf);
+        write_str(STDERR_FILENO, "\n");
+        return FRAME_PARSE_BAD_CHECKSUM;
     }
+    return FRAME_PARSE_OK;
+}
 
-    // Parse header fields
+/**
+ * Validate `count` back-to-back 320-byte frames in one pass: the checksums
+ * are computed by a single batch call, then each frame's length and stored
+ * checksum are checked. Returns how many leading frames are valid, stopping
+ * at the first bad one; results[] is filled up to and including it.
+ */
+size_t frame_validate_batch(const uint8_t* frames, size_t count, FrameParseResult* results) {
+    if (frames == NULL || results == NULL || count == 0) return 0;
+    uint16_t sums[FRAME_BATCH_MAX];
+    if (count > FRAME_BATCH_MAX) {
+        count = FRAME_BATCH_MAX;
+    }
+    checksum_compute_batch(frames, FRAME_MAX_SIZE, 318, count, sums);
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* frame = frames + i * FRAME_MAX_SIZE;
+        uint16_t data_len = (uint16_t)((frame[FRAME_HEADER_LEN - 2] << 8) | frame[FRAME_HEADER_LEN - 1]);
+        results[i] = (data_len > FRAME_MAX_DATA) ? FRAME_PARSE_INVALID : frame_check_checksum(frame, sums[i]);
+        if (results[i] != FRAME_PARSE_OK) {
+            return i;
+        }
+    }
+    return count;
+}
+
+// Copies the wire fields of a 320-byte frame into a CitadelFrame (no validation)
+void frame_decode_bytes(const uint8_t* buffer, CitadelFrame* frame) {
+    if (buffer == NULL || frame == NULL) return;
     size_t offset = 0;
     frame->type = (FrameType)buffer[offset++];
 
@@ -134,9 +232,8 @@ FrameParseResult frame_deserialize(const uint8_t* buffer, size_t length, Citadel
 
     uint16_t data_len = (uint16_t)((buffer[offset] << 8) | buffer[offset + 1]);
     offset += 2;
-
     if (data_len > FRAME_MAX_DATA) {
-        return FRAME_PARSE_INVALID;
+        data_len = FRAME_MAX_DATA;
     }
 
     // Extract data (rest is padding until checksum)
@@ -144,46 +241,44 @@ FrameParseResult frame_deserialize(const uint8_t* buffer, size_t length, Citadel
     if (data_len > 0) {
         memcpy(frame->data, buffer + offset, data_len);
     }
-
-    // Checksum is ALWAYS at fixed position (bytes 318-319)
     frame->checksum = (uint16_t)((buffer[318] << 8) | buffer[319]);
+}
 
-    // Compute checksum over first 318 bytes (excludes checksum itself)
-    uint16_t computed = frame_compute_checksum_bytes(buffer, 318);
-    if (frame->checksum != computed) {
-        // Debug: Log checksum mismatch
-        write_str(STDERR_FILENO, "DEBUG Checksum: received=0x");
-        char hex_buf[16];
-        ulong_to_str(frame->checksum, hex_buf);
-        write_str(STDERR_FILENO, hex_buf);
-        write_str(STDERR_FILENO, " computed=0x");
-        ulong_to_str(computed, hex_buf);
-        write_str(STDERR_FILENO, hex_buf);
-        write_str(STDERR_FILENO, "\n");
+FrameParseResult frame_deserialize(const uint8_t* buffer, size_t length, CitadelFrame* frame, size_t* consumed_bytes) {
+    if (consumed_bytes != NULL) {
+        *consumed_bytes = 0;
+    }
+    if (buffer == NULL || frame == NULL) {
+        return FRAME_PARSE_INVALID;
+    }
 
-        if (consumed_bytes != NULL) {
-            *consumed_bytes = FRAME_MAX_SIZE;
-        }
-        return FRAME_PARSE_BAD_CHECKSUM;
+    // Protocol specifies FIXED 320-byte frames
+    if (length < FRAME_MAX_SIZE) {
+        return FRAME_PARSE_NEED_MORE;
+    }
+
+    FrameParseResult result = frame_validate_bytes(buffer);
+    if (result == FRAME_PARSE_INVALID) {
+        return result;
     }
+    // Decode even on a checksum mismatch so the caller can NACK the origin
+    frame_decode_bytes(buffer, frame);
 
     if (consumed_bytes != NULL) {
         *consumed_bytes = FRAME_MAX_SIZE;
     }
-    return FRAME_PARSE_OK;
+    return result;
 }
 
+// Dispatches to the SIMD kernel picked by checksum_init() (see checksum.c)
 uint16_t frame_compute_checksum_bytes(const uint8_t* buffer, size_t length) {
-    uint32_t sum = 0;
-    for (size_t i = 0; i < length; i++) {
-        sum += buffer[i];
-    }
-    return (uint16_t)(sum % 65536);
+    return checksum_compute(buffer, length);
 }
 
 const char* frame_type_to_string(FrameType type) {
     switch (type) {
         case FRAME_TYPE_PLEDGE: return "PLEDGE";
+        case FRAME_TYPE_SIGIL_DATA: return "SIGIL_DATA";
         case FRAME_TYPE_PLEDGE_RESPONSE: return "PLEDGE_RESP";
         case FRAME_TYPE_LIST_REQUEST: return "LIST_REQ";
         case FRAME_TYPE_LIST_RESPONSE: return "LIST_RESP";
@@ -195,6 +290,9 @@ const char* frame_type_to_string(FrameType type) {
         case FRAME_TYPE_ERROR_UNAUTHORIZED: return "ERR_AUTH";
         case FRAME_TYPE_ACK_FILE: return "ACK_FILE";
         case FRAME_TYPE_ACK_MD5: return "ACK_MD5";
+        case FRAME_TYPE_ACK_DATA: return "ACK_DATA";
+        case FRAME_TYPE_TRANSFER_RESUME: return "RESUME";
+        case FRAME_TYPE_LINK_OPTIONS: return "LINK_OPTIONS";
         case FRAME_TYPE_NACK: return "NACK";
         default: return "UNKNOWN";
     }
@@ -218,108 +316,736 @@ void frame_log_summary(const char* prefix, const CitadelFrame* frame) {
     write_str(STDOUT_FILENO, "\n");
 }
 
+void recv_pool_init(RecvBufferPool* pool) {
+    if (pool == NULL) return;
+    pool->count = 0;
+}
+
+void recv_pool_destroy(RecvBufferPool* pool) {
+    if (pool == NULL) return;
+    while (pool->count > 0) {
+        free(pool->blocks[--pool->count]);
+    }
+}
+
+static uint8_t* frame_buffer_alloc(FrameBuffer* fb, size_t capacity) {
+    if (fb->pool != NULL && capacity == RECV_BLOCK_SIZE && fb->pool->count > 0) {
+        return fb->pool->blocks[--fb->pool->count];
+    }
+    return (uint8_t*)malloc(capacity);
+}
+
+static void frame_buffer_free_storage(FrameBuffer* fb, uint8_t* data, size_t capacity) {
+    if (data == NULL) return;
+    if (fb->pool != NULL && capacity == RECV_BLOCK_SIZE && fb->pool->count < RECV_POOL_KEEP) {
+        fb->pool->blocks[fb->pool->count++] = data;
+        return;
+    }
+    free(data);
+}
+
 void frame_buffer_init(FrameBuffer* fb) {
     if (fb == NULL) return;
-    fb->length = 0;
+    fb->data = NULL;
+    fb->capacity = 0;
+    fb->max_capacity = FRAME_BUFFER_CAPACITY;
+    fb->head = 0;
+    fb->tail = 0;
+    fb->pool = NULL;
+}
+
+// Attach a block pool and let the ring grow up to `max_capacity` bytes
+void frame_buffer_configure(FrameBuffer* fb, RecvBufferPool* pool, size_t max_capacity) {
+    if (fb == NULL) return;
+    fb->pool = pool;
+    size_t limit = (pool != NULL) ? RECV_BLOCK_SIZE : FRAME_BUFFER_CAPACITY;
+    while (limit < max_capacity) {
+        limit <<= 1;
+    }
+    fb->max_capacity = limit;
+}
+
+void frame_buffer_release(FrameBuffer* fb) {
+    if (fb == NULL) return;
+    frame_buffer_free_storage(fb, fb->data, fb->capacity);
+    fb->data = NULL;
+    fb->capacity = 0;
+    fb->head = 0;
+    fb->tail = 0;
 }
 
 void frame_buffer_reset(FrameBuffer* fb) {
     if (fb == NULL) return;
-    fb->length = 0;
+    fb->head = 0;
+    fb->tail = 0;
+}
+
+size_t frame_buffer_length(const FrameBuffer* fb) {
+    if (fb == NULL) return 0;
+    return fb->tail - fb->head;
+}
+
+size_t frame_buffer_space(const FrameBuffer* fb) {
+    if (fb == NULL) return 0;
+    return fb->capacity - (fb->tail - fb->head);
 }
 
-static void frame_buffer_consume(FrameBuffer* fb, size_t bytes) {
-    if (fb == NULL || bytes == 0 || fb->length == 0) return;
-    if (bytes >= fb->length) {
-        fb->length = 0;
+/**
+ * Make room for at least `min_free` more bytes by doubling the ring, copying
+ * the unread bytes to the start of the new storage. Returns -1 once the ring
+ * has reached max_capacity or allocation fails.
+ */
+static int frame_buffer_grow(FrameBuffer* fb, size_t min_free) {
+    size_t length = fb->tail - fb->head;
+    size_t capacity = fb->capacity;
+    if (capacity == 0) {
+        capacity = (fb->pool != NULL) ? RECV_BLOCK_SIZE : FRAME_BUFFER_CAPACITY;
+    }
+    while (capacity - length < min_free && capacity < fb->max_capacity) {
+        capacity <<= 1;
+    }
+    if (capacity == fb->capacity || capacity - length < min_free) {
+        return -1;
+    }
+    uint8_t* data = frame_buffer_alloc(fb, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    if (length > 0) {
+        size_t mask = fb->capacity - 1;
+        size_t pos = fb->head & mask;
+        size_t first = fb->capacity - pos;
+        if (first > length) {
+            first = length;
+        }
+        memcpy(data, fb->data + pos, first);
+        memcpy(data + first, fb->data, length - first);
+    }
+    frame_buffer_free_storage(fb, fb->data, fb->capacity);
+    fb->data = data;
+    fb->capacity = capacity;
+    fb->head = 0;
+    fb->tail = length;
+    return 0;
+}
+
+void frame_buffer_consume(FrameBuffer* fb, size_t bytes) {
+    if (fb == NULL || bytes == 0) return;
+    if (bytes >= fb->tail - fb->head) {
+        // Empty again: rewind so the next frames land contiguously
+        fb->head = 0;
+        fb->tail = 0;
         return;
     }
-    memmove(fb->data, fb->data + bytes, fb->length - bytes);
-    fb->length -= bytes;
+    fb->head += bytes;
 }
 
 int frame_buffer_append(FrameBuffer* fb, const uint8_t* data, size_t length) {
     if (fb == NULL || data == NULL) return -1;
     if (length == 0) return 0;
-    if (fb->length + length > FRAME_BUFFER_CAPACITY) {
+    if (length > frame_buffer_space(fb) && frame_buffer_grow(fb, length) != 0) {
         return -1;
     }
-    memcpy(fb->data + fb->length, data, length);
-    fb->length += length;
+    size_t pos = fb->tail & (fb->capacity - 1);
+    size_t first = fb->capacity - pos;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(fb->data + pos, data, first);
+    if (length > first) {
+        memcpy(fb->data, data + first, length - first);
+    }
+    fb->tail += length;
     return 0;
 }
 
+// Append past max_capacity, up to twice it: for bytes that were already taken
+// off the socket when the connection stopped being read
+int frame_buffer_append_over(FrameBuffer* fb, const uint8_t* data, size_t length) {
+    if (fb == NULL) return -1;
+    size_t limit = fb->max_capacity;
+    fb->max_capacity = limit * 2;
+    int result = frame_buffer_append(fb, data, length);
+    fb->max_capacity = limit;
+    return result;
+}
+
+/**
+ * Read straight from `fd` into the free part of the ring (one readv covering
+ * both sides of the wrap point), growing the ring first when it is getting
+ * full. `requested` receives how many bytes were asked for, so a short read
+ * tells the caller the socket is drained without paying for an EAGAIN call.
+ * Returns what read() returns; 0 with *requested == 0 means the ring is full
+ * at max_capacity and frames must be parsed before reading more.
+ */
+ssize_t frame_buffer_read_fd(FrameBuffer* fb, int fd, size_t* requested) {
+    if (requested != NULL) {
+        *requested = 0;
+    }
+    if (fb == NULL || fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t free_bytes = frame_buffer_space(fb);
+    if (free_bytes < FRAME_MAX_SIZE || free_bytes < fb->capacity / 4) {
+        frame_buffer_grow(fb, fb->capacity / 2 + FRAME_MAX_SIZE);
+        free_bytes = frame_buffer_space(fb);
+    }
+    if (free_bytes == 0) {
+        return 0;
+    }
+
+    struct iovec iov[2];
+    size_t pos = fb->tail & (fb->capacity - 1);
+    size_t first = fb->capacity - pos;
+    if (first > free_bytes) {
+        first = free_bytes;
+    }
+    iov[0].iov_base = fb->data + pos;
+    iov[0].iov_len = first;
+    int iov_count = 1;
+    if (free_bytes > first) {
+        iov[1].iov_base = fb->data;
+        iov[1].iov_len = free_bytes - first;
+        iov_count = 2;
+    }
+    if (requested != NULL) {
+        *requested = free_bytes;
+    }
+    ssize_t bytes = readv(fd, iov, iov_count);
+    if (bytes > 0) {
+        fb->tail += (size_t)bytes;
+    }
+    return bytes;
+}
+
+// Longest run of readable bytes starting at head that does not wrap
+size_t frame_buffer_contiguous(const FrameBuffer* fb, const uint8_t** out) {
+    if (fb == NULL) return 0;
+    size_t length = fb->tail - fb->head;
+    if (length == 0) {
+        return 0;
+    }
+    size_t pos = fb->head & (fb->capacity - 1);
+    size_t run = fb->capacity - pos;
+    if (run > length) {
+        run = length;
+    }
+    if (out != NULL) {
+        *out = fb->data + pos;
+    }
+    return run;
+}
+
+/**
+ * Expose the frame at the head of the ring without consuming it.
+ * On FRAME_PARSE_INVALID / FRAME_PARSE_BAD_CHECKSUM the view is still filled
+ * so the caller can read the origin to NACK it. Call frame_buffer_consume()
+ * with FRAME_MAX_SIZE once the frame has been handled.
+ */
+FrameParseResult frame_buffer_peek_view(FrameBuffer* fb, FrameView* view) {
+    if (fb == NULL || view == NULL) {
+        return FRAME_PARSE_INVALID;
+    }
+    if (fb->tail - fb->head < FRAME_MAX_SIZE) {
+        return FRAME_PARSE_NEED_MORE;
+    }
+    const uint8_t* run = NULL;
+    size_t run_len = frame_buffer_contiguous(fb, &run);
+    if (run_len >= FRAME_MAX_SIZE) {
+        view->bytes = run;
+    } else {
+        memcpy(view->scratch, run, run_len);
+        memcpy(view->scratch + run_len, fb->data, FRAME_MAX_SIZE - run_len);
+        view->bytes = view->scratch;
+    }
+    return frame_validate_bytes(view->bytes);
+}
+
+/**
+ * Compact counterpart of frame_buffer_peek_view() for a connection that
+ * switched to compact frames: the frame at the head is expanded into the
+ * view's scratch as the 320-byte frame it stands for, so everything past the
+ * receive path sees one format. `*length` is what to consume once handled.
+ * The checksum is checked over the bytes received only.
+ */
+FrameParseResult frame_buffer_peek_compact(FrameBuffer* fb, FrameView* view, size_t* length) {
+    if (fb == NULL || view == NULL || length == NULL) {
+        return FRAME_PARSE_INVALID;
+    }
+    size_t available = fb->tail - fb->head;
+    if (available < FRAME_HEADER_LEN + FRAME_CHECKSUM_LEN) {
+        return FRAME_PARSE_NEED_MORE;
+    }
+    size_t mask = fb->capacity - 1;
+    uint16_t data_len = (uint16_t)((fb->data[(fb->head + FRAME_HEADER_LEN - 2) & mask] << 8) |
+                                   fb->data[(fb->head + FRAME_HEADER_LEN - 1) & mask]);
+    if (data_len > FRAME_MAX_DATA) {
+        return FRAME_PARSE_INVALID;
+    }
+    size_t used = FRAME_HEADER_LEN + data_len;
+    size_t total = used + FRAME_CHECKSUM_LEN;
+    if (available < total) {
+        return FRAME_PARSE_NEED_MORE;
+    }
+
+    uint8_t* frame = view->scratch;
+    size_t pos = fb->head & mask;
+    if (fb->capacity - pos >= total) {
+        memcpy(frame, fb->data + pos, used);
+        frame[FRAME_MAX_SIZE - 2] = fb->data[pos + used];
+        frame[FRAME_MAX_SIZE - 1] = fb->data[pos + used + 1];
+    } else {
+        for (size_t i = 0; i < total; i++) {
+            uint8_t byte = fb->data[(fb->head + i) & mask];
+            if (i < used) {
+                frame[i] = byte;
+            } else {
+                frame[FRAME_MAX_SIZE - FRAME_CHECKSUM_LEN + (i - used)] = byte;
+            }
+        }
+    }
+    memset(frame + used, 0, FRAME_MAX_SIZE - FRAME_CHECKSUM_LEN - used);
+    view->bytes = frame;
+    *length = total;
+    return frame_check_checksum(frame, checksum_compute_padded(frame, used, FRAME_MAX_SIZE - FRAME_CHECKSUM_LEN));
+}
+
 FrameParseResult frame_buffer_extract(FrameBuffer* fb, CitadelFrame* frame, size_t* consumed_bytes) {
     if (fb == NULL || frame == NULL) {
         return FRAME_PARSE_INVALID;
     }
-    if (fb->length == 0) {
-        if (consumed_bytes) {
-            *consumed_bytes = 0;
-        }
-        return FRAME_PARSE_NEED_MORE;
+    if (consumed_bytes) {
+        *consumed_bytes = 0;
     }
 
-    size_t consumed = 0;
-    FrameParseResult result = frame_deserialize(fb->data, fb->length, frame, &consumed);
+    FrameView view;
+    FrameParseResult result = frame_buffer_peek_view(fb, &view);
+    if (result == FRAME_PARSE_NEED_MORE) {
+        return result;
+    }
+    if (result != FRAME_PARSE_INVALID) {
+        frame_decode_bytes(view.bytes, frame);
+    }
     if (result == FRAME_PARSE_OK) {
-        frame_buffer_consume(fb, consumed);
+        frame_buffer_consume(fb, FRAME_MAX_SIZE);
         if (consumed_bytes) {
-            *consumed_bytes = consumed;
+            *consumed_bytes = FRAME_MAX_SIZE;
         }
         return FRAME_PARSE_OK;
     }
-    if (result == FRAME_PARSE_BAD_CHECKSUM || result == FRAME_PARSE_INVALID) {
-        frame_buffer_reset(fb);
+    frame_buffer_reset(fb);
+    return result;
+}
+
+FrameType frame_view_type(const FrameView* view) {
+    return (FrameType)view->bytes[0];
+}
+
+uint16_t frame_view_data_length(const FrameView* view) {
+    return (uint16_t)((view->bytes[FRAME_HEADER_LEN - 2] << 8) | view->bytes[FRAME_HEADER_LEN - 1]);
+}
+
+const uint8_t* frame_view_data(const FrameView* view) {
+    return view->bytes + FRAME_HEADER_LEN;
+}
+
+// Case-insensitive compare of the padded DESTINATION field against `realm`, in place
+int frame_view_destination_is(const FrameView* view, const char* realm) {
+    if (view == NULL || realm == NULL) return 0;
+    const uint8_t* field = view->bytes + 1 + FRAME_ORIGIN_LEN;
+    size_t i = 0;
+    for (; i < FRAME_DEST_LEN && realm[i] != '\0'; i++) {
+        char a = (char)field[i];
+        char b = realm[i];
+        if (a >= 'a' && a <= 'z') a = a - 'a' + 'A';
+        if (b >= 'a' && b <= 'z') b = b - 'a' + 'A';
+        if (a != b) return 0;
+    }
+    if (realm[i] != '\0') return 0;
+    // Same rule as frame_extract_field(): the name ends at NUL, trailing spaces are padding
+    while (i < FRAME_DEST_LEN && field[i] == ' ') {
+        i++;
     }
-    if (consumed_bytes) {
-        *consumed_bytes = consumed;
+    return (i == FRAME_DEST_LEN || field[i] == '\0');
+}
+
+void frame_view_origin(const FrameView* view, char* dst, size_t dst_len) {
+    frame_extract_field(view->bytes + 1, FRAME_ORIGIN_LEN, dst, dst_len);
+}
+
+void frame_view_destination(const FrameView* view, char* dst, size_t dst_len) {
+    frame_extract_field(view->bytes + 1 + FRAME_ORIGIN_LEN, FRAME_DEST_LEN, dst, dst_len);
+}
+
+void frame_view_to_frame(const FrameView* view, CitadelFrame* frame) {
+    frame_decode_bytes(view->bytes, frame);
+}
+
+void send_pool_init(SendSlotPool* pool, size_t max_bytes) {
+    if (pool == NULL) return;
+    pool->free_list = NULL;
+    pool->free_count = 0;
+    pool->allocated = 0;
+    pool->max_slots = max_bytes / SEND_SLOT_SIZE;
+    if (pool->max_slots == 0) {
+        pool->max_slots = 1;
     }
-    return result;
 }
 
-static Route* maester_find_route(Maester* maester, const char* realm) {
-    if (maester == NULL || realm == NULL) return NULL;
-    for (int i = 0; i < maester->num_routes; i++) {
-        if (my_strcasecmp(maester->routes[i].realm, realm) == 0) {
-            return &maester->routes[i];
+void send_pool_destroy(SendSlotPool* pool) {
+    if (pool == NULL) return;
+    while (pool->free_list != NULL) {
+        SendSlot* slot = pool->free_list;
+        pool->free_list = slot->next;
+        free(slot);
+    }
+    pool->free_count = 0;
+    pool->allocated = 0;
+}
+
+static SendSlot* send_pool_get(SendSlotPool* pool) {
+    SendSlot* slot = pool->free_list;
+    if (slot != NULL) {
+        pool->free_list = slot->next;
+        pool->free_count--;
+    } else {
+        if (pool->allocated >= pool->max_slots) {
+            return NULL;
+        }
+        slot = (SendSlot*)malloc(sizeof(SendSlot));
+        if (slot == NULL) {
+            return NULL;
         }
+        pool->allocated++;
     }
-    return NULL;
+    slot->next = NULL;
+    slot->length = 0;
+    slot->offset = 0;
+    return slot;
 }
 
-static Route* maester_find_default_route(Maester* maester) {
-    if (maester == NULL) return NULL;
+static void send_pool_put(SendSlotPool* pool, SendSlot* slot) {
+    if (pool->free_count >= SEND_POOL_KEEP_FREE) {
+        free(slot);
+        pool->allocated--;
+        return;
+    }
+    slot->next = pool->free_list;
+    pool->free_list = slot;
+    pool->free_count++;
+}
+
+void send_queue_init(SendQueue* queue, SendSlotPool* pool, size_t max_bytes) {
+    if (queue == NULL) return;
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->slots = 0;
+    queue->bytes = 0;
+    queue->max_slots = (max_bytes + SEND_SLOT_SIZE - 1) / SEND_SLOT_SIZE;
+    queue->pool = pool;
+    queue->kept = NULL;
+    queue->keep_frames = 0;
+    queue->frames_queued = 0;
+    queue->corrupt_ppm = 0;
+    queue->corrupt_state = 0;
+    queue->repair = NULL;
+}
+
+/**
+ * Keep the last `frames` frames queued on the connection so a NACK naming
+ * one can have it written again (0: none). In the test mode, `corrupt_ppm`
+ * frames per million go out with a damaged byte; the kept copy stays intact.
+ */
+void send_queue_keep_frames(SendQueue* queue, size_t frames, uint32_t corrupt_ppm, LinkRepairStats* repair) {
+    if (queue == NULL) return;
+    queue->keep_frames = frames;
+    queue->corrupt_ppm = corrupt_ppm;
+    queue->corrupt_state = ((uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)queue) | 1;
+    queue->repair = repair;
+}
+
+/**
+ * Account for one frame about to be queued behind everything else: it takes
+ * the next index on the connection and a copy goes into the resend ring.
+ * Returns the bytes to write: `frame`, or in the corruption test mode
+ * sometimes `out` holding a damaged copy (`out` may be `frame` itself when
+ * the frame was built in place).
+ */
+const uint8_t* send_queue_note_frame(SendQueue* queue, const uint8_t* frame, uint8_t* out) {
+    if (queue == NULL || frame == NULL) return frame;
+    if (queue->kept == NULL && queue->keep_frames > 0) {
+        queue->kept = (uint8_t*)malloc(queue->keep_frames * FRAME_MAX_SIZE);
+        if (queue->kept == NULL) {
+            queue->keep_frames = 0;   // Carry on without resends
+        }
+    }
+    if (queue->kept != NULL) {
+        memcpy(queue->kept + (size_t)(queue->frames_queued % queue->keep_frames) * FRAME_MAX_SIZE,
+               frame, FRAME_MAX_SIZE);
+    }
+    queue->frames_queued++;
+
+    if (queue->corrupt_ppm == 0 || out == NULL) {
+        return frame;
+    }
+    uint32_t x = queue->corrupt_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    queue->corrupt_state = x;
+    if (x % 1000000 >= queue->corrupt_ppm) {
+        return frame;
+    }
+    if (out != frame) {
+        memcpy(out, frame, FRAME_MAX_SIZE);
+    }
+    // The stored checksum: it goes out in either wire form, and the header
+    // still names who to NACK
+    out[FRAME_MAX_SIZE - FRAME_CHECKSUM_LEN] ^= 0x5A;
+    if (queue->repair != NULL) {
+        __atomic_fetch_add(&queue->repair->corrupted, 1, __ATOMIC_RELAXED);
+    }
+    return out;
+}
+
+// Copy kept frame number `index` into `out`; -1 once it has left the ring.
+// The oldest slot is not served: a frame that failed to queue may sit there.
+int send_queue_kept_frame(const SendQueue* queue, uint64_t index, uint8_t* out) {
+    if (queue == NULL || queue->kept == NULL || out == NULL ||
+        index >= queue->frames_queued || queue->frames_queued - index >= queue->keep_frames) {
+        return -1;
+    }
+    memcpy(out, queue->kept + (size_t)(index % queue->keep_frames) * FRAME_MAX_SIZE, FRAME_MAX_SIZE);
+    return 0;
+}
+
+/**
+ * Queue `length` bytes behind whatever is pending. Small writes are packed into
+ * the room left in the tail slot before new slots are taken from the pool.
+ * Either everything is queued or nothing is: returns -1 when the connection or
+ * pool memory limit would be exceeded.
+ */
+int send_queue_append(SendQueue* queue, const uint8_t* data, size_t length) {
+    if (queue == NULL || queue->pool == NULL || data == NULL) return -1;
+    if (length == 0) return 0;
+
+    size_t tail_room = (queue->tail != NULL) ? SEND_SLOT_SIZE - queue->tail->length : 0;
+    size_t needed = (length > tail_room) ? (length - tail_room + SEND_SLOT_SIZE - 1) / SEND_SLOT_SIZE : 0;
+    SendSlotPool* pool = queue->pool;
+    if (queue->slots + needed > queue->max_slots ||
+        (pool->allocated - pool->free_count) + needed > pool->max_slots) {
+        return -1;
+    }
+
+    size_t copied = 0;
+    if (tail_room > 0) {
+        size_t chunk = (length < tail_room) ? length : tail_room;
+        memcpy(queue->tail->data + queue->tail->length, data, chunk);
+        queue->tail->length += (uint16_t)chunk;
+        copied = chunk;
+    }
+    while (copied < length) {
+        SendSlot* slot = send_pool_get(pool);
+        if (slot == NULL) {
+            // Only reachable on malloc failure; keep the bytes queued so far consistent
+            send_queue_set_bytes(queue, queue->bytes + copied);
+            return -1;
+        }
+        size_t chunk = length - copied;
+        if (chunk > SEND_SLOT_SIZE) {
+            chunk = SEND_SLOT_SIZE;
+        }
+        memcpy(slot->data, data + copied, chunk);
+        slot->length = (uint16_t)chunk;
+        if (queue->tail != NULL) {
+            queue->tail->next = slot;
+        } else {
+            queue->head = slot;
+        }
+        queue->tail = slot;
+        queue->slots++;
+        copied += chunk;
+    }
+    send_queue_set_bytes(queue, queue->bytes + length);
+    return 0;
+}
+
+/**
+ * Append one fresh slot holding `length` bytes (at most SEND_SLOT_SIZE) and
+ * return its storage for the caller to fill in place. Same limits as
+ * send_queue_append(); NULL when they would be exceeded.
+ */
+uint8_t* send_queue_reserve(SendQueue* queue, size_t length) {
+    if (queue == NULL || queue->pool == NULL || length == 0 || length > SEND_SLOT_SIZE) return NULL;
+    SendSlotPool* pool = queue->pool;
+    if (queue->slots + 1 > queue->max_slots ||
+        (pool->allocated - pool->free_count) + 1 > pool->max_slots) {
+        return NULL;
+    }
+    SendSlot* slot = send_pool_get(pool);
+    if (slot == NULL) {
+        return NULL;
+    }
+    slot->length = (uint16_t)length;
+    if (queue->tail != NULL) {
+        queue->tail->next = slot;
+    } else {
+        queue->head = slot;
+    }
+    queue->tail = slot;
+    queue->slots++;
+    send_queue_set_bytes(queue, queue->bytes + length);
+    return slot->data;
+}
+
+// Shorten the slot just reserved to `length` bytes (a frame built in place,
+// then compacted)
+void send_queue_trim_tail(SendQueue* queue, size_t length) {
+    if (queue == NULL || queue->tail == NULL || length > queue->tail->length) return;
+    send_queue_set_bytes(queue, queue->bytes - (queue->tail->length - length));
+    queue->tail->length = (uint16_t)length;
+}
+
+// Release `bytes` from the front of the queue, returning drained slots to the pool
+void send_queue_consume(SendQueue* queue, size_t bytes) {
+    if (queue == NULL) return;
+    while (bytes > 0 && queue->head != NULL) {
+        SendSlot* slot = queue->head;
+        size_t left = (size_t)(slot->length - slot->offset);
+        if (bytes < left) {
+            slot->offset += (uint16_t)bytes;
+            send_queue_set_bytes(queue, queue->bytes - bytes);
+            return;
+        }
+        bytes -= left;
+        send_queue_set_bytes(queue, queue->bytes - left);
+        queue->head = slot->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+        queue->slots--;
+        send_pool_put(queue->pool, slot);
+    }
+}
+
+void send_queue_clear(SendQueue* queue) {
+    if (queue == NULL) return;
+    while (queue->head != NULL) {
+        SendSlot* slot = queue->head;
+        queue->head = slot->next;
+        if (queue->pool != NULL) {
+            send_pool_put(queue->pool, slot);
+        } else {
+            free(slot);
+        }
+    }
+    queue->tail = NULL;
+    queue->slots = 0;
+    send_queue_set_bytes(queue, 0);
+    free(queue->kept);
+    queue->kept = NULL;
+}
+
+// Only the owning shard writes `bytes`; other shards read it to decide
+// whether to forward into the queue
+static void send_queue_set_bytes(SendQueue* queue, size_t bytes) {
+    __atomic_store_n(&queue->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+// Describe the unsent bytes as up to `max_iov` iovecs (one per slot) for writev()
+int send_queue_iov(const SendQueue* queue, struct iovec* iov, int max_iov) {
+    if (queue == NULL || iov == NULL) return 0;
+    int count = 0;
+    for (SendSlot* slot = queue->head; slot != NULL && count < max_iov; slot = slot->next) {
+        iov[count].iov_base = slot->data + slot->offset;
+        iov[count].iov_len = (size_t)(slot->length - slot->offset);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Compile the route table into a case-insensitive hash index: each route's
+ * "known" flag is computed once and the usable DEFAULT route is remembered, so
+ * resolving a destination is one hash probe whatever the table size.
+ * Duplicate realms keep the first entry, as the old linear scan did.
+ */
+static int maester_build_route_index(Maester* maester) {
+    RouteIndex* index = &maester->route_index;
+    size_t capacity = 16;
+    while (capacity < (size_t)maester->num_routes * 2) {
+        capacity <<= 1;
+    }
+    int* buckets = (int*)calloc(capacity, sizeof(int));
+    if (buckets == NULL) {
+        return -1;
+    }
+    index->default_route = -1;
     for (int i = 0; i < maester->num_routes; i++) {
-        if (my_strcasecmp(maester->routes[i].realm, ROUTE_DEFAULT) == 0) {
-            return &maester->routes[i];
+        Route* route = &maester->routes[i];
+        route->known = (my_strcmp(route->ip, "*.*.*.*") != 0 && route->port > 0);
+        size_t pos = str_hash_nocase(route->realm) & (capacity - 1);
+        int duplicate = 0;
+        while (buckets[pos] != 0) {
+            if (my_strcasecmp(maester->routes[buckets[pos] - 1].realm, route->realm) == 0) {
+                duplicate = 1;
+                break;
+            }
+            pos = (pos + 1) & (capacity - 1);
+        }
+        if (duplicate) {
+            continue;
+        }
+        buckets[pos] = i + 1;
+        if (my_strcasecmp(route->realm, ROUTE_DEFAULT) == 0 && route->known) {
+            index->default_route = i;
         }
     }
-    return NULL;
+    free(index->buckets);
+    index->buckets = buckets;
+    index->capacity = capacity;
+    __atomic_store_n(&index->dirty, 0, __ATOMIC_RELEASE);
+    return 0;
 }
 
-static int maester_route_is_known(const Route* route) {
-    if (route == NULL) return 0;
-    if (my_strcmp(route->ip, "*.*.*.*") == 0) {
-        return 0;
+static Route* maester_find_route(Maester* maester, const char* realm) {
+    RouteIndex* index = &maester->route_index;
+    size_t pos = str_hash_nocase(realm) & (index->capacity - 1);
+    while (index->buckets[pos] != 0) {
+        Route* route = &maester->routes[index->buckets[pos] - 1];
+        if (my_strcasecmp(route->realm, realm) == 0) {
+            return route;
+        }
+        pos = (pos + 1) & (index->capacity - 1);
     }
-    return route->port > 0;
+    return NULL;
 }
 
 Route* maester_resolve_route(Maester* maester, const char* destination, int* used_default) {
     if (used_default != NULL) {
         *used_default = 0;
     }
+    if (maester == NULL || destination == NULL) return NULL;
+    if (__atomic_load_n(&maester->route_index.dirty, __ATOMIC_ACQUIRE)) {
+        // Any thread may be the first to resolve after add_route()
+        pthread_mutex_lock(&maester->routes_lock);
+        int failed = maester->route_index.dirty && maester_build_route_index(maester) != 0;
+        pthread_mutex_unlock(&maester->routes_lock);
+        if (failed) {
+            write_str(STDERR_FILENO, "Error: Unable to build route index.\n");
+            return NULL;
+        }
+    }
     Route* direct = maester_find_route(maester, destination);
-    if (direct != NULL && maester_route_is_known(direct)) {
+    if (direct != NULL && direct->known) {
         return direct;
     }
-    Route* def = maester_find_default_route(maester);
-    if (def != NULL && maester_route_is_known(def)) {
+    if (maester->route_index.default_route >= 0) {
         if (used_default != NULL) {
             *used_default = 1;
         }
-        return def;
+        return &maester->routes[maester->route_index.default_route];
     }
     return NULL;
 }
@@ -340,49 +1066,322 @@ void maester_log_route_resolution(const char* destination, const Route* route, i
     write_str(STDOUT_FILENO, ").\n");
 }
 
-static ConnectionEntry* maester_find_connection(Maester* maester, const char* realm) {
-    if (maester == NULL || realm == NULL) return NULL;
-    for (int i = 0; i < maester->num_connections; i++) {
-        if (my_strcasecmp(maester->connections[i].peer_realm, realm) == 0) {
-            return &maester->connections[i];
-        }
-    }
-    return NULL;
+// True when the calling thread may use the entry's socket and queues directly:
+// it runs the owning shard, or no shard is running (startup, shutdown).
+static int maester_connection_is_local(const ConnectionEntry* entry) {
+    return !shard_running(entry->shard) || entry->shard == shard_current();
 }
 
+// The io_uring driving the entry, or NULL when it is on epoll or its shard has
+// stopped (shutdown then flushes and closes it with plain syscalls)
+static Uring* maester_connection_uring(const ConnectionEntry* entry) {
+    if (entry->uring == NULL || !shard_running(entry->shard)) return NULL;
+    return entry->uring;
+}
+
+/**
+ * Take a connection slot and bind it to its owning shard's buffer pools.
+ * Caller holds connections_lock.
+ */
 ConnectionEntry* maester_add_connection_entry(Maester* maester) {
     if (maester == NULL) return NULL;
-    if (maester->num_connections >= maester->connections_capacity) {
-        int new_capacity = (maester->connections_capacity == 0) ? 4 : maester->connections_capacity * 2;
-        ConnectionEntry* new_entries = (ConnectionEntry*)realloc(maester->connections, new_capacity * sizeof(ConnectionEntry));
-        if (new_entries == NULL) {
-            write_str(STDERR_FILENO, "Error: Unable to expand connection table.\n");
-            return NULL;
-        }
-        maester->connections = new_entries;
-        maester->connections_capacity = new_capacity;
+    ConnectionEntry* entry = connection_table_acquire(&maester->connections);
+    if (entry == NULL) {
+        write_str(STDERR_FILENO, "Error: Unable to expand connection table.\n");
+        return NULL;
     }
-    ConnectionEntry* entry = &maester->connections[maester->num_connections++];
-    memset(entry, 0, sizeof(ConnectionEntry));
-    entry->sockfd = -1;
+    Shard* shard = shard_assign(maester);
+    entry->shard = shard;
     frame_buffer_init(&entry->recv_buffer);
-    frame_buffer_init(&entry->send_buffer);
+    frame_buffer_configure(&entry->recv_buffer, (shard != NULL) ? &shard->recv_pool : &maester->recv_pool,
+                           (size_t)maester->tuning.recv_buffer_kb * 1024);
+    send_queue_init(&entry->send_queue, (shard != NULL) ? &shard->send_pool : &maester->send_pool,
+                    (size_t)maester->tuning.send_queue_kb * 1024);
+    send_queue_keep_frames(&entry->send_queue, (size_t)maester->tuning.resend_frames,
+                           (uint32_t)maester->tuning.corrupt_ppm, &maester->repair);
     return entry;
 }
 
+/**
+ * Start watching the entry's socket on its owning shard. From any other
+ * thread this only queues the request; the shard registers the socket when it
+ * gets to it. The reactor tag is the entry's handle, so events for a recycled
+ * slot are ignored.
+ */
+int maester_register_connection(Maester* maester, ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL || entry->sockfd < 0) return -1;
+    if (!maester_connection_is_local(entry)) {
+        if (shard_post(entry->shard, QUEUED_ADOPT, connection_handle(entry), NULL, 0) != 0) {
+            write_str(STDERR_FILENO, "Error: Network worker queue is full.\n");
+            return -1;
+        }
+        return 0;
+    }
+    Shard* shard = entry->shard;
+    if (!shard_running(shard)) return 0;  // No network thread (e.g. during shutdown)
+    if (shard->uring != NULL) {
+        entry->uring = shard->uring;
+        if (uring_connection_sync(shard->uring, entry) != 0) {
+            write_str(STDERR_FILENO, "Error: Unable to register connection with io_uring.\n");
+            return -1;
+        }
+        if (entry->state == CONNECTION_CONNECTING) {
+            shard->connects_pending = 1;
+        }
+        maester_link_offer(maester, entry);
+        return 0;
+    }
+    uint64_t tag = connection_handle(entry);
+    uint32_t events = REACTOR_READABLE;
+    if (entry->state == CONNECTION_CONNECTING || maester_connection_has_pending_send(entry)) {
+        events |= REACTOR_WRITABLE;
+    }
+    if (reactor_add(&shard->reactor, entry->sockfd, events, tag) != 0) {
+        write_str(STDERR_FILENO, "Error: Unable to register connection with the reactor.\n");
+        return -1;
+    }
+    entry->reactor = &shard->reactor;
+    entry->reactor_tag = tag;
+    entry->reactor_events = events;
+    if (entry->state == CONNECTION_CONNECTING) {
+        shard->connects_pending = 1;
+    }
+    maester_link_offer(maester, entry);
+    return 0;
+}
+
+/**
+ * LINK_OPTIONS from the neighbour on `entry`: "<verb>&<its end>&<our end>&
+ * COMPACT", the ends of the socket as the sender sees them. Ignored unless
+ * they are this socket's two ends: an offer that a neighbour without the
+ * feature forwarded elsewhere arrives on a socket with other ends. An offer
+ * is taken by announcing the switch, as the last fixed-size frame, and
+ * sending compact frames from then on; the neighbour's own switch marks
+ * where its compact frames begin. Run by the shard owning `entry`.
+ */
+void maester_handle_link_options(Maester* maester, ConnectionEntry* entry, const FrameView* view) {
+    if (maester == NULL || entry == NULL || view == NULL || !maester->tuning.compact_frames) return;
+    char text[FRAME_MAX_DATA + 1];
+    uint16_t length = frame_view_data_length(view);
+    memcpy(text, frame_view_data(view), length);
+    text[length] = '\0';
+
+    char fields[4][LINK_ADDRESS_MAX];
+    const char* p = text;
+    for (int i = 0; i < 4; i++) {
+        int n = 0;
+        while (*p != '\0' && *p != '&') {
+            if (n < LINK_ADDRESS_MAX - 1) fields[i][n++] = *p;
+            p++;
+        }
+        fields[i][n] = '\0';
+        if (*p == '&') p++;
+    }
+    char local[LINK_ADDRESS_MAX];
+    char remote[LINK_ADDRESS_MAX];
+    if (maester_link_addresses(entry, local, remote) != 0 ||
+        my_strcmp(fields[1], remote) != 0 || my_strcmp(fields[2], local) != 0 ||
+        my_strcmp(fields[3], LINK_OPTION_COMPACT) != 0) {
+        return;
+    }
+
+    if (my_strcmp(fields[0], LINK_OPTIONS_OFFER) == 0 && !entry->compact_send) {
+        if (maester_send_link_options(maester, entry, LINK_OPTIONS_SWITCH) == 0) {
+            entry->compact_send = 1;
+            __atomic_fetch_add(&maester->compact_links.sending, 1, __ATOMIC_RELAXED);
+        }
+    } else if (my_strcmp(fields[0], LINK_OPTIONS_SWITCH) == 0 && !entry->compact_recv) {
+        entry->compact_recv = 1;
+        __atomic_fetch_add(&maester->compact_links.receiving, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Offer compact frames to the neighbour on a freshly registered socket
+static void maester_link_offer(Maester* maester, ConnectionEntry* entry) {
+    if (maester->tuning.compact_frames) {
+        maester_send_link_options(maester, entry, LINK_OPTIONS_OFFER);
+    }
+}
+
+static int maester_send_link_options(Maester* maester, ConnectionEntry* entry, const char* verb) {
+    char local[LINK_ADDRESS_MAX];
+    char remote[LINK_ADDRESS_MAX];
+    if (maester_link_addresses(entry, local, remote) != 0) {
+        return -1;
+    }
+    // Addressed like DISCONNECT; a neighbour that does not know the type
+    // handles it as any other frame for that destination
+    const char* destination = (entry->peer_realm[0] != '\0') ? entry->peer_realm : entry->peer_ip;
+    CitadelFrame frame;
+    frame_init(&frame, FRAME_TYPE_LINK_OPTIONS, maester->realm_name, destination);
+    char payload[FRAME_MAX_DATA + 1];
+    payload[0] = '\0';
+    safe_append(payload, sizeof(payload), verb);
+    safe_append(payload, sizeof(payload), "&");
+    safe_append(payload, sizeof(payload), local);
+    safe_append(payload, sizeof(payload), "&");
+    safe_append(payload, sizeof(payload), remote);
+    safe_append(payload, sizeof(payload), "&" LINK_OPTION_COMPACT);
+    frame.data_length = (uint16_t)my_strlen(payload);
+    memcpy(frame.data, payload, frame.data_length);
+    return maester_send_frame(entry, &frame);
+}
+
+// The socket's two ends as "ip:port": ours (getsockname) and the peer's
+static int maester_link_addresses(const ConnectionEntry* entry, char* local, char* remote) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(entry->sockfd, (struct sockaddr*)&addr, &addr_len) != 0) {
+        return -1;
+    }
+    maester_format_address(&addr, local);
+    maester_format_address(&entry->addr, remote);
+    return 0;
+}
+
+static void maester_format_address(const struct sockaddr_in* addr, char* out) {
+    char ip[IP_ADDR_MAX];
+    char port[16];
+    if (inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip)) == NULL) {
+        ip[0] = '\0';
+    }
+    int_to_str(ntohs(addr->sin_port), port);
+    out[0] = '\0';
+    safe_append(out, LINK_ADDRESS_MAX, ip);
+    safe_append(out, LINK_ADDRESS_MAX, ":");
+    safe_append(out, LINK_ADDRESS_MAX, port);
+}
+
+/**
+ * Register a socket returned by accept(): index it by ip:port and hand it to
+ * a shard. Returns NULL (socket closed) on failure.
+ */
+ConnectionEntry* maester_add_accepted_connection(Maester* maester, int fd, const struct sockaddr_in* addr) {
+    if (maester == NULL || fd < 0 || addr == NULL) return NULL;
+    pthread_mutex_lock(&maester->connections_lock);
+    ConnectionEntry* entry = maester_add_connection_entry(maester);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&maester->connections_lock);
+        close(fd);
+        return NULL;
+    }
+    set_socket_nodelay(fd);
+    entry->sockfd = fd;
+    entry->addr = *addr;
+    entry->last_used = time(NULL);
+    inet_ntop(AF_INET, &addr->sin_addr, entry->peer_ip, sizeof(entry->peer_ip));
+    entry->peer_port = ntohs(addr->sin_port);
+    entry->peer_realm[0] = '\0';  // Unknown realm until we receive a frame
+    int indexed = connection_table_index(entry);
+    pthread_mutex_unlock(&maester->connections_lock);
+
+    if (indexed != 0) {
+        write_str(STDERR_FILENO, "Error: Unable to index connection.\n");
+    }
+    if (indexed != 0 || maester_register_connection(maester, entry) != 0) {
+        maester_close_connection_entry(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+ConnectionEntry* maester_connection_from_tag(Maester* maester, uint64_t tag) {
+    if (maester == NULL) return NULL;
+    // A slot closed earlier in the same batch fails the generation check
+    return connection_table_lookup(&maester->connections, tag);
+}
+
+// Carry out a request another thread queued for this shard
+void maester_apply_queued(Maester* maester, Shard* shard, const QueuedFrame* item) {
+    if (maester == NULL || shard == NULL || item == NULL) return;
+    ConnectionEntry* entry = connection_table_lookup(&maester->connections, item->handle);
+    if (entry == NULL || entry->shard != shard) {
+        return;  // Closed (and maybe reused) since the request was queued
+    }
+    switch (item->kind) {
+        case QUEUED_SEND:
+            maester_queue_bytes(entry, item->bytes, item->length, 0);
+            __atomic_fetch_sub(&entry->posted, (size_t)item->length, __ATOMIC_RELAXED);
+            break;
+        case QUEUED_ADOPT:
+            if (maester_register_connection(maester, entry) != 0) {
+                maester_close_connection_entry(entry);
+            }
+            break;
+        case QUEUED_CLOSE:
+            maester_close_connection_entry(entry);
+            break;
+        case QUEUED_TRANSFER:
+            transfer_pump(maester, entry);
+            break;
+        case QUEUED_RESUME:
+            maester_resume_reading(maester, entry);
+            break;
+    }
+}
+
+// Refill the entry's send queue from its outgoing transfers, on the owning shard
+int maester_wake_transfers(Maester* maester, ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL || entry->sockfd < 0) return -1;
+    if (!maester_connection_is_local(entry)) {
+        return shard_post(entry->shard, QUEUED_TRANSFER, connection_handle(entry), NULL, 0);
+    }
+    transfer_pump(maester, entry);
+    return 0;
+}
+
+// Watch for writability exactly while bytes are queued (io_uring: schedule the send chain)
+void maester_connection_update_interest(ConnectionEntry* entry) {
+    if (entry == NULL || entry->sockfd < 0) return;
+    Uring* ring = maester_connection_uring(entry);
+    if (ring != NULL) {
+        uring_connection_sync(ring, entry);
+        return;
+    }
+    if (entry->reactor == NULL) return;
+    // A held connection is not read (errors and hangups are reported all the same)
+    uint32_t events = entry->held ? 0 : REACTOR_READABLE;
+    // Connect completion is reported as writability
+    if (entry->state == CONNECTION_CONNECTING || maester_connection_has_pending_send(entry)) {
+        events |= REACTOR_WRITABLE;
+    }
+    if (events == entry->reactor_events) return;
+    if (reactor_modify(entry->reactor, entry->sockfd, events, entry->reactor_tag) == 0) {
+        entry->reactor_events = events;
+    }
+}
+
+// Close on the owning shard (queued there when called from another thread)
 void maester_close_connection_entry(ConnectionEntry* entry) {
-    if (entry == NULL) return;
+    if (entry == NULL || entry->table == NULL) return;
+    if (!maester_connection_is_local(entry)) {
+        shard_post(entry->shard, QUEUED_CLOSE, connection_handle(entry), NULL, 0);
+        return;
+    }
+    ConnectionTable* table = entry->table;
+    if (entry->sockfd >= 0 && entry->reactor != NULL) {
+        reactor_remove(entry->reactor, entry->sockfd);
+    }
+    Uring* ring = maester_connection_uring(entry);
+    if (ring != NULL) {
+        uring_connection_cancel(ring, entry);
+    }
+    entry->reactor = NULL;
+    entry->uring = NULL;
+    frame_buffer_release(&entry->recv_buffer);
+    send_queue_clear(&entry->send_queue);
+
+    // Once released the slot may be handed out again at any moment (and is
+    // cleared by connection_table_acquire), so nothing is touched afterwards
+    pthread_mutex_lock(table->lock);
     if (entry->sockfd >= 0) {
         close(entry->sockfd);
         entry->sockfd = -1;
     }
-    entry->peer_realm[0] = '\0';
-    entry->peer_ip[0] = '\0';
-    entry->peer_port = 0;
-    entry->last_used = 0;
-    memset(&entry->addr, 0, sizeof(entry->addr));
-    frame_buffer_reset(&entry->recv_buffer);
-    frame_buffer_reset(&entry->send_buffer);
+    entry->shard = NULL;
+    // Unindex while the key fields are still intact
+    connection_table_release(entry);
+    pthread_mutex_unlock(table->lock);
 }
 
 static int set_socket_nonblocking(int fd) {
@@ -396,27 +1395,87 @@ static int set_socket_nonblocking(int fd) {
     return 0;
 }
 
+// Frames leave in small bursts (a window refill, an ACK): Nagle would hold
+// them until the peer's delayed ACK, stalling windowed transfers ~40 ms
+static void set_socket_nodelay(int fd) {
+    int enable = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) < 0) {
+        write_str(STDERR_FILENO, "Warning: setsockopt(TCP_NODELAY) failed.\n");
+    }
+}
+
+static void maester_log_connected(const ConnectionEntry* entry) {
+    char port_buf[16];
+    int_to_str(entry->peer_port, port_buf);
+    write_str(STDOUT_FILENO, "Connected to ");
+    write_str(STDOUT_FILENO, entry->peer_realm);
+    write_str(STDOUT_FILENO, " (");
+    write_str(STDOUT_FILENO, entry->peer_ip);
+    write_str(STDOUT_FILENO, ":");
+    write_str(STDOUT_FILENO, port_buf);
+    write_str(STDOUT_FILENO, ").\n");
+}
+
+/**
+ * Return the connection to `realm`, opening one if needed. The connect() is
+ * non-blocking: a fresh entry may come back in CONNECTION_CONNECTING state,
+ * in which case frames sent to it are queued and flushed by the reactor once
+ * the handshake completes (see maester_connection_complete_connect).
+ * Lookup and creation happen under connections_lock, so two threads asking for
+ * the same next hop at once end up sharing one connection.
+ */
 ConnectionEntry* maester_get_or_open_connection(Maester* maester, const char* realm, const char* ip, int port) {
     if (maester == NULL || realm == NULL || ip == NULL || port <= 0) {
         return NULL;
     }
 
-    ConnectionEntry* existing = maester_find_connection(maester, realm);
-    if (existing != NULL && existing->sockfd >= 0) {
-        existing->last_used = time(NULL);
+    pthread_mutex_lock(&maester->connections_lock);
+
+    // Reuse the connection to this realm, or any connection already open to the
+    // same next hop (e.g. DEFAULT and a named route sharing one neighbour)
+    ConnectionEntry* existing = connection_table_find_realm(&maester->connections, realm);
+    if (existing == NULL) {
+        existing = connection_table_find_endpoint(&maester->connections, ip, port);
+    }
+    if (existing != NULL) {
+        pthread_mutex_unlock(&maester->connections_lock);
+        if (maester_connection_is_local(existing)) {
+            existing->last_used = time(NULL);
+        }
         return existing;
     }
+    return maester_open_connection_locked(maester, realm, ip, port, 0);
+}
+
+/**
+ * Open one more connection to the next hop `realm` (ip:port) for a striped
+ * transfer. It is kept out of the indexes, so routed traffic never picks it,
+ * and a failed connect() is not reported to the mission.
+ */
+ConnectionEntry* maester_open_stripe_connection(Maester* maester, const char* realm, const char* ip, int port) {
+    if (maester == NULL || realm == NULL || ip == NULL || port <= 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&maester->connections_lock);
+    return maester_open_connection_locked(maester, realm, ip, port, 1);
+}
 
+// Create, connect and register a client socket; releases connections_lock
+static ConnectionEntry* maester_open_connection_locked(Maester* maester, const char* realm, const char* ip,
+                                                       int port, int stripe) {
     ConnectionEntry* entry = maester_add_connection_entry(maester);
     if (entry == NULL) {
+        pthread_mutex_unlock(&maester->connections_lock);
         return NULL;
     }
 
+    // Until the socket is stored the slot holds nothing but its buffers'
+    // configuration, so failures below just hand it back
     int fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0) {
         write_str(STDERR_FILENO, "Error: Unable to create client socket.\n");
-        maester_close_connection_entry(entry);
-        maester->num_connections--;
+        connection_table_release(entry);
+        pthread_mutex_unlock(&maester->connections_lock);
         return NULL;
     }
 
@@ -427,24 +1486,31 @@ ConnectionEntry* maester_get_or_open_connection(Maester* maester, const char* re
     if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0) {
         write_str(STDERR_FILENO, "Error: Invalid IP when opening connection.\n");
         close(fd);
-        maester_close_connection_entry(entry);
-        maester->num_connections--;
-        return NULL;
-    }
-
-    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        write_str(STDERR_FILENO, "Error: connect() failed when reaching ");
-        write_str(STDERR_FILENO, realm);
-        write_str(STDERR_FILENO, ".\n");
-        close(fd);
-        maester_close_connection_entry(entry);
-        maester->num_connections--;
+        connection_table_release(entry);
+        pthread_mutex_unlock(&maester->connections_lock);
         return NULL;
     }
 
     if (set_socket_nonblocking(fd) < 0) {
         write_str(STDERR_FILENO, "Warning: failed to set non-blocking mode on connection socket.\n");
     }
+    set_socket_nodelay(fd);
+
+    int in_progress = 0;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            if (!stripe) {
+                write_str(STDERR_FILENO, "Error: connect() failed when reaching ");
+                write_str(STDERR_FILENO, realm);
+                write_str(STDERR_FILENO, ".\n");
+            }
+            close(fd);
+            connection_table_release(entry);
+            pthread_mutex_unlock(&maester->connections_lock);
+            return NULL;
+        }
+        in_progress = 1;
+    }
 
     entry->sockfd = fd;
     entry->addr = addr;
@@ -452,30 +1518,145 @@ ConnectionEntry* maester_get_or_open_connection(Maester* maester, const char* re
     my_strcpy(entry->peer_ip, ip);
     entry->peer_port = port;
     entry->last_used = time(NULL);
-    char port_buf[16];
-    int_to_str(port, port_buf);
-    write_str(STDOUT_FILENO, "Connected to ");
-    write_str(STDOUT_FILENO, realm);
-    write_str(STDOUT_FILENO, " (");
-    write_str(STDOUT_FILENO, ip);
-    write_str(STDOUT_FILENO, ":");
-    write_str(STDOUT_FILENO, port_buf);
-    write_str(STDOUT_FILENO, ").\n");
+    entry->stripe = (uint8_t)stripe;
+    if (in_progress) {
+        entry->state = CONNECTION_CONNECTING;
+        entry->connect_deadline = entry->last_used + maester->tuning.connect_timeout_s;
+    }
+    int indexed = stripe ? 0 : connection_table_index(entry);
+    pthread_mutex_unlock(&maester->connections_lock);
+
+    if (indexed != 0) {
+        write_str(STDERR_FILENO, "Error: Unable to index connection.\n");
+    }
+    if (indexed != 0 || maester_register_connection(maester, entry) != 0) {
+        maester_close_connection_entry(entry);
+        return NULL;
+    }
+    if (!in_progress && !stripe) {
+        maester_log_connected(entry);
+    }
     return entry;
 }
 
-void maester_compact_connections(Maester* maester) {
-    if (maester == NULL || maester->connections == NULL) return;
-    int write_idx = 0;
-    for (int i = 0; i < maester->num_connections; i++) {
-        if (maester->connections[i].sockfd >= 0) {
-            if (write_idx != i) {
-                maester->connections[write_idx] = maester->connections[i];
+/**
+ * Connection to a resolved route's next hop. The handle cached in the route
+ * is tried first; a closed or recycled slot fails the generation check and
+ * falls back to maester_get_or_open_connection, whose result is cached again.
+ * The cache is shared by all threads, hence the atomic accesses.
+ */
+ConnectionEntry* maester_route_connection(Maester* maester, Route* route) {
+    if (maester == NULL || route == NULL) return NULL;
+    ConnHandle cached = __atomic_load_n(&route->next_hop, __ATOMIC_ACQUIRE);
+    ConnectionEntry* entry = connection_table_lookup(&maester->connections, cached);
+    if (entry != NULL) {
+        if (maester_connection_is_local(entry)) {
+            entry->last_used = time(NULL);
+        }
+        return entry;
+    }
+    entry = maester_get_or_open_connection(maester, route->realm, route->ip, route->port);
+    __atomic_store_n(&route->next_hop, connection_handle(entry), __ATOMIC_RELEASE);
+    return entry;
+}
+
+static void maester_connect_failed(Maester* maester, ConnectionEntry* entry, const char* reason) {
+    if (entry->stripe) {
+        // Its transfer carries on over the other connections
+        maester_close_connection_entry(entry);
+        return;
+    }
+    write_str(STDERR_FILENO, "Error: connect() failed when reaching ");
+    write_str(STDERR_FILENO, entry->peer_realm);
+    write_str(STDERR_FILENO, " (");
+    write_str(STDERR_FILENO, reason);
+    write_str(STDERR_FILENO, ").\n");
+    char realm[REALM_NAME_MAX];
+    my_strcpy(realm, entry->peer_realm);
+    // Anything queued for this hop is lost with it
+    maester_close_connection_entry(entry);
+    pthread_mutex_lock(&maester->alliances_lock);
+    maester_mission_next_hop_failed(maester, realm, reason);
+    pthread_mutex_unlock(&maester->alliances_lock);
+}
+
+/**
+ * Called for any reactor event on a CONNECTION_CONNECTING entry: reads the
+ * connect() outcome from SO_ERROR, then either flushes the frames queued
+ * meanwhile or drops the entry and reports the failure to the mission.
+ */
+void maester_connection_complete_connect(Maester* maester, ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL || entry->sockfd < 0 || entry->state != CONNECTION_CONNECTING) {
+        return;
+    }
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(entry->sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+        error = errno;
+    }
+    if (error == EINPROGRESS || error == EALREADY) {
+        return;
+    }
+    if (error != 0) {
+        maester_connect_failed(maester, entry, (error == ECONNREFUSED) ? "connection refused" : "unreachable");
+        return;
+    }
+    entry->state = CONNECTION_CONNECTED;
+    entry->connect_deadline = 0;
+    if (!entry->stripe) {
+        maester_log_connected(entry);
+    }
+    maester_flush_send_buffer(entry);
+    maester_connection_update_interest(entry);
+    maester_connection_drained(maester, entry);
+}
+
+#define CONNECT_EXPIRE_BATCH 64
+
+/**
+ * Abandon the shard's connection attempts whose deadline has passed.
+ * Returns milliseconds until the next deadline, -1 when none is pending
+ * (the scan is skipped entirely until the shard opens another connection).
+ */
+int maester_check_connect_timeouts(Maester* maester, Shard* shard) {
+    if (maester == NULL || shard == NULL || !shard->connects_pending) return -1;
+    ConnHandle expired[CONNECT_EXPIRE_BATCH];
+    int num_expired = 0;
+    time_t earliest = 0;
+    time_t now = time(NULL);
+
+    // Slots of other shards are skipped without touching their I/O state
+    pthread_mutex_lock(&maester->connections_lock);
+    int slots = connection_table_slots(&maester->connections);
+    for (int i = 0; i < slots; i++) {
+        ConnectionEntry* entry = connection_table_at(&maester->connections, i);
+        if (entry->shard != shard || entry->sockfd < 0 || entry->state != CONNECTION_CONNECTING) {
+            continue;
+        }
+        if (now < entry->connect_deadline) {
+            if (earliest == 0 || entry->connect_deadline < earliest) {
+                earliest = entry->connect_deadline;
             }
-            write_idx++;
+        } else if (num_expired < CONNECT_EXPIRE_BATCH) {
+            expired[num_expired++] = connection_handle(entry);
+        } else {
+            earliest = now;
+        }
+    }
+    pthread_mutex_unlock(&maester->connections_lock);
+
+    for (int i = 0; i < num_expired; i++) {
+        ConnectionEntry* entry = connection_table_lookup(&maester->connections, expired[i]);
+        if (entry != NULL) {
+            maester_connect_failed(maester, entry, "timed out");
         }
     }
-    maester->num_connections = write_idx;
+    if (earliest == 0) {
+        shard->connects_pending = 0;
+        return -1;
+    }
+    if (now >= earliest) return 0;
+    return (int)(earliest - now) * 1000;
 }
 
 void maester_broadcast_disconnect(Maester* maester) {
@@ -485,14 +1666,15 @@ void maester_broadcast_disconnect(Maester* maester) {
 
     write_str(STDOUT_FILENO, "\nBroadcasting DISCONNECT frames to all peers...\n");
 
-    if (maester->connections == NULL || maester->num_connections == 0) {
+    if (maester->connections.live == 0) {
         write_str(STDOUT_FILENO, "  No active connections to notify.\n");
         return;
     }
 
     // Send DISCONNECT frame to all active connections
-    for (int i = 0; i < maester->num_connections; i++) {
-        ConnectionEntry* entry = &maester->connections[i];
+    int slots = connection_table_slots(&maester->connections);
+    for (int i = 0; i < slots; i++) {
+        ConnectionEntry* entry = connection_table_at(&maester->connections, i);
         if (entry->sockfd < 0) {
             continue;  // Skip closed connections
         }
@@ -533,57 +1715,127 @@ void maester_broadcast_disconnect(Maester* maester) {
 }
 
 void maester_close_all_connections(Maester* maester) {
-    if (maester == NULL || maester->connections == NULL) return;
-    for (int i = 0; i < maester->num_connections; i++) {
-        maester_close_connection_entry(&maester->connections[i]);
+    if (maester == NULL) return;
+    int slots = connection_table_slots(&maester->connections);
+    for (int i = 0; i < slots; i++) {
+        maester_close_connection_entry(connection_table_at(&maester->connections, i));
     }
-    maester->num_connections = 0;
 }
 
-static int maester_queue_bytes(ConnectionEntry* entry, const uint8_t* data, size_t length) {
+// `quiet`: the caller deals with a failure (a forward that holds instead)
+static int maester_queue_bytes(ConnectionEntry* entry, const uint8_t* data, size_t length, int quiet) {
     if (entry == NULL || entry->sockfd < 0 || data == NULL || length == 0) {
         return -1;
     }
 
-    if (entry->send_buffer.length > 0) {
-        return frame_buffer_append(&entry->send_buffer, data, length);
+    if (!maester_connection_is_local(entry)) {
+        // Another shard owns the socket: hand the bytes over, in order. They
+        // count towards its backlog until that shard has queued them
+        __atomic_fetch_add(&entry->posted, length, __ATOMIC_RELAXED);
+        if (shard_post(entry->shard, QUEUED_SEND, connection_handle(entry), data, length) != 0) {
+            __atomic_fetch_sub(&entry->posted, length, __ATOMIC_RELAXED);
+            if (!quiet) {
+                write_str(STDERR_FILENO, "Warning: network worker queue full for ");
+                write_str(STDERR_FILENO, entry->peer_realm[0] ? entry->peer_realm : entry->peer_ip);
+                write_str(STDERR_FILENO, ".\n");
+            }
+            return -1;
+        }
+        return 0;
     }
 
-    ssize_t sent = send(entry->sockfd, data, length, 0);
-    if (sent == (ssize_t)length) {
-        return 0;
+    // Every caller queues one whole frame; it takes its index on the link
+    // here, and goes out compact once the neighbour has switched to that
+    uint8_t damaged[FRAME_MAX_SIZE];
+    int noted = (length == FRAME_MAX_SIZE);
+    if (noted) {
+        data = send_queue_note_frame(&entry->send_queue, data, damaged);
+        if (entry->compact_send) {
+            length = frame_compact_bytes(data, damaged);
+            data = damaged;
+        }
     }
-    if (sent > 0) {
-        size_t remaining = length - (size_t)sent;
-        return frame_buffer_append(&entry->send_buffer, data + sent, remaining);
+
+    int result = -1;
+    if (maester_connection_uring(entry) != NULL) {
+        // Completion backend: queue only; the shard submits the chain with
+        // everything else prepared in this batch
+        result = send_queue_append(&entry->send_queue, data, length);
+    } else if (entry->send_queue.bytes > 0 || entry->state == CONNECTION_CONNECTING) {
+        // Keep ordering: flushed together with the backlog on the next writable event
+        result = send_queue_append(&entry->send_queue, data, length);
+    } else {
+        ssize_t sent = send(entry->sockfd, data, length, 0);
+        if (sent == (ssize_t)length) {
+            return 0;
+        }
+        if (sent > 0) {
+            size_t remaining = length - (size_t)sent;
+            result = send_queue_append(&entry->send_queue, data + sent, remaining);
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            result = send_queue_append(&entry->send_queue, data, length);
+        }
     }
-    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-        return frame_buffer_append(&entry->send_buffer, data, length);
+    if (result != 0) {
+        if (noted) {
+            entry->send_queue.frames_queued--;   // Never written: its index is the next frame's
+        }
+        if (!quiet) {
+            write_str(STDERR_FILENO, "Warning: send queue limit reached for ");
+            write_str(STDERR_FILENO, entry->peer_realm[0] ? entry->peer_realm : entry->peer_ip);
+            write_str(STDERR_FILENO, ".\n");
+        }
     }
-    return -1;
+    // Only pay for an epoll_ctl when the pending state actually flips
+    maester_connection_update_interest(entry);
+    return result;
 }
 
 int maester_connection_has_pending_send(const ConnectionEntry* entry) {
     if (entry == NULL) return 0;
-    return entry->send_buffer.length > 0;
+    return entry->send_queue.bytes > 0;
 }
 
+/**
+ * Drain the send queue with writev(): each call hands up to SEND_QUEUE_IOV_MAX
+ * queued slots (frames) to the kernel at once, until the queue is empty or the
+ * socket would block.
+ */
 void maester_flush_send_buffer(ConnectionEntry* entry) {
-    if (entry == NULL || entry->sockfd < 0) {
+    if (entry == NULL || entry->sockfd < 0 || entry->state == CONNECTION_CONNECTING) {
+        return;
+    }
+    if (maester_connection_uring(entry) != NULL) {
+        maester_connection_update_interest(entry);
         return;
     }
-    while (entry->send_buffer.length > 0) {
-        ssize_t sent = send(entry->sockfd, entry->send_buffer.data, entry->send_buffer.length, 0);
+    struct iovec iov[SEND_QUEUE_IOV_MAX];
+    while (entry->send_queue.bytes > 0) {
+        int count = send_queue_iov(&entry->send_queue, iov, SEND_QUEUE_IOV_MAX);
+        size_t batch = 0;
+        for (int i = 0; i < count; i++) {
+            batch += iov[i].iov_len;
+        }
+        ssize_t sent = writev(entry->sockfd, iov, count);
         if (sent > 0) {
-            frame_buffer_consume(&entry->send_buffer, (size_t)sent);
+            send_queue_consume(&entry->send_queue, (size_t)sent);
+            if ((size_t)sent < batch) {
+                break;  // Socket buffer is full; wait for the next writable event
+            }
             continue;
         }
-        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
             break;
         }
         maester_close_connection_entry(entry);
-        break;
+        return;
     }
+    maester_connection_update_interest(entry);
+}
+
+// Queue already-serialized frame bytes as they are
+int maester_send_bytes(ConnectionEntry* entry, const uint8_t* data, size_t length) {
+    return maester_queue_bytes(entry, data, length, 0);
 }
 
 int maester_send_frame(ConnectionEntry* entry, const CitadelFrame* frame) {
@@ -595,5 +1847,162 @@ int maester_send_frame(ConnectionEntry* entry, const CitadelFrame* frame) {
     if (frame_serialize(frame, buffer, sizeof(buffer), &length) != 0) {
         return -1;
     }
-    return maester_queue_bytes(entry, buffer, length);
+    return maester_queue_bytes(entry, buffer, length, 0);
+}
+
+/**
+ * Forward one frame that arrived on `from` into `next_hop`'s queue. At the
+ * high-water mark (CITADEL_FORWARD_HIGH_KB), or when the queue cannot take the
+ * frame, nothing is queued: `from` stops being read, with the frame left at
+ * the head of its receive ring, until the next hop has drained to half the
+ * mark. Not reading `from` fills the socket buffers behind it, so its
+ * neighbour's queue grows and that realm stops reading in turn: the pressure
+ * travels upstream hop by hop and no realm drops a frame for lack of room.
+ * Returns 0 when queued, 1 when `from` now holds, -1 on failure (only with
+ * the mark at 0: the frame is lost, as it always was).
+ */
+int maester_forward_bytes(Maester* maester, ConnectionEntry* from, ConnectionEntry* next_hop,
+                          const uint8_t* data, size_t length) {
+    if (maester == NULL || next_hop == NULL) return -1;
+    size_t high = (size_t)maester->tuning.forward_high_kb * 1024;
+    if (high == 0 || from == NULL) {
+        return maester_queue_bytes(next_hop, data, length, 0);
+    }
+    if (maester_connection_backlog(next_hop) < high && maester_queue_bytes(next_hop, data, length, 1) == 0) {
+        return 0;
+    }
+    // Name the next hop and announce the wait, then look again: a drain that
+    // finished in between is seen here, one that finishes later finds `from`
+    // holding for it (maester_connection_drained)
+    __atomic_store_n(&from->held_on, connection_handle(next_hop), __ATOMIC_RELAXED);
+    __atomic_store_n(&next_hop->waiters, 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (maester_connection_backlog(next_hop) < high && maester_queue_bytes(next_hop, data, length, 1) == 0) {
+        __atomic_store_n(&from->held_on, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+    maester_connection_hold(maester, from, next_hop);
+    return 1;
+}
+
+// True once the next hop a held connection waits for is below its high-water
+// mark, or gone (the frame then takes whatever route there is now)
+int maester_hold_released(Maester* maester, const ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL) return 1;
+    ConnHandle handle = __atomic_load_n(&entry->held_on, __ATOMIC_RELAXED);
+    ConnectionEntry* next_hop = connection_table_lookup(&maester->connections, handle);
+    if (next_hop == NULL || next_hop->sockfd < 0) {
+        return 1;
+    }
+    return maester_connection_backlog(next_hop) < (size_t)maester->tuning.forward_high_kb * 1024;
+}
+
+/**
+ * The entry's queue shrank: once it is down to the low-water mark (half the
+ * high-water mark), let the connections holding for it read on. Each is
+ * resumed by its own shard; any past FORWARD_WAKE_BATCH, or whose shard's
+ * queue is full, waits for maester_check_holds().
+ */
+void maester_connection_drained(Maester* maester, ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL) return;
+    // Pairs with the fence in maester_forward_bytes(): either the holder sees
+    // the queue shrink or this sees it waiting
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&entry->waiters, __ATOMIC_RELAXED)) return;
+    size_t low = (size_t)maester->tuning.forward_high_kb * 1024 / 2;
+    if (maester_connection_backlog(entry) > low || !__atomic_exchange_n(&entry->waiters, 0, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    ConnHandle handle = connection_handle(entry);
+    ConnHandle held[FORWARD_WAKE_BATCH];
+    int num_held = 0;
+    pthread_mutex_lock(&maester->connections_lock);
+    int slots = connection_table_slots(&maester->connections);
+    for (int i = 0; i < slots && num_held < FORWARD_WAKE_BATCH; i++) {
+        ConnectionEntry* other = connection_table_at(&maester->connections, i);
+        if (other->sockfd >= 0 && __atomic_load_n(&other->held_on, __ATOMIC_RELAXED) == handle) {
+            held[num_held++] = connection_handle(other);
+        }
+    }
+    pthread_mutex_unlock(&maester->connections_lock);
+
+    for (int i = 0; i < num_held; i++) {
+        ConnectionEntry* other = connection_table_lookup(&maester->connections, held[i]);
+        if (other == NULL) continue;
+        if (maester_connection_is_local(other)) {
+            maester_resume_reading(maester, other);
+        } else {
+            shard_post(other->shard, QUEUED_RESUME, held[i], NULL, 0);
+        }
+    }
+}
+
+/**
+ * Look at the shard's held connections again every FORWARD_RECHECK_MS, for
+ * the wakes that never come: the next hop closed, its drain found the other
+ * shard's queue full, or it was the pool rather than its queue that ran
+ * short. Returns milliseconds until the next look, -1 when nothing holds.
+ */
+int maester_check_holds(Maester* maester, Shard* shard) {
+    if (maester == NULL || shard == NULL || !shard->holds_pending) return -1;
+    uint64_t now = maester_now_us();
+    if (now < shard->holds_check_us) {
+        return (int)((shard->holds_check_us - now + 999) / 1000);
+    }
+    ConnHandle held[FORWARD_WAKE_BATCH];
+    int num_held = 0;
+    pthread_mutex_lock(&maester->connections_lock);
+    int slots = connection_table_slots(&maester->connections);
+    for (int i = 0; i < slots; i++) {
+        ConnectionEntry* entry = connection_table_at(&maester->connections, i);
+        if (entry->shard != shard || entry->sockfd < 0 || !entry->held) continue;
+        if (num_held == FORWARD_WAKE_BATCH) break;
+        held[num_held++] = connection_handle(entry);
+    }
+    pthread_mutex_unlock(&maester->connections_lock);
+
+    // Holding again re-arms the look, and so does a connection whose next hop
+    // is still full, or one past the batch: no wake may come for those
+    shard->holds_pending = 0;
+    int still_held = (num_held == FORWARD_WAKE_BATCH);
+    for (int i = 0; i < num_held; i++) {
+        ConnectionEntry* entry = connection_table_lookup(&maester->connections, held[i]);
+        maester_resume_reading(maester, entry);
+        if (entry != NULL && entry->sockfd >= 0 && entry->held) {
+            still_held = 1;
+        }
+    }
+    if (still_held && !shard->holds_pending) {
+        shard->holds_pending = 1;
+        shard->holds_check_us = now + FORWARD_RECHECK_MS * 1000;
+    }
+    return shard->holds_pending ? FORWARD_RECHECK_MS : -1;
+}
+
+// ============= INTERNALS =============
+
+// Unsent bytes of the entry's queue plus those handed to its shard and not
+// queued yet, as seen from any thread
+static size_t maester_connection_backlog(const ConnectionEntry* entry) {
+    return __atomic_load_n(&entry->send_queue.bytes, __ATOMIC_RELAXED) +
+           __atomic_load_n(&entry->posted, __ATOMIC_RELAXED);
+}
+
+// Stop reading `entry` until `next_hop` has room (maester_resume_reading)
+static void maester_connection_hold(Maester* maester, ConnectionEntry* entry, ConnectionEntry* next_hop) {
+    entry->held = 1;
+    __atomic_store_n(&entry->held_on, connection_handle(next_hop), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&maester->forwarding.holds, 1, __ATOMIC_RELAXED);
+    Shard* shard = entry->shard;
+    if (shard != NULL && !shard->holds_pending) {
+        shard->holds_pending = 1;
+        shard->holds_check_us = maester_now_us() + FORWARD_RECHECK_MS * 1000;
+    }
+    maester_connection_update_interest(entry);
+}
+
+static uint64_t maester_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
 }
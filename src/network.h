@@ -6,15 +6,58 @@
 // Frame helpers
 void             frame_init(CitadelFrame* frame, FrameType type, const char* origin, const char* destination);
 int              frame_serialize(const CitadelFrame* frame, uint8_t* buffer, size_t buffer_len, size_t* out_len);
+void             frame_encode_bytes(uint8_t* buffer, FrameType type, const char* origin, const char* destination,
+                                    const uint8_t* data, uint16_t length);
 FrameParseResult frame_deserialize(const uint8_t* buffer, size_t length, CitadelFrame* frame, size_t* consumed_bytes);
 uint16_t         frame_compute_checksum_bytes(const uint8_t* buffer, size_t length);
+size_t           frame_compact_bytes(const uint8_t* frame, uint8_t* out);
 void             frame_log_summary(const char* prefix, const CitadelFrame* frame);
 const char*      frame_type_to_string(FrameType type);
 
-void frame_buffer_init(FrameBuffer* fb);
-void frame_buffer_reset(FrameBuffer* fb);
-int  frame_buffer_append(FrameBuffer* fb, const uint8_t* data, size_t length);
+FrameParseResult frame_validate_bytes(const uint8_t* buffer);
+size_t           frame_validate_batch(const uint8_t* frames, size_t count, FrameParseResult* results);
+void             frame_decode_bytes(const uint8_t* buffer, CitadelFrame* frame);
+
+void   recv_pool_init(RecvBufferPool* pool);
+void   recv_pool_destroy(RecvBufferPool* pool);
+
+void   frame_buffer_init(FrameBuffer* fb);
+void   frame_buffer_configure(FrameBuffer* fb, RecvBufferPool* pool, size_t max_capacity);
+void   frame_buffer_release(FrameBuffer* fb);
+void   frame_buffer_reset(FrameBuffer* fb);
+ssize_t frame_buffer_read_fd(FrameBuffer* fb, int fd, size_t* requested);
+size_t frame_buffer_length(const FrameBuffer* fb);
+size_t frame_buffer_space(const FrameBuffer* fb);
+int    frame_buffer_append(FrameBuffer* fb, const uint8_t* data, size_t length);
+int    frame_buffer_append_over(FrameBuffer* fb, const uint8_t* data, size_t length);
+void   frame_buffer_consume(FrameBuffer* fb, size_t bytes);
+size_t frame_buffer_contiguous(const FrameBuffer* fb, const uint8_t** out);
 FrameParseResult frame_buffer_extract(FrameBuffer* fb, CitadelFrame* frame, size_t* consumed_bytes);
+FrameParseResult frame_buffer_peek_view(FrameBuffer* fb, FrameView* view);
+FrameParseResult frame_buffer_peek_compact(FrameBuffer* fb, FrameView* view, size_t* length);
+
+// Zero-copy frame inspection
+FrameType      frame_view_type(const FrameView* view);
+uint16_t       frame_view_data_length(const FrameView* view);
+const uint8_t* frame_view_data(const FrameView* view);
+int            frame_view_destination_is(const FrameView* view, const char* realm);
+void           frame_view_origin(const FrameView* view, char* dst, size_t dst_len);
+void           frame_view_destination(const FrameView* view, char* dst, size_t dst_len);
+void           frame_view_to_frame(const FrameView* view, CitadelFrame* frame);
+
+// Pooled, chained send queues
+void   send_pool_init(SendSlotPool* pool, size_t max_bytes);
+void   send_pool_destroy(SendSlotPool* pool);
+void   send_queue_init(SendQueue* queue, SendSlotPool* pool, size_t max_bytes);
+void   send_queue_keep_frames(SendQueue* queue, size_t frames, uint32_t corrupt_ppm, LinkRepairStats* repair);
+const uint8_t* send_queue_note_frame(SendQueue* queue, const uint8_t* frame, uint8_t* out);
+int    send_queue_kept_frame(const SendQueue* queue, uint64_t index, uint8_t* out);
+int    send_queue_append(SendQueue* queue, const uint8_t* data, size_t length);
+uint8_t* send_queue_reserve(SendQueue* queue, size_t length);
+void   send_queue_trim_tail(SendQueue* queue, size_t length);
+void   send_queue_consume(SendQueue* queue, size_t bytes);
+void   send_queue_clear(SendQueue* queue);
+int    send_queue_iov(const SendQueue* queue, struct iovec* iov, int max_iov);
 
 // Routing helpers
 Route* maester_resolve_route(Maester* maester, const char* destination, int* used_default);
@@ -22,12 +65,30 @@ void   maester_log_route_resolution(const char* destination, const Route* route,
 
 // Connections
 ConnectionEntry* maester_add_connection_entry(Maester* maester);
+ConnectionEntry* maester_add_accepted_connection(Maester* maester, int fd, const struct sockaddr_in* addr);
 ConnectionEntry* maester_get_or_open_connection(Maester* maester, const char* realm, const char* ip, int port);
-void             maester_compact_connections(Maester* maester);
+ConnectionEntry* maester_open_stripe_connection(Maester* maester, const char* realm, const char* ip, int port);
+ConnectionEntry* maester_route_connection(Maester* maester, Route* route);
+int              maester_register_connection(Maester* maester, ConnectionEntry* entry);
+ConnectionEntry* maester_connection_from_tag(Maester* maester, uint64_t tag);
+void             maester_connection_complete_connect(Maester* maester, ConnectionEntry* entry);
+void             maester_handle_link_options(Maester* maester, ConnectionEntry* entry, const FrameView* view);
+int              maester_check_connect_timeouts(Maester* maester, Shard* shard);
+void             maester_apply_queued(Maester* maester, Shard* shard, const QueuedFrame* item);
+int              maester_wake_transfers(Maester* maester, ConnectionEntry* entry);
+void             maester_connection_update_interest(ConnectionEntry* entry);
 void             maester_broadcast_disconnect(Maester* maester);
 void             maester_close_all_connections(Maester* maester);
 void             maester_close_connection_entry(ConnectionEntry* entry);
 int              maester_send_frame(ConnectionEntry* entry, const CitadelFrame* frame);
+int              maester_send_bytes(ConnectionEntry* entry, const uint8_t* data, size_t length);
+
+// Transit backpressure
+int              maester_forward_bytes(Maester* maester, ConnectionEntry* from, ConnectionEntry* next_hop,
+                                       const uint8_t* data, size_t length);
+int              maester_hold_released(Maester* maester, const ConnectionEntry* entry);
+void             maester_connection_drained(Maester* maester, ConnectionEntry* entry);
+int              maester_check_holds(Maester* maester, Shard* shard);
 int              maester_connection_has_pending_send(const ConnectionEntry* entry);
 void             maester_flush_send_buffer(ConnectionEntry* entry);
 
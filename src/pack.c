@@ -0,0 +1,274 @@
+#include "pack.h"
+#include "helper.h"
+#include "md5.h"
+
+#define PACK_HASH_BITS   16
+#define PACK_SKIP_SHIFT  6     // After every 64 misses in a row, step one byte further
+
+static uint32_t pack_read32(const uint8_t* p);
+static uint32_t pack_read32_at(const uint8_t* dict, size_t dict_len, const uint8_t* in, size_t pos);
+static uint8_t  pack_byte(const uint8_t* dict, size_t dict_len, const uint8_t* in, size_t pos);
+static uint32_t pack_hash(uint32_t value);
+static int      pack_emit(uint8_t* out, size_t capacity, size_t* op, const uint8_t* literals, size_t literal_len,
+                          size_t offset, size_t match);
+static size_t   pack_put_length(uint8_t* out, size_t op, size_t length);
+static int      pack_get_length(const uint8_t* in, size_t length, size_t* ip, size_t* value);
+
+void pack_dictionary_init(PackDictionary* dict) {
+    if (dict == NULL) return;
+    dict->bytes = NULL;
+    dict->length = 0;
+    dict->id[0] = '\0';
+}
+
+int pack_dictionary_build(PackDictionary* dict, const char* const* names, int count) {
+    if (dict == NULL) return -1;
+    pack_dictionary_init(dict);
+    if (names == NULL || count <= 0) return 0;
+    const char** sorted = (const char**)malloc((size_t)count * sizeof(const char*));
+    uint8_t* bytes = (uint8_t*)malloc(PACK_DICT_MAX);
+    if (sorted == NULL || bytes == NULL) {
+        free(sorted);
+        free(bytes);
+        return -1;
+    }
+    // Insertion sort: a stock holds a handful of products
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        const char* name = names[i];
+        if (name == NULL || name[0] == '\0') continue;
+        int j = used;
+        while (j > 0 && my_strcmp(sorted[j - 1], name) > 0) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = name;
+        used++;
+    }
+    size_t length = 0;
+    for (int i = 0; i < used; i++) {
+        if (i > 0 && my_strcmp(sorted[i - 1], sorted[i]) == 0) continue;   // Stocked twice
+        size_t n = (size_t)my_strlen(sorted[i]);
+        if (length + n + 1 > PACK_DICT_MAX) break;
+        memcpy(bytes + length, sorted[i], n);
+        length += n;
+        bytes[length++] = '\n';
+    }
+    free(sorted);
+    if (length == 0) {
+        free(bytes);
+        return 0;
+    }
+
+    uint8_t digest[16];
+    char hex[33];
+    md5_buffer(bytes, length, digest);
+    md5_digest_to_hex(digest, hex);
+    memcpy(dict->id, hex, PACK_DICT_ID_LEN);
+    dict->id[PACK_DICT_ID_LEN] = '\0';
+    dict->bytes = bytes;
+    dict->length = length;
+    return 0;
+}
+
+void pack_dictionary_free(PackDictionary* dict) {
+    if (dict == NULL) return;
+    free(dict->bytes);
+    pack_dictionary_init(dict);
+}
+
+/**
+ * Greedy single pass: a hash of the next four bytes finds the latest position
+ * that started with the same hash (the dictionary is hashed in first), and a
+ * match there is extended as far as it goes. Data that keeps missing is
+ * skipped through faster, so an incompressible file costs little before the
+ * output outgrows `capacity`.
+ */
+size_t pack_compress(const PackDictionary* dict, const uint8_t* in, size_t length, uint8_t* out, size_t capacity) {
+    const uint8_t* d = (dict != NULL) ? dict->bytes : NULL;
+    size_t dict_len = (d != NULL) ? dict->length : 0;
+    if ((in == NULL && length > 0) || out == NULL || length > (size_t)0xFFFFFFFEu - dict_len) {
+        return 0;
+    }
+    // Positions count from the start of the dictionary; the table holds position + 1
+    uint32_t* table = (uint32_t*)calloc((size_t)1 << PACK_HASH_BITS, sizeof(uint32_t));
+    if (table == NULL) {
+        return 0;
+    }
+    for (size_t pos = 0; pos + PACK_MIN_MATCH <= dict_len; pos++) {
+        table[pack_hash(pack_read32(d + pos))] = (uint32_t)(pos + 1);
+    }
+
+    size_t op = 0;
+    size_t anchor = 0;      // First byte not yet emitted
+    size_t i = 0;
+    unsigned misses = 0;
+    int fits = 1;
+    while (fits && i + PACK_MIN_MATCH <= length) {
+        uint32_t value = pack_read32(in + i);
+        uint32_t* slot = &table[pack_hash(value)];
+        size_t pos = dict_len + i;
+        size_t candidate = *slot;
+        *slot = (uint32_t)(pos + 1);
+        if (candidate == 0 || pos - (candidate - 1) > PACK_WINDOW ||
+            pack_read32_at(d, dict_len, in, candidate - 1) != value) {
+            i += 1 + (misses++ >> PACK_SKIP_SHIFT);
+            continue;
+        }
+        size_t from = candidate - 1;
+        size_t match = PACK_MIN_MATCH;
+        if (from >= dict_len) {
+            const uint8_t* earlier = in + (from - dict_len);
+            while (i + match < length && earlier[match] == in[i + match]) match++;
+        } else {
+            while (i + match < length && pack_byte(d, dict_len, in, from + match) == in[i + match]) match++;
+        }
+        fits = pack_emit(out, capacity, &op, in + anchor, i - anchor, pos - from, match);
+        i += match;
+        anchor = i;
+        misses = 0;
+        // The tail of the match starts the next one often enough to be worth a slot
+        if (i + PACK_MIN_MATCH - 2 <= length) {
+            table[pack_hash(pack_read32(in + i - 2))] = (uint32_t)(dict_len + i - 2 + 1);
+        }
+    }
+    if (fits) {
+        fits = pack_emit(out, capacity, &op, in + anchor, length - anchor, 0, 0);
+    }
+    free(table);
+    return fits ? op : 0;
+}
+
+int pack_decompress(const PackDictionary* dict, const uint8_t* in, size_t length, uint8_t* out, size_t out_len) {
+    const uint8_t* d = (dict != NULL) ? dict->bytes : NULL;
+    size_t dict_len = (d != NULL) ? dict->length : 0;
+    if ((in == NULL && length > 0) || (out == NULL && out_len > 0)) {
+        return -1;
+    }
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < length) {
+        uint8_t token = in[ip++];
+        size_t literals = token >> 4;
+        if (literals == 15 && pack_get_length(in, length, &ip, &literals) != 0) {
+            return -1;
+        }
+        if (literals > length - ip || literals > out_len - op) {
+            return -1;
+        }
+        memcpy(out + op, in + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == length) {
+            break;      // The last sequence ends after its literals
+        }
+        if (length - ip < 2) {
+            return -1;
+        }
+        size_t offset = ((size_t)in[ip] << 8) | (size_t)in[ip + 1];
+        ip += 2;
+        size_t match = token & 0x0F;
+        if (match == 15 && pack_get_length(in, length, &ip, &match) != 0) {
+            return -1;
+        }
+        match += PACK_MIN_MATCH;
+        if (offset == 0 || offset > dict_len + op || match > out_len - op) {
+            return -1;
+        }
+        size_t from = dict_len + op - offset;
+        if (from >= dict_len && offset >= match) {
+            memcpy(out + op, out + (from - dict_len), match);
+            op += match;
+        } else {
+            // Byte by byte: the match reads the dictionary or overlaps itself
+            for (size_t k = 0; k < match; k++, from++) {
+                out[op++] = (from < dict_len) ? d[from] : out[from - dict_len];
+            }
+        }
+    }
+    return (op == out_len) ? 0 : -1;
+}
+
+// ============= INTERNALS =============
+
+static uint32_t pack_read32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// Four bytes at `pos` of the dictionary followed by the input
+static uint32_t pack_read32_at(const uint8_t* dict, size_t dict_len, const uint8_t* in, size_t pos) {
+    if (pos >= dict_len) {
+        return pack_read32(in + (pos - dict_len));
+    }
+    if (pos + 4 <= dict_len) {
+        return pack_read32(dict + pos);
+    }
+    return ((uint32_t)pack_byte(dict, dict_len, in, pos) << 24) |
+           ((uint32_t)pack_byte(dict, dict_len, in, pos + 1) << 16) |
+           ((uint32_t)pack_byte(dict, dict_len, in, pos + 2) << 8) |
+           (uint32_t)pack_byte(dict, dict_len, in, pos + 3);
+}
+
+static uint8_t pack_byte(const uint8_t* dict, size_t dict_len, const uint8_t* in, size_t pos) {
+    return (pos < dict_len) ? dict[pos] : in[pos - dict_len];
+}
+
+static uint32_t pack_hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - PACK_HASH_BITS);
+}
+
+// One sequence; a match of 0 bytes ends the image. 0 if it does not fit.
+static int pack_emit(uint8_t* out, size_t capacity, size_t* op, const uint8_t* literals, size_t literal_len,
+                     size_t offset, size_t match) {
+    // Token, length tails, literals and offset, at their longest
+    size_t need = 1 + literal_len / 255 + 1 + literal_len;
+    if (match > 0) {
+        need += 2 + match / 255 + 1;
+    }
+    if (need > capacity - *op) {
+        return 0;
+    }
+    size_t at = *op;
+    uint8_t* token = out + at++;
+    size_t literal_code = (literal_len < 15) ? literal_len : 15;
+    size_t match_code = 0;
+    if (literal_len >= 15) {
+        at = pack_put_length(out, at, literal_len - 15);
+    }
+    memcpy(out + at, literals, literal_len);
+    at += literal_len;
+    if (match > 0) {
+        size_t extra = match - PACK_MIN_MATCH;
+        out[at++] = (uint8_t)(offset >> 8);
+        out[at++] = (uint8_t)offset;
+        match_code = (extra < 15) ? extra : 15;
+        if (extra >= 15) {
+            at = pack_put_length(out, at, extra - 15);
+        }
+    }
+    *token = (uint8_t)((literal_code << 4) | match_code);
+    *op = at;
+    return 1;
+}
+
+static size_t pack_put_length(uint8_t* out, size_t op, size_t length) {
+    while (length >= 255) {
+        out[op++] = 255;
+        length -= 255;
+    }
+    out[op++] = (uint8_t)length;
+    return op;
+}
+
+static int pack_get_length(const uint8_t* in, size_t length, size_t* ip, size_t* value) {
+    for (;;) {
+        if (*ip >= length) {
+            return -1;
+        }
+        uint8_t byte = in[(*ip)++];
+        *value += byte;
+        if (byte != 255) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ77 packing of file payloads, in the style of an LZ4 block. A packed image
+// is a run of sequences: a token (literal count in the high nibble, match
+// length - PACK_MIN_MATCH in the low one; 15 means more length bytes follow,
+// each adding up to 255), the literals, then a big-endian 16-bit offset back
+// into what was already produced and the match length bytes. The last
+// sequence stops after its literals. Matches may reach back into a
+// dictionary, which then counts as the data just before the file; both sides
+// must hold the same one, so it is named by a digest of its contents.
+
+#define PACK_MIN_MATCH    4
+#define PACK_WINDOW       65535             // Farthest a match may reach back
+#define PACK_DICT_MAX     (32 * 1024)       // Names past this are left out of a dictionary
+#define PACK_DICT_ID_LEN  8                 // Hex digits of the dictionary's MD5 naming it
+
+typedef struct {
+    uint8_t* bytes;                         // NULL while empty
+    size_t   length;
+    char     id[PACK_DICT_ID_LEN + 1];
+} PackDictionary;
+
+void pack_dictionary_init(PackDictionary* dict);
+
+// Dictionary of `count` names (product names), sorted and one per line, so
+// that realms stocking the same products in any order end up with the same
+// one. Returns -1 if it cannot be allocated; no names gives an empty one.
+int  pack_dictionary_build(PackDictionary* dict, const char* const* names, int count);
+
+void pack_dictionary_free(PackDictionary* dict);
+
+// Pack `length` bytes into `out` against `dict` (NULL or empty: none).
+// Returns the packed length, 0 if it does not fit in `capacity` bytes.
+size_t pack_compress(const PackDictionary* dict, const uint8_t* in, size_t length, uint8_t* out, size_t capacity);
+
+// Unpack `length` bytes of a packed image into exactly `out_len` bytes.
+// Returns 0, or -1 if the image is damaged or unpacks to another size.
+int  pack_decompress(const PackDictionary* dict, const uint8_t* in, size_t length, uint8_t* out, size_t out_len);
+
+#endif
@@ -0,0 +1,66 @@
+#include "reactor.h"
+
+// Persistent epoll instance: descriptors are registered once and only their
+// interest mask changes, so a wakeup costs O(ready fds) instead of O(all fds).
+
+int reactor_init(Reactor* reactor) {
+    if (reactor == NULL) return -1;
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void reactor_destroy(Reactor* reactor) {
+    if (reactor == NULL) return;
+    if (reactor->epoll_fd >= 0) {
+        close(reactor->epoll_fd);
+        reactor->epoll_fd = -1;
+    }
+}
+
+int reactor_add(Reactor* reactor, int fd, uint32_t events, uint64_t tag) {
+    if (reactor == NULL || reactor->epoll_fd < 0 || fd < 0) return -1;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    return epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int reactor_modify(Reactor* reactor, int fd, uint32_t events, uint64_t tag) {
+    if (reactor == NULL || reactor->epoll_fd < 0 || fd < 0) return -1;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    return epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void reactor_remove(Reactor* reactor, int fd) {
+    if (reactor == NULL || reactor->epoll_fd < 0 || fd < 0) return;
+    // Pre-2.6.9 kernels require a non-NULL event even for DEL
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.u64 = 0;
+    epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+/**
+ * Wait for readiness and copy the ready set into `out`.
+ * Returns the number of events, 0 on timeout or EINTR, -1 on failure.
+ */
+int reactor_wait(Reactor* reactor, ReactorEvent* out, int max_out, int timeout_ms) {
+    if (reactor == NULL || reactor->epoll_fd < 0 || out == NULL || max_out <= 0) return -1;
+    if (max_out > REACTOR_MAX_EVENTS) {
+        max_out = REACTOR_MAX_EVENTS;
+    }
+    int count = epoll_wait(reactor->epoll_fd, reactor->ready, max_out, timeout_ms);
+    if (count < 0) {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        out[i].tag = reactor->ready[i].data.u64;
+        out[i].events = reactor->ready[i].events;
+    }
+    return count;
+}
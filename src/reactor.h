@@ -0,0 +1,40 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Readiness flags reported by reactor_wait() (mirror the poll() names used by the handlers)
+#define REACTOR_READABLE   EPOLLIN
+#define REACTOR_WRITABLE   EPOLLOUT
+#define REACTOR_HANGUP     (EPOLLHUP | EPOLLRDHUP)
+#define REACTOR_ERROR      EPOLLERR
+
+#define REACTOR_MAX_EVENTS 64
+
+// Tags reserved for the fixed descriptors; connection tags are produced by network.c
+#define REACTOR_TAG_STDIN     UINT64_MAX
+#define REACTOR_TAG_LISTENER  (UINT64_MAX - 1)
+#define REACTOR_TAG_WAKE      (UINT64_MAX - 2)
+
+typedef struct {
+    uint64_t tag;
+    uint32_t events;
+} ReactorEvent;
+
+typedef struct Reactor {
+    int                epoll_fd;
+    struct epoll_event ready[REACTOR_MAX_EVENTS];
+} Reactor;
+
+int  reactor_init(Reactor* reactor);
+void reactor_destroy(Reactor* reactor);
+int  reactor_add(Reactor* reactor, int fd, uint32_t events, uint64_t tag);
+int  reactor_modify(Reactor* reactor, int fd, uint32_t events, uint64_t tag);
+void reactor_remove(Reactor* reactor, int fd);
+int  reactor_wait(Reactor* reactor, ReactorEvent* out, int max_out, int timeout_ms);
+
+#endif
@@ -0,0 +1,418 @@
+#include <sys/eventfd.h>
+
+#include "shards.h"
+#include "network.h"
+#include "connections.h"
+#include "uring.h"
+#include "transfer.h"
+
+static __thread Shard* t_shard = NULL;   // Shard run by the calling thread, NULL elsewhere
+
+// ============================================================================
+// Hand-off queue
+// ============================================================================
+
+// `capacity` is rounded up to a power of two; all memory is allocated here
+int frame_queue_init(FrameQueue* queue, size_t capacity) {
+    if (queue == NULL || capacity == 0) return -1;
+    size_t rounded = 2;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    queue->slots = (FrameQueueSlot*)malloc(rounded * sizeof(FrameQueueSlot));
+    if (queue->slots == NULL) {
+        return -1;
+    }
+    queue->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->wake_fd < 0) {
+        free(queue->slots);
+        queue->slots = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < rounded; i++) {
+        queue->slots[i].sequence = i;
+    }
+    queue->capacity = rounded;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->sleeping = 0;
+    return 0;
+}
+
+void frame_queue_destroy(FrameQueue* queue) {
+    if (queue == NULL || queue->slots == NULL) return;
+    free(queue->slots);
+    queue->slots = NULL;
+    close(queue->wake_fd);
+    queue->wake_fd = -1;
+}
+
+/**
+ * Claim a slot, copy the request in and publish it. Costs one CAS and no
+ * syscall unless the consumer is sleeping, in which case exactly one producer
+ * (the one that clears `sleeping`) writes the eventfd.
+ * Returns -1 when the queue is full (never blocks: shards post to each other).
+ */
+int frame_queue_push(FrameQueue* queue, QueuedFrameKind kind, ConnHandle handle, const uint8_t* bytes, size_t length) {
+    if (queue == NULL || queue->slots == NULL || length > FRAME_MAX_SIZE) return -1;
+    size_t mask = queue->capacity - 1;
+    size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    FrameQueueSlot* slot;
+    for (;;) {
+        slot = &queue->slots[pos & mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            // pos was reloaded by the failed CAS
+        } else if (diff < 0) {
+            return -1;  // The consumer has not freed this lap's slot yet
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->frame.kind = kind;
+    slot->frame.handle = handle;
+    slot->frame.length = (uint16_t)length;
+    if (length > 0) {
+        memcpy(slot->frame.bytes, bytes, length);
+    }
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    // Pairs with the consumer's store to `sleeping` before its last emptiness check
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&queue->sleeping, 0, __ATOMIC_ACQ_REL)) {
+        uint64_t one = 1;
+        ssize_t ignored = write(queue->wake_fd, &one, sizeof(one));
+        (void)ignored;  // Counter overflow only means it is already signalled
+    }
+    return 0;
+}
+
+// Oldest published request, or NULL. Consumer only; valid until frame_queue_consume()
+QueuedFrame* frame_queue_peek(FrameQueue* queue) {
+    if (queue == NULL || queue->slots == NULL) return NULL;
+    FrameQueueSlot* slot = &queue->slots[queue->head & (queue->capacity - 1)];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != queue->head + 1) {
+        return NULL;
+    }
+    return &slot->frame;
+}
+
+// Hand the slot returned by frame_queue_peek() back to the producers
+void frame_queue_consume(FrameQueue* queue) {
+    FrameQueueSlot* slot = &queue->slots[queue->head & (queue->capacity - 1)];
+    __atomic_store_n(&slot->sequence, queue->head + queue->capacity, __ATOMIC_RELEASE);
+    queue->head++;
+}
+
+/**
+ * Consumer is about to block: announce it, then look once more. Returns 0
+ * (and stays awake) if a request slipped in, 1 if it may sleep; a producer
+ * publishing after this point sees `sleeping` and writes wake_fd.
+ */
+int frame_queue_prepare_wait(FrameQueue* queue) {
+    __atomic_store_n(&queue->sleeping, 1, __ATOMIC_SEQ_CST);
+    FrameQueueSlot* slot = &queue->slots[queue->head & (queue->capacity - 1)];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST) != queue->head + 1) {
+        return 1;
+    }
+    __atomic_store_n(&queue->sleeping, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void frame_queue_finish_wait(FrameQueue* queue) {
+    __atomic_store_n(&queue->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+// Reset wake_fd after its readiness was reported
+void frame_queue_ack_wake(FrameQueue* queue) {
+    uint64_t signalled;
+    ssize_t ignored = read(queue->wake_fd, &signalled, sizeof(signalled));
+    (void)ignored;
+}
+
+// ============================================================================
+// Shards
+// ============================================================================
+
+Shard* shard_current(void) {
+    return t_shard;
+}
+
+// Whether the shard's thread is up; safe to ask from any thread
+int shard_running(const Shard* shard) {
+    return shard != NULL && __atomic_load_n(&shard->running, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Owner for a connection being created. A shard keeps what it opens itself
+ * (forwarding stays on one thread); other threads spread new connections
+ * round-robin. NULL when no shard is running. Caller holds connections_lock.
+ */
+Shard* shard_assign(Maester* maester) {
+    if (t_shard != NULL) {
+        return t_shard;
+    }
+    if (maester == NULL || maester->num_shards == 0 || !shard_running(&maester->shards[0])) {
+        return NULL;
+    }
+    Shard* shard = &maester->shards[maester->next_shard];
+    maester->next_shard = (maester->next_shard + 1) % maester->num_shards;
+    return shard;
+}
+
+int shard_post(Shard* shard, QueuedFrameKind kind, ConnHandle handle, const uint8_t* bytes, size_t length) {
+    if (shard == NULL) return -1;
+    return frame_queue_push(&shard->outbound, kind, handle, bytes, length);
+}
+
+// Apply what other threads handed over; no syscall, no lock. At most one
+// queue's worth per call so busy producers cannot starve the sockets.
+static void shard_drain_outbound(Shard* shard) {
+    QueuedFrame* item;
+    size_t budget = shard->outbound.capacity;
+    while (budget-- > 0 && (item = frame_queue_peek(&shard->outbound)) != NULL) {
+        maester_apply_queued(shard->maester, shard, item);
+        frame_queue_consume(&shard->outbound);
+    }
+}
+
+// Wait bound of the event loop: nearest connect deadline, retransmission
+// timer or look at the connections held for a full next hop
+static int shard_next_timeout(Maester* maester, Shard* shard) {
+    int waits[3] = {
+        maester_check_connect_timeouts(maester, shard),
+        transfer_check_timeouts(maester, shard),
+        maester_check_holds(maester, shard)
+    };
+    int nearest = -1;
+    for (int i = 0; i < 3; i++) {
+        if (waits[i] >= 0 && (nearest < 0 || waits[i] < nearest)) {
+            nearest = waits[i];
+        }
+    }
+    return nearest;
+}
+
+// Completion loop: one io_uring_enter per round both submits what the last
+// batch prepared (receives, send chains) and waits for the next completions
+static void shard_run_uring(Shard* shard) {
+    Maester* maester = shard->maester;
+    Uring* ring = shard->uring;
+    if (uring_arm_wake(ring, shard->outbound.wake_fd) != 0) {
+        write_str(STDERR_FILENO, "Error: network worker io_uring failed.\n");
+        return;
+    }
+    struct io_uring_cqe cqe;
+    while (!__atomic_load_n(&shard->stop, __ATOMIC_ACQUIRE)) {
+        shard_drain_outbound(shard);
+        int timeout_ms = shard_next_timeout(maester, shard);
+        uring_submit_sends(ring, maester);
+        if (timeout_ms != 0 && !frame_queue_prepare_wait(&shard->outbound)) {
+            timeout_ms = 0;
+        }
+        int result = uring_submit_and_wait(ring, timeout_ms);
+        frame_queue_finish_wait(&shard->outbound);
+        if (result != 0) {
+            write_str(STDERR_FILENO, "Error: network worker io_uring failed.\n");
+            break;
+        }
+        unsigned budget = REACTOR_MAX_EVENTS;
+        while (budget-- > 0 && uring_next_completion(ring, &cqe)) {
+            uring_handle_completion(maester, shard, &cqe);
+        }
+    }
+    shard_drain_outbound(shard);
+    uring_quiesce(maester, shard);
+}
+
+static void* shard_main(void* arg) {
+    Shard* shard = (Shard*)arg;
+    Maester* maester = shard->maester;
+    t_shard = shard;
+    if (shard->uring != NULL) {
+        shard_run_uring(shard);
+        return NULL;
+    }
+
+    ReactorEvent events[REACTOR_MAX_EVENTS];
+    while (!__atomic_load_n(&shard->stop, __ATOMIC_ACQUIRE)) {
+        shard_drain_outbound(shard);
+        int timeout_ms = shard_next_timeout(maester, shard);
+        if (timeout_ms != 0 && !frame_queue_prepare_wait(&shard->outbound)) {
+            timeout_ms = 0;
+        }
+        int ready = reactor_wait(&shard->reactor, events, REACTOR_MAX_EVENTS, timeout_ms);
+        frame_queue_finish_wait(&shard->outbound);
+        if (ready < 0) {
+            write_str(STDERR_FILENO, "Error: network worker reactor failed.\n");
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            if (events[i].tag == REACTOR_TAG_WAKE) {
+                frame_queue_ack_wake(&shard->outbound);
+                continue;
+            }
+            ConnectionEntry* entry = maester_connection_from_tag(maester, events[i].tag);
+            if (entry != NULL && entry->shard == shard) {
+                maester_handle_connection_event(maester, entry, events[i].events);
+            }
+        }
+    }
+    // Deliver whatever other threads handed over before the stop request
+    shard_drain_outbound(shard);
+    return NULL;
+}
+
+static int shard_init(Maester* maester, Shard* shard, int id, size_t pool_bytes) {
+    shard->maester = maester;
+    shard->id = id;
+    __atomic_store_n(&shard->running, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&shard->stop, 0, __ATOMIC_RELEASE);
+    shard->connects_pending = 0;
+    shard->transfers_pending = 0;
+    shard->holds_pending = 0;
+    shard->holds_check_us = 0;
+    shard->uring = NULL;
+    if (reactor_init(&shard->reactor) != 0) {
+        return -1;
+    }
+    if (frame_queue_init(&shard->outbound, SHARD_QUEUE_CAPACITY) != 0) {
+        reactor_destroy(&shard->reactor);
+        return -1;
+    }
+    if (reactor_add(&shard->reactor, shard->outbound.wake_fd, REACTOR_READABLE, REACTOR_TAG_WAKE) != 0) {
+        frame_queue_destroy(&shard->outbound);
+        reactor_destroy(&shard->reactor);
+        return -1;
+    }
+    send_pool_init(&shard->send_pool, pool_bytes);
+    recv_pool_init(&shard->recv_pool);
+    return 0;
+}
+
+// Switch the shard to the io_uring backend; it stays on epoll if that fails
+static int shard_init_uring(Shard* shard) {
+    Uring* ring = (Uring*)malloc(sizeof(Uring));
+    if (ring == NULL) return -1;
+    if (uring_init(ring, URING_ENTRIES, URING_RECV_BUFFERS) != 0) {
+        free(ring);
+        return -1;
+    }
+    shard->uring = ring;
+    return 0;
+}
+
+static void shard_release_uring(Shard* shard) {
+    if (shard->uring != NULL) {
+        uring_destroy(shard->uring);
+        free(shard->uring);
+        shard->uring = NULL;
+    }
+}
+
+static void shard_destroy(Shard* shard) {
+    shard_release_uring(shard);
+    frame_queue_destroy(&shard->outbound);
+    reactor_destroy(&shard->reactor);
+    send_pool_destroy(&shard->send_pool);
+    recv_pool_destroy(&shard->recv_pool);
+}
+
+static int shards_default_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return (cpus > SHARD_AUTO_MAX) ? SHARD_AUTO_MAX : (int)cpus;
+}
+
+/**
+ * Spawn tuning.workers network threads (one per CPU, capped, when 0). The
+ * send pool budget is split between them; each keeps its own pools so the
+ * I/O paths take no locks. With tuning.io_backend set to io_uring each shard
+ * gets a ring, unless the kernel lacks what the backend needs: then every
+ * shard uses the readiness (epoll) backend instead.
+ */
+int shards_start(Maester* maester) {
+    if (maester == NULL) return -1;
+    int count = (maester->tuning.workers > 0) ? maester->tuning.workers : shards_default_count();
+    maester->shards = (Shard*)calloc((size_t)count, sizeof(Shard));
+    if (maester->shards == NULL) {
+        return -1;
+    }
+    size_t pool_bytes = (size_t)maester->tuning.send_pool_kb * 1024 / (size_t)count;
+    if (pool_bytes < 64 * 1024) {
+        pool_bytes = 64 * 1024;
+    }
+    for (int i = 0; i < count; i++) {
+        if (shard_init(maester, &maester->shards[i], i, pool_bytes) != 0) {
+            write_str(STDERR_FILENO, "Error: Unable to set up a network worker.\n");
+            for (int j = 0; j < i; j++) {
+                shard_destroy(&maester->shards[j]);
+            }
+            free(maester->shards);
+            maester->shards = NULL;
+            return -1;
+        }
+        if (maester->tuning.io_backend == IO_BACKEND_URING && shard_init_uring(&maester->shards[i]) != 0) {
+            // All shards run one backend: the listener and the reported
+            // backend follow tuning.io_backend
+            write_str(STDERR_FILENO, "Warning: io_uring is not available; using epoll.\n");
+            maester->tuning.io_backend = IO_BACKEND_EPOLL;
+            for (int j = 0; j < i; j++) {
+                shard_release_uring(&maester->shards[j]);
+            }
+        }
+    }
+    maester->num_shards = count;
+    maester->next_shard = 0;
+
+    for (int i = 0; i < count; i++) {
+        Shard* shard = &maester->shards[i];
+        __atomic_store_n(&shard->running, 1, __ATOMIC_RELEASE);
+        if (pthread_create(&shard->thread, NULL, shard_main, shard) != 0) {
+            __atomic_store_n(&shard->running, 0, __ATOMIC_RELEASE);
+            write_str(STDERR_FILENO, "Error: Unable to start a network worker thread.\n");
+            shards_stop(maester);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Stop and join every worker. Connections stay open; afterwards they are
+// driven directly by the calling thread (shutdown broadcast, close).
+void shards_stop(Maester* maester) {
+    if (maester == NULL || maester->shards == NULL) return;
+    for (int i = 0; i < maester->num_shards; i++) {
+        Shard* shard = &maester->shards[i];
+        if (!__atomic_load_n(&shard->running, __ATOMIC_ACQUIRE)) continue;
+        __atomic_store_n(&shard->stop, 1, __ATOMIC_RELEASE);
+        uint64_t one = 1;
+        ssize_t ignored = write(shard->outbound.wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    for (int i = 0; i < maester->num_shards; i++) {
+        Shard* shard = &maester->shards[i];
+        if (!__atomic_load_n(&shard->running, __ATOMIC_ACQUIRE)) continue;
+        pthread_join(shard->thread, NULL);
+        __atomic_store_n(&shard->running, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// Release worker resources once no connection refers to them any more
+void shards_destroy(Maester* maester) {
+    if (maester == NULL || maester->shards == NULL) return;
+    shards_stop(maester);
+    for (int i = 0; i < maester->num_shards; i++) {
+        shard_destroy(&maester->shards[i]);
+    }
+    free(maester->shards);
+    maester->shards = NULL;
+    maester->num_shards = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include "maester.h"
+
+// Lock-free hand-off queue between threads (one consumer: the owning shard)
+int          frame_queue_init(FrameQueue* queue, size_t capacity);
+void         frame_queue_destroy(FrameQueue* queue);
+int          frame_queue_push(FrameQueue* queue, QueuedFrameKind kind, ConnHandle handle, const uint8_t* bytes, size_t length);
+QueuedFrame* frame_queue_peek(FrameQueue* queue);
+void         frame_queue_consume(FrameQueue* queue);
+int          frame_queue_prepare_wait(FrameQueue* queue);
+void         frame_queue_finish_wait(FrameQueue* queue);
+void         frame_queue_ack_wake(FrameQueue* queue);
+
+// Network worker threads
+int    shards_start(Maester* maester);
+void   shards_stop(Maester* maester);
+void   shards_destroy(Maester* maester);
+Shard* shard_current(void);
+int    shard_running(const Shard* shard);
+Shard* shard_assign(Maester* maester);
+int    shard_post(Shard* shard, QueuedFrameKind kind, ConnHandle handle, const uint8_t* bytes, size_t length);
+
+#endif
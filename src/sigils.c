@@ -0,0 +1,181 @@
+#define _GNU_SOURCE   // madvise()
+
+#include "sigils.h"
+#include "helper.h"
+#include "md5.h"
+
+#include <errno.h>
+#include <stdio.h>    // rename()
+#include <sys/mman.h>
+
+#define SIGIL_COPY_CHUNK  65536
+
+static void sigil_store_path(const SigilStore* store, const char* md5_hex, char* out, size_t out_len);
+static int  sigil_store_verify(DigestCache* digests, const char* path, size_t size, const uint8_t expect[16]);
+static int  sigil_copy_file(const char* from, const char* to);
+
+void sigil_store_init(SigilStore* store, const char* folder_path, int enabled) {
+    if (store == NULL) return;
+    store->enabled = enabled && folder_path != NULL;
+    store->reused = 0;
+    store->bytes_saved = 0;
+    store->dir[0] = '\0';
+    if (store->enabled &&
+        (safe_append(store->dir, sizeof(store->dir), folder_path) != 0 ||
+         safe_append(store->dir, sizeof(store->dir), "/" SIGIL_STORE_DIR) != 0)) {
+        store->enabled = 0;
+    }
+}
+
+int sigil_store_claim(SigilStore* store, DigestCache* digests, const char* md5_hex, size_t size,
+                      const char* out_path) {
+    uint8_t expect[16];
+    if (store == NULL || !store->enabled || out_path == NULL || md5_hex_to_digest(md5_hex, expect) != 0) {
+        return -1;
+    }
+    char path[SIGIL_STORE_PATH_MAX + 40];
+    char hex[33];
+    md5_digest_to_hex(expect, hex);     // Stored under the lowercase digest
+    sigil_store_path(store, hex, path, sizeof(path));
+
+    int verified = sigil_store_verify(digests, path, size, expect);
+    if (verified < 0) {
+        return -1;
+    }
+    if (verified == 0) {
+        write_str(STDERR_FILENO, "Warning: Dropping damaged sigil store entry ");
+        write_str(STDERR_FILENO, hex);
+        write_str(STDERR_FILENO, "\n");
+        unlink(path);
+        return -1;
+    }
+
+    unlink(out_path);
+    if (link(path, out_path) != 0 && sigil_copy_file(path, out_path) != 0) {
+        unlink(out_path);
+        return -1;
+    }
+    __atomic_fetch_add(&store->reused, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&store->bytes_saved, (unsigned long long)size, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void sigil_store_add(SigilStore* store, const char* path, const char* md5_hex) {
+    uint8_t digest[16];
+    if (store == NULL || !store->enabled || path == NULL || md5_hex_to_digest(md5_hex, digest) != 0) {
+        return;
+    }
+    char stored[SIGIL_STORE_PATH_MAX + 40];
+    char hex[33];
+    md5_digest_to_hex(digest, hex);
+    sigil_store_path(store, hex, stored, sizeof(stored));
+
+    mkdir(store->dir, 0755);  // Ignore error if it already exists
+    if (link(path, stored) == 0 || errno == EEXIST) {
+        return;
+    }
+    // No hard links here: keep a copy, published only once complete
+    char tmp[SIGIL_STORE_PATH_MAX + 48];
+    tmp[0] = '\0';
+    safe_append(tmp, sizeof(tmp), stored);
+    safe_append(tmp, sizeof(tmp), ".tmp");
+    if (sigil_copy_file(path, tmp) != 0 || rename(tmp, stored) != 0) {
+        write_str(STDERR_FILENO, "Warning: Could not add a sigil to the store.\n");
+        unlink(tmp);
+    }
+}
+
+void sigil_store_stats(SigilStore* store, unsigned long long* reused, unsigned long long* bytes_saved) {
+    if (store == NULL) return;
+    if (reused != NULL) *reused = __atomic_load_n(&store->reused, __ATOMIC_RELAXED);
+    if (bytes_saved != NULL) *bytes_saved = __atomic_load_n(&store->bytes_saved, __ATOMIC_RELAXED);
+}
+
+// ============= INTERNALS =============
+
+static void sigil_store_path(const SigilStore* store, const char* md5_hex, char* out, size_t out_len) {
+    out[0] = '\0';
+    safe_append(out, out_len, store->dir);
+    safe_append(out, out_len, "/");
+    safe_append(out, out_len, md5_hex);
+}
+
+/**
+ * Check a stored file against the digest it is filed under. Returns 1 if it
+ * matches, 0 if it is damaged, -1 if it is not there (or not `size` bytes).
+ */
+static int sigil_store_verify(DigestCache* digests, const char* path, size_t size, const uint8_t expect[16]) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    off_t length = lseek(fd, 0, SEEK_END);
+    if (length < 0 || (size_t)length != size) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t digest[16];
+    struct stat st;
+    int identified = (digests != NULL && digests->enabled && fstat(fd, &st) == 0);
+    int hashed = 0;
+    int cached = (identified && digest_cache_lookup(digests, path, &st, digest));
+    if (cached) {
+        hashed = 1;
+    } else if (md5_selected() == MD5_BACKEND_MD5SUM) {
+        hashed = (md5_digest_file(path, digest) == 0);
+    } else if (size == 0) {
+        md5_buffer("", 0, digest);
+        hashed = 1;
+    } else {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, size, MADV_SEQUENTIAL);
+            md5_buffer(map, size, digest);
+            munmap(map, size);
+            hashed = 1;
+        }
+    }
+    close(fd);
+    if (!hashed) {
+        return -1;
+    }
+    int match = (memcmp(digest, expect, 16) == 0);
+    if (match && identified && !cached) {
+        digest_cache_store(digests, path, &st, digest);
+    }
+    return match;
+}
+
+static int sigil_copy_file(const char* from, const char* to) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    char buffer[SIGIL_COPY_CHUNK];
+    int result = 0;
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        ssize_t done = 0;
+        while (done < n) {
+            ssize_t written = write(out, buffer + done, (size_t)(n - done));
+            if (written <= 0) {
+                result = -1;
+                break;
+            }
+            done += written;
+        }
+        if (result != 0) break;
+    }
+    if (n < 0) {
+        result = -1;
+    }
+    close(in);
+    close(out);
+    return result;
+}
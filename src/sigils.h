@@ -0,0 +1,36 @@
+#ifndef SIGILS_H
+#define SIGILS_H
+
+#include <stddef.h>
+
+#include "digests.h"
+
+// Content-addressed store of received sigils: <folder>/.sigils/<md5> holds
+// one verified copy of every file that passed its MD5 check, hard-linked to
+// the received file where the filesystem allows it. A header naming a digest
+// the store already holds is answered from it without moving the file.
+
+#define SIGIL_STORE_DIR      ".sigils"
+#define SIGIL_STORE_PATH_MAX 256
+
+typedef struct {
+    char               dir[SIGIL_STORE_PATH_MAX];
+    int                enabled;
+    unsigned long long reused;        // Transfers answered from the store
+    unsigned long long bytes_saved;   // Payload those transfers did not send
+} SigilStore;
+
+void sigil_store_init(SigilStore* store, const char* folder_path, int enabled);
+
+// Place the stored file with digest `md5_hex` and `size` bytes at `out_path`.
+// The stored copy is checked against its digest first (through `digests`
+// when its identity is known); a damaged copy is dropped. Returns 0 if placed.
+int  sigil_store_claim(SigilStore* store, DigestCache* digests, const char* md5_hex, size_t size,
+                       const char* out_path);
+
+// Keep a verified file under its digest
+void sigil_store_add(SigilStore* store, const char* path, const char* md5_hex);
+
+void sigil_store_stats(SigilStore* store, unsigned long long* reused, unsigned long long* bytes_saved);
+
+#endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE   // fallocate(), sync_file_range(), pwrite()
+
+#include "sinks.h"
+#include "helper.h"
+
+#include <errno.h>
+
+#define FILE_SINK_READ_CHUNK  16384
+
+static int  file_sink_pwrite(FileSink* sink, size_t offset, const uint8_t* data, size_t length);
+static int  file_sink_flush_aligned(FileSink* sink);
+static void file_sink_writeback(FileSink* sink, size_t end);
+
+void file_sink_init(FileSink* sink) {
+    if (sink == NULL) return;
+    memset(sink, 0, sizeof(FileSink));
+    sink->fd = -1;
+}
+
+int file_sink_open(FileSink* sink, const char* path, size_t size, size_t* keep, const Md5Context* resumed) {
+    if (sink == NULL || path == NULL || keep == NULL) return -1;
+    file_sink_init(sink);
+    size_t kept = (*keep > size) ? size : *keep;
+    int fd = open(path, O_RDWR | O_CREAT | (kept > 0 ? 0 : O_TRUNC), 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (kept > 0 && lseek(fd, 0, SEEK_END) < (off_t)kept) {
+        kept = 0;   // Part of what the caller expected is gone: start over
+        if (ftruncate(fd, 0) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    // Reserve the blocks without changing the length; a filesystem that
+    // cannot preallocate simply allocates as the data arrives
+    if (size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0 && errno == ENOSPC) {
+        close(fd);
+        return -1;
+    }
+
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, FILE_SINK_ALIGN, FILE_SINK_BUFFER) != 0) {
+        buffer = NULL;
+    }
+    sink->fd = fd;
+    sink->size = size;
+    sink->buffer = (uint8_t*)buffer;
+    sink->buffer_offset = kept;
+    sink->hashed = kept;
+    sink->sync_from = kept;
+    if (kept > 0 && resumed != NULL) {
+        sink->digest = *resumed;
+    } else {
+        md5_init(&sink->digest);
+    }
+    *keep = kept;
+    return 0;
+}
+
+/**
+ * Below the buffer the data goes straight to the file (a retransmission
+ * filling a hole); inside it, it overwrites the buffered bytes; right after
+ * it, it is appended. Data further ahead starts a new buffer there.
+ */
+int file_sink_write(FileSink* sink, size_t offset, const uint8_t* data, size_t length) {
+    if (sink == NULL || sink->fd < 0) return -1;
+    if (sink->buffer == NULL) {
+        return file_sink_pwrite(sink, offset, data, length);
+    }
+    while (length > 0) {
+        size_t end = sink->buffer_offset + sink->buffered;
+        size_t n;
+        if (offset < sink->buffer_offset) {
+            n = sink->buffer_offset - offset;
+            if (n > length) n = length;
+            if (file_sink_pwrite(sink, offset, data, n) != 0) return -1;
+        } else if (offset < end) {
+            n = end - offset;
+            if (n > length) n = length;
+            memcpy(sink->buffer + (offset - sink->buffer_offset), data, n);
+        } else {
+            if (offset > end) {
+                if (file_sink_flush(sink) != 0) return -1;
+                sink->buffer_offset = offset;
+            } else if (sink->buffered == FILE_SINK_BUFFER && file_sink_flush_aligned(sink) != 0) {
+                return -1;
+            }
+            n = FILE_SINK_BUFFER - sink->buffered;
+            if (n > length) n = length;
+            memcpy(sink->buffer + sink->buffered, data, n);
+            sink->buffered += n;
+        }
+        offset += n;
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+ * Hash [hashed, end): straight from the buffer where it is still there,
+ * otherwise read back from the file (the page cache, as it was just written).
+ */
+int file_sink_hash_to(FileSink* sink, size_t end) {
+    if (sink == NULL || sink->fd < 0) return -1;
+    if (end > sink->size) end = sink->size;
+    uint8_t chunk[FILE_SINK_READ_CHUNK];
+    while (sink->hashed < end) {
+        size_t offset = sink->hashed;
+        size_t buffer_end = sink->buffer_offset + sink->buffered;
+        size_t n;
+        if (sink->buffered > 0 && offset >= sink->buffer_offset && offset < buffer_end) {
+            n = ((end < buffer_end) ? end : buffer_end) - offset;
+            md5_update(&sink->digest, sink->buffer + (offset - sink->buffer_offset), n);
+        } else {
+            n = end - offset;
+            if (sink->buffered > 0 && offset < sink->buffer_offset && sink->buffer_offset - offset < n) {
+                n = sink->buffer_offset - offset;
+            }
+            if (n > sizeof(chunk)) n = sizeof(chunk);
+            ssize_t got = pread(sink->fd, chunk, n, (off_t)offset);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return -1;
+            n = (size_t)got;
+            md5_update(&sink->digest, chunk, n);
+        }
+        sink->hashed += n;
+    }
+    return 0;
+}
+
+int file_sink_flush(FileSink* sink) {
+    if (sink == NULL || sink->fd < 0) return -1;
+    if (sink->buffered == 0) return 0;
+    if (file_sink_pwrite(sink, sink->buffer_offset, sink->buffer, sink->buffered) != 0) {
+        return -1;
+    }
+    sink->buffer_offset += sink->buffered;
+    sink->buffered = 0;
+    file_sink_writeback(sink, sink->buffer_offset);
+    return 0;
+}
+
+int file_sink_close(FileSink* sink) {
+    if (sink == NULL || sink->fd < 0) return -1;
+    int result = file_sink_flush(sink);
+    // The rest of the file, to its end; the call only queues the writeback
+    sync_file_range(sink->fd, (off_t)sink->sync_from, 0, SYNC_FILE_RANGE_WRITE);
+    file_sink_abort(sink);
+    return result;
+}
+
+void file_sink_abort(FileSink* sink) {
+    if (sink == NULL) return;
+    if (sink->fd >= 0) {
+        close(sink->fd);
+        sink->fd = -1;
+    }
+    free(sink->buffer);
+    sink->buffer = NULL;
+    sink->buffered = 0;
+}
+
+// ============= INTERNALS =============
+
+static int file_sink_pwrite(FileSink* sink, size_t offset, const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = pwrite(sink->fd, data + written, length - written, (off_t)(offset + written));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        written += (size_t)n;
+    }
+    return 0;
+}
+
+// Full buffer: write it up to the last 4 KiB boundary and keep the tail
+static int file_sink_flush_aligned(FileSink* sink) {
+    size_t end = sink->buffer_offset + sink->buffered;
+    size_t cut = end & ~(size_t)(FILE_SINK_ALIGN - 1);
+    if (cut <= sink->buffer_offset) {
+        return file_sink_flush(sink);
+    }
+    size_t length = cut - sink->buffer_offset;
+    if (file_sink_pwrite(sink, sink->buffer_offset, sink->buffer, length) != 0) {
+        return -1;
+    }
+    memmove(sink->buffer, sink->buffer + length, end - cut);
+    sink->buffer_offset = cut;
+    sink->buffered = end - cut;
+    file_sink_writeback(sink, cut);
+    return 0;
+}
+
+// Hand the data written up to `end` to writeback once enough has piled up
+static void file_sink_writeback(FileSink* sink, size_t end) {
+    if (end <= sink->sync_from || end - sink->sync_from < FILE_SINK_SYNC) {
+        return;
+    }
+    sync_file_range(sink->fd, (off_t)sink->sync_from, (off_t)(end - sink->sync_from), SYNC_FILE_RANGE_WRITE);
+    sink->sync_from = end;
+}
@@ -0,0 +1,56 @@
+#ifndef SINKS_H
+#define SINKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "md5.h"
+
+// Receive-side file writer. The announced size is reserved up front with
+// fallocate() (the file length still follows the data written); payloads are
+// gathered in a page-aligned buffer and written in large, 4 KiB-aligned
+// pieces; the in-order prefix is hashed from that buffer (or read back from
+// the page cache when it arrived out of order); and writeback of what was
+// written is started early with sync_file_range(), so the kernel flushes the
+// file while it is still arriving instead of in one burst afterwards.
+
+#define FILE_SINK_BUFFER  (256 * 1024)       // Payload gathered before a write
+#define FILE_SINK_ALIGN   4096
+#define FILE_SINK_SYNC    (4 * 1024 * 1024)  // Bytes written per background writeback request
+
+typedef struct {
+    int        fd;
+    size_t     size;            // Announced size of the file
+    uint8_t*   buffer;          // FILE_SINK_BUFFER bytes; NULL writes straight through
+    size_t     buffer_offset;   // File offset of buffer[0]
+    size_t     buffered;
+    size_t     hashed;          // Bytes from offset 0 fed to `digest`
+    size_t     sync_from;       // Start of the data written since the last writeback request
+    Md5Context digest;
+} FileSink;
+
+void file_sink_init(FileSink* sink);
+
+// Open `path` for a `size`-byte file. `*keep` bytes of an existing file are
+// kept (a resumption, with `resumed` the digest over them); when the file is
+// shorter, it is emptied and `*keep` set to 0. Returns -1 if the file cannot
+// be created or the disk has no room for it.
+int  file_sink_open(FileSink* sink, const char* path, size_t size, size_t* keep, const Md5Context* resumed);
+
+// Store `length` bytes at `offset`. Writes need not arrive in order, but data
+// continuing the latest write is the case that stays in the buffer.
+int  file_sink_write(FileSink* sink, size_t offset, const uint8_t* data, size_t length);
+
+// Feed the digest up to `end` (every byte below it has been written)
+int  file_sink_hash_to(FileSink* sink, size_t end);
+
+// Write out everything buffered
+int  file_sink_flush(FileSink* sink);
+
+// Flush, start writeback and close; -1 if buffered data could not be written
+int  file_sink_close(FileSink* sink);
+
+// Close without writing what is still buffered (the file is being dropped)
+void file_sink_abort(FileSink* sink);
+
+#endif
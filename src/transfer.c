@@ -0,0 +1,2192 @@
+#define _GNU_SOURCE   // madvise(), pwrite(), clock_gettime()
+
+#include "transfer.h"
+#include "network.h"
+#include "connections.h"
+
+#include <sys/mman.h>
+
+// Delay-based window adaptation: frames the window may keep queued along the
+// path (cwnd * (rtt - rtt_min) / rtt) before it stops growing or shrinks
+#define TRANSFER_QUEUE_LOW       4
+#define TRANSFER_QUEUE_HIGH      16
+
+static OutgoingTransfer* transfer_find_outgoing(TransferTable* table, const char* realm, uint16_t stream);
+static IncomingTransfer* transfer_find_incoming(TransferTable* table, FrameType data_type, const char* origin,
+                                                uint16_t stream);
+static uint16_t transfer_next_stream(TransferTable* table);
+static void   transfer_replace_incoming(TransferTable* table, FrameType data_type, const char* origin,
+                                        uint16_t stream, const char* path, int keep_partial);
+static void   transfer_release_outgoing(TransferTable* table, OutgoingTransfer* transfer);
+static void   transfer_release_incoming(IncomingTransfer* transfer, int keep_partial);
+static void   transfer_fill(Maester* maester, OutgoingTransfer* transfer, ConnectionEntry* entry);
+static void   transfer_fill_windowed(OutgoingTransfer* transfer, ConnectionEntry* entry, int stripe, uint64_t now);
+static int    transfer_start_windowed(OutgoingTransfer* transfer, int window);
+static void   transfer_skip_held(OutgoingTransfer* transfer, uint32_t held);
+static void   transfer_rtt_sample(OutgoingTransfer* transfer, uint64_t sample);
+static uint64_t transfer_base_rto(const OutgoingTransfer* transfer);
+static void   transfer_mark_delivered(OutgoingTransfer* transfer, uint32_t seq);
+static void   transfer_leave_flight(OutgoingTransfer* transfer, uint32_t seq);
+static int    transfer_stripe_id(const OutgoingTransfer* transfer, ConnHandle handle);
+static int    transfer_stripe_handles(const OutgoingTransfer* transfer, ConnHandle* out);
+static void   transfer_open_stripes(Maester* maester, const char* realm, uint16_t stream, ConnHandle next_hop);
+static void   transfer_drop_stripe(OutgoingTransfer* transfer, int stripe);
+static int    transfer_check_stripes(OutgoingTransfer* transfer, const ConnectionTable* connections);
+static void   transfer_adapt_window(OutgoingTransfer* transfer);
+static void   transfer_on_timeout(OutgoingTransfer* transfer);
+static size_t transfer_take_windowed(IncomingTransfer* transfer, const uint8_t* data, uint16_t length,
+                                     uint8_t* ack, int* failed);
+static size_t transfer_build_data_ack(const IncomingTransfer* transfer, uint8_t* ack);
+static int    transfer_hash_part(const char* part, size_t size, uint8_t digest[16]);
+static void   transfer_finish_incoming(Maester* maester, ConnectionEntry* entry, IncomingTransfer* done);
+static int    transfer_receive_from_store(Maester* maester, ConnectionEntry* entry, FrameType data_type,
+                                          const char* origin, const char* realm, uint16_t stream,
+                                          const char* path, const char* md5, size_t size);
+static int    transfer_send_to(Maester* maester, ConnectionEntry* entry, const char* realm, FrameType type,
+                               const uint8_t* data, size_t length);
+static int    transfer_send_ack(Maester* maester, ConnectionEntry* entry, const char* realm, FrameType type, const char* text);
+static int    transfer_parse_size(const char* text, size_t* out);
+static size_t transfer_frame_count(size_t size);
+static void   transfer_part_path(const char* path, char* out, size_t out_len);
+static void   transfer_resume_path(const char* path, char* out, size_t out_len);
+static void   transfer_save_progress(IncomingTransfer* transfer);
+static uint32_t transfer_load_progress(const char* path, const char* md5, size_t size, size_t chunk,
+                                       Md5Context* digest);
+static void   transfer_discard_progress(const char* path);
+static int    transfer_hex_value(char c);
+static void   transfer_suspend(OutgoingTransfer* transfer);
+static void   transfer_reconnect(Maester* maester, const char* realm, uint16_t stream);
+static int    transfer_build_resume(Maester* maester, const OutgoingTransfer* transfer, CitadelFrame* frame);
+static uint64_t transfer_now_us(void);
+static void   transfer_put_u32(uint8_t* out, uint32_t value);
+static uint32_t transfer_get_u32(const uint8_t* in);
+static uint16_t transfer_get_u16(const uint8_t* in);
+static void   transfer_append_stream(char* out, size_t out_len, uint16_t stream);
+static int    transfer_option_value(const char* field, const char* key, size_t* out);
+static void   transfer_pack_images(Maester* maester, const PackDictionary* dict, const uint8_t* map, size_t size,
+                                   uint8_t** packed, size_t* packed_size, char* dict_id);
+static void   transfer_append_packings(char* out, size_t out_len, const OutgoingTransfer* transfer);
+static void   transfer_choose_packing(OutgoingTransfer* transfer, int packing);
+static int    transfer_unpack_part(const char* part, IncomingTransfer* done);
+
+void transfer_table_init(TransferTable* table, ConnectionTable* connections) {
+    if (table == NULL) return;
+    memset(table, 0, sizeof(TransferTable));
+    table->connections = connections;
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        file_sink_init(&table->incoming[i].sink);
+    }
+}
+
+// Shutdown: unmap what is still being sent, drop half-received files that
+// cannot be resumed. The connections (stripes included) are already closed.
+void transfer_table_destroy(TransferTable* table) {
+    if (table == NULL) return;
+    table->connections = NULL;
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        transfer_release_outgoing(table, &table->outgoing[i]);
+        transfer_release_incoming(&table->incoming[i], 1);
+    }
+}
+
+// Transfer to `realm` on `stream`; stream 0 finds the one whose receiver does
+// not tag its answers (there is at most one per realm)
+static OutgoingTransfer* transfer_find_outgoing(TransferTable* table, const char* realm, uint16_t stream) {
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        OutgoingTransfer* transfer = &table->outgoing[i];
+        if (transfer->state != TRANSFER_IDLE && my_strcasecmp(transfer->realm, realm) == 0 &&
+            (stream != 0 ? transfer->stream == stream : !transfer->streamed)) {
+            return transfer;
+        }
+    }
+    return NULL;
+}
+
+static IncomingTransfer* transfer_find_incoming(TransferTable* table, FrameType data_type, const char* origin,
+                                                uint16_t stream) {
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        IncomingTransfer* transfer = &table->incoming[i];
+        if (transfer->in_use && transfer->data_type == data_type && transfer->stream == stream &&
+            my_strcmp(transfer->origin, origin) == 0) {
+            return transfer;
+        }
+    }
+    return NULL;
+}
+
+// Next stream ID no transfer in progress carries (never 0)
+static uint16_t transfer_next_stream(TransferTable* table) {
+    for (;;) {
+        uint16_t stream = ++table->last_stream;
+        int used = (stream == 0);
+        for (int i = 0; i < TRANSFER_MAX && !used; i++) {
+            used = (table->outgoing[i].state != TRANSFER_IDLE && table->outgoing[i].stream == stream);
+        }
+        if (!used) return stream;
+    }
+}
+
+// A header replaces the transfer it repeats: the same stream from the same
+// sender, or whichever transfer is writing the same file
+static void transfer_replace_incoming(TransferTable* table, FrameType data_type, const char* origin,
+                                      uint16_t stream, const char* path, int keep_partial) {
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        IncomingTransfer* transfer = &table->incoming[i];
+        if (!transfer->in_use) continue;
+        if ((transfer->data_type == data_type && transfer->stream == stream &&
+             my_strcmp(transfer->origin, origin) == 0) || my_strcmp(transfer->path, path) == 0) {
+            transfer_release_incoming(transfer, keep_partial);
+        }
+    }
+}
+
+// Stripes are closed from whichever thread lets go of the transfer; a stripe
+// owned by another shard is closed by that shard
+static void transfer_release_outgoing(TransferTable* table, OutgoingTransfer* transfer) {
+    if (transfer->map != NULL) {
+        munmap((void*)transfer->map, transfer->size);
+        transfer->map = NULL;
+    }
+    transfer_choose_packing(transfer, TRANSFER_PACK_NONE);
+    for (int i = 1; i < transfer->num_stripes; i++) {
+        if (table->connections != NULL && transfer->stripes[i] != 0) {
+            maester_close_connection_entry(connection_table_lookup(table->connections, transfer->stripes[i]));
+        }
+        transfer->stripes[i] = 0;
+    }
+    transfer->num_stripes = 1;
+    free(transfer->frame_flags);
+    free(transfer->sent_us);
+    free(transfer->sent_on);
+    transfer->frame_flags = NULL;
+    transfer->sent_us = NULL;
+    transfer->sent_on = NULL;
+    transfer->windowed = 0;
+    transfer->resumable = 0;
+    transfer->timer_us = 0;
+    transfer->state = TRANSFER_IDLE;
+}
+
+// With `keep_partial`, a resumable file that got somewhere keeps its .part
+// and the record of how far it got; anything else is deleted
+static void transfer_release_incoming(IncomingTransfer* transfer, int keep_partial) {
+    if (!transfer->in_use) return;
+    if (keep_partial && transfer->resumable && transfer->next_expected > 0 &&
+        transfer->next_expected < transfer->frames) {
+        transfer_save_progress(transfer);
+        file_sink_close(&transfer->sink);
+    } else {
+        char part[PATH_MAX_LEN + 8];
+        transfer_part_path(transfer->path, part, sizeof(part));
+        file_sink_abort(&transfer->sink);
+        unlink(part);
+        transfer_discard_progress(transfer->path);
+    }
+    free(transfer->have);
+    transfer->have = NULL;
+    pack_dictionary_free(&transfer->dict);
+    transfer->in_use = 0;
+}
+
+static void transfer_part_path(const char* path, char* out, size_t out_len) {
+    out[0] = '\0';
+    safe_append(out, out_len, path);
+    safe_append(out, out_len, ".part");
+}
+
+static void transfer_resume_path(const char* path, char* out, size_t out_len) {
+    out[0] = '\0';
+    safe_append(out, out_len, path);
+    safe_append(out, out_len, ".resume");
+}
+
+static int transfer_parse_size(const char* text, size_t* out) {
+    if (text == NULL || text[0] == '\0') return -1;
+    size_t value = 0;
+    for (const char* p = text; *p != '\0'; ++p) {
+        if (*p < '0' || *p > '9') return -1;
+        value = value * 10 + (size_t)(*p - '0');
+    }
+    *out = value;
+    return 0;
+}
+
+static size_t transfer_frame_count(size_t size) {
+    return (size + FRAME_MAX_DATA - 1) / FRAME_MAX_DATA;
+}
+
+static uint64_t transfer_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+static void transfer_put_u32(uint8_t* out, uint32_t value) {
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+static uint32_t transfer_get_u32(const uint8_t* in) {
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | (uint32_t)in[3];
+}
+
+static uint16_t transfer_get_u16(const uint8_t* in) {
+    return (uint16_t)(((uint16_t)in[0] << 8) | (uint16_t)in[1]);
+}
+
+// "&STREAM=<id>" for a tagged stream, nothing for stream 0
+static void transfer_append_stream(char* out, size_t out_len, uint16_t stream) {
+    if (stream == 0) return;
+    char number[8];
+    int_to_str((int)stream, number);
+    safe_append(out, out_len, "&STREAM=");
+    safe_append(out, out_len, number);
+}
+
+// Option field "<key><number>" (the text after its '&'): 1 with the number in `out`
+static int transfer_option_value(const char* field, const char* key, size_t* out) {
+    while (*key != '\0') {
+        if (*field++ != *key++) return 0;
+    }
+    return transfer_parse_size(field, out) == 0;
+}
+
+// Dictionary of our product names. Callers hold alliances_lock, which guards
+// the stock: incoming frames do, and PLEDGE builds it before letting go of it.
+int transfer_stock_dictionary(Maester* maester, PackDictionary* dict) {
+    pack_dictionary_init(dict);
+    if (maester->stock == NULL || maester->num_products <= 0) return 0;
+    const char** names = (const char**)malloc((size_t)maester->num_products * sizeof(const char*));
+    if (names == NULL) return -1;
+    for (int i = 0; i < maester->num_products; i++) {
+        names[i] = maester->stock[i].name;
+    }
+    int result = pack_dictionary_build(dict, names, maester->num_products);
+    free(names);
+    return result;
+}
+
+// ============= SENDER =============
+
+/**
+ * Map the file, hash it and pack it against `dict` (our stock dictionary, or
+ * NULL) into `source`. Touches no shared state but the digest cache, which
+ * has its own lock, so it runs without alliances_lock: a large file takes a
+ * while. Returns -1 with a message if the file cannot be read.
+ */
+int transfer_send_prepare(Maester* maester, const char* path, const PackDictionary* dict, TransferSource* source) {
+    if (maester == NULL || path == NULL || source == NULL) return -1;
+    memset(source, 0, sizeof(*source));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        write_str(STDOUT_FILENO, "Error: Could not open file for transfer: ");
+        write_str(STDOUT_FILENO, path);
+        write_str(STDOUT_FILENO, "\n");
+        return -1;
+    }
+    // The digest cache knows the file by the identity of this open fd
+    struct stat st;
+    int identified = maester->digests.enabled && fstat(fd, &st) == 0;
+    off_t size = lseek(fd, 0, SEEK_END);
+    const uint8_t* map = NULL;
+    if (size > 0) {
+        void* mapped = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            // Frames are cut front to back: let the kernel read ahead aggressively
+            madvise(mapped, (size_t)size, MADV_SEQUENTIAL);
+            map = (const uint8_t*)mapped;
+        }
+    }
+    close(fd);
+    if (size < 0 || (size > 0 && map == NULL)) {
+        write_str(STDOUT_FILENO, "Error: Could not map file for transfer: ");
+        write_str(STDOUT_FILENO, path);
+        write_str(STDOUT_FILENO, "\n");
+        return -1;
+    }
+
+    // Hashing the mapping also pulls the file into the page cache the data
+    // frames are then cut from
+    uint8_t digest[16];
+    int hashed = 0;
+    if (identified && digest_cache_lookup(&maester->digests, path, &st, digest)) {
+        hashed = 1;
+    } else if (md5_selected() == MD5_BACKEND_MD5SUM) {
+        hashed = (md5_digest_file(path, digest) == 0);
+    } else {
+        md5_buffer(map, (size_t)size, digest);
+        hashed = 1;
+        if (identified) {
+            digest_cache_store(&maester->digests, path, &st, digest);
+        }
+    }
+    if (!hashed) {
+        if (map != NULL) munmap((void*)map, (size_t)size);
+        write_str(STDOUT_FILENO, "Error: Could not compute MD5 of sigil file.\n");
+        return -1;
+    }
+    md5_digest_to_hex(digest, source->md5);
+    source->map = map;
+    source->size = (size_t)size;
+
+    // Packed images are made while the file is in the page cache; the
+    // receiver picks one (or none) in its ACK_FILE
+    transfer_pack_images(maester, dict, map, (size_t)size, source->packed, source->packed_size, source->dict_id);
+    return 0;
+}
+
+void transfer_source_release(TransferSource* source) {
+    if (source == NULL) return;
+    if (source->map != NULL) {
+        munmap((void*)source->map, source->size);
+    }
+    for (int i = 0; i < TRANSFER_PACKINGS; i++) {
+        free(source->packed[i]);
+    }
+    memset(source, 0, sizeof(*source));
+}
+
+/**
+ * Register a prepared file and remember where its data frames go; `source`
+ * is taken over (released on failure). Called before the header frame is
+ * sent, so the receiver's ACK_FILE always finds the transfer; `stream`
+ * receives the ID the header offers. Transfers to the same realm whose
+ * receiver tags its answers keep going alongside; an untagged one, or one of
+ * the same file, is replaced.
+ */
+int transfer_send_begin(Maester* maester, FrameType data_type, const char* realm, const char* origin,
+                        TransferSource* source, const char* name, ConnHandle next_hop, uint16_t* stream) {
+    if (maester == NULL || realm == NULL || origin == NULL || source == NULL || name == NULL || stream == NULL) {
+        transfer_source_release(source);
+        return -1;
+    }
+
+    pthread_mutex_lock(&maester->transfers_lock);
+    OutgoingTransfer* transfer = NULL;
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        OutgoingTransfer* other = &maester->transfers.outgoing[i];
+        if (other->state != TRANSFER_IDLE && my_strcasecmp(other->realm, realm) == 0 &&
+            (!other->streamed || my_strcmp(other->name, name) == 0)) {
+            transfer_release_outgoing(&maester->transfers, other);
+        }
+    }
+    for (int i = 0; i < TRANSFER_MAX && transfer == NULL; i++) {
+        if (maester->transfers.outgoing[i].state == TRANSFER_IDLE) {
+            transfer = &maester->transfers.outgoing[i];
+        }
+    }
+    if (transfer == NULL) {
+        pthread_mutex_unlock(&maester->transfers_lock);
+        transfer_source_release(source);
+        write_str(STDOUT_FILENO, "Error: Too many file transfers in progress.\n");
+        return -1;
+    }
+    transfer->state = TRANSFER_AWAIT_ACK_FILE;
+    transfer->data_type = data_type;
+    my_strcpy(transfer->realm, realm);
+    my_strcpy(transfer->origin, origin);
+    my_strcpy(transfer->md5, source->md5);
+    transfer->stream = transfer_next_stream(&maester->transfers);
+    transfer->streamed = 0;
+    transfer->chunk = TRANSFER_CHUNK;
+    *stream = transfer->stream;
+    transfer->resumable = 0;
+    transfer->name[0] = '\0';
+    safe_append(transfer->name, sizeof(transfer->name), name);
+    transfer->next_hop = next_hop;
+    transfer->map = source->map;
+    transfer->size = source->size;
+    transfer->payload = source->map;
+    transfer->payload_size = source->size;
+    transfer->packing = TRANSFER_PACK_NONE;
+    for (int i = 0; i < TRANSFER_PACKINGS; i++) {
+        transfer->packed[i] = source->packed[i];
+        transfer->packed_size[i] = source->packed_size[i];
+    }
+    my_strcpy(transfer->dict_id, source->dict_id);
+    memset(source, 0, sizeof(*source));   // The transfer owns it now
+    transfer->offset = 0;
+    transfer->last_progress = time(NULL);
+    // Striping is offered with the header and starts once the receiver
+    // answers for the windowed protocol
+    transfer->num_stripes = 1;
+    if (maester->tuning.transfer_stripes > 1 && transfer->size >= TRANSFER_STRIPE_MIN_BYTES) {
+        transfer->num_stripes = maester->tuning.transfer_stripes;
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+    return 0;
+}
+
+/**
+ * Options for the header announcing the transfer to `realm` on `stream`
+ * (after its MD5 field): the windowed protocol and sigil store answers, either
+ * striping for a large file or resumption, the stream ID and the packed
+ * images of the file. A striped file arrives out of order over several
+ * connections and is only hashed once complete, so it cannot resume.
+ */
+void transfer_header_offers(Maester* maester, const char* realm, uint16_t stream, char* out, size_t out_len) {
+    if (out == NULL || out_len == 0) return;
+    int striped = 0;
+    char packings[64];
+    packings[0] = '\0';
+    if (maester != NULL && realm != NULL) {
+        pthread_mutex_lock(&maester->transfers_lock);
+        OutgoingTransfer* transfer = transfer_find_outgoing(&maester->transfers, realm, stream);
+        striped = (transfer != NULL && transfer->num_stripes > 1);
+        if (transfer != NULL) {
+            transfer_append_packings(packings, sizeof(packings), transfer);
+        }
+        pthread_mutex_unlock(&maester->transfers_lock);
+    }
+    out[0] = '\0';
+    safe_append(out, out_len, striped ? "&SACK&DEDUP&STRIPE" : "&SACK&DEDUP&RESUME");
+    transfer_append_stream(out, out_len, stream);
+    safe_append(out, out_len, packings);
+}
+
+/**
+ * Packed images of a file about to be sent: a plain one and, with
+ * CITADEL_TRANSFER_PACK=2 and a non-empty `dict` of our product names, one
+ * against it (whose ID goes to `dict_id`). An image is
+ * kept only when it saves at least 1/TRANSFER_PACK_SAVING of the file, the
+ * dictionary one only when it beats the plain one.
+ */
+static void transfer_pack_images(Maester* maester, const PackDictionary* dict, const uint8_t* map, size_t size,
+                                 uint8_t** packed, size_t* packed_size, char* dict_id) {
+    dict_id[0] = '\0';
+    if (maester->tuning.transfer_pack == TRANSFER_PACK_NONE || size < TRANSFER_PACK_MIN_BYTES ||
+        size > TRANSFER_PACK_MAX_BYTES) {
+        return;
+    }
+    int dictionary = (maester->tuning.transfer_pack == TRANSFER_PACK_DICT && dict != NULL && dict->length > 0);
+    size_t capacity = size - size / TRANSFER_PACK_SAVING;
+    for (int packing = TRANSFER_PACK_PLAIN; packing < TRANSFER_PACKINGS; packing++) {
+        if (packing == TRANSFER_PACK_DICT && !dictionary) break;
+        uint8_t* image = (uint8_t*)malloc(capacity);
+        size_t length = 0;
+        if (image != NULL) {
+            length = pack_compress((packing == TRANSFER_PACK_DICT) ? dict : NULL, map, size, image, capacity);
+        }
+        if (length == 0) {
+            free(image);
+            continue;
+        }
+        // Give back what the worst case reserved
+        uint8_t* fitted = (uint8_t*)realloc(image, length);
+        packed[packing] = (fitted != NULL) ? fitted : image;
+        packed_size[packing] = length;
+        capacity = length - 1;
+    }
+    if (packed[TRANSFER_PACK_DICT] != NULL) {
+        my_strcpy(dict_id, dict->id);
+    }
+}
+
+// "&PACK=<bytes>" and "&DICT=<id>:<bytes>" for the images still held
+static void transfer_append_packings(char* out, size_t out_len, const OutgoingTransfer* transfer) {
+    char number[32];
+    if (transfer->packed[TRANSFER_PACK_PLAIN] != NULL) {
+        ulong_to_str((unsigned long long)transfer->packed_size[TRANSFER_PACK_PLAIN], number);
+        safe_append(out, out_len, "&PACK=");
+        safe_append(out, out_len, number);
+    }
+    if (transfer->packed[TRANSFER_PACK_DICT] != NULL) {
+        ulong_to_str((unsigned long long)transfer->packed_size[TRANSFER_PACK_DICT], number);
+        safe_append(out, out_len, "&DICT=");
+        safe_append(out, out_len, transfer->dict_id);
+        safe_append(out, out_len, ":");
+        safe_append(out, out_len, number);
+    }
+}
+
+// The windowed data frames carry the image of `packing` (TRANSFER_PACK_NONE
+// or one not held: the file itself); the other images are let go
+static void transfer_choose_packing(OutgoingTransfer* transfer, int packing) {
+    if (packing <= TRANSFER_PACK_NONE || packing >= TRANSFER_PACKINGS || transfer->packed[packing] == NULL) {
+        packing = TRANSFER_PACK_NONE;
+    }
+    for (int i = 0; i < TRANSFER_PACKINGS; i++) {
+        if (i != packing) {
+            free(transfer->packed[i]);
+            transfer->packed[i] = NULL;
+            transfer->packed_size[i] = 0;
+        }
+    }
+    transfer->packing = packing;
+    transfer->payload = (packing != TRANSFER_PACK_NONE) ? transfer->packed[packing] : transfer->map;
+    transfer->payload_size = (packing != TRANSFER_PACK_NONE) ? transfer->packed_size[packing] : transfer->size;
+}
+
+void transfer_send_cancel(Maester* maester, const char* realm, uint16_t stream) {
+    if (maester == NULL || realm == NULL) return;
+    pthread_mutex_lock(&maester->transfers_lock);
+    OutgoingTransfer* transfer = transfer_find_outgoing(&maester->transfers, realm, stream);
+    if (transfer != NULL) {
+        transfer_release_outgoing(&maester->transfers, transfer);
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+}
+
+/**
+ * Act on an ACK_FILE or ACK_MD5 from the receiving realm (frame origin).
+ * ACK_FILE "OK&SACK" selects the windowed protocol, plain "OK" the in-order
+ * stream older maesters expect. A trailing "&AT=<bytes>" is the in-order
+ * prefix the receiver already holds: streaming starts after it, and the
+ * transfer may resume again if its next hop is lost. "&STREAM=<id>" names the
+ * transfer among several to the same realm; on ACK_FILE it also switches the
+ * data frames to stream-tagged ones. "&PACK" or "&DICT" picks the packed
+ * image the windowed data frames carry instead of the file.
+ * Returns 1 when the file was accepted (ACK_FILE OK, streaming starts) or
+ * verified (ACK_MD5 CHECK_OK), -1 when it was refused or arrived corrupted
+ * (the transfer is dropped) and 0 when the frame matches no transfer.
+ */
+int transfer_handle_ack(Maester* maester, const CitadelFrame* frame) {
+    if (maester == NULL || frame == NULL) return 0;
+
+    char text[64];
+    int copy_len = (frame->data_length < (int)sizeof(text) - 1) ? frame->data_length : (int)sizeof(text) - 1;
+    memcpy(text, frame->data, copy_len);
+    text[copy_len] = '\0';
+    int resumable = 0;
+    size_t resume_at = 0;
+    uint16_t stream = 0;
+    int packing = TRANSFER_PACK_NONE;
+    for (int i = my_strlen(text) - 1; i > 0; i--) {
+        size_t value = 0;
+        if (text[i] != '&') continue;
+        if (transfer_option_value(text + i + 1, "AT=", &value)) {
+            resumable = 1;
+            resume_at = value;
+        } else if (transfer_option_value(text + i + 1, "STREAM=", &value) && value > 0 && value <= 0xFFFF) {
+            stream = (uint16_t)value;
+        } else if (my_strcasecmp(text + i + 1, "PACK") == 0) {
+            packing = TRANSFER_PACK_PLAIN;
+        } else if (my_strcasecmp(text + i + 1, "DICT") == 0) {
+            packing = TRANSFER_PACK_DICT;
+        } else {
+            break;
+        }
+        text[i] = '\0';
+    }
+    int windowed = (my_strcasecmp(text, "OK&SACK") == 0);
+    size_t chunk = (stream != 0) ? TRANSFER_STREAM_CHUNK : TRANSFER_CHUNK;
+    resumable = resumable && resume_at % chunk == 0;
+
+    char line[PATH_MAX_LEN + 128];
+    char number[32];
+    line[0] = '\0';
+    int result = 0;
+    ConnHandle wake = 0;
+    int stripes = 1;
+
+    pthread_mutex_lock(&maester->transfers_lock);
+    OutgoingTransfer* transfer = transfer_find_outgoing(&maester->transfers, frame->origin, stream);
+    if (transfer != NULL && frame->type == FRAME_TYPE_ACK_FILE && transfer->state == TRANSFER_AWAIT_ACK_FILE) {
+        // Whether the receiver tagged its answer decides the data frame
+        // layout, and its packing what they carry
+        transfer->streamed = (stream != 0);
+        transfer->chunk = chunk;
+        transfer_choose_packing(transfer, windowed ? packing : TRANSFER_PACK_NONE);
+    }
+    if (transfer != NULL && frame->type == FRAME_TYPE_ACK_FILE && transfer->state == TRANSFER_AWAIT_ACK_FILE &&
+        (windowed || my_strcasecmp(text, "OK") == 0) && (!resumable || resume_at < transfer->payload_size) &&
+        (!windowed || transfer_start_windowed(transfer, maester->tuning.transfer_window) == 0)) {
+        transfer->resumable = windowed && resumable;
+        if (!windowed) {
+            transfer->num_stripes = 1;  // Only windowed frames may arrive out of order
+        }
+        stripes = transfer->num_stripes;
+        if (transfer->resumable && resume_at > 0) {
+            transfer_skip_held(transfer, (uint32_t)(resume_at / chunk));
+            safe_append(line, sizeof(line), transfer->realm);
+            safe_append(line, sizeof(line), " is ready. Resuming ");
+            safe_append(line, sizeof(line), transfer->name);
+            safe_append(line, sizeof(line), (transfer->packing != TRANSFER_PACK_NONE) ? " from packed byte "
+                                                                                      : " from byte ");
+            ulong_to_str((unsigned long long)resume_at, number);
+            safe_append(line, sizeof(line), number);
+            safe_append(line, sizeof(line), " (");
+        } else {
+            safe_append(line, sizeof(line), transfer->realm);
+            safe_append(line, sizeof(line), " is ready. Sending ");
+            safe_append(line, sizeof(line), transfer->name);
+            safe_append(line, sizeof(line), " (");
+        }
+        ulong_to_str((unsigned long long)transfer->size, number);
+        safe_append(line, sizeof(line), number);
+        safe_append(line, sizeof(line), " bytes, ");
+        if (transfer->packing != TRANSFER_PACK_NONE) {
+            ulong_to_str((unsigned long long)transfer->payload_size, number);
+            safe_append(line, sizeof(line), "packed into ");
+            safe_append(line, sizeof(line), number);
+            safe_append(line, sizeof(line), (transfer->packing == TRANSFER_PACK_DICT) ? " with the stock dictionary, "
+                                                                                    : ", ");
+        }
+        ulong_to_str(windowed ? (unsigned long long)transfer->frames
+                              : (unsigned long long)transfer_frame_count(transfer->size), number);
+        safe_append(line, sizeof(line), number);
+        if (stripes > 1) {
+            int_to_str(stripes, number);
+            safe_append(line, sizeof(line), " frames, windowed over ");
+            safe_append(line, sizeof(line), number);
+            safe_append(line, sizeof(line), " connections)...\n");
+        } else {
+            safe_append(line, sizeof(line), windowed ? " frames, windowed)...\n" : " frames)...\n");
+        }
+        transfer->state = (transfer->size > 0) ? TRANSFER_STREAMING : TRANSFER_AWAIT_ACK_MD5;
+        transfer->last_progress = time(NULL);
+        wake = transfer->next_hop;
+        result = 1;
+    } else if (transfer != NULL && frame->type == FRAME_TYPE_ACK_FILE && transfer->state == TRANSFER_AWAIT_ACK_FILE) {
+        safe_append(line, sizeof(line), transfer->realm);
+        safe_append(line, sizeof(line), " refused the transfer of ");
+        safe_append(line, sizeof(line), transfer->name);
+        safe_append(line, sizeof(line), ".\n");
+        transfer_release_outgoing(&maester->transfers, transfer);
+        result = -1;
+    } else if (transfer != NULL && frame->type == FRAME_TYPE_ACK_MD5) {
+        // Answered before ACK_FILE: the receiver already held the file (TRANSFER_OFFER_DEDUP)
+        int held = (transfer->state == TRANSFER_AWAIT_ACK_FILE);
+        safe_append(line, sizeof(line), transfer->name);
+        if (my_strcasecmp(text, "CHECK_OK") == 0) {
+            safe_append(line, sizeof(line), " delivered to ");
+            safe_append(line, sizeof(line), transfer->realm);
+            safe_append(line, sizeof(line), held ? " (already held there, nothing sent, MD5 verified).\n"
+                                                 : " (MD5 verified).\n");
+            result = 1;
+        } else {
+            safe_append(line, sizeof(line), " arrived corrupted at ");
+            safe_append(line, sizeof(line), transfer->realm);
+            safe_append(line, sizeof(line), " (MD5 mismatch).\n");
+            result = -1;
+        }
+        transfer_release_outgoing(&maester->transfers, transfer);
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    if (line[0] != '\0') {
+        write_str(STDOUT_FILENO, line);
+    }
+    if (wake != 0) {
+        ConnectionEntry* next_hop = connection_table_lookup(&maester->connections, wake);
+        if (next_hop == NULL || maester_wake_transfers(maester, next_hop) != 0) {
+            // The next hop went away since the header left: try the route again
+            int used_default = 0;
+            Route* route = maester_resolve_route(maester, frame->origin, &used_default);
+            next_hop = (route != NULL) ? maester_route_connection(maester, route) : NULL;
+            pthread_mutex_lock(&maester->transfers_lock);
+            transfer = transfer_find_outgoing(&maester->transfers, frame->origin, stream);
+            if (transfer != NULL && next_hop != NULL) {
+                transfer->next_hop = connection_handle(next_hop);
+            } else if (transfer != NULL) {
+                transfer_release_outgoing(&maester->transfers, transfer);
+                result = -1;
+            }
+            pthread_mutex_unlock(&maester->transfers_lock);
+            if (result < 0) {
+                write_str(STDOUT_FILENO, "Transfer aborted: no connection towards ");
+                write_str(STDOUT_FILENO, frame->origin);
+                write_str(STDOUT_FILENO, ".\n");
+            } else if (maester_wake_transfers(maester, next_hop) != 0) {
+                write_str(STDERR_FILENO, "Warning: Could not start the transfer on its network worker.\n");
+            }
+        }
+    }
+    if (wake != 0 && result > 0 && stripes > 1) {
+        pthread_mutex_lock(&maester->transfers_lock);
+        transfer = transfer_find_outgoing(&maester->transfers, frame->origin, stream);
+        wake = (transfer != NULL) ? transfer->next_hop : 0;
+        pthread_mutex_unlock(&maester->transfers_lock);
+        transfer_open_stripes(maester, frame->origin, stream, wake);
+    }
+    return result;
+}
+
+/**
+ * Open the extra connections of a striped transfer to the same next hop and
+ * start them. Stripes that cannot be opened are left out; the transfer keeps
+ * going over the others.
+ */
+static void transfer_open_stripes(Maester* maester, const char* realm, uint16_t stream, ConnHandle next_hop) {
+    ConnectionEntry* hop = connection_table_lookup(&maester->connections, next_hop);
+    if (hop == NULL) return;
+    char peer_realm[REALM_NAME_MAX];
+    char peer_ip[IP_ADDR_MAX];
+    my_strcpy(peer_realm, hop->peer_realm);
+    my_strcpy(peer_ip, hop->peer_ip);
+    int peer_port = hop->peer_port;
+
+    pthread_mutex_lock(&maester->transfers_lock);
+    OutgoingTransfer* transfer = transfer_find_outgoing(&maester->transfers, realm, stream);
+    int count = (transfer != NULL && transfer->state == TRANSFER_STREAMING) ? transfer->num_stripes : 0;
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    ConnHandle opened[TRANSFER_STRIPE_MAX];
+    opened[0] = 0;
+    for (int i = 1; i < count; i++) {
+        ConnectionEntry* entry = maester_open_stripe_connection(maester, peer_realm, peer_ip, peer_port);
+        opened[i] = connection_handle(entry);
+    }
+
+    int started = 0;
+    pthread_mutex_lock(&maester->transfers_lock);
+    transfer = transfer_find_outgoing(&maester->transfers, realm, stream);
+    if (transfer != NULL && transfer->state == TRANSFER_STREAMING && transfer->next_hop == next_hop &&
+        transfer->num_stripes == count) {
+        for (int i = 1; i < count; i++) {
+            transfer->stripes[i] = opened[i];
+        }
+        started = 1;
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    for (int i = 1; i < count; i++) {
+        ConnectionEntry* entry = connection_table_lookup(&maester->connections, opened[i]);
+        if (!started) {
+            maester_close_connection_entry(entry);  // Finished or replaced meanwhile
+        } else if (entry != NULL) {
+            maester_wake_transfers(maester, entry);
+        }
+    }
+}
+
+// Windowed protocol accepted: per-frame state, send-time ring, initial window
+static int transfer_start_windowed(OutgoingTransfer* transfer, int window) {
+    size_t frames = (transfer->payload_size + transfer->chunk - 1) / transfer->chunk;
+    if (frames > 0xFFFFFFFFu) return -1;
+    if (frames > 0) {
+        transfer->frame_flags = (uint8_t*)calloc(frames, 1);
+        transfer->sent_us = (uint64_t*)calloc(TRANSFER_WINDOW_LIMIT, sizeof(uint64_t));
+        transfer->sent_on = (uint8_t*)calloc(TRANSFER_WINDOW_LIMIT, 1);
+        if (transfer->frame_flags == NULL || transfer->sent_us == NULL || transfer->sent_on == NULL) {
+            free(transfer->frame_flags);
+            free(transfer->sent_us);
+            free(transfer->sent_on);
+            transfer->frame_flags = NULL;
+            transfer->sent_us = NULL;
+            transfer->sent_on = NULL;
+            return -1;
+        }
+    }
+    transfer->windowed = 1;
+    transfer->frames = (uint32_t)frames;
+    transfer->next_seq = 0;
+    transfer->acked = 0;
+    transfer->in_flight = 0;
+    transfer->lost = 0;
+    transfer->lost_cursor = 0;
+    for (int i = 0; i < TRANSFER_STRIPE_MAX; i++) {
+        transfer->delivered_us[i] = 0;
+        transfer->delivered_seq[i] = 0;
+        transfer->stripe_in_flight[i] = 0;
+    }
+    transfer->recovery_end = 0;
+    transfer->cwnd = TRANSFER_WINDOW_MIN;
+    transfer->cwnd_max = (uint32_t)window;
+    transfer->slow_start = 1;
+    transfer->round_end = 0;
+    transfer->round_rtt_us = 0;
+    transfer->rtt_min_us = 0;
+    transfer->srtt_us = 0;
+    transfer->rttvar_us = 0;
+    transfer->rto_us = TRANSFER_RTO_INITIAL_US;
+    transfer->timer_us = 0;
+    return 0;
+}
+
+// Resumed transfer: the receiver already holds frames [0, held)
+static void transfer_skip_held(OutgoingTransfer* transfer, uint32_t held) {
+    if (held > transfer->frames) held = transfer->frames;
+    for (uint32_t seq = 0; seq < held; seq++) {
+        transfer->frame_flags[seq] = TRANSFER_FRAME_SACKED;
+    }
+    transfer->next_seq = held;
+    transfer->acked = held;
+    for (int i = 0; i < TRANSFER_STRIPE_MAX; i++) {
+        transfer->delivered_seq[i] = held;
+    }
+    transfer->recovery_end = held;
+    transfer->round_end = held;
+}
+
+// RFC 6298 smoothing; the minimum is the path's RTT with empty queues
+static void transfer_rtt_sample(OutgoingTransfer* transfer, uint64_t sample) {
+    if (transfer->srtt_us == 0) {
+        transfer->srtt_us = sample;
+        transfer->rttvar_us = sample / 2;
+    } else {
+        uint64_t delta = (sample > transfer->srtt_us) ? sample - transfer->srtt_us : transfer->srtt_us - sample;
+        transfer->rttvar_us = (3 * transfer->rttvar_us + delta) / 4;
+        transfer->srtt_us = (7 * transfer->srtt_us + sample) / 8;
+    }
+    transfer->rto_us = transfer_base_rto(transfer);
+    if (transfer->rtt_min_us == 0 || sample < transfer->rtt_min_us) {
+        transfer->rtt_min_us = sample;
+    }
+    if (transfer->round_rtt_us == 0 || sample < transfer->round_rtt_us) {
+        transfer->round_rtt_us = sample;
+    }
+}
+
+// Retransmission timeout without backoff
+static uint64_t transfer_base_rto(const OutgoingTransfer* transfer) {
+    uint64_t rto = transfer->srtt_us + 4 * transfer->rttvar_us;
+    if (rto < TRANSFER_RTO_MIN_US) rto = TRANSFER_RTO_MIN_US;
+    if (rto > TRANSFER_RTO_MAX_US) rto = TRANSFER_RTO_MAX_US;
+    return rto;
+}
+
+// Remember the latest-sent frame of its stripe known to have arrived (ties:
+// higher seq). A retransmitted frame says nothing: the copy that arrived may
+// be the first one, or one a hop resent on a NACK, not the latest send.
+static void transfer_mark_delivered(OutgoingTransfer* transfer, uint32_t seq) {
+    if (transfer->frame_flags[seq] & TRANSFER_FRAME_RESENT) {
+        return;
+    }
+    uint64_t sent = transfer->sent_us[seq % TRANSFER_WINDOW_LIMIT];
+    int stripe = transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT];
+    if (sent > transfer->delivered_us[stripe] ||
+        (sent == transfer->delivered_us[stripe] && seq > transfer->delivered_seq[stripe])) {
+        transfer->delivered_us[stripe] = sent;
+        transfer->delivered_seq[stripe] = seq;
+    }
+}
+
+// A frame in flight was acknowledged or declared lost
+static void transfer_leave_flight(OutgoingTransfer* transfer, uint32_t seq) {
+    int stripe = transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT];
+    transfer->in_flight--;
+    if (transfer->stripe_in_flight[stripe] > 0) {
+        transfer->stripe_in_flight[stripe]--;
+    }
+}
+
+/**
+ * Once per round trip: estimate how many of the window's frames sit in queues
+ * along the path from how far this round's RTT rose above the minimum. Slow
+ * start doubles the window until queues build; afterwards it grows by one
+ * frame while they stay short and shrinks by one when they grow long, so a
+ * slow hop or receiver is not buried under frames it cannot take.
+ */
+static void transfer_adapt_window(OutgoingTransfer* transfer) {
+    if (transfer->round_rtt_us > 0 && transfer->rtt_min_us > 0) {
+        uint64_t rtt = transfer->round_rtt_us;
+        uint64_t queued = (uint64_t)transfer->cwnd * (rtt - transfer->rtt_min_us) / rtt;
+        if (transfer->slow_start) {
+            if (queued > TRANSFER_QUEUE_HIGH) {
+                transfer->slow_start = 0;
+                transfer->cwnd -= (uint32_t)(queued / 2);
+            } else {
+                transfer->cwnd *= 2;
+            }
+        } else if (queued < TRANSFER_QUEUE_LOW) {
+            transfer->cwnd++;
+        } else if (queued > TRANSFER_QUEUE_HIGH) {
+            transfer->cwnd--;
+        }
+    }
+    if (transfer->cwnd < TRANSFER_WINDOW_MIN) transfer->cwnd = TRANSFER_WINDOW_MIN;
+    if (transfer->cwnd > transfer->cwnd_max) transfer->cwnd = transfer->cwnd_max;
+    transfer->round_end = transfer->next_seq;
+    transfer->round_rtt_us = 0;
+}
+
+// Retransmission timer fired: everything outstanding is presumed lost
+static void transfer_on_timeout(OutgoingTransfer* transfer) {
+    for (uint32_t seq = transfer->acked; seq < transfer->next_seq; seq++) {
+        uint8_t flags = transfer->frame_flags[seq];
+        if (flags & TRANSFER_FRAME_SACKED) continue;
+        if (!(flags & TRANSFER_FRAME_LOST)) {
+            transfer->lost++;
+        }
+        transfer->frame_flags[seq] = TRANSFER_FRAME_LOST;
+    }
+    transfer->in_flight = 0;
+    for (int i = 0; i < TRANSFER_STRIPE_MAX; i++) {
+        transfer->stripe_in_flight[i] = 0;
+    }
+    transfer->lost_cursor = transfer->acked;
+    transfer->recovery_end = transfer->next_seq;
+    transfer->cwnd = TRANSFER_WINDOW_MIN;
+    transfer->slow_start = 1;
+    transfer->round_end = transfer->next_seq;
+    transfer->round_rtt_us = 0;
+    transfer->rto_us *= 2;
+    if (transfer->rto_us > TRANSFER_RTO_MAX_US) transfer->rto_us = TRANSFER_RTO_MAX_US;
+    transfer->timer_us = 0;
+}
+
+/**
+ * ACK_DATA from the receiving realm: cumulative ack, then up to
+ * TRANSFER_SACK_MAX [start, end) blocks received beyond it. A route delivers
+ * in order, so a frame still missing when one sent after it through the same
+ * connection (stripe) has arrived was lost on the way: it is retransmitted
+ * right away, retransmissions included, instead of waiting for the timer.
+ * Returns 1 when the ack matched a transfer, 0 otherwise.
+ */
+int transfer_handle_data_ack(Maester* maester, const FrameView* view) {
+    if (maester == NULL || view == NULL) return 0;
+    char origin[FRAME_ORIGIN_LEN + 1];
+    frame_view_origin(view, origin, sizeof(origin));
+    uint16_t length = frame_view_data_length(view);
+    const uint8_t* data = frame_view_data(view);
+
+    uint64_t now = transfer_now_us();
+    ConnHandle wake[TRANSFER_STRIPE_MAX];
+    int num_wake = 0;
+    pthread_mutex_lock(&maester->transfers_lock);
+    // A tagged ack names its stream; an untagged one belongs to the realm's
+    // untagged transfer
+    OutgoingTransfer* transfer = NULL;
+    if (length >= TRANSFER_STREAM_LEN && transfer_get_u16(data) != 0) {
+        transfer = transfer_find_outgoing(&maester->transfers, origin, transfer_get_u16(data));
+        if (transfer != NULL && !transfer->streamed) {
+            transfer = NULL;
+        }
+    }
+    if (transfer != NULL) {
+        data += TRANSFER_STREAM_LEN;
+        length = (uint16_t)(length - TRANSFER_STREAM_LEN);
+    } else {
+        transfer = transfer_find_outgoing(&maester->transfers, origin, 0);
+    }
+    int blocks = (length >= TRANSFER_SEQ_LEN + 1) ? data[TRANSFER_SEQ_LEN] : -1;
+    uint32_t cum = (blocks >= 0) ? transfer_get_u32(data) : 0;
+    if (transfer == NULL || !transfer->windowed || transfer->state != TRANSFER_STREAMING ||
+        blocks < 0 || blocks > TRANSFER_SACK_MAX || length < TRANSFER_SEQ_LEN + 1 + blocks * 2 * TRANSFER_SEQ_LEN ||
+        cum > transfer->next_seq) {
+        pthread_mutex_unlock(&maester->transfers_lock);
+        return 0;
+    }
+
+    // Newest frame this ack covers for the first time, if sent only once (Karn)
+    int64_t sample_seq = -1;
+    int progress = 0;
+    while (transfer->acked < cum) {
+        uint32_t seq = transfer->acked++;
+        uint8_t flags = transfer->frame_flags[seq];
+        if (flags & TRANSFER_FRAME_LOST) {
+            transfer->lost--;
+        } else if (!(flags & TRANSFER_FRAME_SACKED)) {
+            transfer_leave_flight(transfer, seq);
+            transfer_mark_delivered(transfer, seq);
+            if (!(flags & TRANSFER_FRAME_RESENT)) sample_seq = seq;
+        }
+        progress = 1;
+    }
+    const uint8_t* block = data + TRANSFER_SEQ_LEN + 1;
+    for (int i = 0; i < blocks; i++, block += 2 * TRANSFER_SEQ_LEN) {
+        uint32_t start = transfer_get_u32(block);
+        uint32_t end = transfer_get_u32(block + TRANSFER_SEQ_LEN);
+        if (start < transfer->acked) start = transfer->acked;
+        if (end > transfer->next_seq) end = transfer->next_seq;
+        for (uint32_t seq = start; seq < end; seq++) {
+            uint8_t flags = transfer->frame_flags[seq];
+            if (flags & TRANSFER_FRAME_SACKED) continue;
+            if (flags & TRANSFER_FRAME_LOST) {
+                transfer->lost--;
+            } else {
+                transfer_leave_flight(transfer, seq);
+                transfer_mark_delivered(transfer, seq);
+                if (!(flags & TRANSFER_FRAME_RESENT) && (int64_t)seq > sample_seq) sample_seq = seq;
+            }
+            transfer->frame_flags[seq] = (uint8_t)((flags & ~TRANSFER_FRAME_LOST) | TRANSFER_FRAME_SACKED);
+        }
+    }
+    if (sample_seq >= 0) {
+        transfer_rtt_sample(transfer, now - transfer->sent_us[sample_seq % TRANSFER_WINDOW_LIMIT]);
+    } else if (progress && transfer->srtt_us > 0) {
+        transfer->rto_us = transfer_base_rto(transfer);  // The path works again: drop the backoff
+    }
+
+    // Fast retransmit; the window is cut once per loss episode
+    int loss = 0;
+    for (uint32_t seq = transfer->acked; seq < transfer->next_seq; seq++) {
+        uint8_t flags = transfer->frame_flags[seq];
+        if (flags & (TRANSFER_FRAME_SACKED | TRANSFER_FRAME_LOST)) continue;
+        uint64_t sent = transfer->sent_us[seq % TRANSFER_WINDOW_LIMIT];
+        int stripe = transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT];
+        if (sent > transfer->delivered_us[stripe] ||
+            (sent == transfer->delivered_us[stripe] && seq >= transfer->delivered_seq[stripe])) {
+            continue;  // Sent after everything known delivered on its stripe: may still arrive
+        }
+        transfer->frame_flags[seq] = (uint8_t)(flags | TRANSFER_FRAME_LOST);
+        transfer_leave_flight(transfer, seq);
+        transfer->lost++;
+        if (seq < transfer->lost_cursor) transfer->lost_cursor = seq;
+        loss = 1;
+    }
+    if (loss && transfer->acked >= transfer->recovery_end) {
+        transfer->cwnd /= 2;
+        if (transfer->cwnd < TRANSFER_WINDOW_MIN) transfer->cwnd = TRANSFER_WINDOW_MIN;
+        transfer->slow_start = 0;
+        transfer->recovery_end = transfer->next_seq;
+    } else if (transfer->acked >= transfer->round_end) {
+        transfer_adapt_window(transfer);
+    }
+
+    if (transfer->acked == transfer->frames) {
+        transfer->state = TRANSFER_AWAIT_ACK_MD5;
+        transfer->timer_us = 0;
+    } else if (progress) {
+        transfer->timer_us = now + transfer->rto_us;  // Restarted on every advance
+    }
+    if (progress) {
+        transfer->last_progress = time(NULL);
+    }
+    if (transfer->state == TRANSFER_STREAMING) {
+        num_wake = transfer_stripe_handles(transfer, wake);
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    // A failed wake is caught by the retransmission timer
+    for (int i = 0; i < num_wake; i++) {
+        maester_wake_transfers(maester, connection_table_lookup(&maester->connections, wake[i]));
+    }
+    return 1;
+}
+
+// Stripe number of `handle` in the transfer (0: next_hop), -1 if it carries none of it
+static int transfer_stripe_id(const OutgoingTransfer* transfer, ConnHandle handle) {
+    if (handle == transfer->next_hop) return 0;
+    for (int i = 1; i < transfer->num_stripes; i++) {
+        if (transfer->stripes[i] == handle) return i;
+    }
+    return -1;
+}
+
+// Connections carrying the transfer's data frames, next_hop first
+static int transfer_stripe_handles(const OutgoingTransfer* transfer, ConnHandle* out) {
+    int count = 0;
+    if (transfer->next_hop != 0) {
+        out[count++] = transfer->next_hop;
+    }
+    for (int i = 1; i < transfer->num_stripes; i++) {
+        if (transfer->stripes[i] != 0) {
+            out[count++] = transfer->stripes[i];
+        }
+    }
+    return count;
+}
+
+// A stripe closed: what it still carried is resent through the others
+static void transfer_drop_stripe(OutgoingTransfer* transfer, int stripe) {
+    for (uint32_t seq = transfer->acked; seq < transfer->next_seq; seq++) {
+        uint8_t flags = transfer->frame_flags[seq];
+        if ((flags & (TRANSFER_FRAME_SACKED | TRANSFER_FRAME_LOST)) ||
+            transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT] != stripe) {
+            continue;
+        }
+        transfer->frame_flags[seq] = (uint8_t)(flags | TRANSFER_FRAME_LOST);
+        transfer_leave_flight(transfer, seq);
+        transfer->lost++;
+        if (seq < transfer->lost_cursor) transfer->lost_cursor = seq;
+    }
+    transfer->stripe_in_flight[stripe] = 0;
+    if (stripe > 0) {
+        transfer->stripes[stripe] = 0;
+    }
+}
+
+/**
+ * Drop the stripes of a streaming transfer whose connection went away. When
+ * next_hop itself is gone another stripe takes its place (the frames it
+ * carried are renumbered to stripe 0), so timers and acks keep a home.
+ * Returns 1 when frames were queued for retransmission.
+ */
+static int transfer_check_stripes(OutgoingTransfer* transfer, const ConnectionTable* connections) {
+    int dropped = 0;
+    for (int i = 1; i < transfer->num_stripes; i++) {
+        if (transfer->stripes[i] != 0 && connection_table_lookup(connections, transfer->stripes[i]) == NULL) {
+            transfer_drop_stripe(transfer, i);
+            dropped = 1;
+        }
+    }
+    if (transfer->next_hop == 0 || connection_table_lookup(connections, transfer->next_hop) != NULL) {
+        return dropped;
+    }
+    for (int i = 1; i < transfer->num_stripes; i++) {
+        if (transfer->stripes[i] == 0) continue;
+        transfer_drop_stripe(transfer, 0);
+        for (uint32_t seq = transfer->acked; seq < transfer->next_seq; seq++) {
+            if (transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT] == i) {
+                transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT] = 0;
+            }
+        }
+        transfer->next_hop = transfer->stripes[i];
+        transfer->delivered_us[0] = transfer->delivered_us[i];
+        transfer->delivered_seq[0] = transfer->delivered_seq[i];
+        transfer->stripe_in_flight[0] = transfer->stripe_in_flight[i];
+        transfer->stripe_in_flight[i] = 0;
+        transfer->stripes[i] = 0;
+        return 1;
+    }
+    return dropped;
+}
+
+/**
+ * Top up the next hop's send queue with data frames until it holds `window`
+ * slots or the file is exhausted. Each frame is encoded directly into its send
+ * slot from the mapping: one copy out of the page cache, none in between.
+ */
+static void transfer_fill(Maester* maester, OutgoingTransfer* transfer, ConnectionEntry* entry) {
+    size_t window = (size_t)maester->tuning.transfer_window;
+    size_t before = transfer->offset;
+    while (transfer->offset < transfer->size && entry->send_queue.slots < window) {
+        size_t chunk = transfer->size - transfer->offset;
+        if (chunk > FRAME_MAX_DATA) {
+            chunk = FRAME_MAX_DATA;
+        }
+        uint8_t* slot = send_queue_reserve(&entry->send_queue, FRAME_MAX_SIZE);
+        if (slot == NULL) {
+            break;  // Connection or pool limit: resume once the queue drains
+        }
+        frame_encode_bytes(slot, transfer->data_type, transfer->origin, transfer->realm,
+                           transfer->map + transfer->offset, (uint16_t)chunk);
+        send_queue_note_frame(&entry->send_queue, slot, slot);
+        if (entry->compact_send) {
+            send_queue_trim_tail(&entry->send_queue, frame_compact_bytes(slot, slot));
+        }
+        transfer->offset += chunk;
+    }
+    if (transfer->offset != before) {
+        transfer->last_progress = time(NULL);
+    }
+    if (transfer->offset == transfer->size) {
+        munmap((void*)transfer->map, transfer->size);
+        transfer->map = NULL;
+        transfer->state = TRANSFER_AWAIT_ACK_MD5;
+    }
+}
+
+/**
+ * Windowed counterpart of transfer_fill: retransmissions first, then new
+ * frames (behind the stream ID when the receiver tags them), while fewer
+ * than `cwnd` are in flight. A stripe takes at most its
+ * share of the window, so every connection gets frames to carry. The mapping
+ * (and the packed image the frames carry) stays until the last frame is
+ * acknowledged.
+ */
+static void transfer_fill_windowed(OutgoingTransfer* transfer, ConnectionEntry* entry, int stripe, uint64_t now) {
+    uint32_t live = 1;
+    for (int i = 1; i < transfer->num_stripes; i++) {
+        live += (transfer->stripes[i] != 0);
+    }
+    uint32_t share = (transfer->cwnd + live - 1) / live;
+    while (transfer->in_flight < transfer->cwnd && transfer->stripe_in_flight[stripe] < share) {
+        uint32_t seq;
+        int resend = 0;
+        if (transfer->lost > 0) {
+            seq = (transfer->lost_cursor > transfer->acked) ? transfer->lost_cursor : transfer->acked;
+            while (seq < transfer->next_seq && !(transfer->frame_flags[seq] & TRANSFER_FRAME_LOST)) {
+                seq++;
+            }
+            if (seq == transfer->next_seq) {
+                transfer->lost = 0;  // Count drifted from the flags; they win
+                continue;
+            }
+            resend = 1;
+        } else if (transfer->next_seq < transfer->frames &&
+                   transfer->next_seq - transfer->acked < TRANSFER_WINDOW_LIMIT) {
+            seq = transfer->next_seq;
+        } else {
+            break;
+        }
+        uint8_t* slot = send_queue_reserve(&entry->send_queue, FRAME_MAX_SIZE);
+        if (slot == NULL) {
+            break;  // Connection or pool limit: resume once the queue drains
+        }
+        size_t offset = (size_t)seq * transfer->chunk;
+        size_t chunk = transfer->payload_size - offset;
+        if (chunk > transfer->chunk) {
+            chunk = transfer->chunk;
+        }
+        uint8_t* payload = slot + FRAME_HEADER_LEN;
+        size_t prefix = 0;
+        if (transfer->streamed) {
+            payload[0] = (uint8_t)(transfer->stream >> 8);
+            payload[1] = (uint8_t)transfer->stream;
+            prefix = TRANSFER_STREAM_LEN;
+        }
+        transfer_put_u32(payload + prefix, seq);
+        memcpy(payload + prefix + TRANSFER_SEQ_LEN, transfer->payload + offset, chunk);
+        frame_encode_bytes(slot, transfer->data_type, transfer->origin, transfer->realm,
+                           payload, (uint16_t)(prefix + TRANSFER_SEQ_LEN + chunk));
+        send_queue_note_frame(&entry->send_queue, slot, slot);
+        if (entry->compact_send) {
+            send_queue_trim_tail(&entry->send_queue, frame_compact_bytes(slot, slot));
+        }
+        if (resend) {
+            transfer->frame_flags[seq] = (uint8_t)((transfer->frame_flags[seq] & ~TRANSFER_FRAME_LOST) |
+                                                   TRANSFER_FRAME_RESENT);
+            transfer->lost--;
+            transfer->lost_cursor = seq + 1;
+        } else {
+            transfer->next_seq++;
+        }
+        transfer->in_flight++;
+        transfer->stripe_in_flight[stripe]++;
+        transfer->sent_us[seq % TRANSFER_WINDOW_LIMIT] = now;
+        transfer->sent_on[seq % TRANSFER_WINDOW_LIMIT] = (uint8_t)stripe;
+        if (transfer->timer_us == 0) {
+            transfer->timer_us = now + transfer->rto_us;
+        }
+    }
+}
+
+/**
+ * Run by the shard owning `entry` whenever its send queue drained (writable
+ * event, send completion), an acknowledgement opened the window or a
+ * transfer through it was just accepted.
+ */
+void transfer_pump(Maester* maester, ConnectionEntry* entry) {
+    if (maester == NULL || entry == NULL || entry->sockfd < 0) return;
+    ConnHandle handle = connection_handle(entry);
+    uint64_t now = transfer_now_us();
+    int streaming = 0;
+    int timed = 0;
+    pthread_mutex_lock(&maester->transfers_lock);
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        OutgoingTransfer* transfer = &maester->transfers.outgoing[i];
+        if (transfer->state != TRANSFER_STREAMING) continue;
+        int stripe = transfer_stripe_id(transfer, handle);
+        if (stripe < 0) continue;
+        if (transfer->windowed) {
+            transfer_fill_windowed(transfer, entry, stripe, now);
+            timed |= (transfer->timer_us != 0);
+        } else {
+            transfer_fill(maester, transfer, entry);
+        }
+        if (transfer->state == TRANSFER_STREAMING) {
+            streaming = 1;
+        }
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+    if (timed && entry->shard != NULL) {
+        entry->shard->transfers_pending = 1;
+    }
+    entry->transfer_out = (uint8_t)streaming;
+    maester_connection_update_interest(entry);
+}
+
+/**
+ * Fire the retransmission timers of windowed transfers leaving through the
+ * shard's connections (any of their stripes). Returns milliseconds until the
+ * next deadline, -1 when none is armed (the scan is skipped until a transfer
+ * arms one again).
+ */
+int transfer_check_timeouts(Maester* maester, Shard* shard) {
+    if (maester == NULL || shard == NULL || !shard->transfers_pending) return -1;
+    ConnHandle expired[TRANSFER_MAX * TRANSFER_STRIPE_MAX];
+    int num_expired = 0;
+    uint64_t earliest = 0;
+    uint64_t now = transfer_now_us();
+
+    pthread_mutex_lock(&maester->transfers_lock);
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        OutgoingTransfer* transfer = &maester->transfers.outgoing[i];
+        if (transfer->state != TRANSFER_STREAMING || !transfer->windowed || transfer->timer_us == 0) continue;
+        ConnHandle stripes[TRANSFER_STRIPE_MAX];
+        int num_stripes = transfer_stripe_handles(transfer, stripes);
+        int owned = 0;
+        for (int s = 0; s < num_stripes && !owned; s++) {
+            ConnectionEntry* entry = connection_table_lookup(&maester->connections, stripes[s]);
+            owned = (entry != NULL && entry->shard == shard);
+        }
+        if (!owned) continue;
+        if (now < transfer->timer_us) {
+            if (earliest == 0 || transfer->timer_us < earliest) {
+                earliest = transfer->timer_us;
+            }
+        } else {
+            transfer_on_timeout(transfer);
+            for (int s = 0; s < num_stripes; s++) {
+                expired[num_expired++] = stripes[s];
+            }
+        }
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    // Resending re-arms the timers (and transfers_pending)
+    shard->transfers_pending = 0;
+    for (int i = 0; i < num_expired; i++) {
+        maester_wake_transfers(maester, connection_table_lookup(&maester->connections, expired[i]));
+    }
+    if (earliest == 0) {
+        return shard->transfers_pending ? 0 : -1;
+    }
+    shard->transfers_pending = 1;
+    if (now >= earliest) return 0;
+    return (int)((earliest - now + 999) / 1000);
+}
+
+// ============= RECEIVER =============
+
+// ACKs go to the sending realm by route; without one, back the way the header came
+static int transfer_send_to(Maester* maester, ConnectionEntry* entry, const char* realm, FrameType type,
+                            const uint8_t* data, size_t length) {
+    CitadelFrame ack;
+    frame_init(&ack, type, maester->realm_name, realm);
+    memcpy(ack.data, data, length);
+    ack.data_length = (uint16_t)length;
+
+    int used_default = 0;
+    Route* route = maester_resolve_route(maester, realm, &used_default);
+    ConnectionEntry* connection = (route != NULL) ? maester_route_connection(maester, route) : NULL;
+    if (connection == NULL) {
+        connection = entry;
+    }
+    return maester_send_frame(connection, &ack);
+}
+
+static int transfer_send_ack(Maester* maester, ConnectionEntry* entry, const char* realm, FrameType type, const char* text) {
+    return transfer_send_to(maester, entry, realm, type, (const uint8_t*)text, (size_t)my_strlen(text));
+}
+
+/**
+ * Header of an incoming file: open <folder>/<realm>_<name>.part and answer
+ * ACK_FILE OK, or KO when the file cannot be taken. When the sender offered
+ * the windowed protocol (TRANSFER_OFFER_SACK) the answer is "OK&SACK"; when
+ * it accepts a direct verdict (TRANSFER_OFFER_DEDUP) and the sigil store
+ * already holds the digest, the file is taken from there and the header is
+ * answered with ACK_MD5 straight away. A windowed header naming a `stream`
+ * (TRANSFER_OFFER_STREAM) gets answers tagged "&STREAM=<id>" and its data
+ * frames carry the ID, so other files from the same sender may arrive at the
+ * same time. Of the `packing`s a windowed header offers, the one against our
+ * own stock dictionary is taken when the dictionary IDs match, else the plain
+ * one ("&DICT" or "&PACK" in the answer); the packed image is then what
+ * arrives, unpacked once complete. Returns 0 on OK.
+ */
+int transfer_receive_begin(Maester* maester, ConnectionEntry* entry, FrameType data_type, const char* origin,
+                           const char* realm, const char* name, const char* size, const char* md5, unsigned offers,
+                           uint16_t stream, const TransferPacking* packing) {
+    if (maester == NULL || origin == NULL || realm == NULL || name == NULL || size == NULL || md5 == NULL) return -1;
+    int windowed = (offers & TRANSFER_OFFER_SACK) != 0;
+    if (!windowed || !(offers & TRANSFER_OFFER_STREAM)) {
+        stream = 0;
+    }
+    size_t chunk = (stream != 0) ? TRANSFER_STREAM_CHUNK : TRANSFER_CHUNK;
+
+    size_t file_size = 0;
+    int ok = (transfer_parse_size(size, &file_size) == 0 && my_strlen(md5) == 32 && name[0] != '\0');
+
+    // Only the base name is used: the sender does not get to pick directories
+    const char* base = name;
+    for (const char* p = name; *p != '\0'; ++p) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    // Nor, through its realm name, anything but a file in our folder
+    if (!is_safe_name(realm) || !is_safe_name(base) || my_strcmp(base, ".") == 0) {
+        ok = 0;
+    }
+    // The image arrives in place of the file, which is unpacked in memory
+    int packed = TRANSFER_PACK_NONE;
+    size_t wire_size = file_size;
+    PackDictionary dict;
+    pack_dictionary_init(&dict);
+    if (ok && windowed && packing != NULL && maester->tuning.transfer_pack != TRANSFER_PACK_NONE &&
+        file_size <= TRANSFER_PACK_MAX_BYTES) {
+        if ((offers & TRANSFER_OFFER_DICT) && packing->dict < file_size &&
+            maester->tuning.transfer_pack == TRANSFER_PACK_DICT &&
+            transfer_stock_dictionary(maester, &dict) == 0 && dict.length > 0 &&
+            my_strcasecmp(dict.id, packing->dict_id) == 0) {
+            packed = TRANSFER_PACK_DICT;
+            wire_size = packing->dict;
+        } else if ((offers & TRANSFER_OFFER_PACK) && packing->plain < file_size) {
+            packed = TRANSFER_PACK_PLAIN;
+            wire_size = packing->plain;
+        }
+        if (packed != TRANSFER_PACK_DICT) {
+            pack_dictionary_free(&dict);
+        }
+    }
+    size_t frames = windowed ? (wire_size + chunk - 1) / chunk : 0;
+    if (frames > 0xFFFFFFFFu) {
+        ok = 0;
+    }
+    char path[PATH_MAX_LEN];
+    path[0] = '\0';
+    if (ok) {
+        safe_append(path, sizeof(path), maester->folder_path);
+        safe_append(path, sizeof(path), "/");
+        safe_append(path, sizeof(path), realm);
+        safe_append(path, sizeof(path), "_");
+        if (safe_append(path, sizeof(path), base) != 0) {
+            ok = 0;
+        }
+    }
+    if (ok && (offers & TRANSFER_OFFER_DEDUP) &&
+        transfer_receive_from_store(maester, entry, data_type, origin, realm, stream, path, md5, file_size) == 0) {
+        pack_dictionary_free(&dict);
+        return 0;
+    }
+
+    IncomingTransfer* transfer = NULL;
+    int striped = windowed && (offers & TRANSFER_OFFER_STRIPE) != 0;
+    int resumable = windowed && !striped && (offers & TRANSFER_OFFER_RESUME) && frames > 0;
+    uint32_t held = 0;
+    Md5Context resumed;
+    pthread_mutex_lock(&maester->transfers_lock);
+    if (ok) {
+        // A repeated header replaces its transfer; what already arrived in
+        // order is kept for a resumption
+        transfer_replace_incoming(&maester->transfers, data_type, origin, stream, path, 1);
+        for (int i = 0; i < TRANSFER_MAX && transfer == NULL; i++) {
+            if (!maester->transfers.incoming[i].in_use) {
+                transfer = &maester->transfers.incoming[i];
+            }
+        }
+    }
+    if (transfer != NULL) {
+        my_strcpy(transfer->path, path);
+    }
+    if (transfer != NULL && frames > 0) {
+        transfer->have = (uint8_t*)calloc(frames, 1);
+        if (transfer->have == NULL) {
+            transfer = NULL;
+        }
+    }
+    if (transfer != NULL && resumable) {
+        held = transfer_load_progress(path, md5, wire_size, chunk, &resumed);
+    }
+    if (transfer != NULL) {
+        char part[PATH_MAX_LEN + 8];
+        transfer_part_path(transfer->path, part, sizeof(part));
+        // A resumed file keeps its prefix; the sink reserves the rest
+        size_t keep = (size_t)held * chunk;
+        int opened = (file_sink_open(&transfer->sink, part, wire_size, &keep, &resumed) == 0);
+        if (keep == 0) {
+            held = 0;   // The record outlived part of the file: start over
+            transfer_discard_progress(path);
+        }
+        if (!opened) {
+            write_str(STDERR_FILENO, "Warning: Could not create ");
+            write_str(STDERR_FILENO, part);
+            write_str(STDERR_FILENO, "\n");
+            free(transfer->have);
+            transfer->have = NULL;
+            transfer = NULL;
+        }
+    }
+    if (transfer != NULL) {
+        transfer->in_use = 1;
+        transfer->data_type = data_type;
+        my_strcpy(transfer->origin, origin);
+        my_strcpy(transfer->realm, realm);
+        my_strcpy(transfer->md5, md5);
+        transfer->stream = stream;
+        transfer->chunk = chunk;
+        transfer->size = wire_size;
+        transfer->packing = packed;
+        transfer->unpacked_size = file_size;
+        transfer->dict = dict;
+        transfer->received = 0;
+        transfer->last_progress = time(NULL);
+        transfer->windowed = windowed;
+        transfer->frames = (uint32_t)frames;
+        transfer->next_expected = held;
+        transfer->last_seq = held - 1;     // Frame `held` follows it (0xFFFFFFFF for a fresh file)
+        transfer->highest = held;
+        transfer->since_ack = 0;
+        transfer->resumable = resumable;
+        transfer->striped = striped;
+        transfer->checkpoint = held;
+        if (held > 0) {
+            memset(transfer->have, 1, held);
+            transfer->received = ((size_t)held * chunk < wire_size) ? (size_t)held * chunk : wire_size;
+        }
+    } else {
+        pack_dictionary_free(&dict);
+    }
+    IncomingTransfer done;
+    int empty = (transfer != NULL && file_size == 0);
+    if (empty) {
+        file_sink_close(&transfer->sink);
+        done = *transfer;
+        transfer->in_use = 0;
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    char answer[64];
+    answer[0] = '\0';
+    safe_append(answer, sizeof(answer), (transfer == NULL) ? "KO" : (windowed ? "OK&SACK" : "OK"));
+    transfer_append_stream(answer, sizeof(answer), stream);
+    if (transfer != NULL && resumable) {
+        char number[32];
+        ulong_to_str((unsigned long long)held * chunk, number);
+        safe_append(answer, sizeof(answer), "&AT=");
+        safe_append(answer, sizeof(answer), number);
+    }
+    if (transfer != NULL && packed != TRANSFER_PACK_NONE) {
+        safe_append(answer, sizeof(answer), (packed == TRANSFER_PACK_DICT) ? "&DICT" : "&PACK");
+    }
+    if (transfer != NULL && held > 0) {
+        char line[PATH_MAX_LEN + 128];
+        char number[32];
+        line[0] = '\0';
+        safe_append(line, sizeof(line), "\n>>> Resuming the file from ");
+        safe_append(line, sizeof(line), realm);
+        safe_append(line, sizeof(line), (packed != TRANSFER_PACK_NONE) ? " at packed byte " : " at byte ");
+        ulong_to_str((unsigned long long)held * chunk, number);
+        safe_append(line, sizeof(line), number);
+        safe_append(line, sizeof(line), ".\n$ ");
+        write_str(STDOUT_FILENO, line);
+    }
+    if (transfer_send_ack(maester, entry, realm, FRAME_TYPE_ACK_FILE, answer) != 0) {
+        write_str(STDERR_FILENO, "Warning: Could not send ACK_FILE to ");
+        write_str(STDERR_FILENO, realm);
+        write_str(STDERR_FILENO, "\n");
+    }
+    if (empty) {
+        transfer_finish_incoming(maester, entry, &done);
+    }
+    return (transfer != NULL) ? 0 : -1;
+}
+
+/**
+ * Append one data frame to its transfer, read straight from the receive ring.
+ * Windowed frames are written at their sequence number's offset and answered
+ * with ACK_DATA (every TRANSFER_ACK_EVERY frames, at once on a gap, a
+ * duplicate or the last frame).
+ * Returns 1 once the file is complete and its MD5 matches, -1 when it is
+ * complete but corrupted (realm receives the sender's name), 0 otherwise.
+ */
+int transfer_receive_data(Maester* maester, ConnectionEntry* entry, const FrameView* view,
+                          char* realm, size_t realm_len) {
+    if (maester == NULL || view == NULL) return 0;
+    char origin[FRAME_ORIGIN_LEN + 1];
+    frame_view_origin(view, origin, sizeof(origin));
+    uint16_t length = frame_view_data_length(view);
+    const uint8_t* data = frame_view_data(view);
+    uint8_t ack[FRAME_MAX_DATA];
+    size_t ack_len = 0;
+    char ack_realm[REALM_NAME_MAX];
+
+    pthread_mutex_lock(&maester->transfers_lock);
+    // Tagged frames start with their stream ID; the others belong to the
+    // sender's untagged transfer
+    IncomingTransfer* transfer = NULL;
+    if (length >= TRANSFER_STREAM_LEN + TRANSFER_SEQ_LEN && transfer_get_u16(data) != 0) {
+        transfer = transfer_find_incoming(&maester->transfers, frame_view_type(view), origin, transfer_get_u16(data));
+    }
+    if (transfer != NULL) {
+        data += TRANSFER_STREAM_LEN;
+        length = (uint16_t)(length - TRANSFER_STREAM_LEN);
+    } else {
+        transfer = transfer_find_incoming(&maester->transfers, frame_view_type(view), origin, 0);
+    }
+    if (transfer == NULL) {
+        pthread_mutex_unlock(&maester->transfers_lock);
+        return 0;  // No header seen (or already complete): nothing to append to
+    }
+    int failed = 0;
+    if (transfer->windowed) {
+        ack_len = transfer_take_windowed(transfer, data, length, ack, &failed);
+        my_strcpy(ack_realm, transfer->realm);
+    } else {
+        size_t remaining = transfer->size - transfer->received;
+        size_t chunk = (length < remaining) ? length : remaining;
+        if (file_sink_write(&transfer->sink, transfer->received, data, chunk) != 0 ||
+            file_sink_hash_to(&transfer->sink, transfer->received + chunk) != 0) {
+            failed = 1;
+        } else {
+            transfer->received += chunk;
+        }
+    }
+    if (failed) {
+        // Disk trouble: give up now, the sender hears CHECK_KO
+        transfer->received = transfer->size;
+        if (transfer->windowed) {
+            transfer->next_expected = transfer->frames;
+        }
+    }
+    transfer->last_progress = time(NULL);
+    IncomingTransfer done;
+    int complete = transfer->windowed ? (transfer->next_expected == transfer->frames)
+                                      : (transfer->received == transfer->size);
+    if (complete) {
+        // Whatever is still buffered goes to disk before the file is checked
+        if (file_sink_close(&transfer->sink) != 0) {
+            failed = 1;
+        }
+        done = *transfer;
+        free(transfer->have);
+        done.have = NULL;
+        transfer->have = NULL;
+        pack_dictionary_init(&transfer->dict);    // Unpacking the file takes it over
+        transfer->in_use = 0;
+        if (failed) {
+            done.md5[0] = '\0';  // Never matches
+        }
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    if (ack_len > 0 && transfer_send_to(maester, entry, ack_realm, FRAME_TYPE_ACK_DATA, ack, ack_len) != 0) {
+        write_str(STDERR_FILENO, "Warning: Could not send ACK_DATA to ");
+        write_str(STDERR_FILENO, ack_realm);
+        write_str(STDERR_FILENO, "\n");
+    }
+    if (!complete) return 0;
+    if (realm != NULL && realm_len > 0) {
+        realm[0] = '\0';
+        safe_append(realm, realm_len, done.realm);
+    }
+    // Verification runs outside the lock; the record is already released
+    transfer_finish_incoming(maester, entry, &done);
+    return (done.in_use == 1) ? 1 : -1;
+}
+
+/**
+ * Store one windowed frame (4-byte sequence number, then its slice of the
+ * file). Returns the length of the ACK_DATA payload written to `ack` when one
+ * is due, 0 otherwise; `failed` is set when the disk refused the data.
+ */
+static size_t transfer_take_windowed(IncomingTransfer* transfer, const uint8_t* data, uint16_t length,
+                                     uint8_t* ack, int* failed) {
+    if (length < TRANSFER_SEQ_LEN) return 0;
+    uint32_t seq = transfer_get_u32(data);
+    if (seq >= transfer->frames) return 0;
+    size_t offset = (size_t)seq * transfer->chunk;
+    size_t chunk = transfer->size - offset;
+    if (chunk > transfer->chunk) {
+        chunk = transfer->chunk;
+    }
+    if ((size_t)length - TRANSFER_SEQ_LEN != chunk) return 0;  // Not a slice of this file
+
+    int ack_now = 0;
+    if (transfer->have[seq]) {
+        ack_now = 1;  // Duplicate: the sender missed an ack or resent too early
+    } else {
+        if (file_sink_write(&transfer->sink, offset, data + TRANSFER_SEQ_LEN, chunk) != 0) {
+            *failed = 1;
+            return 0;
+        }
+        transfer->have[seq] = 1;
+        transfer->received += chunk;
+        if (seq != transfer->last_seq + 1) {
+            ack_now = 1;  // Opened or filled a gap: report it without delay
+        }
+        transfer->last_seq = seq;
+        if (seq + 1 > transfer->highest) {
+            transfer->highest = seq + 1;
+        }
+        // The digest follows the in-order prefix, from the sink's buffer or
+        // back from the page cache. A striped file is hashed once complete.
+        // For a packed image it only backs the resume record; the file is
+        // hashed as it is unpacked.
+        while (transfer->next_expected < transfer->frames && transfer->have[transfer->next_expected]) {
+            transfer->next_expected++;
+        }
+        if (!transfer->striped &&
+            file_sink_hash_to(&transfer->sink, (size_t)transfer->next_expected * transfer->chunk) != 0) {
+            *failed = 1;
+            return 0;
+        }
+        if (transfer->resumable && transfer->next_expected < transfer->frames &&
+            transfer->next_expected - transfer->checkpoint >= TRANSFER_CHECKPOINT_FRAMES) {
+            transfer_save_progress(transfer);
+        }
+        if (++transfer->since_ack >= TRANSFER_ACK_EVERY || transfer->next_expected == transfer->frames) {
+            ack_now = 1;
+        }
+    }
+    if (!ack_now) return 0;
+    transfer->since_ack = 0;
+    return transfer_build_data_ack(transfer, ack);
+}
+
+// Digest of a complete striped file, read through a mapping of it
+static int transfer_hash_part(const char* part, size_t size, uint8_t digest[16]) {
+    if (size == 0) {
+        md5_buffer("", 0, digest);
+        return 0;
+    }
+    int fd = open(part, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    md5_buffer(map, size, digest);
+    munmap(map, size);
+    return 0;
+}
+
+/**
+ * Replace the packed image in the .part file by the file it unpacks to, and
+ * hash that into the sink's digest on the way out. Both are held in memory,
+ * which TRANSFER_PACK_MAX_BYTES bounds.
+ */
+static int transfer_unpack_part(const char* part, IncomingTransfer* done) {
+    int fd = open(part, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    void* map = mmap(NULL, done->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    uint8_t* file = (uint8_t*)malloc(done->unpacked_size);
+    int ok = (file != NULL && pack_decompress(&done->dict, (const uint8_t*)map, done->size, file,
+                                              done->unpacked_size) == 0);
+    munmap(map, done->size);
+
+    size_t keep = 0;
+    if (ok) {
+        ok = (file_sink_open(&done->sink, part, done->unpacked_size, &keep, NULL) == 0);
+    }
+    if (ok) {
+        ok = (file_sink_write(&done->sink, 0, file, done->unpacked_size) == 0 &&
+              file_sink_hash_to(&done->sink, done->unpacked_size) == 0);
+        ok = (file_sink_close(&done->sink) == 0) && ok;
+    }
+    free(file);
+    if (ok) {
+        done->size = done->unpacked_size;
+    }
+    return ok ? 0 : -1;
+}
+
+// ACK_DATA payload: stream ID when tagged, cumulative ack, block count,
+// [start, end) blocks held beyond it
+static size_t transfer_build_data_ack(const IncomingTransfer* transfer, uint8_t* ack) {
+    size_t prefix = 0;
+    if (transfer->stream != 0) {
+        ack[0] = (uint8_t)(transfer->stream >> 8);
+        ack[1] = (uint8_t)transfer->stream;
+        prefix = TRANSFER_STREAM_LEN;
+        ack += prefix;
+    }
+    transfer_put_u32(ack, transfer->next_expected);
+    size_t length = TRANSFER_SEQ_LEN + 1;
+    int blocks = 0;
+    uint32_t seq = transfer->next_expected;
+    while (seq < transfer->highest && blocks < TRANSFER_SACK_MAX) {
+        while (seq < transfer->highest && !transfer->have[seq]) seq++;
+        if (seq == transfer->highest) break;
+        uint32_t start = seq;
+        while (seq < transfer->highest && transfer->have[seq]) seq++;
+        transfer_put_u32(ack + length, start);
+        transfer_put_u32(ack + length + TRANSFER_SEQ_LEN, seq);
+        length += 2 * TRANSFER_SEQ_LEN;
+        blocks++;
+    }
+    ack[TRANSFER_SEQ_LEN] = (uint8_t)blocks;
+    return prefix + length;
+}
+
+/**
+ * Whole file on disk: check the digest accumulated while it arrived (a
+ * striped file is hashed now, a packed one as it is unpacked; md5sum runs
+ * over it with the md5sum backend), keep it under its final name or
+ * delete it, and tell the sender. `done->in_use` is left 1 on success, 0 on
+ * failure.
+ */
+static void transfer_finish_incoming(Maester* maester, ConnectionEntry* entry, IncomingTransfer* done) {
+    char part[PATH_MAX_LEN + 8];
+    transfer_part_path(done->path, part, sizeof(part));
+    transfer_discard_progress(done->path);
+
+    if (done->md5[0] != '\0' && done->packing != TRANSFER_PACK_NONE && transfer_unpack_part(part, done) != 0) {
+        done->md5[0] = '\0';   // Never matches
+    }
+    pack_dictionary_free(&done->dict);
+
+    uint8_t digest[16];
+    char md5_hex[33];
+    int verified = 0;
+    int hashed = 0;
+    if (done->md5[0] != '\0' && md5_selected() == MD5_BACKEND_MD5SUM) {
+        hashed = (md5_digest_file(part, digest) == 0);
+    } else if (done->md5[0] != '\0' && done->striped && done->packing == TRANSFER_PACK_NONE) {
+        hashed = (transfer_hash_part(part, done->size, digest) == 0);
+    } else if (done->md5[0] != '\0') {
+        md5_final(&done->sink.digest, digest);
+        hashed = 1;
+    }
+    if (hashed) {
+        md5_digest_to_hex(digest, md5_hex);
+        verified = (my_strcasecmp(md5_hex, done->md5) == 0);
+    }
+    if (verified && rename(part, done->path) != 0) {
+        verified = 0;
+    }
+    if (!verified) {
+        unlink(part);
+    } else {
+        sigil_store_add(&maester->sigils, done->path, md5_hex);
+    }
+    done->in_use = verified;
+
+    char line[PATH_MAX_LEN + 128];
+    line[0] = '\0';
+    safe_append(line, sizeof(line), "\n>>> File from ");
+    safe_append(line, sizeof(line), done->realm);
+    if (verified) {
+        safe_append(line, sizeof(line), " received: ");
+        safe_append(line, sizeof(line), done->path);
+        safe_append(line, sizeof(line), " (MD5 OK).\n$ ");
+    } else {
+        safe_append(line, sizeof(line), " failed the MD5 check and was discarded.\n$ ");
+    }
+    write_str(STDOUT_FILENO, line);
+
+    char answer[32];
+    answer[0] = '\0';
+    safe_append(answer, sizeof(answer), verified ? "CHECK_OK" : "CHECK_KO");
+    transfer_append_stream(answer, sizeof(answer), done->stream);
+    if (transfer_send_ack(maester, entry, done->realm, FRAME_TYPE_ACK_MD5, answer) != 0) {
+        write_str(STDERR_FILENO, "Warning: Could not send ACK_MD5 to ");
+        write_str(STDERR_FILENO, done->realm);
+        write_str(STDERR_FILENO, "\n");
+    }
+}
+
+/**
+ * Answer a file header from the sigil store: place the stored copy at `path`
+ * and send the ACK_MD5 verdict without asking for the file.
+ * Returns -1 (nothing sent) when the store cannot supply it.
+ */
+static int transfer_receive_from_store(Maester* maester, ConnectionEntry* entry, FrameType data_type,
+                                       const char* origin, const char* realm, uint16_t stream,
+                                       const char* path, const char* md5, size_t size) {
+    char part[PATH_MAX_LEN + 8];
+    transfer_part_path(path, part, sizeof(part));
+    if (sigil_store_claim(&maester->sigils, &maester->digests, md5, size, part) != 0) {
+        return -1;
+    }
+    if (rename(part, path) != 0) {
+        unlink(part);
+        return -1;
+    }
+
+    // A repeated header replaces its transfer
+    pthread_mutex_lock(&maester->transfers_lock);
+    transfer_replace_incoming(&maester->transfers, data_type, origin, stream, path, 0);
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    char line[PATH_MAX_LEN + 128];
+    line[0] = '\0';
+    safe_append(line, sizeof(line), "\n>>> File from ");
+    safe_append(line, sizeof(line), realm);
+    safe_append(line, sizeof(line), " received: ");
+    safe_append(line, sizeof(line), path);
+    safe_append(line, sizeof(line), " (already in the sigil store, MD5 OK).\n$ ");
+    write_str(STDOUT_FILENO, line);
+
+    char answer[32];
+    answer[0] = '\0';
+    safe_append(answer, sizeof(answer), "CHECK_OK");
+    transfer_append_stream(answer, sizeof(answer), stream);
+    if (transfer_send_ack(maester, entry, realm, FRAME_TYPE_ACK_MD5, answer) != 0) {
+        write_str(STDERR_FILENO, "Warning: Could not send ACK_MD5 to ");
+        write_str(STDERR_FILENO, realm);
+        write_str(STDERR_FILENO, "\n");
+    }
+    return 0;
+}
+
+/**
+ * Record how far a resumable file got: its MD5, size, the frames held in
+ * order and the digest state over them, as one line in <path>.resume. The
+ * sink is flushed first so the .part file holds that prefix; if it cannot
+ * be, no record is written.
+ */
+static void transfer_save_progress(IncomingTransfer* transfer) {
+    if (file_sink_flush(&transfer->sink) != 0) {
+        return;
+    }
+    const Md5Context* digest = &transfer->sink.digest;
+    char line[256];
+    char number[32];
+    line[0] = '\0';
+    safe_append(line, sizeof(line), transfer->md5);
+    size_t values[7] = {
+        transfer->size, transfer->next_expected,
+        digest->state[0], digest->state[1], digest->state[2], digest->state[3],
+        (size_t)digest->length
+    };
+    for (int i = 0; i < 7; i++) {
+        ulong_to_str((unsigned long long)values[i], number);
+        safe_append(line, sizeof(line), " ");
+        safe_append(line, sizeof(line), number);
+    }
+    // Partial MD5 block, hex
+    static const char* digits = "0123456789abcdef";
+    size_t pending = (size_t)(digest->length % 64);
+    size_t length = (size_t)my_strlen(line);
+    line[length++] = ' ';
+    for (size_t i = 0; i < pending; i++) {
+        line[length++] = digits[digest->block[i] >> 4];
+        line[length++] = digits[digest->block[i] & 0xF];
+    }
+    line[length++] = '\n';
+
+    char record[PATH_MAX_LEN + 16];
+    char tmp[PATH_MAX_LEN + 24];
+    transfer_resume_path(transfer->path, record, sizeof(record));
+    tmp[0] = '\0';
+    safe_append(tmp, sizeof(tmp), record);
+    safe_append(tmp, sizeof(tmp), ".tmp");
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t written = write(fd, line, length);
+    close(fd);
+    if (written != (ssize_t)length || rename(tmp, record) != 0) {
+        unlink(tmp);
+        return;
+    }
+    transfer->checkpoint = transfer->next_expected;
+}
+
+/**
+ * Frames of `chunk` bytes of <path>.part a new header for the same file (MD5
+ * and size) may skip, restoring the digest over them; 0 when there is no
+ * usable record (or it counted frames of another size).
+ */
+static uint32_t transfer_load_progress(const char* path, const char* md5, size_t size, size_t chunk,
+                                       Md5Context* digest) {
+    char record[PATH_MAX_LEN + 16];
+    transfer_resume_path(path, record, sizeof(record));
+    int fd = open(record, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    char line[256];
+    ssize_t length = read(fd, line, sizeof(line) - 1);
+    close(fd);
+    if (length <= 0) {
+        return 0;
+    }
+    line[length] = '\0';
+
+    // md5 size frames state0..3 length block
+    char* fields[9];
+    int count = 0;
+    char* p = line;
+    while (count < 9) {
+        fields[count++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\n') p++;
+        if (*p != ' ') {
+            *p = '\0';
+            break;
+        }
+        *p++ = '\0';
+    }
+    size_t values[7];
+    if (count != 9 || my_strcasecmp(fields[0], md5) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < 7; i++) {
+        if (transfer_parse_size(fields[i + 1], &values[i]) != 0) return 0;
+    }
+    size_t frames = (size + chunk - 1) / chunk;
+    size_t held_bytes = values[1] * chunk;
+    size_t pending = values[6] % 64;
+    if (values[0] != size || values[1] == 0 || values[1] >= frames || values[6] != held_bytes ||
+        (size_t)my_strlen(fields[8]) != pending * 2) {
+        return 0;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (values[i + 2] > 0xFFFFFFFFu) return 0;
+        digest->state[i] = (uint32_t)values[i + 2];
+    }
+    digest->length = (uint64_t)values[6];
+    for (size_t i = 0; i < pending; i++) {
+        int hi = transfer_hex_value(fields[8][i * 2]);
+        int lo = transfer_hex_value(fields[8][i * 2 + 1]);
+        if (hi < 0 || lo < 0) return 0;
+        digest->block[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return (uint32_t)values[1];
+}
+
+static int transfer_hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
+    return -1;
+}
+
+static void transfer_discard_progress(const char* path) {
+    char record[PATH_MAX_LEN + 16];
+    transfer_resume_path(path, record, sizeof(record));
+    unlink(record);
+}
+
+// ============= RESUMPTION =============
+
+// Next hop lost: forget what was in flight, the receiver tells where to resume
+static void transfer_suspend(OutgoingTransfer* transfer) {
+    free(transfer->frame_flags);
+    free(transfer->sent_us);
+    free(transfer->sent_on);
+    transfer->frame_flags = NULL;
+    transfer->sent_us = NULL;
+    transfer->sent_on = NULL;
+    transfer->windowed = 0;
+    transfer->timer_us = 0;
+    transfer->next_hop = 0;
+    transfer->state = TRANSFER_RECONNECT;
+    transfer->retry_at = 0;
+    transfer->retry_delay_s = 1;
+    write_str(STDOUT_FILENO, "Lost the connection carrying ");
+    write_str(STDOUT_FILENO, transfer->name);
+    write_str(STDOUT_FILENO, " to ");
+    write_str(STDOUT_FILENO, transfer->realm);
+    write_str(STDOUT_FILENO, "; it resumes once the route is back.\n");
+}
+
+// TRANSFER_RESUME payload: "<data type>&<our realm>&<name>&<size>&<md5>&SACK&DEDUP&RESUME&STREAM=<id>",
+// then the packing the receiver picked, if any
+static int transfer_build_resume(Maester* maester, const OutgoingTransfer* transfer, CitadelFrame* frame) {
+    char payload[FRAME_MAX_DATA + 1];
+    char number[32];
+    payload[0] = '\0';
+    int_to_str((int)transfer->data_type, number);
+    int fits = (safe_append(payload, sizeof(payload), number) == 0 &&
+                safe_append(payload, sizeof(payload), "&") == 0 &&
+                safe_append(payload, sizeof(payload), maester->realm_name) == 0 &&
+                safe_append(payload, sizeof(payload), "&") == 0 &&
+                safe_append(payload, sizeof(payload), transfer->name) == 0 &&
+                safe_append(payload, sizeof(payload), "&") == 0);
+    ulong_to_str((unsigned long long)transfer->size, number);
+    fits = fits && (safe_append(payload, sizeof(payload), number) == 0 &&
+                    safe_append(payload, sizeof(payload), "&") == 0 &&
+                    safe_append(payload, sizeof(payload), transfer->md5) == 0 &&
+                    safe_append(payload, sizeof(payload), "&SACK&DEDUP&RESUME") == 0);
+    char offers[96];
+    offers[0] = '\0';
+    transfer_append_stream(offers, sizeof(offers), transfer->stream);
+    transfer_append_packings(offers, sizeof(offers), transfer);
+    fits = fits && safe_append(payload, sizeof(payload), offers) == 0;
+    if (!fits) {
+        return -1;
+    }
+    frame_init(frame, FRAME_TYPE_TRANSFER_RESUME, transfer->origin, transfer->realm);
+    size_t length = (size_t)my_strlen(payload);
+    memcpy(frame->data, payload, length);
+    frame->data_length = (uint16_t)length;
+    return 0;
+}
+
+/**
+ * Re-announce a suspended transfer through a fresh connection towards its
+ * receiver. The ACK_FILE answer carries the offset it resumes from.
+ */
+static void transfer_reconnect(Maester* maester, const char* realm, uint16_t stream) {
+    int used_default = 0;
+    Route* route = maester_resolve_route(maester, realm, &used_default);
+    ConnectionEntry* connection = (route != NULL) ? maester_route_connection(maester, route) : NULL;
+
+    CitadelFrame header;
+    int ready = 0;
+    pthread_mutex_lock(&maester->transfers_lock);
+    OutgoingTransfer* transfer = transfer_find_outgoing(&maester->transfers, realm, stream);
+    if (transfer != NULL && transfer->state == TRANSFER_RECONNECT) {
+        if (connection != NULL && transfer_build_resume(maester, transfer, &header) == 0) {
+            transfer->state = TRANSFER_AWAIT_ACK_FILE;
+            transfer->next_hop = connection_handle(connection);
+            ready = 1;
+        } else {
+            transfer->retry_at = time(NULL) + transfer->retry_delay_s;
+            if (transfer->retry_delay_s < TRANSFER_RETRY_MAX_S) transfer->retry_delay_s *= 2;
+        }
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+    if (ready && maester_send_frame(connection, &header) != 0) {
+        pthread_mutex_lock(&maester->transfers_lock);
+        transfer = transfer_find_outgoing(&maester->transfers, realm, stream);
+        if (transfer != NULL && transfer->state == TRANSFER_AWAIT_ACK_FILE) {
+            transfer->state = TRANSFER_RECONNECT;
+            transfer->next_hop = 0;
+            transfer->retry_at = time(NULL) + transfer->retry_delay_s;
+            if (transfer->retry_delay_s < TRANSFER_RETRY_MAX_S) transfer->retry_delay_s *= 2;
+        }
+        pthread_mutex_unlock(&maester->transfers_lock);
+    }
+}
+
+/**
+ * Run from the CLI loop: drop transfers that stopped making progress (sender
+ * gone, receiver unreachable for too long), suspend resumable ones whose next
+ * hop went away and retry those towards a fresh connection. Returns the
+ * milliseconds until it wants to run again, -1 with no transfer going on.
+ */
+int transfer_expire(Maester* maester) {
+    if (maester == NULL) return -1;
+    time_t now = time(NULL);
+    char retry[TRANSFER_MAX][REALM_NAME_MAX];
+    uint16_t retry_stream[TRANSFER_MAX];
+    int num_retry = 0;
+    ConnHandle wake[TRANSFER_MAX * TRANSFER_STRIPE_MAX];
+    int num_wake = 0;
+    int active = 0;
+    pthread_mutex_lock(&maester->transfers_lock);
+    for (int i = 0; i < TRANSFER_MAX; i++) {
+        OutgoingTransfer* out = &maester->transfers.outgoing[i];
+        if (out->state != TRANSFER_IDLE && now - out->last_progress >= TRANSFER_IDLE_TIMEOUT_S) {
+            write_str(STDOUT_FILENO, "Transfer of ");
+            write_str(STDOUT_FILENO, out->name);
+            write_str(STDOUT_FILENO, " to ");
+            write_str(STDOUT_FILENO, out->realm);
+            write_str(STDOUT_FILENO, " timed out.\n");
+            transfer_release_outgoing(&maester->transfers, out);
+        } else if (out->resumable && (out->state == TRANSFER_STREAMING || out->state == TRANSFER_AWAIT_ACK_FILE) &&
+                   connection_table_lookup(&maester->connections, out->next_hop) == NULL) {
+            transfer_suspend(out);
+        } else if (out->state == TRANSFER_STREAMING && out->windowed && out->num_stripes > 1 &&
+                   transfer_check_stripes(out, &maester->connections)) {
+            num_wake += transfer_stripe_handles(out, wake + num_wake);
+        }
+        if (out->state == TRANSFER_RECONNECT && now >= out->retry_at) {
+            retry_stream[num_retry] = out->streamed ? out->stream : 0;
+            my_strcpy(retry[num_retry++], out->realm);
+        }
+        active |= (out->state != TRANSFER_IDLE);
+        IncomingTransfer* in = &maester->transfers.incoming[i];
+        if (in->in_use && now - in->last_progress >= TRANSFER_IDLE_TIMEOUT_S) {
+            int kept = in->resumable && in->next_expected > 0;
+            write_str(STDOUT_FILENO, "Incomplete file from ");
+            write_str(STDOUT_FILENO, in->realm);
+            write_str(STDOUT_FILENO, kept ? " kept for a resumption (timed out).\n" : " discarded (timed out).\n");
+            transfer_release_incoming(in, 1);
+        }
+        active |= in->in_use;
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+
+    for (int i = 0; i < num_wake; i++) {
+        maester_wake_transfers(maester, connection_table_lookup(&maester->connections, wake[i]));
+    }
+    for (int i = 0; i < num_retry; i++) {
+        transfer_reconnect(maester, retry[i], retry_stream[i]);
+    }
+    return active ? 1000 : -1;
+}
+
+/**
+ * True while a transfer to `realm` can still resume after losing its next hop
+ * (suspended, retrying, or going again): the receiver keeps the partial file,
+ * so it may yet arrive. Caller holds alliances_lock or nothing.
+ */
+int transfer_send_resumes(Maester* maester, const char* realm) {
+    if (maester == NULL || realm == NULL) return 0;
+    int resumes = 0;
+    pthread_mutex_lock(&maester->transfers_lock);
+    for (int i = 0; i < TRANSFER_MAX && !resumes; i++) {
+        const OutgoingTransfer* out = &maester->transfers.outgoing[i];
+        resumes = (out->state != TRANSFER_IDLE && out->resumable && my_strcasecmp(out->realm, realm) == 0);
+    }
+    pthread_mutex_unlock(&maester->transfers_lock);
+    return resumes;
+}
@@ -0,0 +1,54 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "maester.h"
+
+// Phase 3 file transfers. The sender announces the file with its header frame
+// (PLEDGE, ...) and offers the windowed protocol with a trailing "&SACK"
+// field; once the receiver answers ACK_FILE the file goes out as data frames
+// built straight out of a read-only mapping of it. With "OK&SACK" every frame
+// carries a sequence number, the receiver answers ACK_DATA (cumulative plus
+// selective acks) and the sender keeps a window of unacknowledged frames that
+// follows the measured RTT, retransmitting on SACK gaps and timeouts. With a
+// plain "OK" the frames are streamed once, in order. The receiver writes the
+// data to <folder>/<realm>_<name>.part, hashes it in file order as it arrives
+// (md5.h) and answers ACK_MD5 once the digest is checked. Verified files are
+// kept in the sigil store (sigils.h); a header offering "&DEDUP" whose digest
+// is already there gets its ACK_MD5 at once and no data frames follow. A large
+// file offered with "&STRIPE" goes out over several connections to the next
+// hop; the receiver checks its digest once complete. Every header also offers
+// "&STREAM=<id>": a receiver that echoes it in its answers gets data frames
+// and ACK_DATA prefixed with that ID, so several files between the same two
+// realms can be in flight at once, interleaved on one connection. Files that
+// pack well (pack.h) are also offered as packed images ("&PACK=<bytes>", and
+// "&DICT=<id>:<bytes>" against a dictionary of product names); the windowed
+// data frames then carry the image the receiver picked, which it unpacks once
+// complete.
+
+void transfer_table_init(TransferTable* table, ConnectionTable* connections);
+void transfer_table_destroy(TransferTable* table);
+
+// Sender side
+int  transfer_stock_dictionary(Maester* maester, PackDictionary* dict);
+int  transfer_send_prepare(Maester* maester, const char* path, const PackDictionary* dict, TransferSource* source);
+void transfer_source_release(TransferSource* source);
+int  transfer_send_begin(Maester* maester, FrameType data_type, const char* realm, const char* origin,
+                         TransferSource* source, const char* name, ConnHandle next_hop, uint16_t* stream);
+void transfer_send_cancel(Maester* maester, const char* realm, uint16_t stream);
+void transfer_header_offers(Maester* maester, const char* realm, uint16_t stream, char* out, size_t out_len);
+int  transfer_handle_ack(Maester* maester, const CitadelFrame* frame);
+int  transfer_handle_data_ack(Maester* maester, const FrameView* view);
+void transfer_pump(Maester* maester, ConnectionEntry* entry);
+int  transfer_check_timeouts(Maester* maester, Shard* shard);
+
+// Receiver side
+int  transfer_receive_begin(Maester* maester, ConnectionEntry* entry, FrameType data_type, const char* origin,
+                            const char* realm, const char* name, const char* size, const char* md5,
+                            unsigned offers, uint16_t stream, const TransferPacking* packing);
+int  transfer_receive_data(Maester* maester, ConnectionEntry* entry, const FrameView* view,
+                           char* realm, size_t realm_len);
+
+int  transfer_expire(Maester* maester);
+int  transfer_send_resumes(Maester* maester, const char* realm);
+
+#endif
@@ -0,0 +1,627 @@
+#define _GNU_SOURCE   // syscall(), MAP_POPULATE, MAP_ANONYMOUS
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+#include "connections.h"
+#include "network.h"
+#include "shards.h"
+#include "transfer.h"
+#include "helper.h"
+
+static void uring_reap_cancelled(Maester* maester, Uring* ring);
+
+// user_data layout: op in the top byte, then the 32-bit generation and the
+// 16-bit slot of the connection handle (slots stay below CONN_SLAB_MAX_CHUNKS *
+// CONN_SLAB_CHUNK = 65536).
+static uint64_t uring_user_data(UringOp op, ConnHandle handle) {
+    return ((uint64_t)op << 56) | ((handle >> 32) << 16) | (handle & 0xFFFF);
+}
+
+static UringOp uring_user_op(uint64_t user_data) {
+    return (UringOp)(user_data >> 56);
+}
+
+static ConnHandle uring_user_handle(uint64_t user_data) {
+    return (((user_data >> 16) & 0xFFFFFFFFull) << 32) | (user_data & 0xFFFF);
+}
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Check the kernel implements every opcode the backend submits. SEND_ZC only
+ * serves as a marker: it arrived in the same release (6.0) as multishot
+ * receive, which has no probe bit of its own.
+ */
+static int uring_probe_ops(int ring_fd) {
+    static const int required[] = {
+        IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_ACCEPT,
+        IORING_OP_SENDMSG, IORING_OP_RECV, IORING_OP_SEND_ZC
+    };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, size);
+    if (probe == NULL) return -1;
+    int result = 0;
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        result = -1;
+    }
+    for (size_t i = 0; result == 0 && i < sizeof(required) / sizeof(required[0]); i++) {
+        if (required[i] > probe->last_op || !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) {
+            result = -1;
+        }
+    }
+    free(probe);
+    return result;
+}
+
+// Hand buffer `bid` (back) to the kernel for the next receive
+static void uring_recycle_buffer(Uring* ring, unsigned bid) {
+    struct io_uring_buf* buf = &ring->buf_ring->bufs[ring->buf_tail & (ring->buf_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)bid * URING_RECV_BUFFER_SIZE);
+    buf->len = URING_RECV_BUFFER_SIZE;
+    buf->bid = (uint16_t)bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, (uint16_t)ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_setup_buffers(Uring* ring, unsigned count) {
+    ring->buf_ring_size = (size_t)count * sizeof(struct io_uring_buf);
+    void* mem = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return -1;
+    }
+    ring->buf_ring = (struct io_uring_buf_ring*)mem;
+    ring->buffers = (uint8_t*)malloc((size_t)count * URING_RECV_BUFFER_SIZE);
+    if (ring->buffers == NULL) {
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)mem;
+    reg.ring_entries = count;
+    reg.bgid = URING_RECV_GROUP;
+    if (sys_io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -1;
+    }
+    ring->buf_count = count;
+    ring->buf_tail = 0;
+    for (unsigned bid = 0; bid < count; bid++) {
+        uring_recycle_buffer(ring, bid);
+    }
+    return 0;
+}
+
+/**
+ * Create a ring with `entries` submission slots (completion queue four times
+ * that, multishot requests post many completions each) and, when
+ * `recv_buffers` > 0, register that many provided receive buffers. Fails on
+ * kernels without the features the backend relies on.
+ */
+int uring_init(Uring* ring, unsigned entries, unsigned recv_buffers) {
+    if (ring == NULL) return -1;
+    memset(ring, 0, sizeof(Uring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    ring->ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring->ring_fd < 0) {
+        return -1;
+    }
+    // SUBMIT_STABLE: a SENDMSG's msghdr may be reused once the SQE is consumed
+    unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_SUBMIT_STABLE;
+    if ((params.features & needed) != needed || uring_probe_ops(ring->ring_fd) != 0) {
+        uring_destroy(ring);
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+    void* mem = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring->ring_fd, IORING_OFF_SQ_RING);
+    if (mem == MAP_FAILED) {
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->ring_mem = mem;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->sqes = (struct io_uring_sqe*)sqes;
+
+    uint8_t* base = (uint8_t*)mem;
+    ring->sq_head = (unsigned*)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(base + params.sq_off.tail);
+    ring->sq_mask = *(unsigned*)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_prepared = *ring->sq_tail;
+    // SQE i always sits in slot i, so the index array is filled once
+    unsigned* array = (unsigned*)(base + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+    ring->cq_head = (unsigned*)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+    if (recv_buffers > 0) {
+        // A shard ring: receive buffers, plus one send msghdr per SQE slot
+        ring->send_msgs = (UringSendMsg*)malloc(params.sq_entries * sizeof(UringSendMsg));
+        if (ring->send_msgs == NULL || uring_setup_buffers(ring, recv_buffers) != 0) {
+            uring_destroy(ring);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void uring_destroy(Uring* ring) {
+    if (ring == NULL) return;
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->ring_mem != NULL) {
+        munmap(ring->ring_mem, ring->ring_size);
+    }
+    if (ring->ring_fd >= 0) {
+        close(ring->ring_fd);   // Also drops the buffer ring registration
+    }
+    if (ring->buf_ring != NULL) {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    free(ring->buffers);
+    free(ring->send_msgs);
+    free(ring->flush);
+    memset(ring, 0, sizeof(Uring));
+    ring->ring_fd = -1;
+}
+
+static unsigned uring_sq_space(const Uring* ring) {
+    return ring->sq_entries - (ring->sq_prepared - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+static int uring_cq_ready(const Uring* ring) {
+    return *ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Publish the prepared SQEs and hand them to the kernel with one
+ * io_uring_enter, waiting for a completion unless `timeout_ms` is 0 or
+ * completions are already queued (-1 waits without limit).
+ */
+int uring_submit_and_wait(Uring* ring, int timeout_ms) {
+    __atomic_store_n(ring->sq_tail, ring->sq_prepared, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->sq_prepared - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned wait_nr = (timeout_ms != 0 && !uring_cq_ready(ring)) ? 1 : 0;
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void* arg_ptr = NULL;
+    size_t arg_size = 0;
+    if (wait_nr && timeout_ms > 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        arg_ptr = &arg;
+        arg_size = sizeof(arg);
+    }
+    if (sys_io_uring_enter(ring->ring_fd, to_submit, wait_nr, flags, arg_ptr, arg_size) < 0) {
+        // Timeout, signal, or a full completion queue: the caller reaps and retries
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Copy out the oldest completion and release its slot. Returns 0 when none is queued.
+int uring_next_completion(Uring* ring, struct io_uring_cqe* out) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    *out = ring->cqes[head & ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Next free SQE, zeroed; submits what is pending first when the queue is full
+static struct io_uring_sqe* uring_get_sqe(Uring* ring) {
+    if (uring_sq_space(ring) == 0 && (uring_submit_and_wait(ring, 0) != 0 || uring_sq_space(ring) == 0)) {
+        return NULL;
+    }
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sq_prepared & ring->sq_mask];
+    ring->sq_prepared++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static int uring_prep_poll(Uring* ring, int fd, unsigned poll_events, int multishot, uint64_t user_data) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_events;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int uring_arm_wake(Uring* ring, int wake_fd) {
+    if (ring == NULL || wake_fd < 0) return -1;
+    return uring_prep_poll(ring, wake_fd, POLLIN, 1, uring_user_data(URING_OP_WAKE, 0));
+}
+
+static int uring_arm_recv(Uring* ring, ConnectionEntry* entry) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = entry->sockfd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RECV_GROUP;
+    sqe->user_data = uring_user_data(URING_OP_RECV, connection_handle(entry));
+    entry->uring_recv = 1;
+    return 0;
+}
+
+// Stop the multishot receive of a held connection; what it has already
+// taken off the socket still completes
+static int uring_cancel_recv(Uring* ring, ConnectionEntry* entry) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = uring_user_data(URING_OP_RECV, connection_handle(entry));
+    sqe->user_data = uring_user_data(URING_OP_NONE, 0);
+    entry->uring_recv_stop = 1;
+    return 0;
+}
+
+/**
+ * Submit the send queue as a chain of linked SENDMSGs, each gathering up to
+ * SEND_QUEUE_IOV_MAX queued slots (frames) like one writev(). The kernel runs
+ * the links in order, each to its end; a failed send cancels the rest of the
+ * chain, which is resubmitted from the new queue head once every link has
+ * completed.
+ * The slots stay in the queue (and in place) until a completion consumes
+ * them; the msghdr and iovecs only have to outlive the submit.
+ */
+static void uring_queue_send_chain(Uring* ring, ConnectionEntry* entry) {
+    SendSlot* slot = entry->send_queue.head;
+    if (slot == NULL || ring->send_msgs == NULL) return;
+    // A chain must not be split across submissions
+    if (uring_sq_space(ring) < URING_SEND_CHAIN_MAX) {
+        uring_submit_and_wait(ring, 0);
+    }
+    uint64_t user_data = uring_user_data(URING_OP_SEND, connection_handle(entry));
+    struct io_uring_sqe* previous = NULL;
+    unsigned links = 0;
+    while (slot != NULL && links < URING_SEND_CHAIN_MAX && uring_sq_space(ring) > 0) {
+        UringSendMsg* batch = &ring->send_msgs[ring->sq_prepared & ring->sq_mask];
+        struct io_uring_sqe* sqe = uring_get_sqe(ring);
+        int count = 0;
+        for (; slot != NULL && count < SEND_QUEUE_IOV_MAX; slot = slot->next) {
+            batch->iov[count].iov_base = slot->data + slot->offset;
+            batch->iov[count].iov_len = (size_t)(slot->length - slot->offset);
+            count++;
+        }
+        memset(&batch->msg, 0, sizeof(batch->msg));
+        batch->msg.msg_iov = batch->iov;
+        batch->msg.msg_iovlen = (size_t)count;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = entry->sockfd;
+        sqe->addr = (uint64_t)(uintptr_t)&batch->msg;
+        sqe->len = 1;
+        // MSG_WAITALL: a partial send is finished by the kernel; completing
+        // short would not break the link, and the next one would run ahead
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = user_data;
+        if (previous != NULL) {
+            previous->flags |= IOSQE_IO_LINK;
+        }
+        previous = sqe;
+        links++;
+    }
+    entry->uring_sends = (uint16_t)links;
+    ring->sends_inflight += links;
+}
+
+static void uring_schedule_flush(Uring* ring, ConnectionEntry* entry) {
+    if (ring->flush_count == ring->flush_capacity) {
+        size_t capacity = (ring->flush_capacity == 0) ? 64 : ring->flush_capacity * 2;
+        ConnHandle* grown = (ConnHandle*)realloc(ring->flush, capacity * sizeof(ConnHandle));
+        if (grown == NULL) {
+            uring_queue_send_chain(ring, entry);  // Cannot defer: submit right away
+            return;
+        }
+        ring->flush = grown;
+        ring->flush_capacity = capacity;
+    }
+    ring->flush[ring->flush_count++] = connection_handle(entry);
+    entry->uring_flush = 1;
+}
+
+/**
+ * Bring the requests in flight for the entry in line with its state: a
+ * POLLOUT while connect() is pending, then a multishot receive (none while
+ * the entry is held), and its send queue scheduled for the next submit when
+ * it has bytes and no chain out.
+ */
+int uring_connection_sync(Uring* ring, ConnectionEntry* entry) {
+    if (ring == NULL || entry == NULL || entry->sockfd < 0) return -1;
+    if (entry->state == CONNECTION_CONNECTING) {
+        if (!entry->uring_poll) {
+            if (uring_prep_poll(ring, entry->sockfd, POLLOUT, 0,
+                                uring_user_data(URING_OP_CONNECT, connection_handle(entry))) != 0) {
+                return -1;
+            }
+            entry->uring_poll = 1;
+        }
+        return 0;
+    }
+    if (entry->held) {
+        if (entry->uring_recv && !entry->uring_recv_stop && uring_cancel_recv(ring, entry) != 0) {
+            return -1;
+        }
+    } else if (!entry->uring_recv && uring_arm_recv(ring, entry) != 0) {
+        return -1;
+    }
+    if (entry->send_queue.bytes > 0 && entry->uring_sends == 0 && !entry->uring_flush) {
+        uring_schedule_flush(ring, entry);
+    }
+    return 0;
+}
+
+/**
+ * Cancel everything in flight on the entry's socket before it is closed and
+ * its send slots recycled. Submitted at once: the cancel has to reach the
+ * kernel while the descriptor still names the socket.
+ */
+void uring_connection_cancel(Uring* ring, ConnectionEntry* entry) {
+    if (ring == NULL || entry == NULL || entry->sockfd < 0) return;
+    if (!entry->uring_recv && !entry->uring_poll && entry->uring_sends == 0) return;
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = entry->sockfd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = uring_user_data(URING_OP_NONE, 0);
+    uring_submit_and_wait(ring, 0);
+    entry->uring_recv = 0;
+    entry->uring_recv_stop = 0;
+    entry->uring_poll = 0;
+}
+
+// Submit the send chains scheduled while handling the last batch
+void uring_submit_sends(Uring* ring, Maester* maester) {
+    if (ring == NULL || maester == NULL) return;
+    for (size_t i = 0; i < ring->flush_count; i++) {
+        ConnectionEntry* entry = connection_table_lookup(&maester->connections, ring->flush[i]);
+        if (entry == NULL || entry->uring != ring || entry->sockfd < 0) {
+            continue;  // Closed meanwhile
+        }
+        entry->uring_flush = 0;
+        if (entry->uring_sends == 0 && entry->state == CONNECTION_CONNECTED) {
+            uring_queue_send_chain(ring, entry);
+        }
+    }
+    ring->flush_count = 0;
+}
+
+static void uring_complete_recv(Maester* maester, Uring* ring, ConnectionEntry* entry,
+                                const struct io_uring_cqe* cqe) {
+    ConnHandle handle = (entry != NULL) ? connection_handle(entry) : 0;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (entry != NULL && cqe->res > 0) {
+            maester_handle_received(maester, entry, ring->buffers + (size_t)bid * URING_RECV_BUFFER_SIZE, cqe->res);
+        }
+        uring_recycle_buffer(ring, bid);
+    } else if (entry != NULL && (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED))) {
+        maester_handle_received(maester, entry, NULL, cqe->res);   // Peer closed, or failed
+    }
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        return;
+    }
+    // The multishot receive ended (buffers ran out, the socket is done, or it
+    // was cancelled): re-arm it if the connection is still there
+    entry = (handle != 0) ? connection_table_lookup(&maester->connections, handle) : NULL;
+    if (entry != NULL && entry->uring == ring) {
+        entry->uring_recv = 0;
+        entry->uring_recv_stop = 0;
+        uring_connection_sync(ring, entry);
+    }
+}
+
+static void uring_complete_send(Maester* maester, Uring* ring, ConnectionEntry* entry, const struct io_uring_cqe* cqe) {
+    ring->sends_inflight--;
+    if (entry == NULL) return;
+    entry->uring_sends--;
+    if (cqe->res > 0) {
+        send_queue_consume(&entry->send_queue, (size_t)cqe->res);
+    } else if (cqe->res < 0 && cqe->res != -ECANCELED && cqe->res != -EAGAIN && cqe->res != -EINTR) {
+        maester_close_connection_entry(entry);
+        return;
+    }
+    if (entry->transfer_out) {
+        // Refill behind the chain still in flight; it goes out once the chain completes
+        transfer_pump(maester, entry);
+    }
+    if (entry->uring_sends == 0) {
+        uring_connection_sync(ring, entry);
+    }
+    maester_connection_drained(maester, entry);
+}
+
+void uring_handle_completion(Maester* maester, Shard* shard, const struct io_uring_cqe* cqe) {
+    if (maester == NULL || shard == NULL || shard->uring == NULL || cqe == NULL) return;
+    Uring* ring = shard->uring;
+    UringOp op = uring_user_op(cqe->user_data);
+    ConnectionEntry* entry = NULL;
+    if (op == URING_OP_RECV || op == URING_OP_SEND || op == URING_OP_CONNECT) {
+        // Completions for a slot closed (and maybe reused) since fail the generation check
+        entry = connection_table_lookup(&maester->connections, uring_user_handle(cqe->user_data));
+        if (entry != NULL && (entry->uring != ring || entry->sockfd < 0)) {
+            entry = NULL;
+        }
+    }
+    switch (op) {
+        case URING_OP_WAKE:
+            frame_queue_ack_wake(&shard->outbound);
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                uring_arm_wake(ring, shard->outbound.wake_fd);
+            }
+            break;
+        case URING_OP_RECV:
+            uring_complete_recv(maester, ring, entry, cqe);
+            break;
+        case URING_OP_SEND:
+            uring_complete_send(maester, ring, entry, cqe);
+            break;
+        case URING_OP_CONNECT:
+            if (entry != NULL) {
+                ConnHandle handle = connection_handle(entry);
+                entry->uring_poll = 0;
+                maester_connection_complete_connect(maester, entry);
+                // Still pending (spurious wakeup): watch again
+                entry = connection_table_lookup(&maester->connections, handle);
+                if (entry != NULL && entry->state == CONNECTION_CONNECTING) {
+                    uring_connection_sync(ring, entry);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+#define URING_QUIESCE_ROUNDS 20   // x 50 ms
+
+/**
+ * Shard shutdown: push out what is scheduled, give the send chains in flight
+ * a moment to complete (their bytes are consumed from the queues, so the
+ * final flush does not send them twice), then cancel whatever is left.
+ */
+void uring_quiesce(Maester* maester, Shard* shard) {
+    if (maester == NULL || shard == NULL || shard->uring == NULL) return;
+    Uring* ring = shard->uring;
+    struct io_uring_cqe cqe;
+    uring_submit_sends(ring, maester);
+    for (int round = 0; round < URING_QUIESCE_ROUNDS && ring->sends_inflight > 0; round++) {
+        if (uring_submit_and_wait(ring, 50) != 0) break;
+        while (uring_next_completion(ring, &cqe)) {
+            uring_handle_completion(maester, shard, &cqe);
+        }
+    }
+    ring->flush_count = 0;
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = uring_user_data(URING_OP_NONE, 0);
+    }
+    uring_submit_and_wait(ring, 0);
+    for (int round = 0; round < URING_QUIESCE_ROUNDS; round++) {
+        uring_reap_cancelled(maester, ring);
+        if (ring->sends_inflight == 0 || uring_submit_and_wait(ring, 50) != 0) break;
+    }
+}
+
+// Reap after the final cancel: account for the sends and return the buffers
+static void uring_reap_cancelled(Maester* maester, Uring* ring) {
+    struct io_uring_cqe cqe;
+    while (uring_next_completion(ring, &cqe)) {
+        UringOp op = uring_user_op(cqe.user_data);
+        ConnectionEntry* entry = connection_table_lookup(&maester->connections, uring_user_handle(cqe.user_data));
+        if (entry != NULL && entry->uring != ring) {
+            entry = NULL;
+        }
+        if ((cqe.flags & IORING_CQE_F_BUFFER) && ring->buf_ring != NULL) {
+            uring_recycle_buffer(ring, cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        if (op == URING_OP_SEND) {
+            ring->sends_inflight--;
+            if (entry != NULL) {
+                entry->uring_sends--;
+                if (cqe.res > 0) {
+                    send_queue_consume(&entry->send_queue, (size_t)cqe.res);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Listener loop on a small private ring: one multishot accept delivers every
+ * incoming connection; a poll on stop_fd ends it.
+ */
+int uring_run_listener(Maester* maester, int listen_fd, int stop_fd, void (*on_accept)(Maester*, int)) {
+    if (maester == NULL || listen_fd < 0 || stop_fd < 0 || on_accept == NULL) return -1;
+    Uring ring;
+    if (uring_init(&ring, 16, 0) != 0) {
+        return -1;
+    }
+    int armed = 0;
+    if (uring_prep_poll(&ring, stop_fd, POLLIN, 0, uring_user_data(URING_OP_STOP, 0)) != 0) {
+        uring_destroy(&ring);
+        return -1;
+    }
+    int stop = 0;
+    while (!stop && !__atomic_load_n(&maester->shutting_down, __ATOMIC_ACQUIRE)) {
+        if (!armed) {
+            struct io_uring_sqe* sqe = uring_get_sqe(&ring);
+            if (sqe == NULL) break;
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = listen_fd;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = uring_user_data(URING_OP_ACCEPT, 0);
+            armed = 1;
+        }
+        if (uring_submit_and_wait(&ring, -1) != 0) {
+            write_str(STDERR_FILENO, "Listener io_uring failed. No longer accepting connections.\n");
+            break;
+        }
+        struct io_uring_cqe cqe;
+        while (uring_next_completion(&ring, &cqe)) {
+            if (uring_user_op(cqe.user_data) == URING_OP_STOP) {
+                stop = 1;
+                continue;
+            }
+            if (cqe.res >= 0) {
+                on_accept(maester, cqe.res);
+            } else if (cqe.res != -ECANCELED) {
+                write_str(STDERR_FILENO, "Warning: accept() failed on listener socket.\n");
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                armed = 0;
+            }
+        }
+    }
+    uring_destroy(&ring);
+    return 0;
+}
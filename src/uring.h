@@ -0,0 +1,81 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+
+#include "maester.h"
+
+// Completion-based socket backend built on the raw io_uring syscalls (no
+// liburing). A shard running it keeps one multishot receive armed per socket,
+// fed from a ring of provided buffers, and submits each connection's send
+// queue as a chain of linked SENDMSG requests; everything prepared while
+// handling a batch of completions goes to the kernel in the next single
+// io_uring_enter.
+
+#define URING_ENTRIES          256   // Submission queue depth per shard
+#define URING_RECV_BUFFERS     64    // Provided receive buffers per shard (power of two)
+#define URING_RECV_BUFFER_SIZE 4096
+#define URING_RECV_GROUP       0     // Buffer group id of the receive buffers
+#define URING_SEND_CHAIN_MAX   8     // Linked SENDMSGs per connection (x SEND_QUEUE_IOV_MAX slots)
+
+// What a completion belongs to; stored in user_data next to the connection handle
+typedef enum {
+    URING_OP_NONE = 0,
+    URING_OP_WAKE,      // Multishot poll on the shard's FrameQueue eventfd
+    URING_OP_RECV,      // Multishot receive
+    URING_OP_SEND,      // One SENDMSG link of a send chain
+    URING_OP_CONNECT,   // POLLOUT on a socket whose connect() is in flight
+    URING_OP_ACCEPT,    // Multishot accept (listener thread)
+    URING_OP_STOP       // Poll on the listener's stop eventfd
+} UringOp;
+
+// Gather list of one SENDMSG; one per SQE slot, reusable once the SQE is consumed
+typedef struct {
+    struct msghdr msg;
+    struct iovec  iov[SEND_QUEUE_IOV_MAX];
+} UringSendMsg;
+
+typedef struct Uring {
+    int                  ring_fd;
+    void*                ring_mem;        // SQ and CQ rings share one mapping
+    size_t               ring_size;
+    struct io_uring_sqe* sqes;
+    size_t               sqes_size;
+    unsigned*            sq_head;
+    unsigned*            sq_tail;
+    unsigned             sq_mask;
+    unsigned             sq_entries;
+    unsigned             sq_prepared;     // Local tail: SQEs filled in, published on submit
+    unsigned*            cq_head;
+    unsigned*            cq_tail;
+    unsigned             cq_mask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_buf_ring* buf_ring;   // Provided receive buffers (NULL if not set up)
+    size_t               buf_ring_size;
+    uint8_t*             buffers;
+    unsigned             buf_count;
+    unsigned             buf_tail;
+    UringSendMsg*        send_msgs;       // Indexed like the SQEs (NULL on the listener ring)
+    unsigned             sends_inflight;  // Across every connection of the ring
+    ConnHandle*          flush;           // Connections whose send queue goes out on the next submit
+    size_t               flush_count;
+    size_t               flush_capacity;
+} Uring;
+
+int  uring_init(Uring* ring, unsigned entries, unsigned recv_buffers);
+void uring_destroy(Uring* ring);
+int  uring_submit_and_wait(Uring* ring, int timeout_ms);
+int  uring_next_completion(Uring* ring, struct io_uring_cqe* out);
+
+// Shard side
+int  uring_arm_wake(Uring* ring, int wake_fd);
+int  uring_connection_sync(Uring* ring, ConnectionEntry* entry);
+void uring_connection_cancel(Uring* ring, ConnectionEntry* entry);
+void uring_submit_sends(Uring* ring, Maester* maester);
+void uring_handle_completion(Maester* maester, Shard* shard, const struct io_uring_cqe* cqe);
+void uring_quiesce(Maester* maester, Shard* shard);
+
+// Listener side: multishot accept until stop_fd fires. -1 if io_uring is unusable.
+int  uring_run_listener(Maester* maester, int listen_fd, int stop_fd, void (*on_accept)(Maester*, int));
+
+#endif